@@ -0,0 +1,103 @@
+#ifndef ALIASANALYSIS_H
+#define ALIASANALYSIS_H
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "IR.h"
+
+enum class AliasResult {
+    NoAlias,
+    MayAlias,
+    PartialAlias,
+    MustAlias
+};
+
+enum ModRefInfo {
+    MRI_NoModRef = 0,
+    MRI_Ref = 1,
+    MRI_Mod = 2,
+    MRI_ModRef = 3
+};
+
+// A pointer split into the object it points into and a byte offset that is
+// a constant plus a sum of scaled SSA values.
+struct DecomposedPointer {
+    enum Kind { Unknown, Global, Alloca, Argument };
+    Kind kind;
+    std::string base;                            // Global, alloca or parameter name
+    int argIndex;                                // Argument only
+    long long offset;
+    std::map<std::string, long long> terms;      // SSA value -> scale in bytes
+
+    DecomposedPointer() : kind(Unknown), argIndex(-1), offset(0) {}
+};
+
+// Layered alias analysis over the optimizer IR:
+//  1. base objects: distinct globals and allocas never alias, and a pointer
+//     parameter never points into the current frame's allocas;
+//  2. GEP offsets: accesses off the same base are compared by constant offset,
+//     or modulo the common stride when their variable parts differ;
+//  3. interprocedural: the objects each pointer parameter may point to are
+//     collected from all call sites, which separates parameters from each
+//     other and from globals.
+// Call effects are summarized per function (globals and parameters read or
+// written, including through callees) for getModRef.
+//
+// Function-local facts are cached; call invalidate() after changing a
+// function's GEPs or arithmetic. Functions may be queried and invalidated
+// from different threads, each function from one of them.
+class AliasAnalysis {
+public:
+    explicit AliasAnalysis(const Module& m);
+
+    AliasResult alias(const Function& f, const std::string& a, int sizeA,
+                      const std::string& b, int sizeB) const;
+    // Loads and stores, compared by their address and value size.
+    AliasResult alias(const Function& f, const Instruction& a, const Instruction& b) const;
+
+    ModRefInfo getModRef(const Function& f, const Instruction& call, const std::string& ptr) const;
+    ModRefInfo getModRef(const Function& f, const Instruction& call, const Instruction& mem) const;
+    // What a call may do to memory visible to its caller at all.
+    ModRefInfo getModRef(const Instruction& call) const;
+
+    DecomposedPointer decompose(const Function& f, const std::string& ptr) const;
+    const std::set<std::string>& pointsTo(const std::string& func, int argIndex) const;
+    void invalidate(const Function& f) const {
+        std::lock_guard<std::mutex> lock(functionInfoMutex);
+        functionInfo.erase(&f);
+    }
+
+private:
+    struct FunctionInfo {
+        std::map<std::string, Instruction> defs;  // Allocas, GEPs and integer arithmetic
+        std::map<std::string, int> params;
+    };
+    struct Summary {
+        std::set<std::string> globalsRead;
+        std::set<std::string> globalsWritten;
+        std::vector<bool> paramRead;
+        std::vector<bool> paramWritten;
+        bool unknownRead = false;
+        bool unknownWritten = false;
+    };
+
+    const FunctionInfo& info(const Function& f) const;
+    void linearize(const FunctionInfo& fi, const std::string& value, long long scale,
+                   DecomposedPointer& out, int depth) const;
+    std::string objectName(const Function& f, const DecomposedPointer& p) const;
+    bool mayPointToGlobal(const Function& f, const DecomposedPointer& p, const std::string& global) const;
+    bool argumentsMayAlias(const Function& f, int a, int b) const;
+    const Summary* summary(const std::string& func) const;
+    void computePointsTo(const Module& m);
+    void computeSummaries(const Module& m);
+
+    std::map<std::string, std::vector<std::set<std::string>>> pointsToSets;
+    std::map<std::string, Summary> summaries;
+    mutable std::map<const Function*, FunctionInfo> functionInfo;
+    mutable std::mutex functionInfoMutex;
+};
+
+#endif // ALIASANALYSIS_H
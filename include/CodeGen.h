@@ -0,0 +1,40 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <string>
+#include <vector>
+#include "IR.h"
+#include "ObjectFile.h"
+
+class ThreadPool;
+
+struct CodeGenOptions {
+    enum class Arch { X86_64, RISCV64 };
+    Arch arch = Arch::X86_64;
+    // Linear scan compiles faster; graph coloring spills less and removes
+    // most copies.
+    enum class RegAllocator { LinearScan, GraphColoring };
+    RegAllocator regAlloc = RegAllocator::LinearScan;
+    // Machine-level peephole rules before register allocation and after
+    // frame layout.
+    bool peephole = false;
+    // Functions are compiled on its threads when set; the output is the
+    // same either way.
+    ThreadPool* threads = nullptr;
+};
+
+// Compiles every defined function of `m` to assembly for the chosen target:
+// instruction selection, register allocation and frame layout.
+std::string emitAssembly(const Module& m, const CodeGenOptions& options = {});
+// The same text in pieces, which emitAssembly joins: one for each defined
+// function of `m` in order, then the globals.
+std::vector<std::string> emitFunctionAssembly(const Module& m, const CodeGenOptions& options = {});
+std::string emitGlobalAssembly(const Module& m, const CodeGenOptions& options = {});
+
+// The same code as a relocatable ELF object, encoded in-process, so that
+// only a linker is needed to build an executable. x86-64 only.
+std::string emitObject(const Module& m, const CodeGenOptions& options = {});
+// The object before serialization, for loading it in-process.
+ObjectFile compileObject(const Module& m, const CodeGenOptions& options = {});
+
+#endif // CODEGEN_H
@@ -0,0 +1,39 @@
+#ifndef COMPILECACHE_H
+#define COMPILECACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Compiler outputs in a local directory, each in a file named by the hash
+// of everything it was produced from. Compilers running at the same time
+// may share the directory: entries are written to a temporary file and
+// renamed into place. A hit refreshes the entry's modification time, and
+// once the directory outgrows its limit the entries least recently used are
+// removed, when the cache is destroyed.
+class CompileCache {
+public:
+    CompileCache(const std::filesystem::path& directory, uintmax_t maxBytes);
+    ~CompileCache();
+    CompileCache(const CompileCache&) = delete;
+    CompileCache& operator=(const CompileCache&) = delete;
+
+    bool lookup(const std::string& key, std::string& contents);
+    void store(const std::string& key, const std::string& contents);
+
+    // A key for `data`: its SHA-256 in hex.
+    static std::string hash(const std::string& data);
+    // Tells builds of the compiler apart: where its executable is, its size
+    // and when it was written. Cheaper than hashing the executable, and
+    // what a rebuild changes.
+    static const std::string& compilerVersion();
+
+private:
+    void evict();
+
+    std::filesystem::path directory;
+    uintmax_t maxBytes;
+    bool stored = false;
+};
+
+#endif // COMPILECACHE_H
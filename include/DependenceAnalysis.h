@@ -0,0 +1,88 @@
+#ifndef DEPENDENCEANALYSIS_H
+#define DEPENDENCEANALYSIS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "IR.h"
+#include "LoopInfo.h"
+#include "AliasAnalysis.h"
+
+// constant + sum(coeff * value) over SSA values that are not themselves
+// additions, subtractions or scalings by a constant.
+struct AffineExpr {
+    long long constant = 0;
+    std::map<std::string, long long> coeffs;
+};
+
+// A load or store. When the address is a GEP, `base` is the pointer it
+// indexes off and there is one subscript per GEP index; otherwise the address
+// itself is the base and there are no subscripts.
+struct MemoryAccess {
+    Instruction* inst = nullptr;
+    BasicBlock* block = nullptr;
+    bool isWrite = false;
+    std::string pointer;
+    std::string base;
+    std::string sourceType;   // GEP source element type, empty if no GEP
+    std::vector<AffineExpr> subscripts;
+};
+
+enum Direction : unsigned {
+    DirLT = 1,   // The sink runs in a later iteration of that loop
+    DirEQ = 2,
+    DirGT = 4,
+    DirAll = 7
+};
+
+struct Dependence {
+    bool independent = true;
+    std::vector<unsigned> directions;  // One mask per loop of the nest
+};
+
+// Subscript-based dependence testing for loop transforms: ZIV and strong SIV
+// tests give exact distances, everything else falls back to the GCD test and
+// an unknown direction. Accesses to different objects are separated by the
+// alias analysis.
+class DependenceAnalysis {
+public:
+    DependenceAnalysis(const Module& m, Function& f, const LoopInfo& li, const AliasAnalysis& aa);
+
+    AffineExpr linearize(const std::string& value) const;
+    std::vector<MemoryAccess> accesses(const Loop* loop) const;
+    // Calls in `loop` to anything but readnone functions, which covers both
+    // memory effects and I/O ordering.
+    bool hasOpaqueCalls(const Loop* loop) const;
+
+    // Dependence from `src` to `dst` for a nest whose loops, outermost first,
+    // have the induction variables `ivs`; values other than the induction
+    // variables must be invariant in `outermost` to be reasoned about.
+    Dependence depends(const MemoryAccess& src, const MemoryAccess& dst,
+                       const std::vector<std::string>& ivs, const Loop* outermost) const;
+
+    // Induction variables of the loops around and including `loop`, outermost
+    // first; unrecognized loops get an empty name.
+    std::vector<std::string> nestIVs(const Loop* loop) const;
+    const Loop* outermostLoop(const Loop* loop) const;
+
+    // True if an iteration of `loop` depends on an earlier one of the same
+    // loop, through memory or through a value carried by a header phi.
+    bool carriesDependence(const Loop* loop) const;
+
+    // True if the perfectly nested loops of `band`, outermost first, can be
+    // reordered or tiled: no dependence left to them by the enclosing loops
+    // runs forward in one band loop and backward in another.
+    bool isPermutable(const std::vector<const Loop*>& band) const;
+
+    // Change of the access address in bytes per unit step of `value`.
+    long long stride(const MemoryAccess& access, const std::string& value) const;
+
+private:
+    const Module& module;
+    Function& func;
+    const LoopInfo& loops;
+    const AliasAnalysis& alias;
+    std::map<std::string, const Instruction*> defs;
+};
+
+#endif // DEPENDENCEANALYSIS_H
@@ -0,0 +1,41 @@
+#ifndef DOMINANCE_H
+#define DOMINANCE_H
+
+#include <map>
+#include <set>
+#include <vector>
+#include <unordered_map>
+#include "IR.h"
+
+// Dominator tree over the reachable blocks of a function, computed with the
+// Cooper-Harvey-Kennedy iterative algorithm on reverse post-order.
+class DominatorTree {
+public:
+    explicit DominatorTree(Function& f);
+
+    BasicBlock* block(const std::string& name) const;
+    BasicBlock* idom(BasicBlock* bb) const;
+    const std::vector<BasicBlock*>& children(BasicBlock* bb) const;
+    bool dominates(BasicBlock* a, BasicBlock* b) const;
+    bool isReachable(BasicBlock* bb) const { return rpoIndex.count(bb) > 0; }
+    int depth(BasicBlock* bb) const { return levels.at(bb); }
+
+    const std::vector<BasicBlock*>& reversePostOrder() const { return rpo; }
+    const std::vector<BasicBlock*>& predecessors(BasicBlock* bb) const;
+    const std::vector<BasicBlock*>& successors(BasicBlock* bb) const;
+
+    // Dominance frontier of every reachable block.
+    std::unordered_map<BasicBlock*, std::set<BasicBlock*>> frontiers() const;
+
+private:
+    std::unordered_map<std::string, BasicBlock*> byName;
+    std::vector<BasicBlock*> rpo;
+    std::unordered_map<BasicBlock*, int> rpoIndex;
+    std::unordered_map<BasicBlock*, BasicBlock*> idoms;
+    std::unordered_map<BasicBlock*, std::vector<BasicBlock*>> kids;
+    std::unordered_map<BasicBlock*, std::vector<BasicBlock*>> preds;
+    std::unordered_map<BasicBlock*, std::vector<BasicBlock*>> succs;
+    std::unordered_map<BasicBlock*, int> levels;
+};
+
+#endif // DOMINANCE_H
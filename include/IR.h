@@ -0,0 +1,173 @@
+#ifndef IR_H
+#define IR_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+
+// In-memory form of the LLVM IR emitted by IRGenerator. Values are referred to
+// by their textual names ("%t3", "@a") or integer literals, the same way the
+// frontend's Value::reg does, so the optimizer can read and write the IR
+// without a separate value graph.
+
+enum class Opcode {
+    Alloca,
+    Load,
+    Store,
+    GetElementPtr,
+    Add,
+    Sub,
+    Mul,
+    SDiv,
+    SRem,
+    Shl,
+    AShr,
+    LShr,
+    And,
+    Or,
+    Xor,
+    ICmp,
+    ZExt,
+    Select,
+    Phi,
+    Call,
+    Br,
+    CondBr,
+    Ret,
+    Unreachable
+};
+
+class Instruction {
+public:
+    Opcode op;
+    std::string result;                 // Defined register, empty if none
+    // Alloca: allocated type; Load/Store: value type; GetElementPtr: source
+    // element type; ICmp: operand type; ZExt: destination type; Call/Ret:
+    // return type; everything else: result type.
+    std::string type;
+    std::vector<std::string> operands;  // Registers, globals or literals
+    std::vector<std::string> labels;    // Branch targets / phi incoming blocks
+    std::string predicate;              // ICmp only
+    std::string callee;                 // Call only, without '@'
+    std::vector<std::string> argTypes;  // Call only
+    std::string srcType;                // ZExt only
+
+    Instruction() : op(Opcode::Unreachable) {}
+    Instruction(Opcode o, const std::string& res, const std::string& ty,
+                const std::vector<std::string>& ops = {})
+        : op(o), result(res), type(ty), operands(ops) {}
+
+    bool isTerminator() const {
+        return op == Opcode::Br || op == Opcode::CondBr ||
+               op == Opcode::Ret || op == Opcode::Unreachable;
+    }
+    bool isBinary() const { return op >= Opcode::Add && op <= Opcode::Xor; }
+    bool hasSideEffects() const {
+        return op == Opcode::Store || op == Opcode::Call || isTerminator();
+    }
+
+    // Type of the value this instruction defines, "void" if none.
+    std::string resultType() const;
+    std::string toString() const;
+};
+
+class BasicBlock {
+public:
+    std::string name;
+    std::vector<Instruction> insts;
+
+    BasicBlock(const std::string& n) : name(n) {}
+
+    Instruction* terminator() {
+        if (insts.empty() || !insts.back().isTerminator()) return nullptr;
+        return &insts.back();
+    }
+    const Instruction* terminator() const {
+        if (insts.empty() || !insts.back().isTerminator()) return nullptr;
+        return &insts.back();
+    }
+    std::vector<std::string> successors() const;
+};
+
+class Function {
+public:
+    std::string name;                     // Without '@'
+    std::string retType;
+    std::vector<std::string> paramTypes;
+    std::vector<std::string> paramNames;  // With '%'
+    std::vector<std::unique_ptr<BasicBlock>> blocks;
+    std::set<std::string> attributes;     // Function attributes, e.g. "readnone"
+    bool isDeclaration;
+    bool isVarArg;
+
+    Function() : isDeclaration(false), isVarArg(false), nextValueId(0), nextBlockId(0) {}
+
+    BasicBlock* entry() { return blocks.empty() ? nullptr : blocks.front().get(); }
+    BasicBlock* getBlock(const std::string& blockName);
+    BasicBlock* addBlock(const std::string& blockName);
+
+    // Fresh names that cannot collide with frontend temporaries ("%t<n>").
+    std::string newReg() { return "%r" + std::to_string(nextValueId++); }
+    std::string newBlockName() { return "bb" + std::to_string(nextBlockId++); }
+    void reserveNames(int valueId, int blockId);
+
+    // Deep copy under a new name; fresh-name counters carry over.
+    std::unique_ptr<Function> clone(const std::string& newName) const;
+
+    std::map<std::string, std::vector<std::string>> predecessors() const;
+    // Rewrites every operand through `replacements`, following chains.
+    void replaceUses(const std::map<std::string, std::string>& replacements);
+    int instructionCount() const;
+    std::string toString() const;
+
+private:
+    int nextValueId;
+    int nextBlockId;
+};
+
+class GlobalVariable {
+public:
+    std::string name;       // Without '@'
+    std::string type;
+    bool isConstant;
+    bool zeroInit;
+    std::vector<int> init;  // Flattened initializer when !zeroInit
+
+    GlobalVariable() : isConstant(false), zeroInit(true) {}
+    std::string toString() const;
+};
+
+class Module {
+public:
+    std::vector<GlobalVariable> globals;
+    std::vector<std::unique_ptr<Function>> functions;
+
+    Function* getFunction(const std::string& name);
+    GlobalVariable* getGlobal(const std::string& name);
+    std::string toString() const;
+};
+
+// Instruction builders
+Instruction makeICmp(const std::string& result, const std::string& pred,
+                     const std::string& lhs, const std::string& rhs);
+Instruction makeBr(const std::string& target);
+Instruction makeCondBr(const std::string& cond, const std::string& t, const std::string& f);
+
+// Operand helpers
+bool isConstantOperand(const std::string& operand);
+int constantValue(const std::string& operand);
+bool isGlobalOperand(const std::string& operand);
+
+// Type string helpers
+bool isPointerType(const std::string& type);
+bool isArrayTypeStr(const std::string& type);
+std::string pointeeType(const std::string& type);
+std::string arrayElementType(const std::string& type);
+int arrayLength(const std::string& type);
+std::vector<int> arrayDimensions(const std::string& type);
+int typeSizeInBytes(const std::string& type);
+std::string gepResultType(const std::string& sourceType, size_t indexCount);
+
+#endif // IR_H
@@ -84,6 +84,11 @@ private:
                                           const std::vector<int>& dimensions, int depth);
     std::vector<int> evaluateInitVal(SysYParser::InitValContext *ctx,
                                      const std::vector<int>& dimensions, int depth);
+    std::vector<std::string> evaluateLocalInitVal(SysYParser::InitValContext *ctx,
+                                                  const std::vector<int>& dimensions, int depth);
+    Value emitElementPtr(std::shared_ptr<Type> type, const std::string& base,
+                         const std::vector<Value>& indices, bool decay);
+    Value emitShortCircuit(antlr4::tree::ParseTree *lhs, antlr4::tree::ParseTree *rhs, bool isAnd);
 };
 
 #endif // IRBUILDER_H
@@ -12,13 +12,16 @@ class IRGenerator {
 private:
     std::ostringstream header;  // For declarations and global variables
     std::ostringstream body;    // For function definitions
+    std::ostringstream function;  // The current function after its entry label
+    std::ostringstream allocas;   // The current function's local variables
+    bool inFunction;
     int tempCounter;
     int labelCounter;
     std::vector<int> breakLabels;
     std::vector<int> continueLabels;
     
 public:
-    IRGenerator() : tempCounter(0), labelCounter(0) {}
+    IRGenerator() : tempCounter(0), labelCounter(0), inFunction(false) {}
     
     std::string getNewTemp() {
         return "%t" + std::to_string(tempCounter++);
@@ -33,11 +36,30 @@ public:
     }
     
     void emit(const std::string& code) {
-        body << code;
+        (inFunction ? function : body) << code;
     }
     
     void emitLabel(int label) {
-        body << "label" << label << ":\n";
+        (inFunction ? function : body) << "label" << label << ":\n";
+    }
+    
+    // Opens the entry block. Allocas emitted until endFunction() go to its
+    // top, so that a variable declared in a loop has one slot rather than
+    // one more on the stack per iteration.
+    void emitEntry() {
+        body << "entry:\n";
+        inFunction = true;
+    }
+    
+    void emitAlloca(const std::string& code) {
+        allocas << code;
+    }
+    
+    void endFunction() {
+        body << allocas.str() << function.str();
+        allocas.str("");
+        function.str("");
+        inFunction = false;
     }
     
     void pushBreakLabel(int label) {
@@ -72,11 +94,21 @@ public:
         return header.str() + "\n" + body.str();
     }
     
+    // Temporaries and labels are numbered from 0 in each function, so that
+    // a function's IR does not depend on the functions before it.
+    void beginFunction() {
+        tempCounter = 0;
+        labelCounter = 0;
+    }
+    
     void reset() {
         header.str("");
         header.clear();
         body.str("");
         body.clear();
+        function.str("");
+        allocas.str("");
+        inFunction = false;
         tempCounter = 0;
         labelCounter = 0;
         breakLabels.clear();
@@ -0,0 +1,14 @@
+#ifndef IRPARSER_H
+#define IRPARSER_H
+
+#include <memory>
+#include <string>
+#include "IR.h"
+
+// Reads the textual IR produced by IRGenerator (and printed back by Module)
+// into a Module. Instructions that follow a terminator inside the same block
+// are unreachable and dropped. Returns nullptr and reports to std::cerr on a
+// malformed line.
+std::unique_ptr<Module> parseIR(const std::string& text);
+
+#endif // IRPARSER_H
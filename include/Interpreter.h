@@ -0,0 +1,70 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "IR.h"
+
+// A loop at whose header execution may move from the interpreter to native
+// code that takes the values live there as arguments, in this order.
+// Iterations of the loops nested in it count towards it.
+struct LoopEntry {
+    std::string header;
+    std::vector<std::string> liveIns;
+    std::vector<std::string> nested;  // Their headers
+};
+
+// Native code for functions and loops that turn hot while interpreted.
+// Native functions take the arguments of the IR function, at most
+// kMaxNativeArgs of them.
+class TierUp {
+public:
+    static constexpr int kMaxNativeArgs = 16;
+
+    virtual ~TierUp() = default;
+
+    // Memory for the globals, which native code has to reach.
+    virtual void* allocateGlobals(size_t bytes) = 0;
+    virtual std::vector<LoopEntry> loopEntries(const std::string& function) = 0;
+    // Entries of native code, or nullptr to go on interpreting.
+    virtual void* compileFunction(const std::string& function) = 0;
+    virtual void* compileLoop(const std::string& function, const std::string& header) = 0;
+};
+
+// Runs a module without compiling it, on any host. Every function is
+// decoded once into a compact bytecode over numbered value slots: constants
+// and global addresses get slots of their own that are filled in on entry,
+// phis become moves on the edges that reach them, and a compare feeding
+// the branch right after it becomes one compare-and-branch. Dispatch is
+// threaded through computed gotos where the host compiler has them. The
+// sylib functions the frontend declares are bound to the compiler's own,
+// and pointers are host addresses, so that they can be passed to them.
+//
+// With a TierUp, calls and loop iterations are counted: a function called
+// often enough is replaced by native code at every call site, and a loop
+// that iterates often enough is left for native code the next time its
+// header is reached.
+class Interpreter {
+public:
+    static constexpr uint32_t kCallThreshold = 1000;
+    static constexpr uint32_t kLoopThreshold = 10000;
+
+    explicit Interpreter(const Module& m, TierUp* tierUp = nullptr);
+    ~Interpreter();
+
+    // Calls main; the result is what it returns.
+    int run();
+
+    // The address of a global, or nullptr.
+    void* globalAddress(const std::string& name) const;
+
+private:
+    struct Program;
+    std::unique_ptr<Program> program;
+};
+
+#endif // INTERPRETER_H
@@ -0,0 +1,62 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include "CodeGen.h"
+#include "ObjectFile.h"
+
+// A stretch of address space reserved up front, for objects loaded one
+// after another and the data they share. Everything allocated from one
+// arena is within reach of 32-bit PC-relative references from the rest.
+class CodeArena {
+public:
+    explicit CodeArena(size_t reserve = size_t(1) << 30);
+    ~CodeArena();
+    CodeArena(const CodeArena&) = delete;
+    CodeArena& operator=(const CodeArena&) = delete;
+
+    // Zeroed, writable, page-aligned memory.
+    uint8_t* allocate(size_t bytes);
+
+private:
+    uint8_t* base;
+    size_t reserved;
+    size_t used = 0;
+};
+
+// An x86-64 object loaded into executable memory of this process. Text and
+// data are mapped together, so the 32-bit PC-relative relocations the
+// encoder emits reach between them; calls to functions outside the object
+// go through a stub holding the full address, wherever the host put them.
+// Data outside the object is referenced directly, so it has to be in the
+// same arena.
+class LoadedObject {
+public:
+    // Where the symbols the object uses but does not define are; nullptr
+    // for unknown ones, which makes loading fail.
+    using Resolver = std::function<void*(const std::string& name)>;
+
+    LoadedObject(const ObjectFile& obj, const Resolver& resolve, CodeArena* arena = nullptr);
+    ~LoadedObject();
+    LoadedObject(const LoadedObject&) = delete;
+    LoadedObject& operator=(const LoadedObject&) = delete;
+
+    // The address of a symbol the object defines, or nullptr.
+    void* address(const std::string& name) const;
+
+private:
+    void release();
+
+    uint8_t* memory = nullptr;
+    size_t length = 0;
+    bool mapped = false;  // Owns its memory rather than an arena
+    std::map<std::string, void*> defined;
+};
+
+// Compiles `m` for x86-64 into this process and calls its main with sylib
+// linked to the compiler's own; the result is what main returns.
+int runInProcess(const Module& m, const CodeGenOptions& options = {});
+
+#endif // JIT_H
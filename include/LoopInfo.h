@@ -0,0 +1,88 @@
+#ifndef LOOPINFO_H
+#define LOOPINFO_H
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "IR.h"
+#include "Dominance.h"
+
+// A natural loop: the header plus every block that reaches a back edge into
+// it without passing through the header.
+class Loop {
+public:
+    BasicBlock* header = nullptr;
+    std::vector<BasicBlock*> blocks;   // In function order, header first
+    std::set<BasicBlock*> blockSet;
+    std::vector<BasicBlock*> latches;  // Sources of the back edges
+    Loop* parent = nullptr;
+    std::vector<Loop*> subLoops;
+
+    bool contains(const BasicBlock* bb) const { return blockSet.count(const_cast<BasicBlock*>(bb)) > 0; }
+    bool contains(const Loop* other) const;
+    int depth() const;
+    BasicBlock* latch() const { return latches.size() == 1 ? latches[0] : nullptr; }
+};
+
+// `phi` steps by a constant from `init` and the loop runs while
+// `compare` (phi against a loop-invariant bound) holds.
+struct InductionVariable {
+    Instruction* phi = nullptr;
+    std::string init;          // Incoming value from the preheader
+    Instruction* increment = nullptr;  // add/sub of phi and the step, in the latch
+    int step = 0;
+    Instruction* compare = nullptr;    // Header icmp deciding whether to stay
+    std::string bound;
+};
+
+// Loop nesting forest of a function, computed from the back edges of the
+// dominator tree. Also answers the questions loop transforms keep asking:
+// preheaders, exits, invariance and counted-loop induction variables.
+class LoopInfo {
+public:
+    explicit LoopInfo(Function& f);
+    // On a dominator tree of `f` that stays valid as long as the loop info.
+    LoopInfo(Function& f, const DominatorTree& dt);
+
+    const std::vector<Loop*>& topLevelLoops() const { return roots; }
+    // Innermost loops first, so a transform sees children before parents.
+    std::vector<Loop*> loopsInPostOrder() const;
+    Loop* loopFor(const BasicBlock* bb) const;
+
+    const DominatorTree& dominators() const { return dt; }
+    BasicBlock* block(const std::string& name) const { return dt.block(name); }
+    std::vector<BasicBlock*> predecessors(BasicBlock* bb) const;
+
+    // The single outside predecessor of the header, if it branches only there.
+    BasicBlock* preheader(const Loop* loop) const;
+    std::vector<BasicBlock*> exitingBlocks(const Loop* loop) const;
+    std::vector<BasicBlock*> exitBlocks(const Loop* loop) const;
+    // Block defining `value`, nullptr for constants, globals and parameters.
+    BasicBlock* definingBlock(const std::string& value) const;
+    bool isInvariant(const Loop* loop, const std::string& value) const;
+
+    // Recognizes a single-latch loop whose header exits on a comparison of a
+    // constant-step induction variable against an invariant bound.
+    bool inductionVariable(const Loop* loop, InductionVariable& iv) const;
+
+    // `outer` holds exactly `inner`, both counted, joined only by a block
+    // entering `inner` and one stepping `outer`; the inner start and bound are
+    // invariant in `outer`, so the iteration space is a rectangle, and neither
+    // induction variable is used after the nest.
+    bool isPerfectNest(const Loop* outer, InductionVariable& ivOuter, InductionVariable& ivInner) const;
+
+private:
+    void build();
+
+    Function& func;
+    std::unique_ptr<DominatorTree> ownDominators;  // Unless given one
+    const DominatorTree& dt;
+    std::vector<std::unique_ptr<Loop>> loops;
+    std::vector<Loop*> roots;
+    std::map<const BasicBlock*, Loop*> innermost;
+    std::map<std::string, BasicBlock*> defs;
+};
+
+#endif // LOOPINFO_H
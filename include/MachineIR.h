@@ -0,0 +1,111 @@
+#ifndef MACHINEIR_H
+#define MACHINEIR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Machine-level IR shared by the native backends. Instructions carry a
+// target opcode and operands in assembler order (sources before the
+// destination); registers are numbered, with physical registers below
+// kFirstVirtualReg and virtual ones above until register allocation.
+
+constexpr int kNoReg = -1;
+constexpr int kFirstVirtualReg = 1024;
+
+inline bool isVirtualReg(int reg) { return reg >= kFirstVirtualReg; }
+inline bool isPhysicalReg(int reg) { return reg >= 0 && reg < kFirstVirtualReg; }
+
+class MachineOperand {
+public:
+    enum Kind { Reg, Imm, Mem, Block, Symbol };
+
+    Kind kind = Imm;
+    int reg = kNoReg;          // Reg, or the base register of Mem
+    long long imm = 0;         // Imm, or the displacement of Mem
+    int index = kNoReg;        // Mem
+    int scale = 1;             // Mem
+    int frameIndex = -1;       // Mem relative to a stack object until frame layout
+    int block = -1;            // Block: index into MachineFunction::blocks
+    std::string symbol;        // Symbol, or the global a Mem is relative to
+    bool isDef = false;        // Reg only: written by the instruction
+    bool isUse = true;         // Reg only: read by the instruction
+
+    static MachineOperand use(int reg);
+    static MachineOperand def(int reg);
+    // Read and written, e.g. the destination of a two-address instruction.
+    static MachineOperand useDef(int reg);
+    static MachineOperand immediate(long long value);
+    static MachineOperand memory(int base, long long disp = 0, int index = kNoReg, int scale = 1);
+    static MachineOperand frame(int frameIndex, long long disp = 0);
+    static MachineOperand global(const std::string& symbol, long long disp = 0);
+    static MachineOperand label(int block);
+    static MachineOperand function(const std::string& symbol);
+
+    bool isReg() const { return kind == Reg; }
+    bool isImm() const { return kind == Imm; }
+    bool isMem() const { return kind == Mem; }
+};
+
+class MachineInstr {
+public:
+    int opcode = 0;
+    int size = 4;              // Operand width in bytes
+    int cond = 0;              // Condition code of conditional instructions
+    std::vector<MachineOperand> ops;
+    // Registers read or written without appearing as operands, such as the
+    // argument registers of a call and the registers it clobbers.
+    std::vector<int> implicitUses;
+    std::vector<int> implicitDefs;
+
+    MachineInstr() = default;
+    MachineInstr(int opc, int sz, std::vector<MachineOperand> operands)
+        : opcode(opc), size(sz), ops(std::move(operands)) {}
+
+    // Every register read or written, including address registers of memory
+    // operands and implicit registers.
+    void uses(std::vector<int>& regs) const;
+    void defs(std::vector<int>& regs) const;
+    // Renames `from` to `to` wherever it appears.
+    void replaceReg(int from, int to);
+};
+
+class MachineBasicBlock {
+public:
+    std::string label;
+    std::vector<MachineInstr> insts;
+    std::vector<int> succs;    // Indices into MachineFunction::blocks
+
+    explicit MachineBasicBlock(const std::string& l) : label(l) {}
+};
+
+// A stack object: an alloca, a spill slot or an incoming stack argument,
+// placed by the target's frame layout after register allocation.
+struct FrameObject {
+    int size;
+    int align;
+    long long offset = 0;      // From the frame pointer, once laid out
+    bool fixed = false;        // Incoming argument at a known offset
+};
+
+class MachineFunction {
+public:
+    std::string name;
+    std::vector<std::unique_ptr<MachineBasicBlock>> blocks;  // Entry first
+    std::vector<FrameObject> frameObjects;
+    std::vector<int> usedCalleeSaved;  // Filled by register allocation
+    int outgoingArgsSize = 0;          // Stack space for arguments of calls
+
+    explicit MachineFunction(const std::string& n) : name(n) {}
+
+    int newVReg(int size);
+    int vregSize(int reg) const { return vregSizes[reg - kFirstVirtualReg]; }
+    int vregCount() const { return static_cast<int>(vregSizes.size()); }
+    int addBlock(const std::string& label);
+    int addFrameObject(int size, int align);
+
+private:
+    std::vector<int> vregSizes;
+};
+
+#endif // MACHINEIR_H
@@ -0,0 +1,66 @@
+#ifndef OBJECTFILE_H
+#define OBJECTFILE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "IR.h"
+
+// A relocatable object under construction: the contents of its sections,
+// the symbols defined in or referenced from them, and the relocations the
+// linker has to apply to the text. Every symbol is global, as in the
+// assembly the backends print; block labels never get this far.
+class ObjectFile {
+public:
+    enum Section { Text, Data, Rodata, Bss, NumSections };
+
+    struct Symbol {
+        std::string name;
+        int section = -1;          // -1 while undefined
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        bool function = false;
+    };
+
+    struct Relocation {
+        uint64_t offset;           // Into the text section
+        int symbol;
+        uint32_t type;             // ELF relocation type of the target
+        int64_t addend;
+    };
+
+    ObjectFile();
+
+    std::vector<uint8_t>& contents(Section s) { return sections[s]; }
+    const std::vector<uint8_t>& contents(Section s) const { return sections[s]; }
+    // Offset of the end of a section; .bss only has a size.
+    uint64_t size(Section s) const { return s == Bss ? bssSize : sections[s].size(); }
+    // Pads the section to a multiple of `alignment`, with `fill` in the text.
+    void align(Section s, uint64_t alignment, uint8_t fill = 0);
+    uint64_t alignment(Section s) const { return alignments[s]; }
+
+    // The index of the symbol called `name`, undefined until defined.
+    int symbol(const std::string& name);
+    void define(const std::string& name, Section s, uint64_t offset, uint64_t size, bool function);
+    void addRelocation(uint64_t offset, const std::string& symbol, uint32_t type, int64_t addend);
+    const std::vector<Symbol>& allSymbols() const { return symbols; }
+    const std::vector<Relocation>& textRelocations() const { return relocations; }
+
+    // Lays out the globals of `m` in .data, .rodata and .bss as 32-bit
+    // little-endian words.
+    void addGlobals(const Module& m);
+
+    // The object as an ELF64 little-endian relocatable file for `machine`.
+    std::string toELF(uint16_t machine) const;
+
+private:
+    std::vector<uint8_t> sections[NumSections];
+    uint64_t bssSize = 0;
+    uint64_t alignments[NumSections];
+    std::vector<Symbol> symbols;
+    std::map<std::string, int> symbolIndex;
+    std::vector<Relocation> relocations;
+};
+
+#endif // OBJECTFILE_H
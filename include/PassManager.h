@@ -0,0 +1,112 @@
+#ifndef PASSMANAGER_H
+#define PASSMANAGER_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "IR.h"
+#include "Dominance.h"
+#include "LoopInfo.h"
+#include "AliasAnalysis.h"
+#include "ValueRange.h"
+#include "ThreadPool.h"
+
+// Analyses a pass leaves valid, as a bit set. Dominators only depend on the
+// CFG; the others also look at instructions.
+enum PreservedAnalysis : unsigned {
+    PreserveNone = 0,
+    PreserveDominators = 1,
+    PreserveLoops = 2,
+    PreserveValueRanges = 4,
+    PreserveAlias = 8,        // Function-local alias facts
+    PreservePurity = 16,      // readnone attributes and the module-level alias facts
+    PreserveAll = 31
+};
+using PreservedAnalyses = unsigned;
+
+// Computes analyses on demand and keeps them until a pass reports that it
+// did not preserve them. Different functions' analyses may be used from
+// different threads; alias() has to be computed before that.
+class AnalysisManager {
+public:
+    explicit AnalysisManager(Module& m) : module(m) {}
+
+    Module& getModule() const { return module; }
+
+    const DominatorTree& dominators(Function& f);
+    const LoopInfo& loops(Function& f);
+    const ValueRangeAnalysis& valueRanges(Function& f);
+    // Module-wide; computing it annotates readnone functions first, which
+    // the dependence tests rely on.
+    const AliasAnalysis& alias();
+
+    void invalidate(Function& f, PreservedAnalyses preserved);
+    void invalidate(PreservedAnalyses preserved);
+
+private:
+    struct FunctionAnalyses {
+        std::unique_ptr<DominatorTree> dominators;
+        std::unique_ptr<LoopInfo> loops;
+        std::unique_ptr<ValueRangeAnalysis> valueRanges;
+    };
+
+    FunctionAnalyses& entry(Function& f);
+
+    Module& module;
+    std::map<const Function*, FunctionAnalyses> functions;
+    std::mutex functionsMutex;
+    std::unique_ptr<AliasAnalysis> aliasAnalysis;
+};
+
+using FunctionPass = std::function<PreservedAnalyses(Function&, AnalysisManager&)>;
+using ModulePass = std::function<PreservedAnalyses(Module&, AnalysisManager&)>;
+
+// Runs a pipeline of registered passes. Consecutive function passes run
+// function by function, so that a function's cached analyses are reused
+// while they are still valid, and with a thread pool on several functions
+// at once. Function passes may only change the function they are given;
+// the module-level alias analysis is computed before the first pass that
+// needs it starts on any function, and if a pass loses it the others keep
+// using the old one until every function is done.
+class PassManager {
+public:
+    // Appends a comma-separated pipeline such as "sroa,mem2reg,tile<32>",
+    // where <N> passes a number to passes that take one. Returns false and
+    // describes the problem in `error` for unknown passes or bad syntax.
+    bool parsePipeline(const std::string& pipeline, std::string& error);
+
+    void addFunctionPass(const std::string& name, FunctionPass pass, bool needsAlias = false);
+    void addModulePass(const std::string& name, ModulePass pass);
+    bool empty() const { return passes.empty(); }
+    // Whether the pipeline leaves each function as it would be in any other
+    // module with the same globals and function signatures: no module
+    // passes and nothing that looks at the alias analysis.
+    bool functionLocal() const;
+    // Function passes run on its threads; nullptr runs them on this one.
+    void setThreadPool(ThreadPool* pool) { threads = pool; }
+
+    void run(Module& m);
+    // With the analyses in `am`, which afterwards holds those still valid.
+    void run(Module& m, AnalysisManager& am);
+
+    // Names accepted by parsePipeline.
+    static std::vector<std::string> registeredPasses();
+
+private:
+    struct Pass {
+        std::string name;
+        FunctionPass function;
+        ModulePass module;
+        bool needsAlias;
+    };
+
+    void runFunctionPasses(Module& m, AnalysisManager& am, size_t begin, size_t end);
+
+    std::vector<Pass> passes;
+    ThreadPool* threads = nullptr;
+};
+
+#endif // PASSMANAGER_H
@@ -0,0 +1,93 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include "IR.h"
+#include "AliasAnalysis.h"
+#include "LoopInfo.h"
+#include "ValueRange.h"
+
+class AnalysisManager;
+
+// Wraps self-recursive readnone functions of up to three i32 arguments in a
+// memo table lookup. Returns true if any function was rewritten.
+bool memoizePureRecursion(Module& m);
+
+// Drops blocks that cannot be reached from the entry block, together with the
+// phi entries that flowed out of them.
+bool removeUnreachableBlocks(Function& f);
+
+// Merges every block into its predecessor when it is that predecessor's only
+// successor and has no other predecessor.
+bool mergeBlocks(Function& f);
+
+// Turns conditional branches whose outcome the value ranges decide into
+// jumps, then cleans up the blocks left unreachable or in a straight line.
+bool foldBranches(Function& f, const ValueRangeAnalysis& vra);
+
+// Replaces instructions whose result the value ranges pin down: decided
+// comparisons, constants, masks and remainders that change nothing.
+bool simplifyInstructions(Function& f, const ValueRangeAnalysis& vra);
+
+// Multiplications by powers of two become shifts, and so do divisions and
+// remainders by them when the dividend cannot be negative.
+bool reduceStrength(Function& f, const ValueRangeAnalysis& vra);
+
+// Splits small local arrays whose every access uses constant indices into one
+// scalar alloca per element, so that mem2reg can promote them.
+bool scalarReplaceAggregates(Function& f);
+
+// Promotes scalar allocas that are only loaded and stored to SSA registers,
+// inserting phis on the iterated dominance frontier.
+bool promoteMemoryToRegisters(Function& f);
+// The same with the dominator tree of `f`, which must have no unreachable
+// blocks.
+bool promoteMemoryToRegisters(Function& f, const DominatorTree& dt);
+
+// Sparse conditional constant propagation across the call graph: arguments
+// and return values constant at every executable call site are folded into
+// the functions, and branches on constants are resolved.
+bool interproceduralSCCP(Module& m);
+
+// Clones functions for groups of call sites passing the same constant
+// arguments when the constants would fold enough of the callee; run
+// interproceduralSCCP afterwards to propagate them into the clones. Calls
+// whose callee returns a constant for their arguments are folded instead.
+bool specializeFunctions(Module& m);
+
+// Replaces branches over small side-effect-free arms, ending in a common
+// join or in returns, with selects when the hoisted work fits the
+// speculation budget.
+bool convertIfsToSelects(Function& f);
+
+// The loop transforms below take the loops and the alias analysis from `am`,
+// and drop the analyses of `f` each time they change it; what is cached
+// afterwards describes the result.
+
+// Splits innermost loops that mix a recurrence with independent iterations
+// into one loop per kind, ordered so that every dependence still runs forward.
+bool distributeLoops(Function& f, AnalysisManager& am);
+
+// Merges adjacent loops over the same iteration space that touch the same
+// arrays when no dependence would run backward in the fused loop.
+bool fuseLoops(Function& f, AnalysisManager& am);
+
+// Swaps perfectly nested counted loops over a rectangular iteration space
+// when dependences allow it and the inner loop would then walk memory with a
+// smaller stride.
+bool interchangeLoops(Function& f, AnalysisManager& am);
+
+// Tiles bands of perfectly nested counted loops that reuse data across an
+// outer loop. `tileSize` overrides the cache model when positive.
+bool tileLoops(Function& f, AnalysisManager& am, int tileSize);
+
+// Moves instructions without side effects to the least deeply nested block
+// between the earliest and the latest position their operands and uses allow.
+bool globalCodeMotion(Function& f);
+// The same on the loops of `f`, which must have no unreachable blocks.
+bool globalCodeMotion(Function& f, const LoopInfo& li);
+
+// Reorders the instructions of each block by critical path, so that loads,
+// multiplies and divisions start as early as their operands allow.
+bool scheduleInstructions(Function& f);
+
+#endif // PASSES_H
@@ -0,0 +1,95 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "MachineIR.h"
+
+// How often each virtual register is read, indexed from kFirstVirtualReg.
+std::vector<int> countRegisterReads(const MachineFunction& mf);
+
+// Whether two memory operands name the same address.
+bool sameAddress(const MachineOperand& a, const MachineOperand& b);
+
+// Where a peephole rule matched: a window of instructions starting at `at`
+// in block `block`.
+struct PeepholeSite {
+    MachineFunction& mf;
+    int block;
+    size_t at;
+    const std::vector<int>& readCounts;
+
+    std::vector<MachineInstr>& insts() const { return mf.blocks[block]->insts; }
+    MachineInstr& inst(size_t k) const { return insts()[at + k]; }
+    void erase(size_t k) const { insts().erase(insts().begin() + static_cast<long>(at + k)); }
+    // Reads of a virtual register; physical registers count as read anywhere.
+    int reads(int reg) const { return isVirtualReg(reg) ? readCounts[reg - kFirstVirtualReg] : 1 << 30; }
+    bool isNextBlock(int block) const { return block == this->block + 1; }
+};
+
+constexpr size_t kMaxPeepholeLength = 4;
+
+// A window of consecutive instructions with the given opcodes, and a rewrite
+// that checks their operands and edits the block, returning whether it did.
+struct PeepholeRule {
+    std::array<int, kMaxPeepholeLength> opcodes;
+    size_t length;
+    bool (*rewrite)(const PeepholeSite& site);
+};
+
+// A rule table indexed by first opcode at compile time, so that each
+// instruction is only tried against the rules that can start at it.
+// `Opcodes` bounds the target's opcode numbers.
+template <size_t N, int Opcodes>
+class PeepholeMatcher {
+public:
+    constexpr explicit PeepholeMatcher(const std::array<PeepholeRule, N>& table)
+        : rules(table), byFirst{}, counts{} {
+        for (size_t r = 0; r < N; ++r) {
+            int opcode = rules[r].opcodes[0];
+            byFirst[opcode][counts[opcode]++] = r;
+        }
+    }
+
+    // Rewrites until no rule matches; returns whether anything changed.
+    bool run(MachineFunction& mf) const {
+        bool changed = false;
+        std::vector<int> reads = countRegisterReads(mf);
+        for (int b = 0; b < static_cast<int>(mf.blocks.size()); ++b) {
+            auto& insts = mf.blocks[b]->insts;
+            size_t at = 0;
+            while (at < insts.size()) {
+                if (!tryAt(mf, b, at, reads)) {
+                    ++at;
+                    continue;
+                }
+                changed = true;
+                reads = countRegisterReads(mf);
+                // A rewrite may complete a window that starts a little earlier.
+                at = at >= kMaxPeepholeLength - 1 ? at - (kMaxPeepholeLength - 1) : 0;
+            }
+        }
+        return changed;
+    }
+
+private:
+    bool tryAt(MachineFunction& mf, int block, size_t at, const std::vector<int>& reads) const {
+        const auto& insts = mf.blocks[block]->insts;
+        int opcode = insts[at].opcode;
+        for (size_t k = 0; k < counts[opcode]; ++k) {
+            const PeepholeRule& rule = rules[byFirst[opcode][k]];
+            if (at + rule.length > insts.size()) continue;
+            bool matches = true;
+            for (size_t i = 1; i < rule.length && matches; ++i) matches = insts[at + i].opcode == rule.opcodes[i];
+            if (matches && rule.rewrite(PeepholeSite{mf, block, at, reads})) return true;
+        }
+        return false;
+    }
+
+    std::array<PeepholeRule, N> rules;
+    std::array<std::array<size_t, N>, Opcodes> byFirst;
+    std::array<size_t, Opcodes> counts;
+};
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,30 @@
+#ifndef PURITYANALYSIS_H
+#define PURITYANALYSIS_H
+
+#include <string>
+#include <set>
+#include <map>
+#include "IR.h"
+
+// Interprocedural readnone analysis. A function is readnone when it calls no
+// external (sylib) function, never loads or stores through a global or a
+// pointer parameter, and only calls readnone functions. Mutually recursive
+// functions are handled by starting from "everything is pure" and removing
+// functions until a fixpoint is reached.
+class PurityAnalysis {
+public:
+    explicit PurityAnalysis(const Module& m);
+
+    bool isReadNone(const std::string& func) const { return pure.count(func) > 0; }
+    bool isSelfRecursive(const std::string& func) const;
+    const std::set<std::string>& callees(const std::string& func) const;
+
+    // Sets or clears the "readnone" attribute on every defined function.
+    void annotate(Module& m) const;
+
+private:
+    std::set<std::string> pure;
+    std::map<std::string, std::set<std::string>> callGraph;
+};
+
+#endif // PURITYANALYSIS_H
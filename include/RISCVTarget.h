@@ -0,0 +1,108 @@
+#ifndef RISCVTARGET_H
+#define RISCVTARGET_H
+
+#include "Target.h"
+
+namespace riscv {
+
+// Numbered as in the instruction encoding (x0 to x31).
+enum Reg {
+    ZERO, RA, SP, GP, TP, T0, T1, T2, S0, S1,
+    A0, A1, A2, A3, A4, A5, A6, A7,
+    S2, S3, S4, S5, S6, S7, S8, S9, S10, S11,
+    T3, T4, T5, T6
+};
+
+// Frame pointer, and the register frame lowering uses to reach offsets that
+// do not fit an immediate; neither is ever allocated.
+constexpr Reg FP = S0;
+constexpr Reg kScratch = T6;
+
+enum MachineOpcode {
+    LI,      // Any 32-bit constant
+    LA,      // Address of a memory operand: la for globals, addi for stack objects
+    MV,
+    ADD,     // 64-bit, for addresses
+    ADDI,
+    MUL,
+    SLLI,
+    ADDW,
+    ADDIW,
+    SUBW,
+    MULW,
+    DIVW,
+    REMW,
+    AND,
+    ANDI,
+    OR,
+    ORI,
+    XOR,
+    XORI,
+    SLLW,
+    SLLIW,
+    SRAW,
+    SRAIW,
+    SRLW,
+    SRLIW,
+    SLT,
+    SLTU,
+    SEQZ,
+    SNEZ,
+    NEG,     // 64-bit, for select masks
+    LW,
+    LD,
+    SW,
+    SD,
+    BCC,     // Compare two registers and branch
+    J,
+    CALL,
+    RET
+};
+
+constexpr int kNumMachineOpcodes = RET + 1;
+
+// Branch conditions of BCC.
+enum Cond { CondEQ, CondNE, CondLT, CondGE, CondLTU, CondGEU };
+
+// Argument registers of the LP64 calling convention, in order.
+extern const Reg kArgRegs[8];
+
+inline bool fitsImm12(long long value) { return value >= -2048 && value <= 2047; }
+
+} // namespace riscv
+
+// RV64IM code for the LP64 ABI in GNU assembler syntax. Functions keep a
+// frame pointer; 32-bit values live sign-extended in 64-bit registers, as
+// the ABI passes them, and use the W forms of arithmetic.
+class RISCVTarget : public Target {
+public:
+    RISCVTarget();
+
+    std::string name() const override { return "riscv64"; }
+    const std::vector<int>& allocatableRegs() const override { return allocatable; }
+    bool isCalleeSaved(int reg) const override;
+    std::string regName(int reg, int size) const override;
+
+    std::unique_ptr<MachineFunction> selectInstructions(const Module& m, const Function& f) const override;
+
+    MachineInstr loadFromFrame(int reg, int frameIndex, int size) const override;
+    MachineInstr storeToFrame(int reg, int frameIndex, int size) const override;
+    bool isCopy(const MachineInstr& mi, int& dst, int& src) const override;
+    bool isRematerializable(const MachineInstr& mi) const override;
+
+    void lowerFrame(MachineFunction& mf) const override;
+    bool runPeephole(MachineFunction& mf) const override;
+
+    std::string printFunction(const MachineFunction& mf) const override;
+    std::string printGlobals(const Module& m) const override;
+    std::string printInstruction(const MachineInstr& mi, const MachineFunction& mf) const;
+
+    // There is no RV64 encoder yet; this throws.
+    void encodeFunction(const MachineFunction& mf, ObjectFile& obj) const override;
+    uint16_t elfMachine() const override { return 243; }  // EM_RISCV
+
+private:
+    std::vector<int> allocatable;
+};
+
+#endif // RISCVTARGET_H
@@ -0,0 +1,78 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+#include "MachineIR.h"
+#include "Target.h"
+
+// Instruction positions for register allocation: instruction i of the
+// function in layout order reads its operands at 2i and writes its results
+// at 2i + 1, so a register that dies at an instruction can take the result.
+struct InstructionNumbering {
+    std::vector<int> blockStart;  // Position of each block's first read
+    std::vector<int> blockEnd;    // Position of each block's last write
+
+    explicit InstructionNumbering(const MachineFunction& mf);
+};
+
+// Virtual registers live on entry to and exit from each block.
+struct Liveness {
+    std::vector<std::vector<bool>> liveIn;
+    std::vector<std::vector<bool>> liveOut;
+
+    explicit Liveness(const MachineFunction& mf);
+};
+
+// A virtual register's live range, as the hull of every position where it
+// is live.
+struct LiveInterval {
+    int reg;
+    int start;
+    int end;
+    bool spillable;
+};
+
+std::vector<LiveInterval> buildLiveIntervals(const MachineFunction& mf, const InstructionNumbering& numbering,
+                                             const Liveness& liveness, const std::set<int>& unspillable);
+
+// Ranges over which each physical register holds a fixed value: arguments and
+// results being passed, operands of instructions with register constraints,
+// and registers a call clobbers.
+std::map<int, std::vector<std::pair<int, int>>> buildFixedRanges(const MachineFunction& mf,
+                                                                 const InstructionNumbering& numbering);
+
+// Loop nesting depth of each block, from the back edges of the machine CFG.
+std::vector<int> computeLoopDepths(const MachineFunction& mf);
+
+// Virtual registers with a single definition the target can repeat anywhere,
+// mapped to that definition.
+std::map<int, MachineInstr> findRematerializable(const MachineFunction& mf, const Target& target);
+
+// Gives each register in `spilled` a stack slot, loaded into a fresh virtual
+// register before every use and stored from one after every definition.
+// Registers in `remat` instead have their definition repeated before every
+// use and dropped. The fresh registers live for one instruction and are added
+// to `unspillable`.
+void insertSpillCode(MachineFunction& mf, const Target& target, const std::set<int>& spilled,
+                     std::set<int>& unspillable, const std::map<int, MachineInstr>& remat = {});
+
+// Rewrites virtual registers to their assigned physical registers and records
+// the callee-saved registers used.
+void applyAssignment(MachineFunction& mf, const Target& target, const std::map<int, int>& assignment);
+
+// Linear scan over live intervals (Poletto and Sarkar), spilling the interval
+// that ends last when registers run out and retrying with the spill code in
+// place.
+void allocateRegistersLinearScan(MachineFunction& mf, const Target& target);
+
+// Iterated register coalescing (George and Appel): graph coloring that
+// coalesces copies where the Briggs or George test shows it safe, spills by
+// use count weighted by loop depth over degree, and rematerializes constants
+// instead of giving them stack slots. Slower than linear scan, but keeps more
+// values in registers and removes most copies.
+void allocateRegistersGraphColoring(MachineFunction& mf, const Target& target);
+
+#endif // REGALLOC_H
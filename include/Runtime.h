@@ -0,0 +1,34 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <string>
+
+// sylib built into the compiler, for running programs in-process. The
+// functions behave as those of test/resources/sylib.c and read and write
+// the compiler's own stdin, stdout and stderr.
+namespace runtime {
+
+int getint();
+int getch();
+int getarray(int a[]);
+void putint(int a);
+void putch(int a);
+void putarray(int n, int a[]);
+void putf(const char* format, ...);
+// starttime() and stoptime(), which sylib.h passes the source line.
+void startTime(int line);
+void stopTime(int line);
+
+// The address of the sylib function called `name`, under the symbol the
+// backend calls it by, or nullptr if there is none.
+void* lookup(const std::string& name);
+
+// Clears the timers before a program starts.
+void reset();
+// Flushes the output of a finished program and reports its timers on
+// stderr, as sylib does when the process exits.
+void finish();
+
+} // namespace runtime
+
+#endif // RUNTIME_H
@@ -0,0 +1,177 @@
+#ifndef SELECTIONTREE_H
+#define SELECTIONTREE_H
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "IR.h"
+#include "MachineIR.h"
+
+// Expression trees for tree-pattern instruction selection. A pure
+// instruction whose only use follows it closely in the same block is
+// folded into the tree of that use, so that one pattern may cover several
+// IR instructions; everything else is a leaf. Address arithmetic of
+// getelementptr is spelled out in 64-bit adds, multiplies and sign
+// extensions, with constant indices gathered into one displacement.
+struct SelectionNode {
+    enum Op {
+        Const,
+        Value,   // A value computed elsewhere, already in its register
+        Frame,   // The address of an alloca
+        Global,  // The address of a global
+        Add,
+        Sub,
+        Mul,
+        And,
+        Or,
+        Xor,
+        Shl,
+        AShr,
+        LShr,
+        ICmp,
+        ZExt,
+        Add64,
+        Mul64,
+        SExt,    // i32 to i64
+        NumOps
+    };
+
+    Op op = Const;
+    int size = 4;                  // Width of the result in bytes
+    long long value = 0;           // Const
+    std::string name;              // Value, Frame and Global
+    std::string predicate;         // ICmp
+    std::vector<SelectionNode*> kids;
+    int dest = kNoReg;             // Where the result of a root should go
+
+    // Set by labeling: per nonterminal, the cheapest cost and its rule.
+    std::vector<int> cost;
+    std::vector<int> rule;
+
+    bool isConst(long long v) const { return op == Const && value == v; }
+    long long constKid(size_t k) const { return kids[k]->op == Const ? kids[k]->value : 0; }
+};
+
+// Builds the trees of one function and owns their nodes.
+class SelectionTrees {
+public:
+    explicit SelectionTrees(const Function& f);
+
+    // Whether `value` is computed inside the tree of its only user.
+    bool isFolded(const std::string& value) const { return folded.count(value) > 0; }
+    // The tree of `value` where it is used.
+    SelectionNode* operand(const std::string& value);
+    // The tree of a pure instruction that computes its own result.
+    SelectionNode* root(const Instruction& inst) { return expand(inst); }
+
+private:
+    SelectionNode* node(SelectionNode::Op op, int size, std::vector<SelectionNode*> kids = {});
+    SelectionNode* constant(long long value, int size);
+    SelectionNode* expand(const Instruction& inst);
+    SelectionNode* address(const Instruction& gep);
+
+    std::map<std::string, const Instruction*> defs;
+    std::map<std::string, int> sizes;
+    std::set<std::string> frames;
+    std::set<std::string> folded;
+    std::vector<std::unique_ptr<SelectionNode>> nodes;
+};
+
+// A bottom-up rewrite system. Each rule derives a nonterminal from a node
+// with the given operator whose children derive the given nonterminals, at
+// a cost; chain rules derive one nonterminal from another at the same node.
+// Labeling finds the cheapest derivation of every nonterminal at every node
+// by dynamic programming from the leaves up; reduction then walks the
+// chosen rules from the root and lets each emit its code once its
+// children have emitted theirs.
+template <typename Selector, typename Result>
+class TreeMatcher {
+public:
+    static constexpr int kChain = -1;
+    static constexpr int kInfinite = std::numeric_limits<int>::max() / 4;
+
+    struct Rule {
+        int result;
+        int op;                  // SelectionNode::Op, or kChain
+        std::vector<int> kids;   // Per child; for a chain rule, the nonterminal it converts
+        int cost;
+        bool (*applies)(const SelectionNode& n);  // Extra condition, or nullptr
+        Result (*emit)(Selector& s, SelectionNode& n, const std::vector<Result>& kids);
+    };
+
+    TreeMatcher(int nonterminals, std::vector<Rule> table)
+        : nonterminals(nonterminals), rules(std::move(table)), byOp(SelectionNode::NumOps) {
+        for (int r = 0; r < static_cast<int>(rules.size()); ++r) {
+            if (rules[r].op == kChain) {
+                chains.push_back(r);
+            } else {
+                byOp[rules[r].op].push_back(r);
+            }
+        }
+    }
+
+    void label(SelectionNode& n) const {
+        if (!n.cost.empty()) return;
+        for (SelectionNode* kid : n.kids) label(*kid);
+        n.cost.assign(nonterminals, kInfinite);
+        n.rule.assign(nonterminals, -1);
+        for (int r : byOp[n.op]) {
+            const Rule& rule = rules[r];
+            if (rule.kids.size() != n.kids.size() || (rule.applies && !rule.applies(n))) continue;
+            int cost = rule.cost;
+            for (size_t i = 0; i < n.kids.size(); ++i) cost = std::min(kInfinite, cost + n.kids[i]->cost[rule.kids[i]]);
+            record(n, r, cost);
+        }
+        // Chain rules until nothing gets cheaper; every cycle of them costs
+        // something, so this ends.
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int r : chains) {
+                const Rule& rule = rules[r];
+                if (rule.applies && !rule.applies(n)) continue;
+                changed |= record(n, r, std::min(kInfinite, n.cost[rule.kids[0]] + rule.cost));
+            }
+        }
+    }
+
+    // Labels `n` if needed; the cost of deriving `nt` from it.
+    int cost(SelectionNode& n, int nt) const {
+        label(n);
+        return n.cost[nt];
+    }
+
+    Result reduce(Selector& s, SelectionNode& n, int nt) const {
+        label(n);
+        if (n.rule[nt] < 0) throw std::runtime_error("instruction selection: no rule covers the tree");
+        const Rule& rule = rules[n.rule[nt]];
+        std::vector<Result> kids;
+        if (rule.op == kChain) {
+            kids.push_back(reduce(s, n, rule.kids[0]));
+        } else {
+            for (size_t i = 0; i < n.kids.size(); ++i) kids.push_back(reduce(s, *n.kids[i], rule.kids[i]));
+        }
+        return rule.emit(s, n, kids);
+    }
+
+private:
+    bool record(SelectionNode& n, int r, int cost) const {
+        int nt = rules[r].result;
+        if (cost >= n.cost[nt]) return false;
+        n.cost[nt] = cost;
+        n.rule[nt] = r;
+        return true;
+    }
+
+    int nonterminals;
+    std::vector<Rule> rules;
+    std::vector<std::vector<int>> byOp;
+    std::vector<int> chains;
+};
+
+#endif // SELECTIONTREE_H
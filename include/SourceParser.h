@@ -0,0 +1,46 @@
+#ifndef SOURCEPARSER_H
+#define SOURCEPARSER_H
+
+#include <istream>
+#include <memory>
+#include <vector>
+#include "antlr4-runtime.h"
+#include "SysYLexer.h"
+#include "SysYParser.h"
+#include "ThreadPool.h"
+
+// Parses a SysY source file into a compUnit. With a thread pool, the
+// tokens are first cut into the top-level declarations and function
+// definitions by matching braces. The declarations are parsed first, then
+// each function with a parser of its own on the pool, all of them sharing
+// the generated parser's DFA cache, and the pieces are put back in source
+// order under one compUnit. A source that does not cut cleanly is parsed
+// whole, as without a pool.
+class SourceParser {
+public:
+    explicit SourceParser(std::istream& stream, ThreadPool* threads = nullptr);
+
+    // nullptr after syntax errors, which have been reported. The tree lives
+    // as long as this object.
+    SysYParser::CompUnitContext* parse();
+
+private:
+    struct Piece {
+        std::unique_ptr<antlr4::ListTokenSource> source;
+        std::unique_ptr<antlr4::CommonTokenStream> tokens;
+        std::unique_ptr<SysYParser> parser;
+        antlr4::ParserRuleContext* tree = nullptr;
+    };
+
+    SysYParser::CompUnitContext* parseWhole();
+
+    ThreadPool* threads;
+    antlr4::ANTLRInputStream input;
+    SysYLexer lexer;
+    antlr4::CommonTokenStream tokens;
+    std::unique_ptr<SysYParser> whole;
+    std::vector<Piece> pieces;
+    std::unique_ptr<SysYParser::CompUnitContext> unit;
+};
+
+#endif // SOURCEPARSER_H
@@ -0,0 +1,59 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "IR.h"
+#include "MachineIR.h"
+#include "ObjectFile.h"
+
+// What the target-independent parts of the native backend need to know about
+// a target: its registers, how to select instructions, how to spill, how to
+// lay out a frame and how to print the result.
+class Target {
+public:
+    virtual ~Target() = default;
+
+    virtual std::string name() const = 0;
+
+    // Registers the allocator may assign, in order of preference.
+    virtual const std::vector<int>& allocatableRegs() const = 0;
+    virtual bool isCalleeSaved(int reg) const = 0;
+    virtual std::string regName(int reg, int size) const = 0;
+
+    // Lowers `f`, phis included, to machine code over virtual registers.
+    virtual std::unique_ptr<MachineFunction> selectInstructions(const Module& m, const Function& f) const = 0;
+
+    // Spill code for the register allocator.
+    virtual MachineInstr loadFromFrame(int reg, int frameIndex, int size) const = 0;
+    virtual MachineInstr storeToFrame(int reg, int frameIndex, int size) const = 0;
+    // Recognizes a register-to-register copy `dst = src`.
+    virtual bool isCopy(const MachineInstr& mi, int& dst, int& src) const = 0;
+    // Whether `mi` computes its one result from constants alone, so that the
+    // allocator may repeat it before each use instead of spilling the result.
+    virtual bool isRematerializable(const MachineInstr& mi) const = 0;
+
+    // Inserts the prologue and epilogues and turns frame indices into
+    // offsets, once registers are allocated.
+    virtual void lowerFrame(MachineFunction& mf) const = 0;
+
+    // Local cleanups by the target's peephole rules, before register
+    // allocation and again once the frame is laid out. Returns whether
+    // anything changed.
+    virtual bool runPeephole(MachineFunction& mf) const = 0;
+
+    virtual std::string printFunction(const MachineFunction& mf) const = 0;
+    virtual std::string printGlobals(const Module& m) const = 0;
+
+    // Machine code for object files: appends `mf` to the text section,
+    // with relocations for the symbols it references.
+    virtual void encodeFunction(const MachineFunction& mf, ObjectFile& obj) const = 0;
+    // The ELF e_machine of the target.
+    virtual uint16_t elfMachine() const = 0;
+};
+
+std::unique_ptr<Target> createX86Target();
+std::unique_ptr<Target> createRISCVTarget();
+
+#endif // TARGET_H
@@ -0,0 +1,58 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads for loops whose iterations are independent, such as one per
+// function. The iterations are dealt out to per-thread deques up front;
+// each thread works from the back of its own and, once that runs dry,
+// steals from the front of the others', so one large function among many
+// small ones does not leave the rest of the threads idle.
+class ThreadPool {
+public:
+    // `threads` counts the thread calling parallelFor, which takes part.
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+    // Runs body(0) .. body(count - 1) and returns once all of them are done.
+    // If any of them throws, the rest still run and the first exception is
+    // rethrown. Not reentrant: `body` must not call parallelFor.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    void workerLoop(unsigned self);
+    void work(unsigned self);
+    bool take(unsigned self, size_t& item);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex running;                 // One loop at a time
+    std::mutex mutex;                   // The rest
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* body = nullptr;
+    size_t remaining = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,20 @@
+#ifndef TIERING_H
+#define TIERING_H
+
+#include <string>
+#include "CodeGen.h"
+#include "IR.h"
+
+// Runs `m` in the interpreter and moves what turns hot to native code
+// optimized by `pipeline`: functions called often at their next call, and
+// the outermost loops of a function once they and the loops in them have
+// iterated often at the next visit of their header, through an entry that
+// takes the values live there. The pipeline first runs, once, when the
+// first function turns hot, over all of the module and those loop entries;
+// after that only instruction selection onwards runs per function. Each
+// function and loop entry is compiled along with whatever it calls that is
+// not native yet. Without an x86-64 host everything is interpreted. The
+// result is what main returns.
+int runTiered(const Module& m, const std::string& pipeline, const CodeGenOptions& options = {});
+
+#endif // TIERING_H
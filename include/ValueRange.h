@@ -0,0 +1,100 @@
+#ifndef VALUERANGE_H
+#define VALUERANGE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "IR.h"
+#include "Dominance.h"
+#include "LoopInfo.h"
+
+// Signed interval [lo, hi] of an i32 or i1 value together with the bits
+// known to be zero or one; the two views tighten each other.
+struct ValueRange {
+    long long lo = INT32_MIN;
+    long long hi = INT32_MAX;
+    uint32_t knownZero = 0;
+    uint32_t knownOne = 0;
+
+    static ValueRange full(const std::string& type = "i32");
+    static ValueRange constant(long long value);
+    // Full if the interval does not fit in an i32, i.e. the operation wraps.
+    static ValueRange between(long long lo, long long hi);
+
+    bool isConstant() const { return lo == hi; }
+    bool isNonNegative() const { return lo >= 0; }
+    ValueRange unite(const ValueRange& other) const;
+    // Left unchanged if the two cannot both hold, which only happens on
+    // paths that never run.
+    ValueRange intersect(const ValueRange& other) const;
+    bool operator==(const ValueRange& other) const {
+        return lo == other.lo && hi == other.hi && knownZero == other.knownZero && knownOne == other.knownOne;
+    }
+    bool operator!=(const ValueRange& other) const { return !(*this == other); }
+
+    void normalize();
+};
+
+// Value range and known-bits analysis over SSA form. Ranges start from
+// constants and from counted loops, whose induction variables are bounded by
+// their start and exit test, and are narrowed by the comparisons on the
+// branch edges that dominate a use. Phis that keep growing are widened to
+// the full range after a few rounds.
+//
+// Queries only read precomputed facts, so the analysis stays usable while a
+// pass replaces uses and deletes instructions, as long as blocks stay.
+class ValueRangeAnalysis {
+public:
+    explicit ValueRangeAnalysis(Function& f);
+    // On the loops of the function, which have to stay valid as long as the
+    // analysis.
+    explicit ValueRangeAnalysis(const LoopInfo& li);
+
+    // Range of `value` wherever it is defined.
+    ValueRange range(const std::string& value) const;
+    // Range of `value` in `bb`, narrowed by the branch conditions that hold
+    // whenever `bb` runs.
+    ValueRange rangeAt(const std::string& value, BasicBlock* bb) const;
+    // 1 or 0 if `icmp pred lhs, rhs` always has that outcome in `bb`, -1 if
+    // it may go either way.
+    int evaluateCompare(const std::string& pred, const std::string& lhs, const std::string& rhs,
+                        BasicBlock* bb) const;
+    // The same for the condition of the conditional branch ending `bb`.
+    int evaluateBranch(BasicBlock* bb) const;
+
+    const DominatorTree& dominators() const { return dt; }
+
+private:
+    // `lhs pred rhs` holds
+    struct Condition {
+        std::string pred;
+        std::string lhs;
+        std::string rhs;
+    };
+
+    void compute(const LoopInfo& li);
+    bool branchCondition(BasicBlock* bb, bool taken, Condition& cond) const;
+    ValueRange narrow(const std::string& value, const ValueRange& r, const Condition& cond) const;
+    ValueRange rangeOnEdge(const std::string& value, BasicBlock* from, BasicBlock* to) const;
+    bool evaluate(const Instruction& inst, BasicBlock* bb, ValueRange& result) const;
+
+    std::unique_ptr<LoopInfo> ownLoops;  // Unless given them
+    const DominatorTree& dt;
+    std::map<std::string, const Instruction*> defs;  // Valid during construction only
+    std::map<std::string, BasicBlock*> defBlocks;
+    std::map<const BasicBlock*, std::vector<Condition>> entryConditions;
+    std::map<const BasicBlock*, Condition> branchConditions;  // Condition of the true edge
+    std::map<std::string, ValueRange> ranges;
+
+    struct CountedLoop {
+        std::string init;
+        std::string bound;
+        std::string pred;
+        int step;
+    };
+    std::map<std::string, CountedLoop> inductionVariables;
+};
+
+#endif // VALUERANGE_H
@@ -0,0 +1,84 @@
+#ifndef X86TARGET_H
+#define X86TARGET_H
+
+#include "Target.h"
+
+namespace x86 {
+
+// Numbered as in the instruction encoding.
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+enum MachineOpcode {
+    MOV,
+    MOVSX,   // movslq: sign-extends a 32-bit value to 64 bits
+    MOVZX8,  // movzbl: zero-extends the low byte
+    LEA,
+    ADD,
+    SUB,
+    IMUL,    // Two operands, or three with an immediate first
+    AND,
+    OR,
+    XOR,
+    SHL,
+    SAR,
+    SHR,
+    CDQ,
+    IDIV,
+    CMP,
+    TEST,
+    SETCC,
+    CMOV,
+    JMP,
+    JCC,
+    CALL,
+    RET,
+    PUSH,
+    POP
+};
+
+constexpr int kNumMachineOpcodes = POP + 1;
+
+// Condition codes, numbered as in the encoding of jcc, setcc and cmovcc.
+enum Cond {
+    CondB = 2, CondAE = 3, CondE = 4, CondNE = 5, CondBE = 6, CondA = 7,
+    CondL = 12, CondGE = 13, CondLE = 14, CondG = 15
+};
+
+// Argument registers of the System V calling convention, in order.
+extern const Reg kArgRegs[6];
+
+} // namespace x86
+
+// x86-64 code for the System V ABI in GNU assembler syntax. Functions keep
+// a frame pointer; values are 32-bit integers and 64-bit pointers.
+class X86Target : public Target {
+public:
+    X86Target();
+
+    std::string name() const override { return "x86-64"; }
+    const std::vector<int>& allocatableRegs() const override { return allocatable; }
+    bool isCalleeSaved(int reg) const override;
+    std::string regName(int reg, int size) const override;
+
+    std::unique_ptr<MachineFunction> selectInstructions(const Module& m, const Function& f) const override;
+
+    MachineInstr loadFromFrame(int reg, int frameIndex, int size) const override;
+    MachineInstr storeToFrame(int reg, int frameIndex, int size) const override;
+    bool isCopy(const MachineInstr& mi, int& dst, int& src) const override;
+    bool isRematerializable(const MachineInstr& mi) const override;
+
+    void lowerFrame(MachineFunction& mf) const override;
+    bool runPeephole(MachineFunction& mf) const override;
+
+    std::string printFunction(const MachineFunction& mf) const override;
+    std::string printGlobals(const Module& m) const override;
+    std::string printInstruction(const MachineInstr& mi, const MachineFunction& mf) const;
+
+    void encodeFunction(const MachineFunction& mf, ObjectFile& obj) const override;
+    uint16_t elfMachine() const override { return 62; }  // EM_X86_64
+
+private:
+    std::vector<int> allocatable;
+};
+
+#endif // X86TARGET_H
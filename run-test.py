@@ -1,7 +1,44 @@
 import os
 import subprocess
+import sys
 from pathlib import Path
 
+# With --target=x86-64 or --target=riscv64 the tests go through the native
+# backend instead of LLVM IR. RISC-V binaries are linked statically with a
+# cross gcc and run under qemu-riscv64 user mode.
+#
+# With --object the compiler writes x86-64 object files itself (-c), which
+# are linked with the system gcc. With --run the compiler runs each test
+# itself, compiled into its own process, and nothing is built or linked;
+# --interpret likewise, through the IR interpreter, and --tiered through
+# the interpreter moving hot code to native code.
+TARGET = "llvm"
+for arg in sys.argv[1:]:
+    if arg.startswith("--target="):
+        TARGET = arg[len("--target="):]
+    elif arg == "--object":
+        TARGET = "object"
+    elif arg in ("--run", "--interpret", "--tiered"):
+        TARGET = arg[2:]
+        TARGET = arg[2:]
+
+# Besides the functional tests, the regression tests cover the optimizer and
+# the backends. A regression test names the options it exercises on its first
+# line, as `// flags: -finterchange | -O2`, and runs once without options and
+# once with each set, always against the same expected output.
+TEST_DIRS = [Path("./test/resources/functional"), Path("./test/resources/regression")]
+
+NATIVE_BUILD = {
+    "x86-64": ["gcc", "-w"],
+    "riscv64": ["riscv64-linux-gnu-gcc", "-static", "-w"],
+    "object": ["gcc", "-w"],
+}
+NATIVE_RUN = {
+    "x86-64": [],
+    "object": [],
+    "riscv64": ["qemu-riscv64"],
+}
+
 def normalize_lines(content):
     lines = [line.rstrip() for line in content.splitlines()]
     while lines and not lines[-1]:
@@ -18,8 +55,17 @@ def compare_files(c_file, res_file):
         return False
     
 
-def generate_llvmir(sysy_file):
-    test_dir = Path("./test/resources/functional")
+def flag_sets(sysy_file):
+    with open(sysy_file, 'r') as f:
+        first = f.readline()
+    sets = [[]]
+    if first.startswith("// flags:"):
+        sets += [flags.split() for flags in first[len("// flags:"):].split("|") if flags.strip()]
+    return sets
+
+
+def generate_llvmir(sysy_file, flags):
+    test_dir = sysy_file.parent
     if not test_dir.exists():
         return False, "Functional test directory not found."
     
@@ -29,18 +75,35 @@ def generate_llvmir(sysy_file):
     
     try:
         base_name = sysy_file.stem
-        llvmir_file = test_dir / f"{base_name}.ll"
-
-        subprocess.run(["timeout", "10s", "./build/compiler", sysy_file, llvmir_file])
+        if TARGET in ("run", "interpret", "tiered"):
+            pass
+        elif TARGET == "llvm":
+            llvmir_file = test_dir / f"{base_name}.ll"
+            subprocess.run(["timeout", "10s", "./build/compiler"] + flags + [sysy_file, llvmir_file])
+        elif TARGET == "object":
+            obj_file = test_dir / f"{base_name}.o"
+            subprocess.run(["timeout", "10s", "./build/compiler", "-c"] + flags + [sysy_file, obj_file])
+        else:
+            asm_file = test_dir / f"{base_name}.s"
+            subprocess.run(["timeout", "10s", "./build/compiler", "-S", f"--target={TARGET}"] + flags +
+                           [sysy_file, asm_file])
         return True, "Output generated successfully."
     except Exception as e:
         return False, str(e)
     
 
-def execute_llvmir(llvmir_file):
-    test_dir = Path("./test/resources/functional")
+def execute_llvmir(llvmir_file, flags):
+    test_dir = llvmir_file.parent
     sylib = Path("./test/resources/sylib.c")
-    subprocess.run(["clang", llvmir_file, sylib, "-w", "-o", "a.out"])
+    if TARGET in ("run", "interpret", "tiered"):
+        run = ["timeout", "60s", "./build/compiler", f"--{TARGET}"] + flags + [llvmir_file.with_suffix(".sy")]
+    elif TARGET == "llvm":
+        subprocess.run(["clang", llvmir_file, sylib, "-w", "-o", "a.out"])
+        run = ["timeout", "60s", "./a.out"]
+    else:
+        native = llvmir_file.with_suffix(".o" if TARGET == "object" else ".s")
+        subprocess.run(NATIVE_BUILD[TARGET] + [native, sylib, "-o", "a.out"])
+        run = ["timeout", "60s"] + NATIVE_RUN[TARGET] + ["./a.out"]
 
     base_name = llvmir_file.stem
     input_file = test_dir / f"{base_name}.in"
@@ -49,14 +112,14 @@ def execute_llvmir(llvmir_file):
     if input_file.exists():
         with open(input_file, 'r') as infile, open(output_file, 'w') as outfile:
             result = subprocess.run(
-                ["timeout", "60s", "./a.out"],
+                run,
                 stdin=infile,
                 stdout=outfile,
             )
     else:
         with open(output_file, 'w') as outfile:
             result = subprocess.run(
-                ["timeout", "60s", "./a.out"],
+                run,
                 stdout=outfile,
             )
     with open(output_file, 'r+') as outfile:
@@ -71,38 +134,44 @@ def execute_llvmir(llvmir_file):
     return result.returncode
 
 def main():    
-    subprocess.run("rm -f ./test/resources/functional/*.ll", shell=True)
-    subprocess.run("rm -f ./test/resources/functional/*.output", shell=True)
+    for test_dir in TEST_DIRS:
+        subprocess.run(f"rm -f {test_dir}/*.ll", shell=True)
+        subprocess.run(f"rm -f {test_dir}/*.s", shell=True)
+        subprocess.run(f"rm -f {test_dir}/*.o", shell=True)
+        subprocess.run(f"rm -f {test_dir}/*.output", shell=True)
     
     total_tests = 0
     passed_tests = 0
     results = {}
     
-    test_dir = Path("./test/resources/functional")
-    
-    for sysy_file in sorted(test_dir.glob("*.sy"), key=lambda x: x.name[:2]):
+    tests = [(sysy_file, flags) for test_dir in TEST_DIRS
+             for sysy_file in sorted(test_dir.glob("*.sy"), key=lambda x: x.name[:2])
+             for flags in flag_sets(sysy_file)]
+    for sysy_file, flags in tests:
 
         total_tests += 1
+        test_dir = sysy_file.parent
         base_name = sysy_file.stem
+        test_name = " ".join([base_name] + flags)
         llvmir_file = test_dir / f"{base_name}.ll"
         output_file = test_dir / f"{base_name}.output"
         ans_file = test_dir / f"{base_name}.out"
 
-        success, message = generate_llvmir(sysy_file)
+        success, message = generate_llvmir(sysy_file, flags)
         if not success:
-            print(f"[ERROR] {base_name.ljust(14)}: \033[31m✗ LLVMIR Generation Failed\033[0m")  # 红色
+            print(f"[ERROR] {test_name.ljust(14)}: \033[31m✗ LLVMIR Generation Failed\033[0m")  # 红色
             print(f"   {message}")
             continue
 
-        execute_llvmir(llvmir_file)
+        execute_llvmir(llvmir_file, flags)
 
         if compare_files(ans_file, output_file):
             passed_tests += 1
-            results[base_name] = "\033[32m✓ Passed\033[0m"
-            print(f"[INFO] {base_name.ljust(14)}: \033[32m✓ Passed\033[0m")  # Green
+            results[test_name] = "\033[32m✓ Passed\033[0m"
+            print(f"[INFO] {test_name.ljust(14)}: \033[32m✓ Passed\033[0m")  # Green
         else:
-            results[base_name] = "\033[31m✗ Failed\033[0m"
-            print(f"[ERROR] {base_name.ljust(14)}: \033[31m✗ Failed\033[0m")  # Red
+            results[test_name] = "\033[31m✗ Failed\033[0m"
+            print(f"[ERROR] {test_name.ljust(14)}: \033[31m✗ Failed\033[0m")  # Red
 
     print("\n╔═══════════════════════════════════════╗")
     print("║            TEST RESULTS               ║")
@@ -110,9 +179,8 @@ def main():
     print("║ Test Name               ║ Result      ║")
     print("╠═════════════════════════╬═════════════╣")
 
-    for sysy_file in sorted(test_dir.glob("*.sy"), key=lambda x: x.name[:2]):
-        base_name = sysy_file.stem
-        print(f"║ {base_name.ljust(23)} ║ {results[base_name]}    ║")
+    for test_name, result in results.items():
+        print(f"║ {test_name.ljust(23)} ║ {result}    ║")
 
     print("╚═════════════════════════╩═════════════╝")
     print("\n📊 Test Summary:")
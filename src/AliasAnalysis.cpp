@@ -0,0 +1,413 @@
+#include "AliasAnalysis.h"
+#include <numeric>
+
+namespace {
+
+const std::set<std::string>& unknownObjects() {
+    static const std::set<std::string> objects = {"*"};
+    return objects;
+}
+
+bool insertAll(std::set<std::string>& into, const std::set<std::string>& from) {
+    size_t before = into.size();
+    into.insert(from.begin(), from.end());
+    return into.size() != before;
+}
+
+bool setFlag(bool& flag, bool value) {
+    if (!value || flag) return false;
+    flag = true;
+    return true;
+}
+
+bool setFlag(std::vector<bool>::reference flag, bool value) {
+    if (!value || flag) return false;
+    flag = true;
+    return true;
+}
+
+} // namespace
+
+AliasAnalysis::AliasAnalysis(const Module& m) {
+    computePointsTo(m);
+    computeSummaries(m);
+}
+
+const AliasAnalysis::FunctionInfo& AliasAnalysis::info(const Function& f) const {
+    // Entries stay put while others come and go, so a reference to one
+    // outlives the lock. An entry is built before it goes in, so that no
+    // thread sees it half done; of two threads building the same one, the
+    // second keeps the first one's.
+    {
+        std::lock_guard<std::mutex> lock(functionInfoMutex);
+        auto it = functionInfo.find(&f);
+        if (it != functionInfo.end()) return it->second;
+    }
+    FunctionInfo fi;
+    for (size_t i = 0; i < f.paramNames.size(); ++i) {
+        fi.params[f.paramNames[i]] = static_cast<int>(i);
+    }
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            switch (inst.op) {
+                case Opcode::Alloca:
+                case Opcode::GetElementPtr:
+                case Opcode::Add:
+                case Opcode::Sub:
+                case Opcode::Mul:
+                case Opcode::Shl:
+                    fi.defs[inst.result] = inst;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(functionInfoMutex);
+    return functionInfo.emplace(&f, std::move(fi)).first->second;
+}
+
+void AliasAnalysis::linearize(const FunctionInfo& fi, const std::string& value, long long scale,
+                              DecomposedPointer& out, int depth) const {
+    if (isConstantOperand(value)) {
+        out.offset += scale * constantValue(value);
+        return;
+    }
+    auto it = fi.defs.find(value);
+    if (depth < 6 && it != fi.defs.end()) {
+        const Instruction& inst = it->second;
+        const auto& ops = inst.operands;
+        switch (inst.op) {
+            case Opcode::Add:
+                linearize(fi, ops[0], scale, out, depth + 1);
+                linearize(fi, ops[1], scale, out, depth + 1);
+                return;
+            case Opcode::Sub:
+                linearize(fi, ops[0], scale, out, depth + 1);
+                linearize(fi, ops[1], -scale, out, depth + 1);
+                return;
+            case Opcode::Mul:
+                if (isConstantOperand(ops[1])) {
+                    linearize(fi, ops[0], scale * constantValue(ops[1]), out, depth + 1);
+                    return;
+                }
+                if (isConstantOperand(ops[0])) {
+                    linearize(fi, ops[1], scale * constantValue(ops[0]), out, depth + 1);
+                    return;
+                }
+                break;
+            case Opcode::Shl:
+                if (isConstantOperand(ops[1]) && constantValue(ops[1]) < 31) {
+                    linearize(fi, ops[0], scale << constantValue(ops[1]), out, depth + 1);
+                    return;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    long long& term = out.terms[value];
+    term += scale;
+    if (term == 0) out.terms.erase(value);
+}
+
+DecomposedPointer AliasAnalysis::decompose(const Function& f, const std::string& ptr) const {
+    const FunctionInfo& fi = info(f);
+    DecomposedPointer result;
+    std::string cur = ptr;
+    while (true) {
+        result.base = cur;
+        if (isGlobalOperand(cur)) {
+            result.kind = DecomposedPointer::Global;
+            return result;
+        }
+        auto param = fi.params.find(cur);
+        if (param != fi.params.end()) {
+            result.kind = DecomposedPointer::Argument;
+            result.argIndex = param->second;
+            return result;
+        }
+        auto it = fi.defs.find(cur);
+        if (it == fi.defs.end()) return result;
+        const Instruction& inst = it->second;
+        if (inst.op == Opcode::Alloca) {
+            result.kind = DecomposedPointer::Alloca;
+            return result;
+        }
+        if (inst.op != Opcode::GetElementPtr) {
+            result.kind = DecomposedPointer::Unknown;
+            return result;
+        }
+        std::string elemType = inst.type;
+        linearize(fi, inst.operands[1], typeSizeInBytes(elemType), result, 0);
+        for (size_t k = 2; k < inst.operands.size(); ++k) {
+            elemType = arrayElementType(elemType);
+            linearize(fi, inst.operands[k], typeSizeInBytes(elemType), result, 0);
+        }
+        cur = inst.operands[0];
+    }
+}
+
+std::string AliasAnalysis::objectName(const Function& f, const DecomposedPointer& p) const {
+    switch (p.kind) {
+        case DecomposedPointer::Global: return p.base;
+        case DecomposedPointer::Alloca: return f.name + "/" + p.base;
+        default: return "*";
+    }
+}
+
+const std::set<std::string>& AliasAnalysis::pointsTo(const std::string& func, int argIndex) const {
+    auto it = pointsToSets.find(func);
+    if (it == pointsToSets.end() || argIndex < 0 || argIndex >= static_cast<int>(it->second.size())) {
+        return unknownObjects();
+    }
+    return it->second[argIndex];
+}
+
+bool AliasAnalysis::mayPointToGlobal(const Function& f, const DecomposedPointer& p,
+                                     const std::string& global) const {
+    switch (p.kind) {
+        case DecomposedPointer::Global: return p.base == global;
+        case DecomposedPointer::Alloca: return false;
+        case DecomposedPointer::Argument: {
+            const auto& objs = pointsTo(f.name, p.argIndex);
+            return objs.count(global) || objs.count("*");
+        }
+        default: return true;
+    }
+}
+
+bool AliasAnalysis::argumentsMayAlias(const Function& f, int a, int b) const {
+    if (a == b) return true;
+    const auto& objsA = pointsTo(f.name, a);
+    const auto& objsB = pointsTo(f.name, b);
+    if (objsA.count("*") || objsB.count("*")) return true;
+    for (const auto& obj : objsA) {
+        if (objsB.count(obj)) return true;
+    }
+    return false;
+}
+
+void AliasAnalysis::computePointsTo(const Module& m) {
+    for (const auto& f : m.functions) {
+        if (!f->isDeclaration) pointsToSets[f->name].resize(f->paramTypes.size());
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto& f : m.functions) {
+            for (const auto& bb : f->blocks) {
+                for (const auto& inst : bb->insts) {
+                    if (inst.op != Opcode::Call) continue;
+                    auto callee = pointsToSets.find(inst.callee);
+                    if (callee == pointsToSets.end()) continue;
+                    for (size_t i = 0; i < inst.operands.size() && i < callee->second.size(); ++i) {
+                        if (!isPointerType(inst.argTypes[i])) continue;
+                        DecomposedPointer arg = decompose(*f, inst.operands[i]);
+                        if (arg.kind == DecomposedPointer::Argument) {
+                            // Copy first: the source set may be the one we grow.
+                            std::set<std::string> objs = pointsTo(f->name, arg.argIndex);
+                            changed |= insertAll(callee->second[i], objs);
+                        } else {
+                            changed |= callee->second[i].insert(objectName(*f, arg)).second;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void AliasAnalysis::computeSummaries(const Module& m) {
+    for (const auto& f : m.functions) {
+        Summary& s = summaries[f->name];
+        s.paramRead.assign(f->paramTypes.size(), false);
+        s.paramWritten.assign(f->paramTypes.size(), false);
+        if (!f->isDeclaration) continue;
+        // sylib only touches program memory through its array arguments.
+        if (f->name == "getarray") {
+            s.paramWritten[0] = true;
+        } else if (f->name == "putarray") {
+            s.paramRead[1] = true;
+        } else if (f->name == "putf") {
+            s.paramRead[0] = true;
+        } else if (f->name != "getint" && f->name != "getch" && f->name != "putint" &&
+                   f->name != "putch" && f->name != "starttime" && f->name != "stoptime") {
+            s.unknownRead = s.unknownWritten = true;
+        }
+    }
+
+    auto record = [](Summary& s, const DecomposedPointer& p, bool write) {
+        switch (p.kind) {
+            case DecomposedPointer::Global:
+                return (write ? s.globalsWritten : s.globalsRead).insert(p.base).second;
+            case DecomposedPointer::Argument:
+                return write ? setFlag(s.paramWritten[p.argIndex], true)
+                             : setFlag(s.paramRead[p.argIndex], true);
+            case DecomposedPointer::Alloca:
+                return false;
+            default:
+                return write ? setFlag(s.unknownWritten, true) : setFlag(s.unknownRead, true);
+        }
+    };
+
+    for (const auto& f : m.functions) {
+        if (f->isDeclaration) continue;
+        Summary& s = summaries[f->name];
+        for (const auto& bb : f->blocks) {
+            for (const auto& inst : bb->insts) {
+                if (inst.op == Opcode::Load) record(s, decompose(*f, inst.operands[0]), false);
+                if (inst.op == Opcode::Store) record(s, decompose(*f, inst.operands[1]), true);
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto& f : m.functions) {
+            if (f->isDeclaration) continue;
+            Summary& s = summaries[f->name];
+            for (const auto& bb : f->blocks) {
+                for (const auto& inst : bb->insts) {
+                    if (inst.op != Opcode::Call) continue;
+                    auto it = summaries.find(inst.callee);
+                    if (it == summaries.end()) {
+                        changed |= setFlag(s.unknownRead, true);
+                        changed |= setFlag(s.unknownWritten, true);
+                        continue;
+                    }
+                    // Copy: the callee may be f itself.
+                    Summary callee = it->second;
+                    changed |= insertAll(s.globalsRead, callee.globalsRead);
+                    changed |= insertAll(s.globalsWritten, callee.globalsWritten);
+                    changed |= setFlag(s.unknownRead, callee.unknownRead);
+                    changed |= setFlag(s.unknownWritten, callee.unknownWritten);
+                    for (size_t i = 0; i < inst.operands.size() && i < callee.paramRead.size(); ++i) {
+                        if (!isPointerType(inst.argTypes[i])) continue;
+                        DecomposedPointer arg = decompose(*f, inst.operands[i]);
+                        if (callee.paramRead[i]) changed |= record(s, arg, false);
+                        if (callee.paramWritten[i]) changed |= record(s, arg, true);
+                    }
+                }
+            }
+        }
+    }
+}
+
+const AliasAnalysis::Summary* AliasAnalysis::summary(const std::string& func) const {
+    auto it = summaries.find(func);
+    return it == summaries.end() ? nullptr : &it->second;
+}
+
+AliasResult AliasAnalysis::alias(const Function& f, const std::string& a, int sizeA,
+                                 const std::string& b, int sizeB) const {
+    if (a == b) return sizeA == sizeB ? AliasResult::MustAlias : AliasResult::PartialAlias;
+    DecomposedPointer pa = decompose(f, a);
+    DecomposedPointer pb = decompose(f, b);
+    if (pa.kind == DecomposedPointer::Unknown || pb.kind == DecomposedPointer::Unknown) {
+        return AliasResult::MayAlias;
+    }
+
+    if (pa.base != pb.base) {
+        bool argA = pa.kind == DecomposedPointer::Argument;
+        bool argB = pb.kind == DecomposedPointer::Argument;
+        if (!argA && !argB) return AliasResult::NoAlias;  // Distinct identified objects
+        if (argA && argB) {
+            return argumentsMayAlias(f, pa.argIndex, pb.argIndex) ? AliasResult::MayAlias
+                                                                  : AliasResult::NoAlias;
+        }
+        const DecomposedPointer& arg = argA ? pa : pb;
+        const DecomposedPointer& other = argA ? pb : pa;
+        // Parameters can only point into allocas of some other frame.
+        if (other.kind == DecomposedPointer::Alloca) return AliasResult::NoAlias;
+        return mayPointToGlobal(f, arg, other.base) ? AliasResult::MayAlias : AliasResult::NoAlias;
+    }
+
+    if (pa.terms == pb.terms) {
+        long long delta = pb.offset - pa.offset;
+        if (delta == 0 && sizeA == sizeB) return AliasResult::MustAlias;
+        bool overlap = delta >= 0 ? delta < sizeA : -delta < sizeB;
+        return overlap ? AliasResult::PartialAlias : AliasResult::NoAlias;
+    }
+
+    // Different variable parts: every offset is congruent to the constant
+    // part modulo the common stride, e.g. a[i][0] and a[j][1] never meet.
+    long long stride = 0;
+    for (const auto& term : pa.terms) stride = std::gcd(stride, std::llabs(term.second));
+    for (const auto& term : pb.terms) stride = std::gcd(stride, std::llabs(term.second));
+    if (stride > 0) {
+        long long delta = ((pb.offset - pa.offset) % stride + stride) % stride;
+        if (delta >= sizeA && delta + sizeB <= stride) return AliasResult::NoAlias;
+    }
+    return AliasResult::MayAlias;
+}
+
+AliasResult AliasAnalysis::alias(const Function& f, const Instruction& a, const Instruction& b) const {
+    const std::string& ptrA = a.op == Opcode::Store ? a.operands[1] : a.operands[0];
+    const std::string& ptrB = b.op == Opcode::Store ? b.operands[1] : b.operands[0];
+    return alias(f, ptrA, typeSizeInBytes(a.type), ptrB, typeSizeInBytes(b.type));
+}
+
+ModRefInfo AliasAnalysis::getModRef(const Instruction& call) const {
+    const Summary* s = summary(call.callee);
+    if (!s) return MRI_ModRef;
+    int result = MRI_NoModRef;
+    if (s->unknownRead || !s->globalsRead.empty()) result |= MRI_Ref;
+    if (s->unknownWritten || !s->globalsWritten.empty()) result |= MRI_Mod;
+    for (size_t i = 0; i < s->paramRead.size(); ++i) {
+        if (s->paramRead[i]) result |= MRI_Ref;
+        if (s->paramWritten[i]) result |= MRI_Mod;
+    }
+    return static_cast<ModRefInfo>(result);
+}
+
+ModRefInfo AliasAnalysis::getModRef(const Function& f, const Instruction& call,
+                                    const std::string& ptr) const {
+    const Summary* s = summary(call.callee);
+    if (!s) return MRI_ModRef;
+    DecomposedPointer loc = decompose(f, ptr);
+    if (loc.kind == DecomposedPointer::Unknown) return getModRef(call);
+
+    int result = MRI_NoModRef;
+    auto touchGlobal = [&](const std::string& global) {
+        if (s->unknownRead || s->globalsRead.count(global)) result |= MRI_Ref;
+        if (s->unknownWritten || s->globalsWritten.count(global)) result |= MRI_Mod;
+    };
+    if (loc.kind == DecomposedPointer::Global) {
+        touchGlobal(loc.base);
+    } else if (loc.kind == DecomposedPointer::Argument) {
+        for (const auto& obj : pointsTo(f.name, loc.argIndex)) {
+            if (obj == "*") return getModRef(call);
+            if (isGlobalOperand(obj)) touchGlobal(obj);
+        }
+    }
+
+    // Memory the callee reaches through its own pointer arguments.
+    for (size_t i = 0; i < call.operands.size() && i < s->paramRead.size(); ++i) {
+        if (!isPointerType(call.argTypes[i])) continue;
+        DecomposedPointer arg = decompose(f, call.operands[i]);
+        bool reaches = false;
+        if (arg.kind == DecomposedPointer::Unknown) {
+            reaches = true;
+        } else if (loc.kind == DecomposedPointer::Alloca) {
+            reaches = arg.kind == DecomposedPointer::Alloca && arg.base == loc.base;
+        } else if (loc.kind == DecomposedPointer::Global) {
+            reaches = mayPointToGlobal(f, arg, loc.base);
+        } else if (arg.kind == DecomposedPointer::Argument) {
+            reaches = argumentsMayAlias(f, loc.argIndex, arg.argIndex);
+        } else if (arg.kind == DecomposedPointer::Global) {
+            reaches = mayPointToGlobal(f, loc, arg.base);
+        }
+        if (!reaches) continue;
+        if (s->paramRead[i]) result |= MRI_Ref;
+        if (s->paramWritten[i]) result |= MRI_Mod;
+    }
+    return static_cast<ModRefInfo>(result);
+}
+
+ModRefInfo AliasAnalysis::getModRef(const Function& f, const Instruction& call,
+                                    const Instruction& mem) const {
+    const std::string& ptr = mem.op == Opcode::Store ? mem.operands[1] : mem.operands[0];
+    return getModRef(f, call, ptr);
+}
@@ -0,0 +1,86 @@
+#include "CodeGen.h"
+#include "RegAlloc.h"
+#include "Target.h"
+#include "ThreadPool.h"
+
+namespace {
+
+std::unique_ptr<Target> createTarget(const CodeGenOptions& options) {
+    return options.arch == CodeGenOptions::Arch::RISCV64 ? createRISCVTarget() : createX86Target();
+}
+
+// Instruction selection through frame layout.
+std::unique_ptr<MachineFunction> compileFunction(const Target& target, const Module& m, const Function& func,
+                                                 const CodeGenOptions& options) {
+    std::unique_ptr<MachineFunction> mf = target.selectInstructions(m, func);
+    if (options.peephole) target.runPeephole(*mf);
+    if (options.regAlloc == CodeGenOptions::RegAllocator::GraphColoring) {
+        allocateRegistersGraphColoring(*mf, target);
+    } else {
+        allocateRegistersLinearScan(*mf, target);
+    }
+    target.lowerFrame(*mf);
+    if (options.peephole) target.runPeephole(*mf);
+    return mf;
+}
+
+// Runs `body` for each defined function of `m` with its index among them,
+// on the threads of `options` if it has any.
+void forEachFunction(const Module& m, const CodeGenOptions& options,
+                     const std::function<void(size_t, const Function&)>& body) {
+    std::vector<const Function*> defined;
+    for (const auto& func : m.functions) {
+        if (!func->isDeclaration) defined.push_back(func.get());
+    }
+    auto run = [&](size_t index) { body(index, *defined[index]); };
+    if (options.threads) {
+        options.threads->parallelFor(defined.size(), run);
+    } else {
+        for (size_t index = 0; index < defined.size(); ++index) run(index);
+    }
+}
+
+size_t definedFunctions(const Module& m) {
+    size_t count = 0;
+    for (const auto& func : m.functions) count += func->isDeclaration ? 0 : 1;
+    return count;
+}
+
+} // namespace
+
+std::string emitAssembly(const Module& m, const CodeGenOptions& options) {
+    std::string out;
+    for (const auto& text : emitFunctionAssembly(m, options)) out += text;
+    out += emitGlobalAssembly(m, options);
+    return out;
+}
+
+std::vector<std::string> emitFunctionAssembly(const Module& m, const CodeGenOptions& options) {
+    std::unique_ptr<Target> target = createTarget(options);
+    std::vector<std::string> functions(definedFunctions(m));
+    forEachFunction(m, options, [&](size_t index, const Function& func) {
+        functions[index] = target->printFunction(*compileFunction(*target, m, func, options));
+    });
+    return functions;
+}
+
+std::string emitGlobalAssembly(const Module& m, const CodeGenOptions& options) {
+    return createTarget(options)->printGlobals(m);
+}
+
+ObjectFile compileObject(const Module& m, const CodeGenOptions& options) {
+    std::unique_ptr<Target> target = createTarget(options);
+    // Encoding appends to the sections, so it goes in order afterwards.
+    std::vector<std::unique_ptr<MachineFunction>> functions(definedFunctions(m));
+    forEachFunction(m, options, [&](size_t index, const Function& func) {
+        functions[index] = compileFunction(*target, m, func, options);
+    });
+    ObjectFile obj;
+    for (const auto& mf : functions) target->encodeFunction(*mf, obj);
+    obj.addGlobals(m);
+    return obj;
+}
+
+std::string emitObject(const Module& m, const CodeGenOptions& options) {
+    return compileObject(m, options).toELF(createTarget(options)->elfMachine());
+}
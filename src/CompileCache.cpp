@@ -0,0 +1,171 @@
+#include "CompileCache.h"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::array<uint32_t, 64> kRoundConstants = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+uint32_t rotateRight(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+// FIPS 180-4.
+std::array<uint32_t, 8> sha256(const std::string& data) {
+    std::array<uint32_t, 8> h = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    std::string message = data;
+    uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+    message += '\x80';
+    while (message.size() % 64 != 56) message += '\0';
+    for (int i = 7; i >= 0; --i) message += static_cast<char>(bits >> (8 * i));
+
+    for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            const auto* p = reinterpret_cast<const unsigned char*>(message.data() + chunk + 4 * i);
+            w[i] = uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | uint32_t(p[3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+            uint32_t choose = (e & f) ^ (~e & g);
+            uint32_t t1 = k + s1 + choose + kRoundConstants[i] + w[i];
+            uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+            k = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += k;
+    }
+    return h;
+}
+
+} // namespace
+
+CompileCache::CompileCache(const fs::path& directory, uintmax_t maxBytes)
+    : directory(directory), maxBytes(maxBytes) {
+    fs::create_directories(directory);
+}
+
+CompileCache::~CompileCache() {
+    if (!stored) return;
+    try {
+        evict();
+    } catch (const fs::filesystem_error&) {
+        // Another compiler got there first; it will have done the same.
+    }
+}
+
+bool CompileCache::lookup(const std::string& key, std::string& contents) {
+    fs::path path = directory / key;
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    std::error_code ignored;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ignored);
+    return true;
+}
+
+void CompileCache::store(const std::string& key, const std::string& contents) {
+    fs::path path = directory / key;
+    fs::path temporary = directory / (key + ".tmp" + std::to_string(getpid()));
+    std::error_code error;
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        if (!out) return;
+        out << contents;
+        if (!out) {
+            out.close();
+            fs::remove(temporary, error);
+            return;
+        }
+    }
+    // A failed store only means a miss the next time.
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return;
+    }
+    stored = true;
+}
+
+void CompileCache::evict() {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type used;
+        uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    for (const auto& file : fs::directory_iterator(directory)) {
+        if (!file.is_regular_file()) continue;
+        entries.push_back({file.path(), file.last_write_time(), file.file_size()});
+        total += entries.back().size;
+    }
+    if (total <= maxBytes) return;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const auto& entry : entries) {
+        if (total <= maxBytes) break;
+        std::error_code ignored;
+        if (fs::remove(entry.path, ignored)) total -= entry.size;
+    }
+}
+
+std::string CompileCache::hash(const std::string& data) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string hex;
+    for (uint32_t word : sha256(data)) {
+        for (int shift = 28; shift >= 0; shift -= 4) hex += kDigits[(word >> shift) & 0xf];
+    }
+    return hex;
+}
+
+const std::string& CompileCache::compilerVersion() {
+    static const std::string version = []() {
+        std::error_code error;
+        fs::path exe = fs::read_symlink("/proc/self/exe", error);
+        if (error) return std::string(__DATE__ " " __TIME__);
+        std::ostringstream id;
+        id << exe.string() << ' ' << fs::file_size(exe, error) << ' '
+           << fs::last_write_time(exe, error).time_since_epoch().count();
+        return id.str();
+    }();
+    return version;
+}
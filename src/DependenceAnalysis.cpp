@@ -0,0 +1,285 @@
+#include "DependenceAnalysis.h"
+#include <cstdlib>
+#include <numeric>
+#include <set>
+
+DependenceAnalysis::DependenceAnalysis(const Module& m, Function& f, const LoopInfo& li,
+                                       const AliasAnalysis& aa)
+    : module(m), func(f), loops(li), alias(aa) {
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (!inst.result.empty()) defs[inst.result] = &inst;
+        }
+    }
+}
+
+AffineExpr DependenceAnalysis::linearize(const std::string& value) const {
+    AffineExpr expr;
+    // (value, scale) pairs still to expand; bounded so that long chains of
+    // arithmetic degrade to an opaque term instead of blowing up.
+    std::vector<std::pair<std::string, long long>> work = {{value, 1}};
+    int budget = 64;
+    while (!work.empty()) {
+        auto [v, scale] = work.back();
+        work.pop_back();
+        if (isConstantOperand(v)) {
+            expr.constant += scale * constantValue(v);
+            continue;
+        }
+        auto it = defs.find(v);
+        const Instruction* def = it == defs.end() ? nullptr : it->second;
+        if (def && --budget > 0) {
+            const auto& ops = def->operands;
+            if (def->op == Opcode::Add) {
+                work.push_back({ops[0], scale});
+                work.push_back({ops[1], scale});
+                continue;
+            }
+            if (def->op == Opcode::Sub) {
+                work.push_back({ops[0], scale});
+                work.push_back({ops[1], -scale});
+                continue;
+            }
+            if (def->op == Opcode::Mul && isConstantOperand(ops[1])) {
+                work.push_back({ops[0], scale * constantValue(ops[1])});
+                continue;
+            }
+            if (def->op == Opcode::Mul && isConstantOperand(ops[0])) {
+                work.push_back({ops[1], scale * constantValue(ops[0])});
+                continue;
+            }
+            if (def->op == Opcode::Shl && isConstantOperand(ops[1]) &&
+                constantValue(ops[1]) >= 0 && constantValue(ops[1]) < 31) {
+                work.push_back({ops[0], scale << constantValue(ops[1])});
+                continue;
+            }
+        }
+        expr.coeffs[v] += scale;
+        if (expr.coeffs[v] == 0) expr.coeffs.erase(v);
+    }
+    return expr;
+}
+
+std::vector<MemoryAccess> DependenceAnalysis::accesses(const Loop* loop) const {
+    std::vector<MemoryAccess> result;
+    for (BasicBlock* bb : loop->blocks) {
+        for (auto& inst : bb->insts) {
+            if (inst.op != Opcode::Load && inst.op != Opcode::Store) continue;
+            MemoryAccess access;
+            access.inst = &inst;
+            access.block = bb;
+            access.isWrite = inst.op == Opcode::Store;
+            access.pointer = inst.operands[inst.op == Opcode::Load ? 0 : 1];
+            access.base = access.pointer;
+            auto it = defs.find(access.pointer);
+            if (it != defs.end() && it->second->op == Opcode::GetElementPtr) {
+                const Instruction* gep = it->second;
+                access.base = gep->operands[0];
+                access.sourceType = gep->type;
+                for (size_t i = 1; i < gep->operands.size(); ++i) {
+                    access.subscripts.push_back(linearize(gep->operands[i]));
+                }
+            }
+            result.push_back(access);
+        }
+    }
+    return result;
+}
+
+bool DependenceAnalysis::hasOpaqueCalls(const Loop* loop) const {
+    for (BasicBlock* bb : loop->blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op != Opcode::Call) continue;
+            const Function* callee = nullptr;
+            for (const auto& candidate : module.functions) {
+                if (candidate->name == inst.callee) callee = candidate.get();
+            }
+            if (!callee || !callee->attributes.count("readnone")) return true;
+        }
+    }
+    return false;
+}
+
+Dependence DependenceAnalysis::depends(const MemoryAccess& src, const MemoryAccess& dst,
+                                       const std::vector<std::string>& ivs,
+                                       const Loop* outermost) const {
+    Dependence dep;
+    if (!src.isWrite && !dst.isWrite) return dep;
+    // Only the object-level answer holds across iterations; the alias
+    // analysis compares offsets as if both addresses used the same values.
+    DecomposedPointer pa = alias.decompose(func, src.pointer);
+    DecomposedPointer pb = alias.decompose(func, dst.pointer);
+    if (pa.kind != DecomposedPointer::Unknown && pb.kind != DecomposedPointer::Unknown &&
+        pa.base != pb.base &&
+        alias.alias(func, src.pointer, typeSizeInBytes(src.inst->type),
+                    dst.pointer, typeSizeInBytes(dst.inst->type)) == AliasResult::NoAlias) {
+        return dep;
+    }
+    dep.independent = false;
+    dep.directions.assign(ivs.size(), DirAll);
+    if (src.base != dst.base || src.sourceType != dst.sourceType ||
+        src.subscripts.size() != dst.subscripts.size() ||
+        !loops.isInvariant(outermost, src.base)) {
+        return dep;
+    }
+
+    std::map<std::string, size_t> level;
+    for (size_t i = 0; i < ivs.size(); ++i) level[ivs[i]] = i;
+    std::map<size_t, long long> distance;
+
+    for (size_t k = 0; k < src.subscripts.size(); ++k) {
+        const AffineExpr& a = src.subscripts[k];
+        const AffineExpr& b = dst.subscripts[k];
+        // a(x) == b(y) with x the source and y the sink iteration:
+        // sum(a_l * x_l) - sum(b_l * y_l) == b.constant - a.constant
+        std::map<size_t, std::pair<long long, long long>> ivCoeffs;
+        bool analyzable = true;
+        std::set<std::string> others;
+        for (const auto& [v, c] : a.coeffs) {
+            if (level.count(v)) ivCoeffs[level[v]].first = c; else others.insert(v);
+        }
+        for (const auto& [v, c] : b.coeffs) {
+            if (level.count(v)) ivCoeffs[level[v]].second = c; else others.insert(v);
+        }
+        for (const auto& v : others) {
+            auto ca = a.coeffs.find(v), cb = b.coeffs.find(v);
+            if (ca == a.coeffs.end() || cb == b.coeffs.end() || ca->second != cb->second ||
+                !loops.isInvariant(outermost, v)) {
+                analyzable = false;
+            }
+        }
+        if (!analyzable) continue;
+        long long delta = b.constant - a.constant;
+
+        if (ivCoeffs.empty()) {
+            if (delta != 0) {
+                dep.independent = true;
+                return dep;
+            }
+            continue;
+        }
+        if (ivCoeffs.size() == 1) {
+            auto [l, coeffs] = *ivCoeffs.begin();
+            if (coeffs.first == coeffs.second) {
+                // Strong SIV: c * (x - y) == delta
+                long long c = coeffs.first;
+                if (delta % c != 0) {
+                    dep.independent = true;
+                    return dep;
+                }
+                long long dist = -delta / c;
+                auto prev = distance.find(l);
+                if (prev != distance.end() && prev->second != dist) {
+                    dep.independent = true;
+                    return dep;
+                }
+                distance[l] = dist;
+                continue;
+            }
+        }
+        long long g = 0;
+        for (const auto& [l, coeffs] : ivCoeffs) {
+            g = std::gcd(g, std::llabs(coeffs.first));
+            g = std::gcd(g, std::llabs(coeffs.second));
+        }
+        if (g != 0 && delta % g != 0) {
+            dep.independent = true;
+            return dep;
+        }
+    }
+
+    // Distances are in induction variable values. The sink runs `dist / step`
+    // iterations after the source, so a loop counting down turns the
+    // direction around, and a distance that is no multiple of the step is
+    // never covered.
+    for (const auto& [l, dist] : distance) {
+        InductionVariable iv;
+        BasicBlock* header = loops.definingBlock(ivs[l]);
+        Loop* loop = header ? loops.loopFor(header) : nullptr;
+        if (!loop || loop->header != header || !loops.inductionVariable(loop, iv) || iv.step == 0) continue;
+        if (dist % iv.step != 0) {
+            dep.independent = true;
+            return dep;
+        }
+        long long iterations = dist / iv.step;
+        dep.directions[l] = iterations > 0 ? DirLT : iterations < 0 ? DirGT : DirEQ;
+    }
+    return dep;
+}
+
+std::vector<std::string> DependenceAnalysis::nestIVs(const Loop* loop) const {
+    std::vector<std::string> ivs;
+    for (const Loop* l = loop; l; l = l->parent) {
+        InductionVariable iv;
+        // A loop without a recognized induction variable gets a name no
+        // subscript mentions, i.e. an unknown direction.
+        ivs.insert(ivs.begin(), loops.inductionVariable(l, iv) ? iv.phi->result : std::string());
+    }
+    return ivs;
+}
+
+const Loop* DependenceAnalysis::outermostLoop(const Loop* loop) const {
+    while (loop->parent) loop = loop->parent;
+    return loop;
+}
+
+bool DependenceAnalysis::carriesDependence(const Loop* loop) const {
+    InductionVariable iv;
+    bool counted = loops.inductionVariable(loop, iv);
+    for (const auto& inst : loop->header->insts) {
+        if (inst.op == Opcode::Phi && (!counted || &inst != iv.phi)) return true;
+    }
+    if (hasOpaqueCalls(loop)) return true;
+
+    std::vector<std::string> ivs = nestIVs(loop);
+    size_t level = ivs.size() - 1;
+    std::vector<MemoryAccess> all = accesses(loop);
+    for (size_t a = 0; a < all.size(); ++a) {
+        for (size_t b = a; b < all.size(); ++b) {
+            Dependence dep = depends(all[a], all[b], ivs, outermostLoop(loop));
+            if (dep.independent) continue;
+            bool carriedOutside = false;
+            for (size_t l = 0; l < level; ++l) carriedOutside |= !(dep.directions[l] & DirEQ);
+            if (!carriedOutside && (dep.directions[level] & (DirLT | DirGT))) return true;
+        }
+    }
+    return false;
+}
+
+bool DependenceAnalysis::isPermutable(const std::vector<const Loop*>& band) const {
+    const Loop* innermost = band.back();
+    if (hasOpaqueCalls(innermost)) return false;
+    std::vector<std::string> ivs = nestIVs(innermost);
+    size_t nestSize = ivs.size();
+    size_t first = nestSize - band.size();
+
+    std::vector<MemoryAccess> all = accesses(innermost);
+    for (size_t a = 0; a < all.size(); ++a) {
+        for (size_t b = a; b < all.size(); ++b) {
+            Dependence dep = depends(all[a], all[b], ivs, outermostLoop(innermost));
+            if (dep.independent) continue;
+            bool carriedOutside = false;
+            for (size_t l = 0; l < first; ++l) carriedOutside |= !(dep.directions[l] & DirEQ);
+            if (carriedOutside) continue;
+            // Directions are per level, so any forward level combined with a
+            // backward one at another level is a possible vector.
+            for (size_t p = first; p < nestSize; ++p) {
+                for (size_t q = first; q < nestSize; ++q) {
+                    if (p != q && (dep.directions[p] & DirLT) && (dep.directions[q] & DirGT)) return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+long long DependenceAnalysis::stride(const MemoryAccess& access, const std::string& value) const {
+    long long bytes = 0;
+    std::string type = access.sourceType;
+    for (size_t k = 0; k < access.subscripts.size(); ++k) {
+        if (k > 0) type = arrayElementType(type);
+        auto it = access.subscripts[k].coeffs.find(value);
+        if (it != access.subscripts[k].coeffs.end()) bytes += it->second * typeSizeInBytes(type);
+    }
+    return bytes;
+}
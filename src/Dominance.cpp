@@ -0,0 +1,121 @@
+#include "Dominance.h"
+#include <algorithm>
+
+DominatorTree::DominatorTree(Function& f) {
+    for (auto& bb : f.blocks) byName[bb->name] = bb.get();
+    for (auto& bb : f.blocks) {
+        auto& out = succs[bb.get()];
+        for (const auto& name : bb->successors()) {
+            BasicBlock* succ = byName.at(name);
+            if (std::find(out.begin(), out.end(), succ) == out.end()) out.push_back(succ);
+        }
+    }
+
+    // Post-order DFS from the entry block, iterative to survive long chains.
+    std::vector<BasicBlock*> postOrder;
+    std::set<BasicBlock*> visited;
+    std::vector<std::pair<BasicBlock*, size_t>> stack;
+    if (BasicBlock* entry = f.entry()) {
+        stack.push_back({entry, 0});
+        visited.insert(entry);
+    }
+    while (!stack.empty()) {
+        auto& [bb, next] = stack.back();
+        const auto& out = succs[bb];
+        if (next < out.size()) {
+            BasicBlock* succ = out[next++];
+            if (visited.insert(succ).second) stack.push_back({succ, 0});
+        } else {
+            postOrder.push_back(bb);
+            stack.pop_back();
+        }
+    }
+    rpo.assign(postOrder.rbegin(), postOrder.rend());
+    for (size_t i = 0; i < rpo.size(); ++i) rpoIndex[rpo[i]] = static_cast<int>(i);
+
+    for (BasicBlock* bb : rpo) {
+        for (BasicBlock* succ : succs[bb]) preds[succ].push_back(bb);
+    }
+
+    if (rpo.empty()) return;
+    BasicBlock* entry = rpo[0];
+    idoms[entry] = entry;
+    auto intersect = [&](BasicBlock* a, BasicBlock* b) {
+        while (a != b) {
+            while (rpoIndex[a] > rpoIndex[b]) a = idoms[a];
+            while (rpoIndex[b] > rpoIndex[a]) b = idoms[b];
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); ++i) {
+            BasicBlock* bb = rpo[i];
+            BasicBlock* newIdom = nullptr;
+            for (BasicBlock* pred : preds[bb]) {
+                if (!idoms.count(pred)) continue;
+                newIdom = newIdom ? intersect(pred, newIdom) : pred;
+            }
+            if (idoms[bb] != newIdom) {
+                idoms[bb] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 1; i < rpo.size(); ++i) kids[idoms[rpo[i]]].push_back(rpo[i]);
+    levels[entry] = 0;
+    for (size_t i = 1; i < rpo.size(); ++i) levels[rpo[i]] = levels[idoms[rpo[i]]] + 1;
+}
+
+BasicBlock* DominatorTree::block(const std::string& name) const {
+    auto it = byName.find(name);
+    return it == byName.end() ? nullptr : it->second;
+}
+
+BasicBlock* DominatorTree::idom(BasicBlock* bb) const {
+    auto it = idoms.find(bb);
+    if (it == idoms.end() || it->second == bb) return nullptr;
+    return it->second;
+}
+
+const std::vector<BasicBlock*>& DominatorTree::children(BasicBlock* bb) const {
+    static const std::vector<BasicBlock*> none;
+    auto it = kids.find(bb);
+    return it == kids.end() ? none : it->second;
+}
+
+const std::vector<BasicBlock*>& DominatorTree::predecessors(BasicBlock* bb) const {
+    static const std::vector<BasicBlock*> none;
+    auto it = preds.find(bb);
+    return it == preds.end() ? none : it->second;
+}
+
+const std::vector<BasicBlock*>& DominatorTree::successors(BasicBlock* bb) const {
+    static const std::vector<BasicBlock*> none;
+    auto it = succs.find(bb);
+    return it == succs.end() ? none : it->second;
+}
+
+bool DominatorTree::dominates(BasicBlock* a, BasicBlock* b) const {
+    if (!isReachable(a) || !isReachable(b)) return false;
+    while (levels.at(b) > levels.at(a)) b = idoms.at(b);
+    return a == b;
+}
+
+std::unordered_map<BasicBlock*, std::set<BasicBlock*>> DominatorTree::frontiers() const {
+    std::unordered_map<BasicBlock*, std::set<BasicBlock*>> df;
+    for (BasicBlock* bb : rpo) {
+        const auto& ps = predecessors(bb);
+        if (ps.size() < 2) continue;
+        for (BasicBlock* pred : ps) {
+            BasicBlock* runner = pred;
+            while (runner != idoms.at(bb)) {
+                df[runner].insert(bb);
+                runner = idoms.at(runner);
+            }
+        }
+    }
+    return df;
+}
@@ -0,0 +1,191 @@
+#include "Passes.h"
+#include "LoopInfo.h"
+
+// Global code motion after Click, "Global Code Motion / Global Value
+// Numbering" (PLDI 1995). Instructions without side effects are detached
+// from their blocks; each is scheduled early (the deepest block dominated
+// by all of its operands) and late (the common dominator of its uses), and
+// then placed on the dominator path between the two in the block of least
+// loop depth, preferring the later block among equals. Loop-invariant code
+// thereby leaves loops, and code needed on only one path sinks into it.
+
+namespace {
+
+// Instructions that must stay where they are: memory accesses and calls,
+// whose order matters, phis and terminators, which belong to their block,
+// and divisions that might trap on a path that would not have run them.
+bool isPinned(const Instruction& inst) {
+    switch (inst.op) {
+        case Opcode::SDiv:
+        case Opcode::SRem:
+            return !isConstantOperand(inst.operands[1]) || constantValue(inst.operands[1]) == 0 ||
+                   constantValue(inst.operands[1]) == -1;
+        case Opcode::GetElementPtr:
+        case Opcode::ICmp:
+        case Opcode::ZExt:
+        case Opcode::Select:
+            return false;
+        default:
+            return !inst.isBinary();
+    }
+}
+
+class CodeMotion {
+public:
+    CodeMotion(Function& f, const LoopInfo& li) : func(f), li(li), dt(li.dominators()) {}
+
+    bool run();
+
+private:
+    struct Node {
+        Instruction inst;
+        BasicBlock* home;          // Original block
+        bool pinned;
+        BasicBlock* early = nullptr;
+        BasicBlock* late = nullptr;
+        bool visited = false;
+    };
+
+    BasicBlock* scheduleEarly(int id);
+    BasicBlock* scheduleLate(int id);
+    BasicBlock* commonDominator(BasicBlock* a, BasicBlock* b) const;
+    int loopDepth(const BasicBlock* bb) const;
+    void emit(int id, BasicBlock* bb, std::vector<Instruction>& out, std::set<int>& emitted);
+
+    Function& func;
+    const LoopInfo& li;
+    const DominatorTree& dt;
+    std::vector<Node> nodes;
+    std::map<std::string, int> defs;
+    // Users of each value: the user's node and, for phis, the incoming block
+    // through which the value flows.
+    std::map<std::string, std::vector<std::pair<int, BasicBlock*>>> uses;
+};
+
+BasicBlock* CodeMotion::commonDominator(BasicBlock* a, BasicBlock* b) const {
+    if (!a) return b;
+    while (dt.depth(a) > dt.depth(b)) a = dt.idom(a);
+    while (dt.depth(b) > dt.depth(a)) b = dt.idom(b);
+    while (a != b) {
+        a = dt.idom(a);
+        b = dt.idom(b);
+    }
+    return a;
+}
+
+int CodeMotion::loopDepth(const BasicBlock* bb) const {
+    Loop* loop = li.loopFor(bb);
+    return loop ? loop->depth() : 0;
+}
+
+BasicBlock* CodeMotion::scheduleEarly(int id) {
+    Node& node = nodes[id];
+    if (node.early) return node.early;
+    if (node.pinned) return node.early = node.home;
+    // Constants, globals and parameters are available from the entry block.
+    BasicBlock* early = func.entry();
+    for (const auto& operand : node.inst.operands) {
+        auto it = defs.find(operand);
+        if (it == defs.end()) continue;
+        BasicBlock* bb = scheduleEarly(it->second);
+        if (dt.depth(bb) > dt.depth(early)) early = bb;
+    }
+    return nodes[id].early = early;
+}
+
+BasicBlock* CodeMotion::scheduleLate(int id) {
+    Node& node = nodes[id];
+    if (node.visited) return node.late;
+    node.visited = true;
+    if (node.pinned) return node.late = node.home;
+    BasicBlock* lca = nullptr;
+    for (const auto& [user, through] : uses[node.inst.result]) {
+        BasicBlock* bb = through ? through : scheduleLate(user);
+        lca = commonDominator(lca, bb);
+    }
+    if (!lca) return node.late = node.early;  // Dead; left for the cleanups
+    // Walk up to the early block, keeping the least nested block seen.
+    BasicBlock* best = lca;
+    for (BasicBlock* bb = lca; bb != node.early;) {
+        bb = dt.idom(bb);
+        if (loopDepth(bb) < loopDepth(best)) best = bb;
+    }
+    return node.late = best;
+}
+
+// Appends `id` to `out`, after its operands placed in the same block.
+void CodeMotion::emit(int id, BasicBlock* bb, std::vector<Instruction>& out, std::set<int>& emitted) {
+    if (!emitted.insert(id).second) return;
+    const Node& node = nodes[id];
+    if (node.inst.op != Opcode::Phi) {
+        for (const auto& operand : node.inst.operands) {
+            auto it = defs.find(operand);
+            if (it == defs.end() || nodes[it->second].pinned) continue;
+            if (nodes[it->second].late == bb) emit(it->second, bb, out, emitted);
+        }
+    }
+    out.push_back(node.inst);
+}
+
+bool CodeMotion::run() {
+    std::map<BasicBlock*, std::vector<int>> pinnedIn;
+    for (auto& bb : func.blocks) {
+        for (auto& inst : bb->insts) {
+            int id = static_cast<int>(nodes.size());
+            nodes.push_back({inst, bb.get(), isPinned(inst)});
+            if (!inst.result.empty()) defs[inst.result] = id;
+            if (nodes.back().pinned) pinnedIn[bb.get()].push_back(id);
+        }
+    }
+    for (size_t id = 0; id < nodes.size(); ++id) {
+        const Instruction& inst = nodes[id].inst;
+        for (size_t i = 0; i < inst.operands.size(); ++i) {
+            BasicBlock* through = inst.op == Opcode::Phi ? dt.block(inst.labels[i]) : nullptr;
+            if (inst.op == Opcode::Phi && !through) continue;
+            uses[inst.operands[i]].push_back({static_cast<int>(id), through});
+        }
+    }
+
+    for (size_t id = 0; id < nodes.size(); ++id) scheduleEarly(static_cast<int>(id));
+    bool changed = false;
+    std::map<BasicBlock*, std::vector<int>> floatingIn;
+    for (size_t id = 0; id < nodes.size(); ++id) {
+        BasicBlock* bb = scheduleLate(static_cast<int>(id));
+        if (nodes[id].pinned) continue;
+        floatingIn[bb].push_back(static_cast<int>(id));
+        changed |= bb != nodes[id].home;
+    }
+    if (!changed) return false;
+
+    // Within a block, pinned instructions keep their order and every other
+    // instruction goes right before its first user there, or before the
+    // terminator if it is only used elsewhere.
+    for (auto& bb : func.blocks) {
+        std::vector<Instruction> out;
+        std::set<int> emitted;
+        const std::vector<int>& pinned = pinnedIn[bb.get()];
+        for (int id : pinned) {
+            if (nodes[id].inst.isTerminator()) {
+                for (int floating : floatingIn[bb.get()]) emit(floating, bb.get(), out, emitted);
+            }
+            emit(id, bb.get(), out, emitted);
+        }
+        bb->insts = std::move(out);
+    }
+    return true;
+}
+
+} // namespace
+
+bool globalCodeMotion(Function& f) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    // Dominance is only defined on reachable blocks.
+    bool changed = removeUnreachableBlocks(f);
+    changed |= globalCodeMotion(f, LoopInfo(f));
+    return changed;
+}
+
+bool globalCodeMotion(Function& f, const LoopInfo& li) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    return CodeMotion(f, li).run();
+}
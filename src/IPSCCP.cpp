@@ -0,0 +1,585 @@
+#include "Passes.h"
+#include "PurityAnalysis.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+// Specialization cost model. A clone is made for a set of call sites sharing
+// the same constant arguments when propagating those constants through the
+// callee folds or kills at least kMinSpecializationGain instructions and at
+// least 1/kSpecializationGainDivisor of its body, among them a branch or a
+// call. A recursive callee is only cloned if some recursive call passes the
+// constants on, so that the clone is more than its first level. Growth is
+// capped per callee and, for the whole module, at half of its original size
+// or kMinGrowthBudget instructions, whichever is larger.
+static const int kMinSpecializationGain = 4;
+static const int kSpecializationGainDivisor = 8;
+static const int kMaxSpecializationsPerFunction = 4;
+static const int kMaxSpecializedFunctionSize = 400;
+static const int kMinGrowthBudget = 400;
+
+namespace {
+
+struct LatticeValue {
+    enum Kind { Undefined, Constant, Overdefined };
+    Kind kind = Undefined;
+    int value = 0;
+
+    static LatticeValue constant(int v) {
+        LatticeValue l;
+        l.kind = Constant;
+        l.value = v;
+        return l;
+    }
+    static LatticeValue overdefined() {
+        LatticeValue l;
+        l.kind = Overdefined;
+        return l;
+    }
+    bool isConstant() const { return kind == Constant; }
+
+    // Lowers this value to its meet with `other`; true if it changed.
+    bool merge(const LatticeValue& other) {
+        if (other.kind == Undefined || kind == Overdefined) return false;
+        if (kind == Undefined) {
+            *this = other;
+            return true;
+        }
+        if (other.kind == Constant && other.value == value) return false;
+        kind = Overdefined;
+        return true;
+    }
+};
+
+int wrap(long long v) { return static_cast<int>(static_cast<uint32_t>(v)); }
+
+bool foldBinary(Opcode op, int a, int b, int& out) {
+    switch (op) {
+        case Opcode::Add: out = wrap(static_cast<long long>(a) + b); return true;
+        case Opcode::Sub: out = wrap(static_cast<long long>(a) - b); return true;
+        case Opcode::Mul: out = wrap(static_cast<long long>(a) * b); return true;
+        case Opcode::SDiv:
+        case Opcode::SRem:
+            if (b == 0 || (a == INT_MIN && b == -1)) return false;
+            out = op == Opcode::SDiv ? a / b : a % b;
+            return true;
+        case Opcode::Shl:
+        case Opcode::AShr:
+        case Opcode::LShr:
+            if (b < 0 || b >= 32) return false;
+            if (op == Opcode::Shl) out = wrap(static_cast<long long>(static_cast<uint32_t>(a) << b));
+            else if (op == Opcode::AShr) out = a >> b;
+            else out = static_cast<int>(static_cast<uint32_t>(a) >> b);
+            return true;
+        case Opcode::And: out = a & b; return true;
+        case Opcode::Or: out = a | b; return true;
+        case Opcode::Xor: out = a ^ b; return true;
+        default: return false;
+    }
+}
+
+bool foldCompare(const std::string& pred, int a, int b) {
+    uint32_t ua = static_cast<uint32_t>(a), ub = static_cast<uint32_t>(b);
+    if (pred == "eq") return a == b;
+    if (pred == "ne") return a != b;
+    if (pred == "sgt") return a > b;
+    if (pred == "sge") return a >= b;
+    if (pred == "slt") return a < b;
+    if (pred == "sle") return a <= b;
+    if (pred == "ugt") return ua > ub;
+    if (pred == "uge") return ua >= ub;
+    if (pred == "ult") return ua < ub;
+    return ua <= ub;  // ule
+}
+
+// Wegman-Zadeck sparse conditional constant propagation over SSA registers.
+// In interprocedural mode a defined callee's arguments are the meet over its
+// executable call sites and a call's result is the callee's merged return
+// value; otherwise calls are opaque and only the roots are solved.
+class SCCPSolver {
+public:
+    SCCPSolver(Module& m, bool interprocedural);
+
+    void addRoot(Function* f, const std::vector<LatticeValue>& args);
+    void solve();
+
+    LatticeValue valueOf(Function* f, const std::string& operand) const;
+    bool isExecutable(Function* f, const BasicBlock* bb) const;
+    bool isEdgeExecutable(Function* f, const BasicBlock* from, const std::string& to) const;
+    LatticeValue returnValue(Function* f) const;
+
+private:
+    struct FunctionState {
+        std::map<std::string, LatticeValue> values;
+        std::vector<LatticeValue> args;
+        std::map<std::string, int> params;
+        LatticeValue ret;
+        std::map<std::string, BasicBlock*> blocks;
+        std::map<const Instruction*, BasicBlock*> parent;
+        std::map<std::string, std::vector<Instruction*>> users;
+        std::set<const BasicBlock*> executable;
+        std::set<std::pair<const BasicBlock*, std::string>> edges;
+    };
+
+    void markBlock(Function* f, BasicBlock* bb);
+    void markEdge(Function* f, BasicBlock* from, const std::string& to);
+    void setValue(Function* f, const std::string& reg, const LatticeValue& v);
+    void mergeArgument(Function* f, size_t index, const LatticeValue& v);
+    void visit(Function* f, Instruction& inst);
+
+    Module& module;
+    bool interprocedural;
+    std::map<Function*, FunctionState> states;
+    std::map<std::string, std::vector<std::pair<Function*, Instruction*>>> callSites;
+    std::vector<std::pair<Function*, Instruction*>> worklist;
+};
+
+SCCPSolver::SCCPSolver(Module& m, bool ip) : module(m), interprocedural(ip) {
+    for (auto& func : m.functions) {
+        if (func->isDeclaration) continue;
+        Function* f = func.get();
+        FunctionState& fs = states[f];
+        fs.args.resize(f->paramNames.size());
+        for (size_t i = 0; i < f->paramNames.size(); ++i) fs.params[f->paramNames[i]] = static_cast<int>(i);
+        for (auto& bb : f->blocks) {
+            fs.blocks[bb->name] = bb.get();
+            for (auto& inst : bb->insts) {
+                fs.parent[&inst] = bb.get();
+                for (const auto& operand : inst.operands) {
+                    if (!operand.empty() && operand[0] == '%') fs.users[operand].push_back(&inst);
+                }
+                if (inst.op == Opcode::Call) callSites[inst.callee].push_back({f, &inst});
+            }
+        }
+    }
+}
+
+void SCCPSolver::addRoot(Function* f, const std::vector<LatticeValue>& args) {
+    for (size_t i = 0; i < args.size(); ++i) mergeArgument(f, i, args[i]);
+    markBlock(f, f->entry());
+}
+
+LatticeValue SCCPSolver::valueOf(Function* f, const std::string& operand) const {
+    if (isConstantOperand(operand)) return LatticeValue::constant(constantValue(operand));
+    auto st = states.find(f);
+    if (st == states.end()) return LatticeValue::overdefined();
+    const FunctionState& fs = st->second;
+    auto param = fs.params.find(operand);
+    if (param != fs.params.end()) return fs.args[param->second];
+    auto it = fs.values.find(operand);
+    if (it != fs.values.end()) return it->second;
+    // Globals and anything else we do not track
+    return operand[0] == '%' ? LatticeValue() : LatticeValue::overdefined();
+}
+
+bool SCCPSolver::isExecutable(Function* f, const BasicBlock* bb) const {
+    auto st = states.find(f);
+    return st != states.end() && st->second.executable.count(bb);
+}
+
+bool SCCPSolver::isEdgeExecutable(Function* f, const BasicBlock* from, const std::string& to) const {
+    auto st = states.find(f);
+    return st != states.end() && st->second.edges.count({from, to});
+}
+
+LatticeValue SCCPSolver::returnValue(Function* f) const {
+    auto st = states.find(f);
+    return st != states.end() ? st->second.ret : LatticeValue();
+}
+
+void SCCPSolver::markBlock(Function* f, BasicBlock* bb) {
+    if (!states[f].executable.insert(bb).second) return;
+    for (auto& inst : bb->insts) worklist.push_back({f, &inst});
+}
+
+void SCCPSolver::markEdge(Function* f, BasicBlock* from, const std::string& to) {
+    FunctionState& fs = states[f];
+    if (!fs.edges.insert({from, to}).second) return;
+    BasicBlock* target = fs.blocks.at(to);
+    if (!fs.executable.count(target)) {
+        markBlock(f, target);
+        return;
+    }
+    // A new incoming edge only changes the phis
+    for (auto& inst : target->insts) {
+        if (inst.op != Opcode::Phi) break;
+        worklist.push_back({f, &inst});
+    }
+}
+
+void SCCPSolver::setValue(Function* f, const std::string& reg, const LatticeValue& v) {
+    FunctionState& fs = states[f];
+    if (!fs.values[reg].merge(v)) return;
+    for (Instruction* user : fs.users[reg]) worklist.push_back({f, user});
+}
+
+void SCCPSolver::mergeArgument(Function* f, size_t index, const LatticeValue& v) {
+    FunctionState& fs = states[f];
+    if (!fs.args[index].merge(v)) return;
+    for (Instruction* user : fs.users[f->paramNames[index]]) worklist.push_back({f, user});
+}
+
+void SCCPSolver::solve() {
+    while (!worklist.empty()) {
+        auto [f, inst] = worklist.back();
+        worklist.pop_back();
+        if (states[f].executable.count(states[f].parent.at(inst))) visit(f, *inst);
+    }
+}
+
+void SCCPSolver::visit(Function* f, Instruction& inst) {
+    FunctionState& fs = states[f];
+    BasicBlock* bb = fs.parent.at(&inst);
+
+    if (inst.isBinary() || inst.op == Opcode::ICmp) {
+        LatticeValue a = valueOf(f, inst.operands[0]);
+        LatticeValue b = valueOf(f, inst.operands[1]);
+        if (a.kind == LatticeValue::Overdefined || b.kind == LatticeValue::Overdefined) {
+            setValue(f, inst.result, LatticeValue::overdefined());
+        } else if (a.isConstant() && b.isConstant()) {
+            int folded;
+            if (inst.op == Opcode::ICmp) {
+                setValue(f, inst.result, LatticeValue::constant(foldCompare(inst.predicate, a.value, b.value)));
+            } else if (foldBinary(inst.op, a.value, b.value, folded)) {
+                setValue(f, inst.result, LatticeValue::constant(folded));
+            } else {
+                setValue(f, inst.result, LatticeValue::overdefined());
+            }
+        }
+        return;
+    }
+
+    switch (inst.op) {
+        case Opcode::ZExt:
+            setValue(f, inst.result, valueOf(f, inst.operands[0]));
+            break;
+        case Opcode::Select: {
+            LatticeValue cond = valueOf(f, inst.operands[0]);
+            if (cond.isConstant()) {
+                setValue(f, inst.result, valueOf(f, inst.operands[cond.value ? 1 : 2]));
+            } else if (cond.kind == LatticeValue::Overdefined) {
+                LatticeValue v = valueOf(f, inst.operands[1]);
+                v.merge(valueOf(f, inst.operands[2]));
+                setValue(f, inst.result, v);
+            }
+            break;
+        }
+        case Opcode::Phi: {
+            LatticeValue v;
+            for (size_t i = 0; i < inst.operands.size(); ++i) {
+                auto pred = fs.blocks.find(inst.labels[i]);
+                if (pred != fs.blocks.end() && fs.edges.count({pred->second, bb->name})) {
+                    v.merge(valueOf(f, inst.operands[i]));
+                }
+            }
+            setValue(f, inst.result, v);
+            break;
+        }
+        case Opcode::Call: {
+            Function* callee = module.getFunction(inst.callee);
+            if (!interprocedural || !callee || callee->isDeclaration) {
+                if (!inst.result.empty()) setValue(f, inst.result, LatticeValue::overdefined());
+                break;
+            }
+            for (size_t i = 0; i < inst.operands.size() && i < callee->paramNames.size(); ++i) {
+                mergeArgument(callee, i, valueOf(f, inst.operands[i]));
+            }
+            markBlock(callee, callee->entry());
+            if (!inst.result.empty()) setValue(f, inst.result, states[callee].ret);
+            break;
+        }
+        case Opcode::Ret:
+            if (!inst.operands.empty() && fs.ret.merge(valueOf(f, inst.operands[0]))) {
+                for (auto& site : callSites[f->name]) worklist.push_back(site);
+            }
+            break;
+        case Opcode::Br:
+            markEdge(f, bb, inst.labels[0]);
+            break;
+        case Opcode::CondBr: {
+            LatticeValue cond = valueOf(f, inst.operands[0]);
+            if (cond.isConstant()) {
+                markEdge(f, bb, inst.labels[cond.value ? 0 : 1]);
+            } else if (cond.kind == LatticeValue::Overdefined) {
+                markEdge(f, bb, inst.labels[0]);
+                markEdge(f, bb, inst.labels[1]);
+            }
+            break;
+        }
+        case Opcode::Store:
+        case Opcode::Unreachable:
+            break;
+        default:
+            // Loads, allocas and address arithmetic
+            if (!inst.result.empty()) setValue(f, inst.result, LatticeValue::overdefined());
+            break;
+    }
+}
+
+// Folds what the solver proved about `f`. Blocks the solver never reached are
+// left for removeUnreachableBlocks once their branches are folded away.
+bool applySolution(const SCCPSolver& solver, Function* f) {
+    if (!solver.isExecutable(f, f->entry())) return false;
+    std::map<std::string, std::string> replacements;
+    for (size_t i = 0; i < f->paramNames.size(); ++i) {
+        LatticeValue v = solver.valueOf(f, f->paramNames[i]);
+        if (v.isConstant()) replacements[f->paramNames[i]] = std::to_string(v.value);
+    }
+
+    bool changed = !replacements.empty();
+    for (auto& bb : f->blocks) {
+        if (!solver.isExecutable(f, bb.get())) continue;
+        auto& insts = bb->insts;
+        std::vector<Instruction> kept;
+        kept.reserve(insts.size());
+        for (auto& inst : insts) {
+            if (!inst.result.empty()) {
+                LatticeValue v = solver.valueOf(f, inst.result);
+                if (v.isConstant()) {
+                    replacements[inst.result] = std::to_string(v.value);
+                    changed = true;
+                    // Calls stay for their side effects, only their result goes
+                    if (inst.op != Opcode::Call) continue;
+                }
+            }
+            kept.push_back(std::move(inst));
+        }
+        insts = std::move(kept);
+    }
+
+    std::map<std::string, BasicBlock*> byName;
+    for (auto& bb : f->blocks) byName[bb->name] = bb.get();
+    for (auto& bb : f->blocks) {
+        Instruction* term = bb->terminator();
+        if (!term || term->op != Opcode::CondBr || !solver.isExecutable(f, bb.get())) continue;
+        bool takeTrue = solver.isEdgeExecutable(f, bb.get(), term->labels[0]);
+        bool takeFalse = solver.isEdgeExecutable(f, bb.get(), term->labels[1]);
+        if (takeTrue == takeFalse || term->labels[0] == term->labels[1]) continue;
+        std::string kept = term->labels[takeTrue ? 0 : 1];
+        std::string dropped = term->labels[takeTrue ? 1 : 0];
+        *term = makeBr(kept);
+        for (auto& inst : byName.at(dropped)->insts) {
+            if (inst.op != Opcode::Phi) break;
+            for (size_t i = inst.labels.size(); i-- > 0;) {
+                if (inst.labels[i] == bb->name) {
+                    inst.labels.erase(inst.labels.begin() + i);
+                    inst.operands.erase(inst.operands.begin() + i);
+                }
+            }
+        }
+        changed = true;
+    }
+
+    f->replaceUses(replacements);
+    changed |= removeUnreachableBlocks(*f);
+    return changed;
+}
+
+// What SCCP makes of `f` given `args`, with every call treated as opaque.
+struct Folding {
+    int instructions = 0;      // Folded or proved dead
+    int branchesAndCalls = 0;  // Of those, resolved branches and dead calls
+    int callsLeft = 0;         // Calls still executed
+    LatticeValue ret;
+};
+
+Folding fold(Module& m, Function* f, const std::vector<LatticeValue>& args) {
+    SCCPSolver solver(m, false);
+    solver.addRoot(f, args);
+    solver.solve();
+    Folding result;
+    result.ret = solver.returnValue(f);
+    for (auto& bb : f->blocks) {
+        bool executable = solver.isExecutable(f, bb.get());
+        for (auto& inst : bb->insts) {
+            if (!executable) {
+                ++result.instructions;
+                if (inst.op == Opcode::Call || inst.op == Opcode::CondBr) ++result.branchesAndCalls;
+            } else if (inst.op == Opcode::Call) {
+                ++result.callsLeft;
+            } else if (!inst.result.empty() && solver.valueOf(f, inst.result).isConstant()) {
+                ++result.instructions;
+            }
+        }
+        const Instruction* term = bb->terminator();
+        if (executable && term && term->op == Opcode::CondBr &&
+            solver.isEdgeExecutable(f, bb.get(), term->labels[0]) !=
+                solver.isEdgeExecutable(f, bb.get(), term->labels[1])) {
+            ++result.instructions;
+            ++result.branchesAndCalls;
+        }
+    }
+    return result;
+}
+
+// Whether a recursive call in `f` passes the constant arguments of `sig` on
+// unchanged, so that in a clone for `sig` it can call the clone.
+bool passesConstantsOn(const Function& f, const Instruction& call, const std::vector<std::string>& sig) {
+    if (call.op != Opcode::Call || call.callee != f.name) return false;
+    for (size_t i = 0; i < sig.size(); ++i) {
+        if (!sig[i].empty() && call.operands[i] != sig[i] && call.operands[i] != f.paramNames[i]) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool interproceduralSCCP(Module& m) {
+    SCCPSolver solver(m, true);
+    // Functions without callers other than themselves are entered from
+    // outside with unknown arguments; everything else only from its callers.
+    std::set<std::string> called;
+    for (auto& func : m.functions) {
+        for (auto& bb : func->blocks) {
+            for (auto& inst : bb->insts) {
+                if (inst.op == Opcode::Call && inst.callee != func->name) called.insert(inst.callee);
+            }
+        }
+    }
+    for (auto& func : m.functions) {
+        if (func->isDeclaration || func->blocks.empty()) continue;
+        if (func->name == "main" || !called.count(func->name)) {
+            solver.addRoot(func.get(), std::vector<LatticeValue>(func->paramNames.size(),
+                                                                  LatticeValue::overdefined()));
+        }
+    }
+    solver.solve();
+
+    bool changed = false;
+    for (auto& func : m.functions) {
+        if (!func->isDeclaration) changed |= applySolution(solver, func.get());
+    }
+    return changed;
+}
+
+bool specializeFunctions(Module& m) {
+    // Call sites grouped by callee and the constants they pass; an empty
+    // string marks a non-constant argument.
+    using Signature = std::vector<std::string>;
+    std::map<std::pair<std::string, Signature>, std::vector<Instruction*>> groups;
+    std::map<Instruction*, Function*> caller;
+    int moduleSize = 0;
+    for (auto& func : m.functions) {
+        moduleSize += func->instructionCount();
+        for (auto& bb : func->blocks) {
+            for (auto& inst : bb->insts) {
+                if (inst.op != Opcode::Call) continue;
+                Function* callee = m.getFunction(inst.callee);
+                if (!callee || callee->isDeclaration || callee->name == "main" ||
+                    callee->instructionCount() > kMaxSpecializedFunctionSize) {
+                    continue;
+                }
+                Signature sig;
+                bool anyConstant = false;
+                for (const auto& arg : inst.operands) {
+                    sig.push_back(isConstantOperand(arg) ? arg : "");
+                    anyConstant |= isConstantOperand(arg);
+                }
+                if (anyConstant) {
+                    groups[{callee->name, sig}].push_back(&inst);
+                    caller[&inst] = func.get();
+                }
+            }
+        }
+    }
+
+    // A callee that returns a constant for the arguments needs no clone: the
+    // constant replaces the call's result, and the call goes too when it has
+    // no effect and makes no calls of its own.
+    struct Candidate {
+        std::string callee;
+        Signature sig;
+        int gain;
+    };
+    std::vector<Candidate> candidates;
+    struct ConstantCall {
+        Instruction* site;
+        int value;
+        bool removable;
+    };
+    std::vector<ConstantCall> constantCalls;
+    std::map<std::string, Folding> baseline;
+    PurityAnalysis purity(m);
+    for (const auto& [key, sites] : groups) {
+        Function* callee = m.getFunction(key.first);
+        std::vector<LatticeValue> args;
+        for (const auto& arg : key.second) {
+            args.push_back(arg.empty() ? LatticeValue::overdefined() : LatticeValue::constant(constantValue(arg)));
+        }
+        Folding folding = fold(m, callee, args);
+        if (folding.ret.isConstant()) {
+            bool removable = purity.isReadNone(callee->name) && folding.callsLeft == 0;
+            for (Instruction* site : sites) constantCalls.push_back({site, folding.ret.value, removable});
+            continue;
+        }
+        if (!baseline.count(callee->name)) {
+            baseline[callee->name] =
+                fold(m, callee, std::vector<LatticeValue>(args.size(), LatticeValue::overdefined()));
+        }
+        const Folding& before = baseline[callee->name];
+        int gain = folding.instructions - before.instructions;
+        if (gain < kMinSpecializationGain || gain * kSpecializationGainDivisor < callee->instructionCount() ||
+            folding.branchesAndCalls <= before.branchesAndCalls) {
+            continue;
+        }
+        bool recursive = false, staysInside = false;
+        for (auto& bb : callee->blocks) {
+            for (auto& inst : bb->insts) {
+                if (inst.op != Opcode::Call || inst.callee != callee->name) continue;
+                recursive = true;
+                staysInside |= passesConstantsOn(*callee, inst, key.second);
+            }
+        }
+        if (!recursive || staysInside) candidates.push_back({key.first, key.second, gain});
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate& a, const Candidate& b) { return a.gain > b.gain; });
+
+    int budget = std::max(moduleSize / 2, kMinGrowthBudget);
+    std::map<std::string, int> clones;
+    bool changed = false;
+    for (const auto& cand : candidates) {
+        Function* callee = m.getFunction(cand.callee);
+        int size = callee->instructionCount();
+        if (size > budget || clones[cand.callee] >= kMaxSpecializationsPerFunction) continue;
+        budget -= size;
+        std::string name = cand.callee + ".spec" + std::to_string(clones[cand.callee]++);
+
+        auto clone = callee->clone(name);
+        // Recursive calls that pass the specialized arguments through
+        // unchanged stay inside the clone.
+        for (auto& bb : clone->blocks) {
+            for (auto& inst : bb->insts) {
+                if (passesConstantsOn(*callee, inst, cand.sig)) inst.callee = name;
+            }
+        }
+        for (Instruction* site : groups[{cand.callee, cand.sig}]) site->callee = name;
+
+        auto pos = std::find_if(m.functions.begin(), m.functions.end(),
+                                [&](const std::unique_ptr<Function>& f) { return f.get() == callee; });
+        ++pos;
+        while (pos != m.functions.end() && (*pos)->name.rfind(cand.callee + ".spec", 0) == 0) ++pos;
+        m.functions.insert(pos, std::move(clone));
+        changed = true;
+    }
+
+    std::map<Function*, std::map<std::string, std::string>> replacements;
+    std::set<const Instruction*> dead;
+    for (const auto& call : constantCalls) {
+        if (!call.site->result.empty()) {
+            replacements[caller[call.site]][call.site->result] = std::to_string(call.value);
+        }
+        if (call.removable) dead.insert(call.site);
+        changed = true;
+    }
+    for (auto& [f, map] : replacements) f->replaceUses(map);
+    for (auto& func : m.functions) {
+        for (auto& bb : func->blocks) {
+            auto& insts = bb->insts;
+            insts.erase(std::remove_if(insts.begin(), insts.end(),
+                                       [&](const Instruction& inst) { return dead.count(&inst) > 0; }),
+                        insts.end());
+        }
+    }
+    return changed;
+}
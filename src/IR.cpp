@@ -0,0 +1,358 @@
+#include "IR.h"
+#include <sstream>
+
+Instruction makeICmp(const std::string& result, const std::string& pred,
+                     const std::string& lhs, const std::string& rhs) {
+    Instruction inst(Opcode::ICmp, result, "i32", {lhs, rhs});
+    inst.predicate = pred;
+    return inst;
+}
+
+Instruction makeBr(const std::string& target) {
+    Instruction inst(Opcode::Br, "", "");
+    inst.labels = {target};
+    return inst;
+}
+
+Instruction makeCondBr(const std::string& cond, const std::string& t, const std::string& f) {
+    Instruction inst(Opcode::CondBr, "", "", {cond});
+    inst.labels = {t, f};
+    return inst;
+}
+
+bool isConstantOperand(const std::string& operand) {
+    if (operand.empty()) return false;
+    char c = operand[0];
+    return (c >= '0' && c <= '9') || c == '-';
+}
+
+int constantValue(const std::string& operand) {
+    return static_cast<int>(std::stoll(operand));
+}
+
+bool isGlobalOperand(const std::string& operand) {
+    return !operand.empty() && operand[0] == '@';
+}
+
+bool isPointerType(const std::string& type) {
+    return !type.empty() && type.back() == '*';
+}
+
+bool isArrayTypeStr(const std::string& type) {
+    return !type.empty() && type[0] == '[' && type.back() == ']';
+}
+
+std::string pointeeType(const std::string& type) {
+    return type.substr(0, type.size() - 1);
+}
+
+std::string arrayElementType(const std::string& type) {
+    // "[4 x [2 x i32]]" -> "[2 x i32]"
+    size_t pos = type.find(" x ");
+    return type.substr(pos + 3, type.size() - pos - 4);
+}
+
+int arrayLength(const std::string& type) {
+    return std::stoi(type.substr(1, type.find(" x ") - 1));
+}
+
+std::vector<int> arrayDimensions(const std::string& type) {
+    std::vector<int> dims;
+    std::string cur = type;
+    while (isArrayTypeStr(cur)) {
+        dims.push_back(arrayLength(cur));
+        cur = arrayElementType(cur);
+    }
+    return dims;
+}
+
+int typeSizeInBytes(const std::string& type) {
+    if (isPointerType(type)) return 8;
+    if (isArrayTypeStr(type)) return arrayLength(type) * typeSizeInBytes(arrayElementType(type));
+    if (type == "i1" || type == "i8") return 1;
+    return 4;
+}
+
+std::string gepResultType(const std::string& sourceType, size_t indexCount) {
+    // The first index steps over the pointer itself, every further one
+    // descends into an array level.
+    std::string cur = sourceType;
+    for (size_t i = 1; i < indexCount; ++i) {
+        cur = arrayElementType(cur);
+    }
+    return cur + "*";
+}
+
+static std::string formatOperand(const std::string& type, const std::string& operand) {
+    if (type == "i1" && isConstantOperand(operand)) {
+        return constantValue(operand) ? "true" : "false";
+    }
+    return operand;
+}
+
+static const char* opcodeName(Opcode op) {
+    switch (op) {
+        case Opcode::Add: return "add";
+        case Opcode::Sub: return "sub";
+        case Opcode::Mul: return "mul";
+        case Opcode::SDiv: return "sdiv";
+        case Opcode::SRem: return "srem";
+        case Opcode::Shl: return "shl";
+        case Opcode::AShr: return "ashr";
+        case Opcode::LShr: return "lshr";
+        case Opcode::And: return "and";
+        case Opcode::Or: return "or";
+        case Opcode::Xor: return "xor";
+        default: return "";
+    }
+}
+
+std::string Instruction::resultType() const {
+    switch (op) {
+        case Opcode::Alloca: return type + "*";
+        case Opcode::GetElementPtr: return gepResultType(type, operands.size() - 1);
+        case Opcode::ICmp: return "i1";
+        case Opcode::Store:
+        case Opcode::Br:
+        case Opcode::CondBr:
+        case Opcode::Ret:
+        case Opcode::Unreachable:
+            return "void";
+        default: return type;
+    }
+}
+
+std::string Instruction::toString() const {
+    std::ostringstream out;
+    out << "  ";
+    if (!result.empty()) out << result << " = ";
+    switch (op) {
+        case Opcode::Alloca:
+            out << "alloca " << type;
+            break;
+        case Opcode::Load:
+            out << "load " << type << ", " << type << "* " << operands[0];
+            break;
+        case Opcode::Store:
+            out << "store " << type << " " << formatOperand(type, operands[0])
+                << ", " << type << "* " << operands[1];
+            break;
+        case Opcode::GetElementPtr:
+            out << "getelementptr " << type << ", " << type << "* " << operands[0];
+            for (size_t i = 1; i < operands.size(); ++i) {
+                out << ", i32 " << operands[i];
+            }
+            break;
+        case Opcode::ICmp:
+            out << "icmp " << predicate << " " << type << " "
+                << formatOperand(type, operands[0]) << ", " << formatOperand(type, operands[1]);
+            break;
+        case Opcode::ZExt:
+            out << "zext " << srcType << " " << formatOperand(srcType, operands[0]) << " to " << type;
+            break;
+        case Opcode::Select:
+            out << "select i1 " << formatOperand("i1", operands[0]) << ", "
+                << type << " " << formatOperand(type, operands[1]) << ", "
+                << type << " " << formatOperand(type, operands[2]);
+            break;
+        case Opcode::Phi:
+            out << "phi " << type << " ";
+            for (size_t i = 0; i < operands.size(); ++i) {
+                if (i > 0) out << ", ";
+                out << "[ " << formatOperand(type, operands[i]) << ", %" << labels[i] << " ]";
+            }
+            break;
+        case Opcode::Call:
+            out << "call " << type << " @" << callee << "(";
+            for (size_t i = 0; i < operands.size(); ++i) {
+                if (i > 0) out << ", ";
+                out << argTypes[i] << " " << formatOperand(argTypes[i], operands[i]);
+            }
+            out << ")";
+            break;
+        case Opcode::Br:
+            out << "br label %" << labels[0];
+            break;
+        case Opcode::CondBr:
+            out << "br i1 " << formatOperand("i1", operands[0]) << ", label %" << labels[0]
+                << ", label %" << labels[1];
+            break;
+        case Opcode::Ret:
+            if (operands.empty()) {
+                out << "ret void";
+            } else {
+                out << "ret " << type << " " << formatOperand(type, operands[0]);
+            }
+            break;
+        case Opcode::Unreachable:
+            out << "unreachable";
+            break;
+        default:
+            out << opcodeName(op) << " " << type << " " << formatOperand(type, operands[0])
+                << ", " << formatOperand(type, operands[1]);
+            break;
+    }
+    return out.str();
+}
+
+std::vector<std::string> BasicBlock::successors() const {
+    const Instruction* term = terminator();
+    if (!term) return {};
+    if (term->op == Opcode::Br || term->op == Opcode::CondBr) return term->labels;
+    return {};
+}
+
+BasicBlock* Function::getBlock(const std::string& blockName) {
+    for (auto& bb : blocks) {
+        if (bb->name == blockName) return bb.get();
+    }
+    return nullptr;
+}
+
+BasicBlock* Function::addBlock(const std::string& blockName) {
+    blocks.push_back(std::make_unique<BasicBlock>(blockName));
+    return blocks.back().get();
+}
+
+void Function::reserveNames(int valueId, int blockId) {
+    if (valueId >= nextValueId) nextValueId = valueId + 1;
+    if (blockId >= nextBlockId) nextBlockId = blockId + 1;
+}
+
+std::unique_ptr<Function> Function::clone(const std::string& newName) const {
+    auto copy = std::make_unique<Function>();
+    copy->name = newName;
+    copy->retType = retType;
+    copy->paramTypes = paramTypes;
+    copy->paramNames = paramNames;
+    copy->attributes = attributes;
+    copy->isDeclaration = isDeclaration;
+    copy->isVarArg = isVarArg;
+    copy->nextValueId = nextValueId;
+    copy->nextBlockId = nextBlockId;
+    for (const auto& bb : blocks) copy->blocks.push_back(std::make_unique<BasicBlock>(*bb));
+    return copy;
+}
+
+std::map<std::string, std::vector<std::string>> Function::predecessors() const {
+    std::map<std::string, std::vector<std::string>> preds;
+    for (const auto& bb : blocks) {
+        preds[bb->name];
+        for (const auto& succ : bb->successors()) {
+            auto& list = preds[succ];
+            // A conditional branch with both edges to the same block is still
+            // a single predecessor as far as phis are concerned.
+            if (list.empty() || list.back() != bb->name) list.push_back(bb->name);
+        }
+    }
+    return preds;
+}
+
+void Function::replaceUses(const std::map<std::string, std::string>& replacements) {
+    if (replacements.empty()) return;
+    for (auto& bb : blocks) {
+        for (auto& inst : bb->insts) {
+            for (auto& operand : inst.operands) {
+                auto it = replacements.find(operand);
+                while (it != replacements.end()) {
+                    operand = it->second;
+                    it = replacements.find(operand);
+                }
+            }
+        }
+    }
+}
+
+int Function::instructionCount() const {
+    int count = 0;
+    for (const auto& bb : blocks) count += static_cast<int>(bb->insts.size());
+    return count;
+}
+
+std::string Function::toString() const {
+    std::ostringstream out;
+    if (isDeclaration) {
+        out << "declare " << retType << " @" << name << "(";
+        for (size_t i = 0; i < paramTypes.size(); ++i) {
+            if (i > 0) out << ", ";
+            out << paramTypes[i];
+        }
+        if (isVarArg) out << (paramTypes.empty() ? "..." : ", ...");
+        out << ")\n";
+        return out.str();
+    }
+    out << "define dso_local " << retType << " @" << name << "(";
+    for (size_t i = 0; i < paramTypes.size(); ++i) {
+        if (i > 0) out << ", ";
+        out << paramTypes[i] << " " << paramNames[i];
+    }
+    out << ")";
+    for (const auto& attr : attributes) out << " " << attr;
+    out << " {\n";
+    for (const auto& bb : blocks) {
+        out << bb->name << ":\n";
+        for (const auto& inst : bb->insts) {
+            out << inst.toString() << "\n";
+        }
+    }
+    out << "}\n";
+    return out.str();
+}
+
+static void printInitializer(std::ostringstream& out, const std::string& type,
+                             const std::vector<int>& values, size_t& index) {
+    if (!isArrayTypeStr(type)) {
+        out << values[index++];
+        return;
+    }
+    std::string elemType = arrayElementType(type);
+    int length = arrayLength(type);
+    out << "[";
+    for (int i = 0; i < length; ++i) {
+        if (i > 0) out << ", ";
+        out << elemType << " ";
+        printInitializer(out, elemType, values, index);
+    }
+    out << "]";
+}
+
+std::string GlobalVariable::toString() const {
+    std::ostringstream out;
+    out << "@" << name << " = dso_local " << (isConstant ? "constant " : "global ") << type << " ";
+    if (zeroInit) {
+        out << (isArrayTypeStr(type) ? "zeroinitializer" : "0");
+    } else {
+        size_t index = 0;
+        printInitializer(out, type, init, index);
+    }
+    out << "\n";
+    return out.str();
+}
+
+Function* Module::getFunction(const std::string& name) {
+    for (auto& f : functions) {
+        if (f->name == name) return f.get();
+    }
+    return nullptr;
+}
+
+GlobalVariable* Module::getGlobal(const std::string& name) {
+    for (auto& g : globals) {
+        if (g.name == name) return &g;
+    }
+    return nullptr;
+}
+
+std::string Module::toString() const {
+    std::ostringstream out;
+    for (const auto& f : functions) {
+        if (f->isDeclaration) out << f->toString();
+    }
+    out << "\n";
+    for (const auto& g : globals) out << g.toString();
+    out << "\n";
+    for (const auto& f : functions) {
+        if (!f->isDeclaration) out << f->toString() << "\n";
+    }
+    return out.str();
+}
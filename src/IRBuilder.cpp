@@ -172,6 +172,19 @@ std::any IRBuilder::visitConstDef(SysYParser::ConstDefContext *ctx) {
             emitArrayInitializerHelper(ir, symbol->arrayValues, dimensions, 0, index);
             ir.emitHeader("\n");
         }
+    } else if (!dimensions.empty()) {
+        // Local constant arrays need storage once they are indexed by a
+        // non-constant expression.
+        std::string reg = ir.getNewTemp();
+        varMap[name] = reg;
+        ir.emitAlloca("  " + reg + " = alloca " + type->toString() + "\n");
+        for (size_t i = 0; i < symbol->arrayValues.size(); ++i) {
+            std::string ptrReg = ir.getNewTemp();
+            std::string indices = getArrayIndicesFromFlat(i, dimensions);
+            ir.emit("  " + ptrReg + " = getelementptr " + type->toString() +
+                   ", " + type->toString() + "* " + reg + ", i32 0" + indices + "\n");
+            ir.emit("  store i32 " + std::to_string(symbol->arrayValues[i]) + ", i32* " + ptrReg + "\n");
+        }
     }
     
     return nullptr;
@@ -234,6 +247,78 @@ std::vector<int> IRBuilder::evaluateInitVal(SysYParser::InitValContext *ctx,
     return result;
 }
 
+std::vector<std::string> IRBuilder::evaluateLocalInitVal(SysYParser::InitValContext *ctx,
+                                                         const std::vector<int>& dimensions, int depth) {
+    std::vector<std::string> result;
+    
+    if (ctx->exp()) {
+        auto val = std::any_cast<Value>(visit(ctx->exp()));
+        result.push_back(val.reg);
+    } else {
+        for (auto initVal : ctx->initVal()) {
+            auto subResult = evaluateLocalInitVal(initVal, dimensions, depth + 1);
+            result.insert(result.end(), subResult.begin(), subResult.end());
+        }
+        size_t expectedSize = 1;
+        for (size_t i = depth; i < dimensions.size(); ++i) {
+            expectedSize *= dimensions[i];
+        }
+        if (result.size() < expectedSize) {
+            result.resize(expectedSize, "0");
+        }
+    }
+    
+    return result;
+}
+
+Value IRBuilder::emitElementPtr(std::shared_ptr<Type> type, const std::string& base,
+                                const std::vector<Value>& indices, bool decay) {
+    // Arrays are addressed through their alloca or global, which needs a
+    // leading zero index; array parameters already are element pointers.
+    std::shared_ptr<Type> sourceType;
+    std::vector<int> dims;
+    std::vector<std::string> gepIndices;
+    if (type->isArray()) {
+        auto arrayType = std::static_pointer_cast<ArrayType>(type);
+        sourceType = arrayType;
+        dims = arrayType->dimensions;
+        gepIndices.push_back("0");
+    } else {
+        sourceType = std::static_pointer_cast<PointerType>(type)->pointeeType;
+        dims.push_back(0);
+        if (sourceType->isArray()) {
+            auto inner = std::static_pointer_cast<ArrayType>(sourceType)->dimensions;
+            dims.insert(dims.end(), inner.begin(), inner.end());
+        }
+    }
+    for (const auto& index : indices) {
+        gepIndices.push_back(index.reg);
+    }
+    if (decay) {
+        gepIndices.push_back("0");
+    }
+    
+    size_t consumed = indices.size() + (decay ? 1 : 0);
+    std::shared_ptr<Type> elemType = std::make_shared<IntType>();
+    if (consumed < dims.size()) {
+        elemType = std::make_shared<ArrayType>(elemType,
+            std::vector<int>(dims.begin() + consumed, dims.end()));
+    }
+    Value result(base, std::make_shared<PointerType>(elemType));
+    if (gepIndices.empty()) {
+        return result;
+    }
+    
+    result.reg = ir.getNewTemp();
+    std::string gep = "  " + result.reg + " = getelementptr " + sourceType->toString() + ", " +
+                      sourceType->toString() + "* " + base;
+    for (const auto& index : gepIndices) {
+        gep += ", i32 " + index;
+    }
+    ir.emit(gep + "\n");
+    return result;
+}
+
 std::any IRBuilder::visitVarDef(SysYParser::VarDefContext *ctx) {
     std::string name = ctx->IDENT()->getText();
     std::vector<int> dimensions;
@@ -285,21 +370,21 @@ std::any IRBuilder::visitVarDef(SysYParser::VarDefContext *ctx) {
         varMap[name] = reg;
         
         if (dimensions.empty()) {
-            ir.emit("  " + reg + " = alloca i32\n");
+            ir.emitAlloca("  " + reg + " = alloca i32\n");
             if (ctx->initVal()) {
                 auto val = std::any_cast<Value>(visit(ctx->initVal()));
                 ir.emit("  store i32 " + val.reg + ", i32* " + reg + "\n");
             }
         } else {
-            ir.emit("  " + reg + " = alloca " + type->toString() + "\n");
+            ir.emitAlloca("  " + reg + " = alloca " + type->toString() + "\n");
             if (ctx->initVal()) {
-                auto values = evaluateInitVal(ctx->initVal(), dimensions, 0);
+                auto values = evaluateLocalInitVal(ctx->initVal(), dimensions, 0);
                 for (size_t i = 0; i < values.size(); ++i) {
                     std::string ptrReg = ir.getNewTemp();
                     std::string indices = getArrayIndicesFromFlat(i, dimensions);
                     ir.emit("  " + ptrReg + " = getelementptr " + type->toString() + 
                            ", " + type->toString() + "* " + reg + ", i32 0" + indices + "\n");
-                    ir.emit("  store i32 " + std::to_string(values[i]) + ", i32* " + ptrReg + "\n");
+                    ir.emit("  store i32 " + values[i] + ", i32* " + ptrReg + "\n");
                 }
             }
         }
@@ -323,31 +408,66 @@ std::any IRBuilder::visitFuncDef(SysYParser::FuncDefContext *ctx) {
     std::string funcName = ctx->IDENT()->getText();
     std::string retTypeStr = ctx->funcType()->INT() ? "i32" : "void";
     currentFuncReturnType = retTypeStr;
+    ir.beginFunction();
     
     std::vector<std::pair<std::string, std::shared_ptr<Type>>> params;
     if (ctx->funcFParams()) {
         for (auto param : ctx->funcFParams()->funcFParam()) {
             std::string paramName = param->IDENT()->getText();
             std::shared_ptr<Type> paramType = std::make_shared<IntType>();
+            if (!param->LBRACKET().empty()) {
+                // Array parameters decay to a pointer to their first element
+                std::vector<int> dims;
+                for (auto exp : param->exp()) {
+                    dims.push_back(std::any_cast<Value>(visit(exp)).constValue);
+                }
+                std::shared_ptr<Type> pointee = std::make_shared<IntType>();
+                if (!dims.empty()) {
+                    pointee = std::make_shared<ArrayType>(pointee, dims);
+                }
+                paramType = std::make_shared<PointerType>(pointee);
+            }
             params.push_back({paramName, paramType});
         }
     }
     
+    // Register the function before its body so recursive calls resolve.
+    std::vector<std::shared_ptr<Type>> paramTypes;
+    for (const auto& param : params) {
+        paramTypes.push_back(param.second);
+    }
+    std::shared_ptr<Type> retType;
+    if (retTypeStr == "void") {
+        retType = std::make_shared<VoidType>();
+    } else {
+        retType = std::make_shared<IntType>();
+    }
+    symbolTable.addSymbol(funcName, std::make_shared<Symbol>(funcName,
+        std::make_shared<FunctionType>(retType, paramTypes)));
+    
     ir.emit("define dso_local " + retTypeStr + " @" + funcName + "(");
     for (size_t i = 0; i < params.size(); ++i) {
         if (i > 0) ir.emit(", ");
-        ir.emit("i32 %" + params[i].first + ".param");
+        ir.emit(params[i].second->toString() + " %" + params[i].first + ".param");
     }
     ir.emit(") {\n");
-    ir.emit("entry:\n");
+    ir.emitEntry();
     
     symbolTable.enterScope();
+    // Names the body binds go away with it, so the next function sees the
+    // globals and nothing of this one.
+    std::map<std::string, std::string> outerNames = varMap;
     
     for (const auto& param : params) {
-        std::string reg = ir.getNewTemp();
-        varMap[param.first] = reg;
-        ir.emit("  " + reg + " = alloca i32\n");
-        ir.emit("  store i32 %" + param.first + ".param, i32* " + reg + "\n");
+        if (param.second->isPointer()) {
+            // Array parameters cannot be reassigned, use the pointer directly
+            varMap[param.first] = "%" + param.first + ".param";
+        } else {
+            std::string reg = ir.getNewTemp();
+            varMap[param.first] = reg;
+            ir.emitAlloca("  " + reg + " = alloca i32\n");
+            ir.emit("  store i32 %" + param.first + ".param, i32* " + reg + "\n");
+        }
         
         auto symbol = std::make_shared<Symbol>(param.first, param.second);
         symbolTable.addSymbol(param.first, symbol);
@@ -360,18 +480,24 @@ std::any IRBuilder::visitFuncDef(SysYParser::FuncDefContext *ctx) {
     } else {
         ir.emit("  ret i32 0\n");
     }
+    ir.endFunction();
     
     ir.emit("}\n\n");
     
+    varMap = std::move(outerNames);
     symbolTable.exitScope();
     return nullptr;
 }
 
 std::any IRBuilder::visitBlock(SysYParser::BlockContext *ctx) {
     symbolTable.enterScope();
+    // A declaration in the block hides an outer variable of the same name
+    // only until the block ends.
+    std::map<std::string, std::string> outerNames = varMap;
     for (auto item : ctx->blockItem()) {
         visit(item);
     }
+    varMap = std::move(outerNames);
     symbolTable.exitScope();
     return nullptr;
 }
@@ -386,8 +512,16 @@ std::any IRBuilder::visitAssignStmt(SysYParser::AssignStmtContext *ctx) {
         return nullptr;
     }
     
-    auto expVal = std::any_cast<Value>(visit(ctx->exp()));
     std::string varReg = varMap[varName];
+    if (symbol->type->isArray() || symbol->type->isPointer()) {
+        std::vector<Value> indices;
+        for (auto exp : lval->exp()) {
+            indices.push_back(std::any_cast<Value>(visit(exp)));
+        }
+        varReg = emitElementPtr(symbol->type, varReg, indices, false).reg;
+    }
+    
+    auto expVal = std::any_cast<Value>(visit(ctx->exp()));
     ir.emit("  store i32 " + expVal.reg + ", i32* " + varReg + "\n");
     
     return nullptr;
@@ -467,6 +601,8 @@ std::any IRBuilder::visitBreakStmt(SysYParser::BreakStmtContext *ctx) {
     int breakLabel = ir.getBreakLabel();
     if (breakLabel != -1) {
         ir.emit("  br label %label" + std::to_string(breakLabel) + "\n");
+        // Anything after the break is unreachable but needs a block to live in
+        ir.emitLabel(ir.getNewLabel());
     }
     return nullptr;
 }
@@ -475,6 +611,7 @@ std::any IRBuilder::visitContinueStmt(SysYParser::ContinueStmtContext *ctx) {
     int continueLabel = ir.getContinueLabel();
     if (continueLabel != -1) {
         ir.emit("  br label %label" + std::to_string(continueLabel) + "\n");
+        ir.emitLabel(ir.getNewLabel());
     }
     return nullptr;
 }
@@ -486,6 +623,7 @@ std::any IRBuilder::visitReturnStmt(SysYParser::ReturnStmtContext *ctx) {
     } else {
         ir.emit("  ret void\n");
     }
+    ir.emitLabel(ir.getNewLabel());
     return nullptr;
 }
 
@@ -515,6 +653,57 @@ std::any IRBuilder::visitLVal(SysYParser::LValContext *ctx) {
     }
     
     std::string varReg = varMap[varName];
+    if (symbol->type->isPointer()) {
+        std::vector<Value> indices;
+        for (auto exp : ctx->exp()) {
+            indices.push_back(std::any_cast<Value>(visit(exp)));
+        }
+        size_t depth = 1;
+        auto pointee = std::static_pointer_cast<PointerType>(symbol->type)->pointeeType;
+        if (pointee->isArray()) {
+            depth += std::static_pointer_cast<ArrayType>(pointee)->dimensions.size();
+        }
+        // Partially indexed array parameters are passed on as pointers
+        if (indices.size() < depth) {
+            return emitElementPtr(symbol->type, varReg, indices, !indices.empty());
+        }
+        varReg = emitElementPtr(symbol->type, varReg, indices, false).reg;
+    } else if (symbol->type->isArray()) {
+        auto arrayType = std::static_pointer_cast<ArrayType>(symbol->type);
+        std::vector<Value> indices;
+        bool allConst = true;
+        for (auto exp : ctx->exp()) {
+            indices.push_back(std::any_cast<Value>(visit(exp)));
+            allConst = allConst && indices.back().isConst;
+        }
+        
+        // Constant arrays indexed by constants fold to the element itself
+        if (symbol->isConst && allConst && indices.size() == arrayType->dimensions.size()) {
+            size_t flat = 0;
+            bool inRange = true;
+            for (size_t i = 0; i < indices.size(); ++i) {
+                int index = indices[i].constValue;
+                if (index < 0 || index >= arrayType->dimensions[i]) {
+                    std::cerr << "Array index out of range: " << varName << "[" << index << "]" << std::endl;
+                    inRange = false;
+                    break;
+                }
+                flat = flat * arrayType->dimensions[i] + index;
+            }
+            Value val;
+            val.isConst = true;
+            val.constValue = inRange && flat < symbol->arrayValues.size() ? symbol->arrayValues[flat] : 0;
+            val.reg = std::to_string(val.constValue);
+            val.type = std::make_shared<IntType>();
+            return val;
+        }
+        // Partially indexed arrays decay to a pointer to their next level
+        if (indices.size() < arrayType->dimensions.size()) {
+            return emitElementPtr(arrayType, varReg, indices, true);
+        }
+        varReg = emitElementPtr(arrayType, varReg, indices, false).reg;
+    }
+    
     std::string loadReg = ir.getNewTemp();
     ir.emit("  " + loadReg + " = load i32, i32* " + varReg + "\n");
     
@@ -572,11 +761,16 @@ std::any IRBuilder::visitFuncCallExp(SysYParser::FuncCallExpContext *ctx) {
             args.push_back(std::any_cast<Value>(visit(exp)));
         }
     }
+    if (args.size() != funcType->paramTypes.size()) {
+        std::cerr << "Wrong number of arguments to " << funcName << ": expected "
+                  << funcType->paramTypes.size() << ", got " << args.size() << std::endl;
+        return Value();
+    }
     
     std::string callInstr = "call " + funcType->returnType->toString() + " @" + funcName + "(";
     for (size_t i = 0; i < args.size(); ++i) {
         if (i > 0) callInstr += ", ";
-        callInstr += "i32 " + args[i].reg;
+        callInstr += funcType->paramTypes[i]->toString() + " " + args[i].reg;
     }
     callInstr += ")";
     
@@ -747,21 +941,7 @@ std::any IRBuilder::visitEqLAndExp(SysYParser::EqLAndExpContext *ctx) {
 }
 
 std::any IRBuilder::visitAndExp(SysYParser::AndExpContext *ctx) {
-    auto left = std::any_cast<Value>(visit(ctx->lAndExp()));
-    auto right = std::any_cast<Value>(visit(ctx->eqExp()));
-    
-    std::string leftBool = ir.getNewTemp();
-    ir.emit("  " + leftBool + " = icmp ne i32 " + left.reg + ", 0\n");
-    std::string rightBool = ir.getNewTemp();
-    ir.emit("  " + rightBool + " = icmp ne i32 " + right.reg + ", 0\n");
-    
-    std::string andReg = ir.getNewTemp();
-    ir.emit("  " + andReg + " = and i1 " + leftBool + ", " + rightBool + "\n");
-    
-    std::string resultReg = ir.getNewTemp();
-    ir.emit("  " + resultReg + " = zext i1 " + andReg + " to i32\n");
-    
-    return Value(resultReg, std::make_shared<IntType>());
+    return emitShortCircuit(ctx->lAndExp(), ctx->eqExp(), true);
 }
 
 std::any IRBuilder::visitLAndLOrExp(SysYParser::LAndLOrExpContext *ctx) {
@@ -769,20 +949,43 @@ std::any IRBuilder::visitLAndLOrExp(SysYParser::LAndLOrExpContext *ctx) {
 }
 
 std::any IRBuilder::visitOrExp(SysYParser::OrExpContext *ctx) {
-    auto left = std::any_cast<Value>(visit(ctx->lOrExp()));
-    auto right = std::any_cast<Value>(visit(ctx->lAndExp()));
+    return emitShortCircuit(ctx->lOrExp(), ctx->lAndExp(), false);
+}
+
+// The right operand of && and || only runs if the left one does not decide
+// the result. The left one decides it in a block of its own, so that the
+// phi joining the two outcomes knows both predecessors, whatever blocks the
+// operands open themselves.
+Value IRBuilder::emitShortCircuit(antlr4::tree::ParseTree *lhs, antlr4::tree::ParseTree *rhs, bool isAnd) {
+    int rightLabel = ir.getNewLabel();
+    int decidedLabel = ir.getNewLabel();
+    int rightEndLabel = ir.getNewLabel();
+    int endLabel = ir.getNewLabel();
     
+    auto left = std::any_cast<Value>(visit(lhs));
     std::string leftBool = ir.getNewTemp();
     ir.emit("  " + leftBool + " = icmp ne i32 " + left.reg + ", 0\n");
+    std::string next = "label %label" + std::to_string(rightLabel);
+    std::string decided = "label %label" + std::to_string(decidedLabel);
+    ir.emit("  br i1 " + leftBool + ", " + (isAnd ? next + ", " + decided : decided + ", " + next) + "\n");
+    
+    ir.emitLabel(decidedLabel);
+    ir.emit("  br label %label" + std::to_string(endLabel) + "\n");
+    
+    ir.emitLabel(rightLabel);
+    auto right = std::any_cast<Value>(visit(rhs));
     std::string rightBool = ir.getNewTemp();
     ir.emit("  " + rightBool + " = icmp ne i32 " + right.reg + ", 0\n");
+    std::string rightReg = ir.getNewTemp();
+    ir.emit("  " + rightReg + " = zext i1 " + rightBool + " to i32\n");
+    ir.emit("  br label %label" + std::to_string(rightEndLabel) + "\n");
+    ir.emitLabel(rightEndLabel);
+    ir.emit("  br label %label" + std::to_string(endLabel) + "\n");
     
-    std::string orReg = ir.getNewTemp();
-    ir.emit("  " + orReg + " = or i1 " + leftBool + ", " + rightBool + "\n");
-    
+    ir.emitLabel(endLabel);
     std::string resultReg = ir.getNewTemp();
-    ir.emit("  " + resultReg + " = zext i1 " + orReg + " to i32\n");
-    
+    ir.emit("  " + resultReg + " = phi i32 [ " + (isAnd ? "0" : "1") + ", %label" + std::to_string(decidedLabel) +
+            " ], [ " + rightReg + ", %label" + std::to_string(rightEndLabel) + " ]\n");
     return Value(resultReg, std::make_shared<IntType>());
 }
 
@@ -0,0 +1,382 @@
+#include "IRParser.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+class LineCursor {
+public:
+    LineCursor(const std::string& l) : line(l), pos(0) {}
+
+    void skipWs() {
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) ++pos;
+    }
+
+    bool atEnd() {
+        skipWs();
+        return pos >= line.size();
+    }
+
+    char peek() {
+        skipWs();
+        return pos < line.size() ? line[pos] : '\0';
+    }
+
+    bool accept(const std::string& s) {
+        skipWs();
+        if (line.compare(pos, s.size(), s) != 0) return false;
+        size_t end = pos + s.size();
+        // Keywords must not be a prefix of a longer identifier.
+        if (isalpha(static_cast<unsigned char>(s.back())) && end < line.size() &&
+            (isalnum(static_cast<unsigned char>(line[end])) || line[end] == '_')) {
+            return false;
+        }
+        pos = end;
+        return true;
+    }
+
+    void expect(const std::string& s) {
+        if (!accept(s)) fail("expected '" + s + "'");
+    }
+
+    std::string word() {
+        skipWs();
+        size_t start = pos;
+        while (pos < line.size() && (isalnum(static_cast<unsigned char>(line[pos])) ||
+                                     line[pos] == '_' || line[pos] == '.')) {
+            ++pos;
+        }
+        if (start == pos) fail("expected identifier");
+        return line.substr(start, pos - start);
+    }
+
+    std::string type() {
+        skipWs();
+        std::string result;
+        if (peek() == '[') {
+            ++pos;
+            std::string count = word();
+            expect("x");
+            std::string elem = type();
+            expect("]");
+            result = "[" + count + " x " + elem + "]";
+        } else {
+            result = word();
+        }
+        while (pos < line.size() && line[pos] == '*') {
+            result += '*';
+            ++pos;
+        }
+        return result;
+    }
+
+    std::string value() {
+        skipWs();
+        size_t start = pos;
+        while (pos < line.size() && line[pos] != ',' && line[pos] != ' ' &&
+               line[pos] != ')' && line[pos] != ']') {
+            ++pos;
+        }
+        if (start == pos) fail("expected value");
+        std::string v = line.substr(start, pos - start);
+        if (v == "true") return "1";
+        if (v == "false") return "0";
+        return v;
+    }
+
+    std::string label() {
+        expect("%");
+        return word();
+    }
+
+    [[noreturn]] void fail(const std::string& msg) {
+        throw std::runtime_error(msg + " at column " + std::to_string(pos) + ": " + line);
+    }
+
+    const std::string& line;
+    size_t pos;
+};
+
+Opcode binaryOpcode(const std::string& name, bool& ok) {
+    static const std::map<std::string, Opcode> ops = {
+        {"add", Opcode::Add}, {"sub", Opcode::Sub}, {"mul", Opcode::Mul},
+        {"sdiv", Opcode::SDiv}, {"srem", Opcode::SRem}, {"shl", Opcode::Shl},
+        {"ashr", Opcode::AShr}, {"lshr", Opcode::LShr}, {"and", Opcode::And},
+        {"or", Opcode::Or}, {"xor", Opcode::Xor}
+    };
+    auto it = ops.find(name);
+    ok = it != ops.end();
+    return ok ? it->second : Opcode::Add;
+}
+
+void parseInitializer(LineCursor& cur, const std::string& type, std::vector<int>& out) {
+    if (cur.accept("zeroinitializer")) {
+        int count = 1;
+        for (int dim : arrayDimensions(type)) count *= dim;
+        out.insert(out.end(), count, 0);
+        return;
+    }
+    if (!isArrayTypeStr(type)) {
+        out.push_back(constantValue(cur.value()));
+        return;
+    }
+    cur.expect("[");
+    std::string elemType = arrayElementType(type);
+    for (int i = 0; i < arrayLength(type); ++i) {
+        if (i > 0) cur.expect(",");
+        cur.type();
+        parseInitializer(cur, elemType, out);
+    }
+    cur.expect("]");
+}
+
+GlobalVariable parseGlobal(LineCursor& cur) {
+    GlobalVariable g;
+    cur.expect("@");
+    g.name = cur.word();
+    cur.expect("=");
+    cur.accept("dso_local");
+    cur.accept("internal");
+    if (cur.accept("constant")) {
+        g.isConstant = true;
+    } else {
+        cur.expect("global");
+    }
+    g.type = cur.type();
+    if (cur.accept("zeroinitializer")) {
+        g.zeroInit = true;
+        return g;
+    }
+    parseInitializer(cur, g.type, g.init);
+    g.zeroInit = true;
+    for (int v : g.init) {
+        if (v != 0) g.zeroInit = false;
+    }
+    if (g.zeroInit) g.init.clear();
+    return g;
+}
+
+void parseSignature(LineCursor& cur, Function& f, bool named) {
+    f.retType = cur.type();
+    cur.expect("@");
+    f.name = cur.word();
+    cur.expect("(");
+    while (!cur.accept(")")) {
+        if (!f.paramTypes.empty()) cur.expect(",");
+        if (cur.accept("...")) {
+            f.isVarArg = true;
+            continue;
+        }
+        f.paramTypes.push_back(cur.type());
+        if (named) f.paramNames.push_back(cur.value());
+    }
+}
+
+Instruction parseInstruction(LineCursor& cur) {
+    Instruction inst;
+    if (cur.peek() == '%') {
+        inst.result = cur.value();
+        cur.expect("=");
+    }
+    std::string name = cur.word();
+    bool isBinary = false;
+    Opcode binOp = binaryOpcode(name, isBinary);
+    if (isBinary) {
+        inst.op = binOp;
+        cur.accept("nsw");
+        cur.accept("nuw");
+        cur.accept("exact");
+        inst.type = cur.type();
+        inst.operands.push_back(cur.value());
+        cur.expect(",");
+        inst.operands.push_back(cur.value());
+    } else if (name == "alloca") {
+        inst.op = Opcode::Alloca;
+        inst.type = cur.type();
+    } else if (name == "load") {
+        inst.op = Opcode::Load;
+        inst.type = cur.type();
+        cur.expect(",");
+        cur.type();
+        inst.operands.push_back(cur.value());
+    } else if (name == "store") {
+        inst.op = Opcode::Store;
+        inst.type = cur.type();
+        inst.operands.push_back(cur.value());
+        cur.expect(",");
+        cur.type();
+        inst.operands.push_back(cur.value());
+    } else if (name == "getelementptr") {
+        inst.op = Opcode::GetElementPtr;
+        cur.accept("inbounds");
+        inst.type = cur.type();
+        cur.expect(",");
+        cur.type();
+        inst.operands.push_back(cur.value());
+        while (cur.accept(",")) {
+            cur.type();
+            inst.operands.push_back(cur.value());
+        }
+    } else if (name == "icmp") {
+        inst.op = Opcode::ICmp;
+        inst.predicate = cur.word();
+        inst.type = cur.type();
+        inst.operands.push_back(cur.value());
+        cur.expect(",");
+        inst.operands.push_back(cur.value());
+    } else if (name == "zext") {
+        inst.op = Opcode::ZExt;
+        inst.srcType = cur.type();
+        inst.operands.push_back(cur.value());
+        cur.expect("to");
+        inst.type = cur.type();
+    } else if (name == "select") {
+        inst.op = Opcode::Select;
+        cur.type();
+        inst.operands.push_back(cur.value());
+        cur.expect(",");
+        inst.type = cur.type();
+        inst.operands.push_back(cur.value());
+        cur.expect(",");
+        cur.type();
+        inst.operands.push_back(cur.value());
+    } else if (name == "phi") {
+        inst.op = Opcode::Phi;
+        inst.type = cur.type();
+        do {
+            cur.expect("[");
+            inst.operands.push_back(cur.value());
+            cur.expect(",");
+            inst.labels.push_back(cur.label());
+            cur.expect("]");
+        } while (cur.accept(","));
+    } else if (name == "call") {
+        inst.op = Opcode::Call;
+        inst.type = cur.type();
+        if (cur.peek() == '(') {
+            // Explicit function type of a varargs callee: "(i8*, ...)"
+            while (!cur.accept(")")) cur.pos++;
+        }
+        cur.expect("@");
+        inst.callee = cur.word();
+        cur.expect("(");
+        while (!cur.accept(")")) {
+            if (!inst.operands.empty()) cur.expect(",");
+            inst.argTypes.push_back(cur.type());
+            inst.operands.push_back(cur.value());
+        }
+    } else if (name == "br") {
+        if (cur.accept("label")) {
+            inst.op = Opcode::Br;
+            inst.labels.push_back(cur.label());
+        } else {
+            inst.op = Opcode::CondBr;
+            cur.type();
+            inst.operands.push_back(cur.value());
+            cur.expect(",");
+            cur.expect("label");
+            inst.labels.push_back(cur.label());
+            cur.expect(",");
+            cur.expect("label");
+            inst.labels.push_back(cur.label());
+        }
+    } else if (name == "ret") {
+        inst.op = Opcode::Ret;
+        inst.type = cur.type();
+        if (inst.type != "void") inst.operands.push_back(cur.value());
+    } else if (name == "unreachable") {
+        inst.op = Opcode::Unreachable;
+    } else {
+        cur.fail("unknown instruction '" + name + "'");
+    }
+    return inst;
+}
+
+int numericSuffix(const std::string& name, const std::string& prefix) {
+    if (name.compare(0, prefix.size(), prefix) != 0 || name.size() == prefix.size()) return -1;
+    for (size_t i = prefix.size(); i < name.size(); ++i) {
+        if (!isdigit(static_cast<unsigned char>(name[i]))) return -1;
+    }
+    return std::stoi(name.substr(prefix.size()));
+}
+
+std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(start, end - start + 1);
+}
+
+} // namespace
+
+std::unique_ptr<Module> parseIR(const std::string& text) {
+    auto module = std::make_unique<Module>();
+    std::istringstream in(text);
+    std::string raw;
+    Function* func = nullptr;
+    BasicBlock* block = nullptr;
+    int lineNo = 0;
+
+    try {
+        while (std::getline(in, raw)) {
+            ++lineNo;
+            std::string line = trim(raw);
+            if (line.empty() || line[0] == ';') continue;
+            LineCursor cur(line);
+
+            if (!func) {
+                if (cur.accept("declare")) {
+                    auto f = std::make_unique<Function>();
+                    f->isDeclaration = true;
+                    parseSignature(cur, *f, false);
+                    module->functions.push_back(std::move(f));
+                } else if (line[0] == '@') {
+                    module->globals.push_back(parseGlobal(cur));
+                } else if (cur.accept("define")) {
+                    cur.accept("dso_local");
+                    auto f = std::make_unique<Function>();
+                    parseSignature(cur, *f, true);
+                    while (cur.peek() != '{') f->attributes.insert(cur.word());
+                    func = f.get();
+                    block = nullptr;
+                    module->functions.push_back(std::move(f));
+                } else {
+                    cur.fail("unexpected top-level line");
+                }
+                continue;
+            }
+
+            if (line == "}") {
+                func = nullptr;
+                continue;
+            }
+            if (line.back() == ':') {
+                std::string name = line.substr(0, line.size() - 1);
+                block = func->addBlock(name);
+                func->reserveNames(-1, numericSuffix(name, "bb"));
+                continue;
+            }
+            if (!block) block = func->addBlock("entry");
+            if (block->terminator()) continue;  // Dead code after a terminator
+
+            Instruction inst = parseInstruction(cur);
+            func->reserveNames(numericSuffix(inst.result, "%r"), -1);
+            block->insts.push_back(std::move(inst));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "IR parse error on line " << lineNo << ": " << e.what() << std::endl;
+        return nullptr;
+    }
+
+    // Blocks that ran off the end without a terminator cannot be reached in
+    // valid IR; give them one so every block is well formed.
+    for (auto& f : module->functions) {
+        for (auto& bb : f->blocks) {
+            if (!bb->terminator()) {
+                bb->insts.push_back(Instruction(Opcode::Unreachable, "", ""));
+            }
+        }
+    }
+    return module;
+}
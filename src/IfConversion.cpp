@@ -0,0 +1,187 @@
+#include "Passes.h"
+#include <algorithm>
+
+// Cost model: a converted branch executes both arms, so the instructions
+// hoisted out of them plus the selects joining their results must stay
+// within a few cycles, roughly what a mispredicted branch costs. Multiplies
+// count double for their latency.
+static const int kSpeculationBudget = 8;
+
+namespace {
+
+int speculationCost(const Instruction& inst) {
+    return inst.op == Opcode::Mul ? 2 : 1;
+}
+
+// Instructions that may run whether or not the branch would have reached
+// them: no memory access, no call, and no division that could trap.
+bool isSpeculatable(const Instruction& inst) {
+    switch (inst.op) {
+        case Opcode::SDiv:
+        case Opcode::SRem:
+            return isConstantOperand(inst.operands[1]) && constantValue(inst.operands[1]) != 0 &&
+                   constantValue(inst.operands[1]) != -1;
+        case Opcode::GetElementPtr:
+        case Opcode::ICmp:
+        case Opcode::ZExt:
+        case Opcode::Select:
+            return true;
+        default:
+            return inst.isBinary();
+    }
+}
+
+// An arm is a block entered only from the branch whose body can be hoisted.
+bool isArm(BasicBlock* bb, const std::string& branch,
+           std::map<std::string, std::vector<std::string>>& preds, int& cost) {
+    if (preds[bb->name].size() != 1 || preds[bb->name][0] != branch) return false;
+    for (const auto& inst : bb->insts) {
+        if (inst.isTerminator()) continue;
+        if (!isSpeculatable(inst)) return false;
+        cost += speculationCost(inst);
+    }
+    return true;
+}
+
+void hoist(BasicBlock* arm, BasicBlock* into) {
+    into->insts.insert(into->insts.end() - 1, arm->insts.begin(), arm->insts.end() - 1);
+}
+
+// Incoming value of `phi` along the edge from `label`.
+std::string incoming(const Instruction& phi, const std::string& label) {
+    for (size_t i = 0; i < phi.labels.size(); ++i) {
+        if (phi.labels[i] == label) return phi.operands[i];
+    }
+    return std::string();
+}
+
+// Converts the branch ending `bb` if both ways lead, through hoistable arms,
+// to the same join block (a diamond, or a triangle when one way goes there
+// directly) or to returns. Returns the arms to delete.
+std::vector<BasicBlock*> convert(Function& f, BasicBlock* bb,
+                                 std::map<std::string, std::vector<std::string>>& preds) {
+    Instruction* term = bb->terminator();
+    if (!term || term->op != Opcode::CondBr || term->labels[0] == term->labels[1]) return {};
+    std::string cond = term->operands[0];
+    BasicBlock* t = f.getBlock(term->labels[0]);
+    BasicBlock* e = f.getBlock(term->labels[1]);
+    const Instruction* tTerm = t->terminator();
+    const Instruction* eTerm = e->terminator();
+
+    // Both arms return: select the returned value.
+    if (tTerm->op == Opcode::Ret && eTerm->op == Opcode::Ret) {
+        int cost = 0;
+        if (!isArm(t, bb->name, preds, cost) || !isArm(e, bb->name, preds, cost)) return {};
+        Instruction ret = *tTerm;
+        bool selects = !ret.operands.empty() && ret.operands[0] != eTerm->operands[0];
+        if (cost + selects > kSpeculationBudget) return {};
+        hoist(t, bb);
+        hoist(e, bb);
+        if (selects) {
+            std::string value = f.newReg();
+            bb->insts.insert(bb->insts.end() - 1,
+                             Instruction(Opcode::Select, value, ret.type, {cond, ret.operands[0], eTerm->operands[0]}));
+            ret.operands[0] = value;
+        }
+        bb->insts.back() = ret;
+        return {t, e};
+    }
+
+    // Otherwise find the join: the common successor of two arms, or one side
+    // of the branch when the other is an arm leading to it.
+    std::vector<BasicBlock*> arms;
+    BasicBlock* join = nullptr;
+    int cost = 0;
+    auto leadsTo = [](const Instruction* branch, const std::string& target) {
+        return branch->op == Opcode::Br && branch->labels[0] == target;
+    };
+    if (leadsTo(tTerm, e->name) && isArm(t, bb->name, preds, cost)) {
+        arms = {t};
+        join = e;
+    } else if (leadsTo(eTerm, t->name) && isArm(e, bb->name, preds, cost)) {
+        arms = {e};
+        join = t;
+    } else if (tTerm->op == Opcode::Br && leadsTo(eTerm, tTerm->labels[0]) &&
+               isArm(t, bb->name, preds, cost) && isArm(e, bb->name, preds, cost)) {
+        arms = {t, e};
+        join = f.getBlock(tTerm->labels[0]);
+    } else {
+        return {};
+    }
+    if (join == bb) return {};
+
+    // Where the join would take a value from the true side and from the
+    // false side, it takes a select from `bb` instead.
+    std::string fromTrue = join == t ? bb->name : t->name;
+    std::string fromFalse = join == e ? bb->name : e->name;
+    std::vector<std::pair<std::string, std::string>> values;
+    for (const auto& inst : join->insts) {
+        if (inst.op != Opcode::Phi) break;
+        values.push_back({incoming(inst, fromTrue), incoming(inst, fromFalse)});
+        if (values.back().first != values.back().second) ++cost;
+    }
+    if (cost > kSpeculationBudget) return {};
+
+    for (BasicBlock* arm : arms) hoist(arm, bb);
+    std::set<std::string> armNames;
+    for (BasicBlock* arm : arms) armNames.insert(arm->name);
+    size_t k = 0;
+    for (auto& inst : join->insts) {
+        if (inst.op != Opcode::Phi) break;
+        auto [a, b] = values[k++];
+        std::string value = a;
+        if (a != b) {
+            value = f.newReg();
+            bb->insts.insert(bb->insts.end() - 1, Instruction(Opcode::Select, value, inst.type, {cond, a, b}));
+        }
+        // Both edges collapse into one from `bb`.
+        for (size_t i = inst.labels.size(); i-- > 0;) {
+            if (inst.labels[i] == bb->name || armNames.count(inst.labels[i])) {
+                inst.labels.erase(inst.labels.begin() + i);
+                inst.operands.erase(inst.operands.begin() + i);
+            }
+        }
+        inst.operands.push_back(value);
+        inst.labels.push_back(bb->name);
+    }
+    bb->insts.back() = makeBr(join->name);
+    return arms;
+}
+
+} // namespace
+
+bool convertIfsToSelects(Function& f) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    bool changed = false;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        auto preds = f.predecessors();
+        std::set<BasicBlock*> dead;
+        // Innermost conditions first, so that a converted inner if becomes a
+        // hoistable arm of the one around it in the next round.
+        for (size_t i = f.blocks.size(); i-- > 0;) {
+            BasicBlock* bb = f.blocks[i].get();
+            if (dead.count(bb)) continue;
+            std::vector<BasicBlock*> arms = convert(f, bb, preds);
+            if (arms.empty()) continue;
+            for (BasicBlock* arm : arms) {
+                dead.insert(arm);
+                for (const auto& succ : arm->successors()) {
+                    auto& list = preds[succ];
+                    list.erase(std::remove(list.begin(), list.end(), arm->name), list.end());
+                    if (std::find(list.begin(), list.end(), bb->name) == list.end()) list.push_back(bb->name);
+                }
+            }
+            changed = progress = true;
+        }
+        if (!progress) break;
+        f.blocks.erase(std::remove_if(f.blocks.begin(), f.blocks.end(),
+                                      [&](const std::unique_ptr<BasicBlock>& b) { return dead.count(b.get()); }),
+                       f.blocks.end());
+        // A converted diamond leaves its head and join as a straight line,
+        // which has to be one block to be seen as an arm itself.
+        mergeBlocks(f);
+    }
+    return changed;
+}
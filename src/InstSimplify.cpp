@@ -0,0 +1,75 @@
+#include "Passes.h"
+#include <algorithm>
+
+namespace {
+
+// Value `inst` can be replaced with, or empty if it has to stay.
+std::string simplify(const Instruction& inst, BasicBlock* bb, const ValueRangeAnalysis& vra) {
+    if (inst.op == Opcode::ICmp) {
+        int outcome = vra.evaluateCompare(inst.predicate, inst.operands[0], inst.operands[1], bb);
+        if (outcome >= 0) return std::to_string(outcome);
+    }
+    ValueRange r = vra.rangeAt(inst.result, bb);
+    if (r.isConstant()) return std::to_string(r.lo);
+
+    switch (inst.op) {
+        case Opcode::And:
+            // A mask that only clears bits already known to be zero
+            for (int i = 0; i < 2; ++i) {
+                const std::string& mask = inst.operands[1 - i];
+                if (!isConstantOperand(mask)) continue;
+                ValueRange x = vra.rangeAt(inst.operands[i], bb);
+                if ((x.knownZero | static_cast<uint32_t>(constantValue(mask))) == 0xFFFFFFFFu) return inst.operands[i];
+            }
+            break;
+        case Opcode::SRem: {
+            // A dividend already smaller than the divisor
+            ValueRange x = vra.rangeAt(inst.operands[0], bb), d = vra.rangeAt(inst.operands[1], bb);
+            long long m = d.lo > 0 ? d.lo : d.hi < 0 && d.hi > INT32_MIN ? -d.hi : 0;
+            if (m > 0 && x.lo > -m && x.hi < m) return inst.operands[0];
+            break;
+        }
+        case Opcode::SDiv:
+        case Opcode::Mul:
+            if (isConstantOperand(inst.operands[1]) && constantValue(inst.operands[1]) == 1) return inst.operands[0];
+            break;
+        case Opcode::Select: {
+            ValueRange c = vra.rangeAt(inst.operands[0], bb);
+            if (c.isConstant()) return inst.operands[c.lo ? 1 : 2];
+            if (inst.operands[1] == inst.operands[2]) return inst.operands[1];
+            break;
+        }
+        default:
+            break;
+    }
+    return std::string();
+}
+
+} // namespace
+
+bool simplifyInstructions(Function& f, const ValueRangeAnalysis& vra) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    std::map<std::string, std::string> replacements;
+    for (auto& bb : f.blocks) {
+        if (!vra.dominators().isReachable(bb.get())) continue;
+        for (const auto& inst : bb->insts) {
+            if (inst.result.empty() || inst.hasSideEffects() || inst.op == Opcode::Load ||
+                inst.op == Opcode::Alloca || inst.op == Opcode::Call) {
+                continue;
+            }
+            std::string type = inst.resultType();
+            if (type != "i32" && type != "i1") continue;
+            std::string value = simplify(inst, bb.get(), vra);
+            if (!value.empty() && value != inst.result) replacements[inst.result] = value;
+        }
+    }
+    if (replacements.empty()) return false;
+    for (auto& bb : f.blocks) {
+        auto& insts = bb->insts;
+        insts.erase(std::remove_if(insts.begin(), insts.end(),
+                                   [&](const Instruction& i) { return replacements.count(i.result) > 0; }),
+                    insts.end());
+    }
+    f.replaceUses(replacements);
+    return true;
+}
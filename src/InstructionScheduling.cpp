@@ -0,0 +1,137 @@
+#include "Passes.h"
+#include <algorithm>
+
+// List scheduling within basic blocks. The frontend emits instructions in
+// source evaluation order, so an expression's loads and multiplies sit right
+// before their first use and every operation waits for the one before it.
+// Ordering by critical path instead starts long-latency work early, so that
+// independent operations overlap.
+
+namespace {
+
+// Rough latencies of a modern out-of-order core, in cycles.
+int latency(const Instruction& inst) {
+    switch (inst.op) {
+        case Opcode::Load:
+            return 4;
+        case Opcode::Mul:
+            return 3;
+        case Opcode::SDiv:
+        case Opcode::SRem:
+            return 20;
+        case Opcode::Call:
+            return 10;
+        default:
+            return 1;
+    }
+}
+
+bool readsMemory(const Instruction& inst) {
+    return inst.op == Opcode::Load || inst.op == Opcode::Call;
+}
+
+bool writesMemory(const Instruction& inst) {
+    return inst.op == Opcode::Store || inst.op == Opcode::Call;
+}
+
+// Schedules the instructions between the phis and the terminator of `bb`.
+// Returns true if their order changed.
+bool scheduleBlock(BasicBlock* bb) {
+    auto& insts = bb->insts;
+    size_t begin = 0;
+    while (begin < insts.size() && insts[begin].op == Opcode::Phi) ++begin;
+    size_t end = insts.size();
+    if (end > begin && insts[end - 1].isTerminator()) --end;
+    size_t n = end - begin;
+    if (n < 3) return false;
+
+    // Dependences: operands defined in the block, and memory accesses, which
+    // keep their order unless both only read. Allocas stay in front, where
+    // they make the frame static.
+    std::vector<std::vector<int>> succs(n);
+    std::vector<int> predCount(n, 0);
+    std::map<std::string, int> defs;
+    int lastWrite = -1;
+    int lastAlloca = -1;
+    std::vector<int> readsSinceWrite;
+    auto addEdge = [&](int from, int to) {
+        if (from < 0 || std::find(succs[from].begin(), succs[from].end(), to) != succs[from].end()) return;
+        succs[from].push_back(to);
+        ++predCount[to];
+    };
+    for (size_t i = 0; i < n; ++i) {
+        const Instruction& inst = insts[begin + i];
+        int id = static_cast<int>(i);
+        for (const auto& operand : inst.operands) {
+            auto it = defs.find(operand);
+            if (it != defs.end()) addEdge(it->second, id);
+        }
+        addEdge(lastAlloca, id);
+        if (inst.op == Opcode::Alloca) lastAlloca = id;
+        if (readsMemory(inst) || writesMemory(inst)) addEdge(lastWrite, id);
+        if (writesMemory(inst)) {
+            for (int read : readsSinceWrite) addEdge(read, id);
+            readsSinceWrite.clear();
+            lastWrite = id;
+        } else if (readsMemory(inst)) {
+            readsSinceWrite.push_back(id);
+        }
+        if (!inst.result.empty()) defs[inst.result] = id;
+    }
+
+    // Priority: the latency-weighted length of the longest path from an
+    // instruction to the end of the block.
+    std::vector<int> height(n, 0);
+    for (size_t i = n; i-- > 0;) {
+        int below = 0;
+        for (int succ : succs[i]) below = std::max(below, height[succ]);
+        height[i] = latency(insts[begin + i]) + below;
+    }
+
+    // One instruction per cycle. Among those whose operands are ready, take
+    // the highest; if none is, the one that gets ready first. Ties keep the
+    // original order.
+    std::vector<int> readyAt(n, 0);
+    std::vector<int> available;
+    for (size_t i = 0; i < n; ++i) {
+        if (predCount[i] == 0) available.push_back(static_cast<int>(i));
+    }
+    std::vector<int> order;
+    int cycle = 0;
+    while (!available.empty()) {
+        auto better = [&](int a, int b) {
+            bool readyA = readyAt[a] <= cycle, readyB = readyAt[b] <= cycle;
+            if (readyA != readyB) return readyA;
+            if (!readyA && readyAt[a] != readyAt[b]) return readyAt[a] < readyAt[b];
+            if (height[a] != height[b]) return height[a] > height[b];
+            return a < b;
+        };
+        auto pick = std::min_element(available.begin(), available.end(), better);
+        int id = *pick;
+        available.erase(pick);
+        order.push_back(id);
+        cycle = std::max(cycle, readyAt[id]) + 1;
+        for (int succ : succs[id]) {
+            readyAt[succ] = std::max(readyAt[succ], cycle - 1 + latency(insts[begin + id]));
+            if (--predCount[succ] == 0) available.push_back(succ);
+        }
+    }
+
+    bool changed = false;
+    std::vector<Instruction> scheduled;
+    scheduled.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        changed |= order[i] != static_cast<int>(i);
+        scheduled.push_back(std::move(insts[begin + order[i]]));
+    }
+    std::move(scheduled.begin(), scheduled.end(), insts.begin() + begin);
+    return changed;
+}
+
+} // namespace
+
+bool scheduleInstructions(Function& f) {
+    bool changed = false;
+    for (auto& bb : f.blocks) changed |= scheduleBlock(bb.get());
+    return changed;
+}
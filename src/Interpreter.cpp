@@ -0,0 +1,824 @@
+#include "Interpreter.h"
+#include "Runtime.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// Threaded dispatch jumps from the end of each handler straight to the
+// next one through a table of label addresses, a GNU extension; elsewhere
+// a switch does.
+#if defined(__GNUC__)
+#define INTERPRETER_THREADED 1
+#else
+#define INTERPRETER_THREADED 0
+#endif
+
+namespace {
+
+// The bytecode. Slots are numbered per call; a, b, c and d name slots or
+// code offsets as each op says.
+#define FOR_EACH_OP(X) \
+    X(Move)          /* a = b */ \
+    X(Add)           /* a = b + c, and so on for the binary ops */ \
+    X(Sub) \
+    X(Mul) \
+    X(SDiv) \
+    X(SRem) \
+    X(Shl) \
+    X(AShr) \
+    X(LShr) \
+    X(And) \
+    X(Or) \
+    X(Xor) \
+    X(Eq)            /* a = b == c, and so on for the predicates */ \
+    X(Ne) \
+    X(Lt) \
+    X(Le) \
+    X(Gt) \
+    X(Ge) \
+    X(ULt) \
+    X(ULe) \
+    X(UGt) \
+    X(UGe) \
+    X(Select)        /* a = b ? c : d */ \
+    X(Load32)        /* a = *b */ \
+    X(Load64) \
+    X(Store32)       /* *b = a */ \
+    X(Store64) \
+    X(Alloca)        /* a = imm bytes of the call's frame */ \
+    X(Offset)        /* a = b + imm */ \
+    X(Index)         /* a = b + c * imm + d */ \
+    X(Jump)          /* to a */ \
+    X(Branch)        /* to b if a, else to c */ \
+    X(BranchEq)      /* to c if a == b, else to d, and so on */ \
+    X(BranchNe) \
+    X(BranchLt) \
+    X(BranchLe) \
+    X(BranchGt) \
+    X(BranchGe) \
+    X(Call)          /* a = function b of the d arguments from c */ \
+    X(CallNative)    /* The same, once function b is native */ \
+    X(CallBuiltin)   /* a = builtin b of the d arguments from c */ \
+    X(LoopHeader)    /* Counts an iteration of loop a, or leaves for its native code */ \
+    X(LoopCount)     /* Counts an iteration of a loop nested in loop a */ \
+    X(Ret)           /* a */ \
+    X(RetVoid) \
+    X(Trap)
+
+enum Op : int32_t {
+#define X(name) name,
+    FOR_EACH_OP(X)
+#undef X
+};
+
+struct Insn {
+    const void* handler = nullptr;  // Threaded dispatch only
+    int32_t op;
+    int32_t a = 0, b = 0, c = 0, d = 0;
+    int64_t imm = 0;
+};
+
+struct DecodedFunction {
+    std::string name;
+    int params = 0;
+    std::vector<Insn> code;
+    int slots = 0;
+    // Slots from `firstConstant` on hold constants, global addresses and
+    // temporaries, set to these values whenever the function is entered.
+    int firstConstant = 0;
+    std::vector<int64_t> constants;
+    std::vector<int32_t> args;          // Argument slots of the calls
+
+    // Tiering
+    struct Loop {
+        std::string header;
+        std::vector<int32_t> liveIns;
+        uint32_t iterations = 0;
+        void* native = nullptr;
+        bool failed = false;
+    };
+    std::vector<Loop> loops;
+    uint32_t calls = 0;
+    void* native = nullptr;
+};
+
+// Calls native code with the arguments in the slots `args`. Passing every
+// argument register is harmless under the SysV ABI, where the caller pops
+// the stack arguments; the result is an i32 or nothing.
+int64_t callNative(void* entry, const int64_t* regs, const int32_t* args, int count) {
+    int64_t a[TierUp::kMaxNativeArgs] = {};
+    for (int i = 0; i < count; ++i) a[i] = regs[args[i]];
+    using Entry = int64_t (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t,
+                              int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t);
+    int64_t result = reinterpret_cast<Entry>(entry)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9],
+                                                     a[10], a[11], a[12], a[13], a[14], a[15]);
+    return static_cast<int32_t>(result);
+}
+
+// sylib functions over argument slots, returning the result if any.
+using Builtin = int64_t (*)(const int64_t* regs, const int32_t* args, int count);
+
+int arg(const int64_t* regs, const int32_t* args, int count, int i) {
+    return i < count ? static_cast<int>(regs[args[i]]) : 0;
+}
+
+int* array(const int64_t* regs, const int32_t* args, int i) {
+    return reinterpret_cast<int*>(regs[args[i]]);
+}
+
+const std::map<std::string, Builtin>& builtins() {
+    static const std::map<std::string, Builtin> table = {
+        {"getint", [](const int64_t*, const int32_t*, int) -> int64_t { return runtime::getint(); }},
+        {"getch", [](const int64_t*, const int32_t*, int) -> int64_t { return runtime::getch(); }},
+        {"getarray",
+         [](const int64_t* r, const int32_t* a, int) -> int64_t { return runtime::getarray(array(r, a, 0)); }},
+        {"putint",
+         [](const int64_t* r, const int32_t* a, int n) -> int64_t {
+             runtime::putint(arg(r, a, n, 0));
+             return 0;
+         }},
+        {"putch",
+         [](const int64_t* r, const int32_t* a, int n) -> int64_t {
+             runtime::putch(arg(r, a, n, 0));
+             return 0;
+         }},
+        {"putarray",
+         [](const int64_t* r, const int32_t* a, int n) -> int64_t {
+             runtime::putarray(arg(r, a, n, 0), array(r, a, 1));
+             return 0;
+         }},
+        // printf ignores arguments past those the format uses.
+        {"putf",
+         [](const int64_t* r, const int32_t* a, int n) -> int64_t {
+             runtime::putf(reinterpret_cast<const char*>(r[a[0]]), arg(r, a, n, 1), arg(r, a, n, 2),
+                           arg(r, a, n, 3), arg(r, a, n, 4), arg(r, a, n, 5), arg(r, a, n, 6));
+             return 0;
+         }},
+        {"starttime",
+         [](const int64_t*, const int32_t*, int) -> int64_t {
+             runtime::startTime(0);
+             return 0;
+         }},
+        {"stoptime",
+         [](const int64_t*, const int32_t*, int) -> int64_t {
+             runtime::stopTime(0);
+             return 0;
+         }},
+    };
+    return table;
+}
+
+// What the decoder resolves names against.
+struct Linkage {
+    std::map<std::string, int> functions;
+    std::map<std::string, int> builtins;
+    std::map<std::string, int64_t> globals;  // Addresses
+};
+
+Op comparison(const std::string& pred) {
+    if (pred == "eq") return Eq;
+    if (pred == "ne") return Ne;
+    if (pred == "slt") return Lt;
+    if (pred == "sle") return Le;
+    if (pred == "sgt") return Gt;
+    if (pred == "sge") return Ge;
+    if (pred == "ult") return ULt;
+    if (pred == "ule") return ULe;
+    if (pred == "ugt") return UGt;
+    if (pred == "uge") return UGe;
+    throw std::runtime_error("interpreter: unknown predicate " + pred);
+}
+
+Op binary(Opcode op) {
+    switch (op) {
+        case Opcode::Add: return Add;
+        case Opcode::Sub: return Sub;
+        case Opcode::Mul: return Mul;
+        case Opcode::SDiv: return SDiv;
+        case Opcode::SRem: return SRem;
+        case Opcode::Shl: return Shl;
+        case Opcode::AShr: return AShr;
+        case Opcode::LShr: return LShr;
+        case Opcode::And: return And;
+        case Opcode::Or: return Or;
+        default: return Xor;
+    }
+}
+
+class FunctionDecoder {
+public:
+    FunctionDecoder(const Function& f, const Linkage& linkage, const std::vector<LoopEntry>& loops,
+                    DecodedFunction& out)
+        : f(f), linkage(linkage), loops(loops), out(out) {}
+
+    void decode() {
+        out.name = f.name;
+        out.params = static_cast<int>(f.paramNames.size());
+        for (size_t i = 0; i < f.paramNames.size(); ++i) slots[f.paramNames[i]] = next++;
+        for (const auto& bb : f.blocks) {
+            blocks[bb->name] = bb.get();
+            for (const auto& inst : bb->insts) {
+                if (!inst.result.empty()) slots[inst.result] = next++;
+                for (const auto& operand : inst.operands) ++uses[operand];
+                if (inst.op == Opcode::Phi) phiBlocks.insert(bb->name);
+            }
+        }
+        out.firstConstant = next;
+
+        std::map<std::string, Op> loopOps;
+        std::map<std::string, int32_t> loopIndex;
+        for (size_t i = 0; i < loops.size(); ++i) {
+            DecodedFunction::Loop loop;
+            loop.header = loops[i].header;
+            for (const auto& value : loops[i].liveIns) loop.liveIns.push_back(slot(value));
+            out.loops.push_back(loop);
+            loopOps[loops[i].header] = LoopHeader;
+            loopIndex[loops[i].header] = static_cast<int32_t>(i);
+            for (const auto& header : loops[i].nested) {
+                loopOps[header] = LoopCount;
+                loopIndex[header] = static_cast<int32_t>(i);
+            }
+        }
+
+        for (size_t b = 0; b < f.blocks.size(); ++b) {
+            const BasicBlock& bb = *f.blocks[b];
+            nextBlock = b + 1 < f.blocks.size() ? f.blocks[b + 1]->name : "";
+            labels[bb.name] = static_cast<int32_t>(out.code.size());
+            if (loopOps.count(bb.name)) emit(loopOps[bb.name], loopIndex[bb.name]);
+            for (size_t i = 0; i < bb.insts.size(); ++i) {
+                const Instruction* following = i + 1 < bb.insts.size() ? &bb.insts[i + 1] : nullptr;
+                decode(bb, bb.insts[i], following);
+            }
+        }
+        // Edges into blocks with phis, for conditional branches: the moves,
+        // then on to the block.
+        for (const auto& edge : edges) {
+            labels[edge.first + "->" + edge.second] = static_cast<int32_t>(out.code.size());
+            phiMoves(edge.first, edge.second);
+            jumpTo(edge.second);
+        }
+        for (const auto& fixup : fixups) out.code[fixup.insn].*fixup.field = labels.at(fixup.label);
+
+        out.slots = next;
+        out.constants.resize(next - out.firstConstant);
+        for (const auto& constant : constantValues) out.constants[constant.first - out.firstConstant] = constant.second;
+    }
+
+private:
+    struct Fixup {
+        size_t insn;
+        int32_t Insn::*field;
+        std::string label;
+    };
+
+    void emit(Op op, int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0, int64_t imm = 0) {
+        Insn insn;
+        insn.op = op;
+        insn.a = a;
+        insn.b = b;
+        insn.c = c;
+        insn.d = d;
+        insn.imm = imm;
+        out.code.push_back(insn);
+    }
+
+    int32_t constant(int64_t value) {
+        auto it = constantSlots.find(value);
+        if (it != constantSlots.end()) return it->second;
+        int32_t s = next++;
+        constantSlots[value] = s;
+        constantValues[s] = value;
+        return s;
+    }
+
+    int32_t slot(const std::string& operand) {
+        if (isConstantOperand(operand)) return constant(constantValue(operand));
+        if (isGlobalOperand(operand)) return constant(linkage.globals.at(operand.substr(1)));
+        return slots.at(operand);
+    }
+
+    // A branch to `label`, patched once the code is laid out.
+    void target(int32_t Insn::*field, const std::string& label) {
+        fixups.push_back({out.code.size() - 1, field, label});
+    }
+
+    void jumpTo(const std::string& block) {
+        emit(Jump);
+        target(&Insn::a, block);
+    }
+
+    // Where a conditional branch from `from` to `to` goes.
+    std::string edge(const std::string& from, const std::string& to) {
+        if (!phiBlocks.count(to)) return to;
+        edges.insert({from, to});
+        return from + "->" + to;
+    }
+
+    // The phis of `to` for the edge from `from`, as a parallel copy:
+    // moves go in an order that reads every source before overwriting it,
+    // and a cycle is broken by saving one of its values in a temporary.
+    void phiMoves(const std::string& from, const std::string& to) {
+        std::vector<std::pair<int32_t, int32_t>> moves;  // (destination, source)
+        for (const auto& inst : blocks.at(to)->insts) {
+            if (inst.op != Opcode::Phi) break;
+            for (size_t i = 0; i < inst.labels.size(); ++i) {
+                if (inst.labels[i] != from) continue;
+                int32_t src = slot(inst.operands[i]);
+                int32_t dst = slots.at(inst.result);
+                if (src != dst) moves.push_back({dst, src});
+                break;
+            }
+        }
+        while (!moves.empty()) {
+            bool progress = false;
+            for (size_t i = 0; i < moves.size(); ++i) {
+                bool read = false;
+                for (const auto& other : moves) read |= other.second == moves[i].first;
+                if (read) continue;
+                emit(Move, moves[i].first, moves[i].second);
+                moves.erase(moves.begin() + i);
+                progress = true;
+                break;
+            }
+            if (progress) continue;
+            int32_t saved = moves[0].first;
+            int32_t temp = next++;
+            emit(Move, temp, saved);
+            for (auto& move : moves) {
+                if (move.second == saved) move.second = temp;
+            }
+        }
+    }
+
+    void decode(const BasicBlock& bb, const Instruction& inst, const Instruction* following) {
+        switch (inst.op) {
+            case Opcode::Alloca:
+                emit(Alloca, slots.at(inst.result), 0, 0, 0, typeSizeInBytes(inst.type));
+                break;
+            case Opcode::Load:
+                emit(typeSizeInBytes(inst.type) == 8 ? Load64 : Load32, slots.at(inst.result), slot(inst.operands[0]));
+                break;
+            case Opcode::Store:
+                emit(typeSizeInBytes(inst.type) == 8 ? Store64 : Store32, slot(inst.operands[0]),
+                     slot(inst.operands[1]));
+                break;
+            case Opcode::GetElementPtr:
+                address(inst);
+                break;
+            case Opcode::ICmp:
+                // Left to the branch that follows if only it uses the result.
+                if (following && following->op == Opcode::CondBr && following->operands[0] == inst.result &&
+                    uses[inst.result] == 1 && comparison(inst.predicate) <= Ge) {
+                    fused = &inst;
+                    break;
+                }
+                emit(comparison(inst.predicate), slots.at(inst.result), slot(inst.operands[0]),
+                     slot(inst.operands[1]));
+                break;
+            case Opcode::ZExt:
+                emit(Move, slots.at(inst.result), slot(inst.operands[0]));
+                break;
+            case Opcode::Select:
+                emit(Select, slots.at(inst.result), slot(inst.operands[0]), slot(inst.operands[1]),
+                     slot(inst.operands[2]));
+                break;
+            case Opcode::Phi:
+                break;
+            case Opcode::Call:
+                call(inst);
+                break;
+            case Opcode::Br:
+                phiMoves(bb.name, inst.labels[0]);
+                if (inst.labels[0] != nextBlock) jumpTo(inst.labels[0]);
+                break;
+            case Opcode::CondBr: {
+                std::string whenTrue = edge(bb.name, inst.labels[0]);
+                std::string whenFalse = edge(bb.name, inst.labels[1]);
+                if (fused) {
+                    Op op = static_cast<Op>(BranchEq + (comparison(fused->predicate) - Eq));
+                    emit(op, slot(fused->operands[0]), slot(fused->operands[1]));
+                    target(&Insn::c, whenTrue);
+                    target(&Insn::d, whenFalse);
+                    fused = nullptr;
+                } else {
+                    emit(Branch, slot(inst.operands[0]));
+                    target(&Insn::b, whenTrue);
+                    target(&Insn::c, whenFalse);
+                }
+                break;
+            }
+            case Opcode::Ret:
+                if (inst.operands.empty()) {
+                    emit(RetVoid);
+                } else {
+                    emit(Ret, slot(inst.operands[0]));
+                }
+                break;
+            case Opcode::Unreachable:
+                emit(Trap);
+                break;
+            default:
+                emit(binary(inst.op), slots.at(inst.result), slot(inst.operands[0]), slot(inst.operands[1]));
+                break;
+        }
+    }
+
+    // Constant indices go into the displacement; each variable one scales
+    // by its stride, the first into the result and the rest onto it.
+    void address(const Instruction& gep) {
+        int32_t result = slots.at(gep.result);
+        int32_t base = slot(gep.operands[0]);
+        std::string type = gep.type;
+        int64_t disp = 0;
+        std::vector<std::pair<int32_t, int64_t>> terms;
+        for (size_t k = 1; k < gep.operands.size(); ++k) {
+            if (k > 1) type = arrayElementType(type);
+            int64_t stride = typeSizeInBytes(type);
+            if (isConstantOperand(gep.operands[k])) {
+                disp += constantValue(gep.operands[k]) * stride;
+            } else {
+                terms.push_back({slot(gep.operands[k]), stride});
+            }
+        }
+        if (terms.empty()) {
+            emit(Offset, result, base, 0, 0, disp);
+            return;
+        }
+        for (size_t i = 0; i < terms.size(); ++i) {
+            emit(Index, result, i == 0 ? base : result, terms[i].first, i == 0 ? static_cast<int32_t>(disp) : 0,
+                 terms[i].second);
+        }
+    }
+
+    void call(const Instruction& inst) {
+        int32_t result = inst.result.empty() ? -1 : slots.at(inst.result);
+        int32_t first = static_cast<int32_t>(out.args.size());
+        for (const auto& operand : inst.operands) out.args.push_back(slot(operand));
+        int32_t count = static_cast<int32_t>(inst.operands.size());
+        auto it = linkage.functions.find(inst.callee);
+        if (it != linkage.functions.end()) {
+            emit(Call, result, it->second, first, count);
+            return;
+        }
+        auto builtin = linkage.builtins.find(inst.callee);
+        if (builtin == linkage.builtins.end()) throw std::runtime_error("interpreter: undefined function " + inst.callee);
+        emit(CallBuiltin, result, builtin->second, first, count);
+    }
+
+    const Function& f;
+    const Linkage& linkage;
+    const std::vector<LoopEntry>& loops;
+    DecodedFunction& out;
+    int32_t next = 0;
+    std::map<std::string, const BasicBlock*> blocks;
+    std::map<std::string, int32_t> slots;
+    std::map<int64_t, int32_t> constantSlots;
+    std::map<int32_t, int64_t> constantValues;
+    std::map<std::string, int> uses;
+    std::set<std::string> phiBlocks;
+    std::set<std::pair<std::string, std::string>> edges;
+    std::map<std::string, int32_t> labels;
+    std::vector<Fixup> fixups;
+    std::string nextBlock;
+    const Instruction* fused = nullptr;
+};
+
+int64_t wrap(uint32_t value) {
+    return static_cast<int32_t>(value);
+}
+
+constexpr size_t kSlotStack = size_t(1) << 24;    // Slots, for all active calls
+constexpr size_t kMemoryStack = size_t(1) << 26;  // Bytes of allocas
+
+} // namespace
+
+struct Interpreter::Program {
+    TierUp* tierUp = nullptr;
+    Linkage linkage;
+    std::vector<DecodedFunction> functions;
+    std::vector<Builtin> builtins;
+    std::unique_ptr<uint64_t[]> globals;
+    std::unique_ptr<int64_t[]> slotStack;
+    std::unique_ptr<uint64_t[]> memoryStack;
+    int main = -1;
+};
+
+Interpreter::Interpreter(const Module& m, TierUp* tierUp) : program(std::make_unique<Program>()) {
+    Linkage& linkage = program->linkage;
+    program->tierUp = tierUp;
+
+    // Globals, laid out as in the object files.
+    size_t size = 0;
+    std::vector<size_t> offsets;
+    for (const auto& g : m.globals) {
+        size_t bytes = typeSizeInBytes(g.type);
+        size_t alignment = bytes >= 16 ? 16 : 8;
+        size = (size + alignment - 1) / alignment * alignment;
+        offsets.push_back(size);
+        size += bytes;
+    }
+    uint8_t* base;
+    if (tierUp) {
+        base = static_cast<uint8_t*>(tierUp->allocateGlobals(size));
+    } else {
+        program->globals.reset(new uint64_t[size / 8 + 1]());
+        base = reinterpret_cast<uint8_t*>(program->globals.get());
+    }
+    for (size_t i = 0; i < m.globals.size(); ++i) {
+        const GlobalVariable& g = m.globals[i];
+        if (!g.zeroInit && !g.init.empty()) std::memcpy(base + offsets[i], g.init.data(), 4 * g.init.size());
+        linkage.globals[g.name] = reinterpret_cast<int64_t>(base + offsets[i]);
+    }
+
+    for (const auto& f : m.functions) {
+        if (f->isDeclaration) {
+            auto it = builtins().find(f->name);
+            if (it == builtins().end()) continue;
+            linkage.builtins[f->name] = static_cast<int>(program->builtins.size());
+            program->builtins.push_back(it->second);
+            continue;
+        }
+        if (f->name == "main") program->main = static_cast<int>(linkage.functions.size());
+        linkage.functions[f->name] = static_cast<int>(linkage.functions.size());
+    }
+    program->functions.resize(linkage.functions.size());
+    for (const auto& f : m.functions) {
+        if (f->isDeclaration) continue;
+        std::vector<LoopEntry> loops;
+        if (tierUp) loops = tierUp->loopEntries(f->name);
+        FunctionDecoder(*f, linkage, loops, program->functions[linkage.functions.at(f->name)]).decode();
+    }
+}
+
+Interpreter::~Interpreter() = default;
+
+void* Interpreter::globalAddress(const std::string& name) const {
+    auto it = program->linkage.globals.find(name);
+    return it == program->linkage.globals.end() ? nullptr : reinterpret_cast<void*>(it->second);
+}
+
+int Interpreter::run() {
+    if (program->main < 0) throw std::runtime_error("interpreter: the program has no main");
+
+    // Slots of the calls in progress lie one after another, as do their
+    // allocas; returning pops both.
+    if (!program->slotStack) program->slotStack.reset(new int64_t[kSlotStack]);
+    if (!program->memoryStack) program->memoryStack.reset(new uint64_t[kMemoryStack / 8]);
+    int64_t* const slotLimit = program->slotStack.get() + kSlotStack;
+    uint8_t* const memoryLimit = reinterpret_cast<uint8_t*>(program->memoryStack.get()) + kMemoryStack;
+
+    struct Frame {
+        DecodedFunction* function;
+        const Insn* pc;        // Where to go on
+        int64_t* regs;
+        uint8_t* memory;
+        int32_t result;        // Slot of the caller for the result, or -1
+    };
+    std::vector<Frame> frames;
+    frames.reserve(1024);
+    const std::vector<Builtin>& builtins = program->builtins;
+    TierUp* const tierUp = program->tierUp;
+
+#if INTERPRETER_THREADED
+    static const void* const handlers[] = {
+#define X(name) &&Label##name,
+        FOR_EACH_OP(X)
+#undef X
+    };
+    for (auto& function : program->functions) {
+        for (auto& insn : function.code) insn.handler = handlers[insn.op];
+    }
+#endif
+    // Switches every call of a function that turned hot to its native code.
+    auto promote = [&](int32_t index) {
+        DecodedFunction& callee = program->functions[index];
+        if (callee.params <= TierUp::kMaxNativeArgs) callee.native = tierUp->compileFunction(callee.name);
+        if (!callee.native) return false;
+        for (auto& function : program->functions) {
+            for (auto& insn : function.code) {
+                if (insn.op != Call || insn.b != index) continue;
+                insn.op = CallNative;
+#if INTERPRETER_THREADED
+                insn.handler = handlers[CallNative];
+#endif
+            }
+        }
+        return true;
+    };
+
+#if INTERPRETER_THREADED
+#define OP(name) Label##name:
+#define DISPATCH() goto *pc->handler
+#else
+#define OP(name) case name:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() \
+    do { \
+        ++pc; \
+        DISPATCH(); \
+    } while (0)
+#define JUMP(offset) \
+    do { \
+        pc = code + (offset); \
+        DISPATCH(); \
+    } while (0)
+#define BINARY(name, expr) \
+    OP(name) { \
+        uint32_t x = static_cast<uint32_t>(regs[pc->b]); \
+        uint32_t y = static_cast<uint32_t>(regs[pc->c]); \
+        (void)x; \
+        (void)y; \
+        regs[pc->a] = (expr); \
+        NEXT(); \
+    }
+#define COMPARE(name, type, op) \
+    OP(name) { \
+        regs[pc->a] = static_cast<type>(regs[pc->b]) op static_cast<type>(regs[pc->c]); \
+        NEXT(); \
+    }
+#define BRANCH(name, op) \
+    OP(name) { \
+        JUMP(regs[pc->a] op regs[pc->b] ? pc->c : pc->d); \
+    }
+
+    DecodedFunction* function = &program->functions[program->main];
+    int64_t value = 0;                  // Being returned
+    const Insn* code = function->code.data();
+    const Insn* pc = code;
+    int64_t* regs = program->slotStack.get();
+    uint8_t* memory = reinterpret_cast<uint8_t*>(program->memoryStack.get());
+    if (function->slots > static_cast<int>(kSlotStack)) throw std::runtime_error("interpreter: stack overflow");
+    std::copy(function->constants.begin(), function->constants.end(), regs + function->firstConstant);
+    runtime::reset();
+
+#if INTERPRETER_THREADED
+    DISPATCH();
+#else
+dispatch:
+    switch (pc->op) {
+#endif
+    OP(Move) {
+        regs[pc->a] = regs[pc->b];
+        NEXT();
+    }
+    BINARY(Add, wrap(x + y))
+    BINARY(Sub, wrap(x - y))
+    BINARY(Mul, wrap(x * y))
+    OP(SDiv)
+    OP(SRem) {
+        int32_t x = static_cast<int32_t>(regs[pc->b]);
+        int32_t y = static_cast<int32_t>(regs[pc->c]);
+        if (y == 0) throw std::runtime_error("interpreter: division by zero");
+        // INT_MIN / -1 wraps instead of trapping.
+        if (y == -1) {
+            regs[pc->a] = pc->op == SDiv ? wrap(0u - static_cast<uint32_t>(x)) : 0;
+        } else {
+            regs[pc->a] = pc->op == SDiv ? x / y : x % y;
+        }
+        NEXT();
+    }
+    BINARY(Shl, wrap(x << (y & 31)))
+    BINARY(AShr, static_cast<int32_t>(x) >> (y & 31))
+    BINARY(LShr, wrap(x >> (y & 31)))
+    BINARY(And, wrap(x & y))
+    BINARY(Or, wrap(x | y))
+    BINARY(Xor, wrap(x ^ y))
+    COMPARE(Eq, int64_t, ==)
+    COMPARE(Ne, int64_t, !=)
+    COMPARE(Lt, int64_t, <)
+    COMPARE(Le, int64_t, <=)
+    COMPARE(Gt, int64_t, >)
+    COMPARE(Ge, int64_t, >=)
+    COMPARE(ULt, uint32_t, <)
+    COMPARE(ULe, uint32_t, <=)
+    COMPARE(UGt, uint32_t, >)
+    COMPARE(UGe, uint32_t, >=)
+    OP(Select) {
+        regs[pc->a] = regs[pc->b] ? regs[pc->c] : regs[pc->d];
+        NEXT();
+    }
+    OP(Load32) {
+        regs[pc->a] = *reinterpret_cast<const int32_t*>(regs[pc->b]);
+        NEXT();
+    }
+    OP(Load64) {
+        regs[pc->a] = *reinterpret_cast<const int64_t*>(regs[pc->b]);
+        NEXT();
+    }
+    OP(Store32) {
+        *reinterpret_cast<int32_t*>(regs[pc->b]) = static_cast<int32_t>(regs[pc->a]);
+        NEXT();
+    }
+    OP(Store64) {
+        *reinterpret_cast<int64_t*>(regs[pc->b]) = regs[pc->a];
+        NEXT();
+    }
+    OP(Alloca) {
+        size_t bytes = (static_cast<size_t>(pc->imm) + 15) & ~size_t(15);
+        if (static_cast<size_t>(memoryLimit - memory) < bytes) throw std::runtime_error("interpreter: stack overflow");
+        regs[pc->a] = reinterpret_cast<int64_t>(memory);
+        memory += bytes;
+        NEXT();
+    }
+    OP(Offset) {
+        regs[pc->a] = regs[pc->b] + pc->imm;
+        NEXT();
+    }
+    OP(Index) {
+        regs[pc->a] = regs[pc->b] + regs[pc->c] * pc->imm + pc->d;
+        NEXT();
+    }
+    OP(Jump) {
+        JUMP(pc->a);
+    }
+    OP(Branch) {
+        JUMP(regs[pc->a] ? pc->b : pc->c);
+    }
+    BRANCH(BranchEq, ==)
+    BRANCH(BranchNe, !=)
+    BRANCH(BranchLt, <)
+    BRANCH(BranchLe, <=)
+    BRANCH(BranchGt, >)
+    BRANCH(BranchGe, >=)
+    OP(Call) {
+        DecodedFunction* callee = &program->functions[pc->b];
+        // Again, as a native call, if it just turned hot.
+        if (tierUp && ++callee->calls == kCallThreshold && promote(pc->b)) DISPATCH();
+        int64_t* calleeRegs = regs + function->slots;
+        if (callee->slots > slotLimit - calleeRegs) throw std::runtime_error("interpreter: stack overflow");
+        const int32_t* args = function->args.data() + pc->c;
+        for (int32_t i = 0; i < pc->d; ++i) calleeRegs[i] = regs[args[i]];
+        std::copy(callee->constants.begin(), callee->constants.end(), calleeRegs + callee->firstConstant);
+        frames.push_back({function, pc + 1, regs, memory, pc->a});
+        function = callee;
+        regs = calleeRegs;
+        code = callee->code.data();
+        pc = code;
+        DISPATCH();
+    }
+    OP(CallNative) {
+        int64_t result = callNative(program->functions[pc->b].native, regs, function->args.data() + pc->c, pc->d);
+        if (pc->a >= 0) regs[pc->a] = result;
+        NEXT();
+    }
+    OP(CallBuiltin) {
+        int64_t result = builtins[pc->b](regs, function->args.data() + pc->c, pc->d);
+        if (pc->a >= 0) regs[pc->a] = result;
+        NEXT();
+    }
+    OP(LoopHeader) {
+        DecodedFunction::Loop& loop = function->loops[pc->a];
+        if (!loop.native) {
+            if (loop.failed || ++loop.iterations < kLoopThreshold) NEXT();
+            loop.native = tierUp->compileLoop(function->name, loop.header);
+            if (!loop.native) {
+                loop.failed = true;
+                NEXT();
+            }
+        }
+        // The native code finishes the call.
+        value = callNative(loop.native, regs, loop.liveIns.data(), static_cast<int>(loop.liveIns.size()));
+        goto leave;
+    }
+    OP(LoopCount) {
+        ++function->loops[pc->a].iterations;
+        NEXT();
+    }
+    OP(Ret)
+    OP(RetVoid) {
+        value = pc->op == Ret ? regs[pc->a] : 0;
+        goto leave;
+    }
+    OP(Trap) {
+        throw std::runtime_error("interpreter: reached unreachable code");
+    }
+#if !INTERPRETER_THREADED
+    }
+    throw std::logic_error("interpreter: unknown op");
+#endif
+
+leave:
+    if (frames.empty()) {
+        runtime::finish();
+        return static_cast<int>(value);
+    }
+    const Frame& caller = frames.back();
+    function = caller.function;
+    code = function->code.data();
+    pc = caller.pc;
+    regs = caller.regs;
+    memory = caller.memory;
+    if (caller.result >= 0) regs[caller.result] = value;
+    frames.pop_back();
+    DISPATCH();
+
+#undef OP
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef BINARY
+#undef COMPARE
+#undef BRANCH
+}
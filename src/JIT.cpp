@@ -0,0 +1,154 @@
+#include "JIT.h"
+#include "Runtime.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+uint64_t alignTo(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// jmp *0(%rip), followed by the 64-bit target, padded to 16 bytes.
+constexpr size_t kStubSize = 16;
+
+constexpr uint32_t R_X86_64_PC32 = 2;
+
+uint64_t pageSize() {
+    return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+} // namespace
+
+CodeArena::CodeArena(size_t reserve) : reserved(reserve) {
+    void* mapped = mmap(nullptr, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapped == MAP_FAILED) throw std::runtime_error("jit: cannot reserve memory");
+    base = static_cast<uint8_t*>(mapped);
+}
+
+CodeArena::~CodeArena() {
+    munmap(base, reserved);
+}
+
+uint8_t* CodeArena::allocate(size_t bytes) {
+    bytes = std::max<uint64_t>(alignTo(bytes, pageSize()), pageSize());
+    if (bytes > reserved - used) throw std::runtime_error("jit: code arena exhausted");
+    uint8_t* memory = base + used;
+    if (mprotect(memory, bytes, PROT_READ | PROT_WRITE) != 0) throw std::runtime_error("jit: cannot map memory");
+    used += bytes;
+    return memory;
+}
+
+LoadedObject::LoadedObject(const ObjectFile& obj, const Resolver& resolve, CodeArena* arena) {
+    const auto& symbols = obj.allSymbols();
+    std::vector<size_t> stubOf(symbols.size(), SIZE_MAX);
+    size_t stubs = 0;
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        if (symbols[i].section < 0) stubOf[i] = stubs++;
+    }
+
+    // Text and stubs, then the read-only data and then the writable data,
+    // each section group on pages of its own for its protection.
+    const uint64_t page = pageSize();
+    uint64_t start[ObjectFile::NumSections];
+    start[ObjectFile::Text] = 0;
+    uint64_t stubStart = alignTo(obj.size(ObjectFile::Text), kStubSize);
+    start[ObjectFile::Rodata] = alignTo(stubStart + stubs * kStubSize, page);
+    start[ObjectFile::Data] = alignTo(start[ObjectFile::Rodata] + obj.size(ObjectFile::Rodata), page);
+    start[ObjectFile::Bss] = alignTo(start[ObjectFile::Data] + obj.size(ObjectFile::Data),
+                                     obj.alignment(ObjectFile::Bss));
+    length = std::max<uint64_t>(alignTo(start[ObjectFile::Bss] + obj.size(ObjectFile::Bss), page), page);
+
+    if (arena) {
+        memory = arena->allocate(length);
+    } else {
+        void* region = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) throw std::runtime_error("jit: cannot map memory");
+        memory = static_cast<uint8_t*>(region);
+        mapped = true;
+    }
+    for (int s = 0; s < ObjectFile::NumSections; ++s) {
+        const auto& bytes = obj.contents(static_cast<ObjectFile::Section>(s));
+        if (s != ObjectFile::Bss && !bytes.empty()) std::memcpy(memory + start[s], bytes.data(), bytes.size());
+    }
+
+    // Calls go to `addresses`, data references to `targets`; they differ
+    // for symbols outside the object.
+    std::vector<uint8_t*> addresses(symbols.size());
+    std::vector<uint8_t*> targets(symbols.size());
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const ObjectFile::Symbol& sym = symbols[i];
+        if (sym.section >= 0) {
+            addresses[i] = targets[i] = memory + start[sym.section] + sym.offset;
+            defined[sym.name] = addresses[i];
+            continue;
+        }
+        void* target = resolve(sym.name);
+        if (!target) {
+            release();
+            throw std::runtime_error("jit: undefined symbol " + sym.name);
+        }
+        uint8_t* stub = memory + stubStart + stubOf[i] * kStubSize;
+        const uint8_t jump[] = {0xff, 0x25, 0, 0, 0, 0};
+        std::memcpy(stub, jump, sizeof(jump));
+        std::memcpy(stub + sizeof(jump), &target, sizeof(target));
+        addresses[i] = stub;
+        targets[i] = static_cast<uint8_t*>(target);
+    }
+
+    // Every relocation of the encoder is S + A - P into a 32-bit field.
+    for (const auto& r : obj.textRelocations()) {
+        uint8_t* place = memory + r.offset;
+        uint8_t* symbol = r.type == R_X86_64_PC32 ? targets[r.symbol] : addresses[r.symbol];
+        int64_t value = reinterpret_cast<int64_t>(symbol) + r.addend - reinterpret_cast<int64_t>(place);
+        if (value < INT32_MIN || value > INT32_MAX) {
+            release();
+            throw std::runtime_error("jit: relocation out of range");
+        }
+        int32_t field = static_cast<int32_t>(value);
+        std::memcpy(place, &field, sizeof(field));
+    }
+
+    mprotect(memory, start[ObjectFile::Rodata], PROT_READ | PROT_EXEC);
+    if (start[ObjectFile::Data] > start[ObjectFile::Rodata]) {
+        mprotect(memory + start[ObjectFile::Rodata], start[ObjectFile::Data] - start[ObjectFile::Rodata], PROT_READ);
+    }
+}
+
+LoadedObject::~LoadedObject() {
+    release();
+}
+
+void LoadedObject::release() {
+    if (mapped) munmap(memory, length);
+    mapped = false;
+}
+
+void* LoadedObject::address(const std::string& name) const {
+    auto it = defined.find(name);
+    return it == defined.end() ? nullptr : it->second;
+}
+
+int runInProcess(const Module& m, const CodeGenOptions& options) {
+#if defined(__x86_64__)
+    if (options.arch != CodeGenOptions::Arch::X86_64) {
+        throw std::runtime_error("jit: only x86-64 code runs in-process");
+    }
+    ObjectFile obj = compileObject(m, options);
+    LoadedObject loaded(obj, runtime::lookup);
+    auto entry = reinterpret_cast<int (*)()>(loaded.address("main"));
+    if (!entry) throw std::runtime_error("jit: the program has no main");
+    runtime::reset();
+    int status = entry();
+    runtime::finish();
+    return status;
+#else
+    (void)m;
+    (void)options;
+    throw std::runtime_error("jit: running in-process needs an x86-64 host");
+#endif
+}
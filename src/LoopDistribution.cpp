@@ -0,0 +1,332 @@
+#include "Passes.h"
+#include "LoopInfo.h"
+#include "PassManager.h"
+#include "DependenceAnalysis.h"
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+namespace {
+
+// A group of body instructions that moves to its own loop. Nodes are body
+// instruction indices; header phis are numbered after the body.
+struct Partition {
+    std::vector<size_t> nodes;
+    bool recurrent = false;
+};
+
+struct Candidate {
+    Loop* loop = nullptr;
+    BasicBlock* header = nullptr;
+    BasicBlock* body = nullptr;     // Also the latch
+    InductionVariable iv;
+    std::vector<Instruction*> phis; // Header phis other than the induction variable
+};
+
+size_t findRoot(std::vector<size_t>& parent, size_t x) {
+    while (parent[x] != x) x = parent[x] = parent[parent[x]];
+    return x;
+}
+
+bool usedIn(const BasicBlock* bb, const std::string& value, const Instruction* except = nullptr) {
+    for (const auto& inst : bb->insts) {
+        if (&inst != except && std::count(inst.operands.begin(), inst.operands.end(), value)) return true;
+    }
+    return false;
+}
+
+// Innermost counted loops of two blocks, the header and a body that is also
+// the latch, where the header computes nothing the body reads besides the
+// phis and the body uses the increment only to step.
+bool recognize(const LoopInfo& li, Loop* loop, Candidate& c) {
+    if (!loop->subLoops.empty() || loop->blocks.size() != 2 || !li.preheader(loop)) return false;
+    if (!li.inductionVariable(loop, c.iv)) return false;
+    c.loop = loop;
+    c.header = loop->header;
+    c.body = loop->latch();
+    if (!c.body || c.body == c.header || li.exitingBlocks(loop).size() != 1) return false;
+    if (c.body->terminator()->op != Opcode::Br) return false;
+    for (auto& inst : c.header->insts) {
+        if (inst.op == Opcode::Phi) {
+            if (&inst != c.iv.phi) c.phis.push_back(&inst);
+            continue;
+        }
+        if (inst.isTerminator()) continue;
+        if (inst.op != Opcode::ICmp && inst.op != Opcode::ZExt) return false;
+        if (usedIn(c.body, inst.result)) return false;
+    }
+    return !usedIn(c.body, c.iv.increment->result) &&
+           !std::any_of(c.phis.begin(), c.phis.end(), [&](const Instruction* phi) {
+               return std::count(phi->operands.begin(), phi->operands.end(), c.iv.increment->result) > 0;
+           });
+}
+
+// Splits the loop into strongly connected groups of the dependence graph,
+// ordered so that every dependence between groups runs forward, then merges
+// neighbours of the same kind: what is left alternates between loops with a
+// recurrence and loops whose iterations are independent.
+std::vector<Partition> partition(const DependenceAnalysis& da, const Candidate& c) {
+    std::vector<Instruction*> nodes;
+    for (auto& inst : c.body->insts) {
+        if (&inst != c.iv.increment && !inst.isTerminator()) nodes.push_back(&inst);
+    }
+    size_t bodySize = nodes.size();
+    nodes.insert(nodes.end(), c.phis.begin(), c.phis.end());
+    std::map<std::string, size_t> nodeOf;
+    std::map<const Instruction*, size_t> indexOf;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (!nodes[i]->result.empty()) nodeOf[nodes[i]->result] = i;
+        indexOf[nodes[i]] = i;
+    }
+
+    // Values stay with their users: SSA edges join nodes outright.
+    std::vector<size_t> parent(nodes.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        for (const auto& operand : nodes[i]->operands) {
+            auto it = nodeOf.find(operand);
+            if (it != nodeOf.end()) parent[findRoot(parent, i)] = findRoot(parent, it->second);
+        }
+    }
+    std::vector<size_t> component(nodes.size());
+    std::map<size_t, size_t> componentOfRoot;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        size_t root = findRoot(parent, i);
+        if (!componentOfRoot.count(root)) {
+            size_t id = componentOfRoot.size();
+            componentOfRoot[root] = id;
+        }
+        component[i] = componentOfRoot[root];
+    }
+    size_t n = componentOfRoot.size();
+
+    // Memory dependences order components; carried ones make them recurrent.
+    std::vector<std::set<size_t>> succ(n);
+    std::vector<bool> carried(n, false);
+    std::vector<std::pair<size_t, size_t>> carriedPairs;
+    std::vector<std::string> ivs = da.nestIVs(c.loop);
+    size_t level = ivs.size() - 1;
+    std::vector<MemoryAccess> all = da.accesses(c.loop);
+    for (size_t a = 0; a < all.size(); ++a) {
+        for (size_t b = a; b < all.size(); ++b) {
+            Dependence dep = da.depends(all[a], all[b], ivs, da.outermostLoop(c.loop));
+            if (dep.independent) continue;
+            bool carriedOutside = false;
+            for (size_t l = 0; l < level; ++l) carriedOutside |= !(dep.directions[l] & DirEQ);
+            if (carriedOutside) continue;
+            size_t x = component[indexOf[all[a].inst]], y = component[indexOf[all[b].inst]];
+            unsigned dir = dep.directions[level];
+            if (dir & (DirLT | DirEQ)) succ[x].insert(y);
+            if (dir & DirGT) succ[y].insert(x);
+            if (dir & (DirLT | DirGT)) carriedPairs.push_back({x, y});
+        }
+    }
+    for (size_t i = bodySize; i < nodes.size(); ++i) carried[component[i]] = true;
+
+    // Tarjan's algorithm; merges cycles between components.
+    std::vector<int> index(n, -1), low(n, 0), scc(n, -1);
+    std::vector<bool> onStack(n, false);
+    std::vector<size_t> stack;
+    int counter = 0, sccCount = 0;
+    std::function<void(size_t)> visit = [&](size_t v) {
+        index[v] = low[v] = counter++;
+        stack.push_back(v);
+        onStack[v] = true;
+        for (size_t w : succ[v]) {
+            if (index[w] < 0) {
+                visit(w);
+                low[v] = std::min(low[v], low[w]);
+            } else if (onStack[w]) {
+                low[v] = std::min(low[v], index[w]);
+            }
+        }
+        if (low[v] == index[v]) {
+            size_t w;
+            do {
+                w = stack.back();
+                stack.pop_back();
+                onStack[w] = false;
+                scc[w] = sccCount;
+            } while (w != v);
+            ++sccCount;
+        }
+    };
+    for (size_t v = 0; v < n; ++v) {
+        if (index[v] < 0) visit(v);
+    }
+
+    std::vector<Partition> groups(sccCount);
+    std::vector<size_t> firstNode(sccCount, nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        size_t g = scc[component[i]];
+        groups[g].nodes.push_back(i);
+        firstNode[g] = std::min(firstNode[g], i);
+        groups[g].recurrent = groups[g].recurrent || carried[component[i]];
+    }
+    for (const auto& [x, y] : carriedPairs) {
+        if (scc[x] == scc[y]) groups[scc[x]].recurrent = true;
+    }
+
+    // Topological order, keeping the original order where it is free.
+    std::vector<std::set<size_t>> edges(sccCount);
+    std::vector<int> inDegree(sccCount, 0);
+    for (size_t v = 0; v < n; ++v) {
+        for (size_t w : succ[v]) {
+            if (scc[v] != scc[w] && edges[scc[v]].insert(scc[w]).second) ++inDegree[scc[w]];
+        }
+    }
+    std::vector<Partition> ordered;
+    std::set<std::pair<size_t, size_t>> ready;  // (first node, group)
+    for (int g = 0; g < sccCount; ++g) {
+        if (inDegree[g] == 0) ready.insert({firstNode[g], g});
+    }
+    while (!ready.empty()) {
+        size_t g = ready.begin()->second;
+        ready.erase(ready.begin());
+        if (!ordered.empty() && ordered.back().recurrent == groups[g].recurrent) {
+            auto& merged = ordered.back().nodes;
+            merged.insert(merged.end(), groups[g].nodes.begin(), groups[g].nodes.end());
+        } else {
+            ordered.push_back(groups[g]);
+        }
+        for (size_t w : edges[g]) {
+            if (--inDegree[w] == 0) ready.insert({firstNode[w], w});
+        }
+    }
+    for (auto& p : ordered) std::sort(p.nodes.begin(), p.nodes.end());
+    return ordered;
+}
+
+void renameOperands(Instruction& inst, const std::map<std::string, std::string>& names) {
+    for (auto& operand : inst.operands) {
+        auto it = names.find(operand);
+        if (it != names.end()) operand = it->second;
+    }
+}
+
+// Leaves the first partition in the original loop and gives each later one a
+// copy of the loop control, chained on the exit edge:
+//   H -> H2 -> ... -> Hn -> exit
+// Moved instructions keep their names; only the induction variable and the
+// exit test are fresh in each copy.
+void distribute(Function& f, const LoopInfo& li, Candidate& c, const std::vector<Partition>& parts) {
+    std::vector<Instruction*> bodyInsts;
+    for (auto& inst : c.body->insts) {
+        if (&inst != c.iv.increment && !inst.isTerminator()) bodyInsts.push_back(&inst);
+    }
+    auto nodeInst = [&](size_t i) { return i < bodyInsts.size() ? bodyInsts[i] : c.phis[i - bodyInsts.size()]; };
+
+    BasicBlock* pre = li.preheader(c.loop);
+    std::string exit = c.header->terminator()->labels[1];
+    std::string prevHeader = c.header->name;
+    std::vector<std::unique_ptr<BasicBlock>> created;
+    std::set<const Instruction*> moved;
+    for (size_t j = 1; j < parts.size(); ++j) {
+        auto header = std::make_unique<BasicBlock>(f.newBlockName());
+        auto body = std::make_unique<BasicBlock>(f.newBlockName());
+        std::string iv = f.newReg(), next = f.newReg();
+        std::map<std::string, std::string> names = {{c.iv.phi->result, iv}};
+
+        Instruction phi = *c.iv.phi;
+        phi.result = iv;
+        for (size_t k = 0; k < phi.operands.size(); ++k) {
+            if (phi.labels[k] == pre->name) {
+                phi.labels[k] = prevHeader;
+            } else {
+                phi.operands[k] = next;
+                phi.labels[k] = body->name;
+            }
+        }
+        header->insts.push_back(phi);
+        for (size_t i : parts[j].nodes) {
+            Instruction* inst = nodeInst(i);
+            if (inst->op != Opcode::Phi) continue;
+            Instruction copy = *inst;
+            renameOperands(copy, names);
+            for (auto& label : copy.labels) label = label == pre->name ? prevHeader : body->name;
+            header->insts.push_back(copy);
+            moved.insert(inst);
+        }
+        for (const auto& inst : c.header->insts) {
+            if (inst.op == Opcode::Phi || inst.isTerminator()) continue;
+            Instruction copy = inst;
+            renameOperands(copy, names);
+            copy.result = names[inst.result] = f.newReg();
+            header->insts.push_back(copy);
+        }
+        Instruction branch = *c.header->terminator();
+        renameOperands(branch, names);
+        branch.labels = {body->name, exit};
+        header->insts.push_back(branch);
+
+        for (size_t i : parts[j].nodes) {
+            Instruction* inst = nodeInst(i);
+            if (inst->op == Opcode::Phi) continue;
+            Instruction copy = *inst;
+            renameOperands(copy, names);
+            body->insts.push_back(copy);
+            moved.insert(inst);
+        }
+        Instruction step = *c.iv.increment;
+        step.result = next;
+        renameOperands(step, names);
+        body->insts.push_back(step);
+        body->insts.push_back(makeBr(header->name));
+
+        // The previous loop now leaves into this one.
+        BasicBlock* prev = created.empty() ? c.header : created[created.size() - 2].get();
+        prev->terminator()->labels[1] = header->name;
+        prevHeader = header->name;
+        created.push_back(std::move(header));
+        created.push_back(std::move(body));
+    }
+
+    for (BasicBlock* bb : {c.header, c.body}) {
+        auto& insts = bb->insts;
+        insts.erase(std::remove_if(insts.begin(), insts.end(),
+                                   [&](const Instruction& i) { return moved.count(&i) > 0; }),
+                    insts.end());
+    }
+    for (auto& inst : li.block(exit)->insts) {
+        if (inst.op != Opcode::Phi) break;
+        for (auto& label : inst.labels) {
+            if (label == c.header->name) label = prevHeader;
+        }
+    }
+    auto after = std::find_if(f.blocks.begin(), f.blocks.end(),
+                              [&](const std::unique_ptr<BasicBlock>& b) { return b.get() == c.loop->blocks.back(); });
+    f.blocks.insert(after + 1, std::make_move_iterator(created.begin()), std::make_move_iterator(created.end()));
+}
+
+} // namespace
+
+bool distributeLoops(Function& f, AnalysisManager& am) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    Module& m = am.getModule();
+    const AliasAnalysis& aa = am.alias();
+    bool changed = false;
+    std::set<std::string> done;  // Headers already considered
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        const LoopInfo& li = am.loops(f);
+        DependenceAnalysis da(m, f, li, aa);
+        for (Loop* loop : li.loopsInPostOrder()) {
+            if (done.count(loop->header->name)) continue;
+            done.insert(loop->header->name);
+            Candidate c;
+            if (!recognize(li, loop, c) || da.hasOpaqueCalls(loop)) continue;
+
+            // Only a mix pays for the extra loop control: the parallel loops
+            // can then be vectorized without the recurrence holding them back.
+            std::vector<Partition> parts = partition(da, c);
+            if (parts.size() < 2) continue;
+
+            distribute(f, li, c, parts);
+            am.invalidate(f, PreservePurity);
+            changed = progress = true;
+            break;
+        }
+    }
+    return changed;
+}
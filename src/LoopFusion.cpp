@@ -0,0 +1,235 @@
+#include "Passes.h"
+#include "LoopInfo.h"
+#include "PassManager.h"
+#include "DependenceAnalysis.h"
+#include <algorithm>
+
+namespace {
+
+bool onlyPhisAndConditionCode(const BasicBlock* header) {
+    for (const auto& inst : header->insts) {
+        if (inst.isTerminator() || inst.op == Opcode::Phi) continue;
+        if (inst.op != Opcode::ICmp && inst.op != Opcode::ZExt) return false;
+    }
+    return true;
+}
+
+bool sameIterationSpace(const InductionVariable& a, const InductionVariable& b) {
+    return a.init == b.init && a.bound == b.bound && a.step == b.step &&
+           a.compare->predicate == b.compare->predicate;
+}
+
+bool sharesArray(const std::vector<MemoryAccess>& a, const std::vector<MemoryAccess>& b) {
+    for (const auto& x : a) {
+        for (const auto& y : b) {
+            if (x.base == y.base) return true;
+        }
+    }
+    return false;
+}
+
+// Everything `second` computes from `first` other than its memory, which
+// fusion would hand over half-finished.
+bool usesValuesOf(const LoopInfo& li, const Loop* first, const Loop* second) {
+    for (BasicBlock* bb : second->blocks) {
+        for (const auto& inst : bb->insts) {
+            for (const auto& operand : inst.operands) {
+                BasicBlock* def = li.definingBlock(operand);
+                if (def && first->contains(def)) return true;
+            }
+        }
+    }
+    return false;
+}
+
+// After fusion iteration k of `second` runs right after iteration k of
+// `first` instead of after all of `first`, so no access of `second` may
+// touch what a later iteration of `first` accesses.
+bool fusionIsLegal(const DependenceAnalysis& da, const LoopInfo& li, const Loop* first,
+                   const Loop* second, const InductionVariable& ivFirst, const InductionVariable& ivSecond) {
+    std::vector<std::string> ivs = da.nestIVs(first);
+    const Loop* outermost = da.outermostLoop(first);
+    std::vector<MemoryAccess> before = da.accesses(first);
+    std::vector<MemoryAccess> after = da.accesses(second);
+    for (auto& access : after) {
+        // Both loops step through the same values, so the second induction
+        // variable can be read as the first.
+        if (!li.isInvariant(second, access.base)) return false;
+        for (auto& subscript : access.subscripts) {
+            auto it = subscript.coeffs.find(ivSecond.phi->result);
+            if (it != subscript.coeffs.end()) {
+                subscript.coeffs[ivFirst.phi->result] += it->second;
+                subscript.coeffs.erase(ivSecond.phi->result);
+            }
+            for (const auto& [v, c] : subscript.coeffs) {
+                if (v != ivFirst.phi->result && !li.isInvariant(second, v)) return false;
+            }
+        }
+    }
+    size_t level = ivs.size() - 1;
+    for (const auto& src : before) {
+        for (const auto& dst : after) {
+            Dependence dep = da.depends(src, dst, ivs, outermost);
+            if (dep.independent) continue;
+            bool carriedOutside = false;
+            for (size_t l = 0; l < level; ++l) carriedOutside |= !(dep.directions[l] & DirEQ);
+            if (!carriedOutside && (dep.directions[level] & DirGT)) return false;
+        }
+    }
+    return true;
+}
+
+void removeBlocks(Function& f, const std::set<BasicBlock*>& dead) {
+    f.blocks.erase(std::remove_if(f.blocks.begin(), f.blocks.end(),
+                                  [&](const std::unique_ptr<BasicBlock>& bb) { return dead.count(bb.get()); }),
+                   f.blocks.end());
+}
+
+void relabelPhis(BasicBlock* bb, const std::string& from, const std::string& to) {
+    for (auto& inst : bb->insts) {
+        if (inst.op != Opcode::Phi) break;
+        for (auto& label : inst.labels) {
+            if (label == from) label = to;
+        }
+    }
+}
+
+// Runs the body of `second` at the end of every iteration of `first`:
+//   first latch -> second body -> second latch -> first header
+// The second loop's header, with its induction variable and exit test, and
+// the block between the loops disappear.
+void fuse(Function& f, const LoopInfo& li, Loop* first, Loop* second, InductionVariable& ivFirst,
+          InductionVariable& ivSecond) {
+    BasicBlock* header = first->header;
+    BasicBlock* latch = first->latch();
+    BasicBlock* between = li.preheader(second);
+    BasicBlock* secondHeader = second->header;
+    BasicBlock* secondLatch = second->latch();
+    BasicBlock* secondBody = li.block(secondHeader->terminator()->labels[0]);
+    BasicBlock* exit = li.block(secondHeader->terminator()->labels[1]);
+    BasicBlock* pre = li.preheader(first);
+    // Inserting phis below moves the header's instructions.
+    std::string iv = ivFirst.phi->result;
+    std::string oldIV = ivSecond.phi->result;
+    std::string increment = ivSecond.increment->result;
+
+    // Carried values of both loops now come around from the second latch.
+    relabelPhis(header, latch->name, secondLatch->name);
+    std::vector<Instruction> moved;
+    for (auto& inst : secondHeader->insts) {
+        if (inst.op != Opcode::Phi || &inst == ivSecond.phi) continue;
+        Instruction phi = inst;
+        for (auto& label : phi.labels) {
+            if (label == between->name) label = pre->name;
+        }
+        moved.push_back(phi);
+    }
+    auto firstNonPhi = std::find_if(header->insts.begin(), header->insts.end(),
+                                    [](const Instruction& i) { return i.op != Opcode::Phi; });
+    header->insts.insert(firstNonPhi, moved.begin(), moved.end());
+
+    *latch->terminator() = makeBr(secondBody->name);
+    relabelPhis(secondBody, secondHeader->name, latch->name);
+    for (auto& label : secondLatch->terminator()->labels) {
+        if (label == secondHeader->name) label = header->name;
+    }
+    header->terminator()->labels[1] = exit->name;
+    relabelPhis(exit, secondHeader->name, header->name);
+
+    auto& insts = secondLatch->insts;
+    insts.erase(std::remove_if(insts.begin(), insts.end(),
+                               [&](const Instruction& i) { return i.result == increment; }),
+                insts.end());
+    // The surviving increment moves to the new latch, where induction
+    // variable recognition looks for it.
+    Instruction step = *ivFirst.increment;
+    auto& firstInsts = latch->insts;
+    firstInsts.erase(firstInsts.begin() + (ivFirst.increment - firstInsts.data()));
+    insts.insert(insts.end() - 1, step);
+    removeBlocks(f, {between, secondHeader});
+    f.replaceUses({{oldIV, iv}});
+}
+
+} // namespace
+
+bool fuseLoops(Function& f, AnalysisManager& am) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    Module& m = am.getModule();
+    const AliasAnalysis& aa = am.alias();
+    bool changed = false;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        const LoopInfo& li = am.loops(f);
+        DependenceAnalysis da(m, f, li, aa);
+        for (Loop* first : li.loopsInPostOrder()) {
+            InductionVariable ivFirst, ivSecond;
+            if (!li.inductionVariable(first, ivFirst)) continue;
+            std::string exitName = first->header->terminator()->labels[1];
+            BasicBlock* between = li.block(exitName);
+            if (between->insts.size() != 1 || between->insts[0].op != Opcode::Br ||
+                li.predecessors(between).size() != 1 || !li.preheader(first)) {
+                continue;
+            }
+            Loop* second = li.loopFor(li.block(between->terminator()->labels[0]));
+            if (!second || second->header->name != between->terminator()->labels[0] ||
+                second->parent != first->parent || li.preheader(second) != between) {
+                continue;
+            }
+            if (!li.inductionVariable(second, ivSecond) || !sameIterationSpace(ivFirst, ivSecond)) continue;
+            if (li.exitingBlocks(first).size() != 1 || li.exitingBlocks(second).size() != 1) continue;
+            if (first->latches.size() != 1 || second->latches.size() != 1 ||
+                first->latch() == first->header || second->latch() == second->header) {
+                continue;
+            }
+            if (!onlyPhisAndConditionCode(first->header) || !onlyPhisAndConditionCode(second->header)) continue;
+            if (da.hasOpaqueCalls(first) || da.hasOpaqueCalls(second)) continue;
+
+            // The second loop's exit test and step go away with its header, and the
+            // first loop's step moves to the end of the fused body.
+            bool selfContained = true;
+            for (const auto& inst : second->header->insts) {
+                if (inst.op == Opcode::Phi) {
+                    for (size_t i = 0; i < inst.operands.size(); ++i) {
+                        BasicBlock* def = li.definingBlock(inst.operands[i]);
+                        if (inst.labels[i] == between->name && def && (first->contains(def) || def == between)) {
+                            selfContained = false;
+                        }
+                    }
+                    continue;
+                }
+                if (inst.isTerminator()) continue;
+                for (BasicBlock* bb : second->blocks) {
+                    if (bb == second->header) continue;
+                    for (const auto& user : bb->insts) {
+                        if (std::count(user.operands.begin(), user.operands.end(), inst.result)) selfContained = false;
+                    }
+                }
+            }
+            for (auto [loop, iv] : {std::make_pair(first, &ivFirst), std::make_pair(second, &ivSecond)}) {
+                for (BasicBlock* bb : loop->blocks) {
+                    for (const auto& inst : bb->insts) {
+                        if (&inst != iv->phi &&
+                            std::count(inst.operands.begin(), inst.operands.end(), iv->increment->result)) {
+                            selfContained = false;
+                        }
+                    }
+                }
+            }
+            if (!selfContained || usesValuesOf(li, first, second)) continue;
+
+            // Fuse loops that touch the same arrays, and only loops of the
+            // same kind: merging a parallel loop into one with a recurrence
+            // would undo loop distribution.
+            std::vector<MemoryAccess> a = da.accesses(first), b = da.accesses(second);
+            if (!sharesArray(a, b) || da.carriesDependence(first) != da.carriesDependence(second)) continue;
+            if (!fusionIsLegal(da, li, first, second, ivFirst, ivSecond)) continue;
+
+            fuse(f, li, first, second, ivFirst, ivSecond);
+            am.invalidate(f, PreservePurity);
+            changed = progress = true;
+            break;
+        }
+    }
+    return changed;
+}
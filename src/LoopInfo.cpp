@@ -0,0 +1,294 @@
+#include "LoopInfo.h"
+#include <algorithm>
+
+namespace {
+
+bool onlyConditionCode(const BasicBlock* header, const Instruction* phi) {
+    for (const auto& inst : header->insts) {
+        if (&inst == phi || inst.isTerminator()) continue;
+        if (inst.op != Opcode::ICmp && inst.op != Opcode::ZExt) return false;
+    }
+    return true;
+}
+
+bool usedOnlyIn(const Function& f, const std::string& value, const Loop* loop) {
+    for (const auto& bb : f.blocks) {
+        if (loop->contains(bb.get())) continue;
+        for (const auto& inst : bb->insts) {
+            for (const auto& operand : inst.operands) {
+                if (operand == value) return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool usedOnlyBy(const Function& f, const std::string& value, const Instruction* user) {
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (&inst == user) continue;
+            for (const auto& operand : inst.operands) {
+                if (operand == value) return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool Loop::contains(const Loop* other) const {
+    for (; other; other = other->parent) {
+        if (other == this) return true;
+    }
+    return false;
+}
+
+int Loop::depth() const {
+    int d = 1;
+    for (Loop* p = parent; p; p = p->parent) ++d;
+    return d;
+}
+
+LoopInfo::LoopInfo(Function& f) : func(f), ownDominators(std::make_unique<DominatorTree>(f)), dt(*ownDominators) {
+    build();
+}
+
+LoopInfo::LoopInfo(Function& f, const DominatorTree& tree) : func(f), dt(tree) {
+    build();
+}
+
+void LoopInfo::build() {
+    for (auto& bb : func.blocks) {
+        for (auto& inst : bb->insts) {
+            if (!inst.result.empty()) defs[inst.result] = bb.get();
+        }
+    }
+
+    // One loop per header; back edges into the same header share it.
+    std::map<BasicBlock*, Loop*> byHeader;
+    for (BasicBlock* bb : dt.reversePostOrder()) {
+        for (BasicBlock* succ : dt.successors(bb)) {
+            if (!dt.dominates(succ, bb)) continue;
+            Loop*& loop = byHeader[succ];
+            if (!loop) {
+                loops.push_back(std::make_unique<Loop>());
+                loop = loops.back().get();
+                loop->header = succ;
+                loop->blockSet.insert(succ);
+            }
+            loop->latches.push_back(bb);
+            std::vector<BasicBlock*> worklist;
+            if (loop->blockSet.insert(bb).second) worklist.push_back(bb);
+            while (!worklist.empty()) {
+                BasicBlock* cur = worklist.back();
+                worklist.pop_back();
+                for (BasicBlock* pred : dt.predecessors(cur)) {
+                    if (loop->blockSet.insert(pred).second) worklist.push_back(pred);
+                }
+            }
+        }
+    }
+
+    for (auto& loop : loops) {
+        for (auto& bb : func.blocks) {
+            if (loop->blockSet.count(bb.get())) loop->blocks.push_back(bb.get());
+        }
+        auto header = std::find(loop->blocks.begin(), loop->blocks.end(), loop->header);
+        std::rotate(loop->blocks.begin(), header, header + 1);
+    }
+
+    // The parent of a loop is the smallest other loop containing its header.
+    for (auto& loop : loops) {
+        Loop* best = nullptr;
+        for (auto& other : loops) {
+            if (other.get() == loop.get() || !other->blockSet.count(loop->header)) continue;
+            if (!best || other->blockSet.size() < best->blockSet.size()) best = other.get();
+        }
+        loop->parent = best;
+        if (best) {
+            best->subLoops.push_back(loop.get());
+        } else {
+            roots.push_back(loop.get());
+        }
+    }
+    for (auto& loop : loops) {
+        for (BasicBlock* bb : loop->blocks) {
+            auto it = innermost.find(bb);
+            if (it == innermost.end() || it->second->blockSet.size() > loop->blockSet.size()) {
+                innermost[bb] = loop.get();
+            }
+        }
+    }
+
+    // Keep siblings in program order.
+    std::map<BasicBlock*, size_t> position;
+    for (size_t i = 0; i < func.blocks.size(); ++i) position[func.blocks[i].get()] = i;
+    auto byPosition = [&](Loop* a, Loop* b) { return position[a->header] < position[b->header]; };
+    std::sort(roots.begin(), roots.end(), byPosition);
+    for (auto& loop : loops) std::sort(loop->subLoops.begin(), loop->subLoops.end(), byPosition);
+}
+
+std::vector<Loop*> LoopInfo::loopsInPostOrder() const {
+    std::vector<Loop*> order;
+    std::vector<std::pair<Loop*, bool>> stack;
+    for (auto it = roots.rbegin(); it != roots.rend(); ++it) stack.push_back({*it, false});
+    while (!stack.empty()) {
+        auto [loop, expanded] = stack.back();
+        stack.pop_back();
+        if (expanded) {
+            order.push_back(loop);
+            continue;
+        }
+        stack.push_back({loop, true});
+        for (auto it = loop->subLoops.rbegin(); it != loop->subLoops.rend(); ++it) {
+            stack.push_back({*it, false});
+        }
+    }
+    return order;
+}
+
+Loop* LoopInfo::loopFor(const BasicBlock* bb) const {
+    auto it = innermost.find(bb);
+    return it == innermost.end() ? nullptr : it->second;
+}
+
+std::vector<BasicBlock*> LoopInfo::predecessors(BasicBlock* bb) const {
+    return dt.predecessors(bb);
+}
+
+BasicBlock* LoopInfo::preheader(const Loop* loop) const {
+    BasicBlock* outside = nullptr;
+    for (BasicBlock* pred : dt.predecessors(loop->header)) {
+        if (loop->contains(pred)) continue;
+        if (outside) return nullptr;
+        outside = pred;
+    }
+    if (!outside || dt.successors(outside).size() != 1) return nullptr;
+    return outside;
+}
+
+std::vector<BasicBlock*> LoopInfo::exitingBlocks(const Loop* loop) const {
+    std::vector<BasicBlock*> result;
+    for (BasicBlock* bb : loop->blocks) {
+        for (BasicBlock* succ : dt.successors(bb)) {
+            if (!loop->contains(succ)) {
+                result.push_back(bb);
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<BasicBlock*> LoopInfo::exitBlocks(const Loop* loop) const {
+    std::vector<BasicBlock*> result;
+    for (BasicBlock* bb : loop->blocks) {
+        for (BasicBlock* succ : dt.successors(bb)) {
+            if (!loop->contains(succ) && std::find(result.begin(), result.end(), succ) == result.end()) {
+                result.push_back(succ);
+            }
+        }
+    }
+    return result;
+}
+
+BasicBlock* LoopInfo::definingBlock(const std::string& value) const {
+    auto it = defs.find(value);
+    return it == defs.end() ? nullptr : it->second;
+}
+
+bool LoopInfo::isInvariant(const Loop* loop, const std::string& value) const {
+    BasicBlock* def = definingBlock(value);
+    return !def || !loop->contains(def);
+}
+
+bool LoopInfo::inductionVariable(const Loop* loop, InductionVariable& iv) const {
+    BasicBlock* latch = loop->latch();
+    BasicBlock* pre = preheader(loop);
+    Instruction* term = loop->header->terminator();
+    if (!latch || !pre || !term || term->op != Opcode::CondBr) return false;
+    if (!loop->contains(block(term->labels[0])) || loop->contains(block(term->labels[1]))) return false;
+
+    // The frontend tests conditions as "icmp ne (zext (icmp ...)), 0"; look
+    // through that wrapper to the comparison itself.
+    std::map<std::string, Instruction*> local;
+    for (auto& inst : loop->header->insts) {
+        if (!inst.result.empty()) local[inst.result] = &inst;
+    }
+    auto definedHere = [&](const std::string& v) {
+        auto it = local.find(v);
+        return it == local.end() ? nullptr : it->second;
+    };
+    Instruction* cmp = definedHere(term->operands[0]);
+    while (cmp && cmp->op == Opcode::ICmp && cmp->predicate == "ne" && cmp->operands[1] == "0") {
+        Instruction* ext = definedHere(cmp->operands[0]);
+        if (!ext || ext->op != Opcode::ZExt) break;
+        Instruction* inner = definedHere(ext->operands[0]);
+        if (!inner || inner->op != Opcode::ICmp) break;
+        cmp = inner;
+    }
+    if (!cmp || cmp->op != Opcode::ICmp) return false;
+
+    Instruction* phi = definedHere(cmp->operands[0]);
+    if (!phi || phi->op != Opcode::Phi || phi->operands.size() != 2) return false;
+    if (!isInvariant(loop, cmp->operands[1])) return false;
+
+    int fromPre = phi->labels[0] == pre->name ? 0 : 1;
+    if (phi->labels[fromPre] != pre->name || phi->labels[1 - fromPre] != latch->name) return false;
+    Instruction* inc = nullptr;
+    for (auto& inst : latch->insts) {
+        if (inst.result == phi->operands[1 - fromPre]) inc = &inst;
+    }
+    if (!inc || (inc->op != Opcode::Add && inc->op != Opcode::Sub) ||
+        inc->operands[0] != phi->result || !isConstantOperand(inc->operands[1])) {
+        return false;
+    }
+    int step = constantValue(inc->operands[1]);
+    if (inc->op == Opcode::Sub) step = -step;
+    if (step == 0) return false;
+
+    iv.phi = phi;
+    iv.init = phi->operands[fromPre];
+    iv.increment = inc;
+    iv.step = step;
+    iv.compare = cmp;
+    iv.bound = cmp->operands[1];
+    return true;
+}
+
+bool LoopInfo::isPerfectNest(const Loop* outer, InductionVariable& ivOuter,
+                             InductionVariable& ivInner) const {
+    if (outer->subLoops.size() != 1) return false;
+    const Loop* inner = outer->subLoops[0];
+    if (!inductionVariable(outer, ivOuter) || !inductionVariable(inner, ivInner)) return false;
+    if (outer->blocks.size() != inner->blocks.size() + 3) return false;
+
+    BasicBlock* enter = preheader(inner);
+    BasicBlock* step = outer->latch();
+    if (!enter || !outer->contains(enter) || enter->insts.size() != 1) return false;
+    if (block(outer->header->terminator()->labels[0]) != enter) return false;
+    if (step->insts.size() != 2 || ivOuter.increment != &step->insts[0]) return false;
+    auto innerExits = exitingBlocks(inner);
+    auto outerExits = exitingBlocks(outer);
+    if (innerExits.size() != 1 || innerExits[0] != inner->header) return false;
+    if (outerExits.size() != 1 || outerExits[0] != outer->header) return false;
+    if (block(inner->header->terminator()->labels[1]) != step) return false;
+
+    if (!onlyConditionCode(outer->header, ivOuter.phi) || !onlyConditionCode(inner->header, ivInner.phi)) {
+        return false;
+    }
+    for (const auto& inst : outer->header->insts) {
+        if (inst.op == Opcode::Phi && &inst != ivOuter.phi) return false;
+    }
+    for (const auto& inst : inner->header->insts) {
+        if (inst.op == Opcode::Phi && &inst != ivInner.phi) return false;
+    }
+    if (!isInvariant(outer, ivInner.init) || !isInvariant(outer, ivInner.bound)) return false;
+
+    // The induction variables must not be live after the nest, and the next
+    // values only feed their phis.
+    return usedOnlyIn(func, ivOuter.phi->result, outer) && usedOnlyIn(func, ivInner.phi->result, outer) &&
+           usedOnlyBy(func, ivOuter.increment->result, ivOuter.phi) &&
+           usedOnlyBy(func, ivInner.increment->result, ivInner.phi);
+}
@@ -0,0 +1,97 @@
+#include "Passes.h"
+#include "LoopInfo.h"
+#include "PassManager.h"
+#include "DependenceAnalysis.h"
+
+// Consecutive accesses closer than a cache line share it, so an access with
+// stride s in the innermost loop costs min(|s|, kCacheLineBytes) / line per
+// iteration; invariant accesses cost nothing.
+static const long long kCacheLineBytes = 64;
+
+namespace {
+
+long long localityCost(const DependenceAnalysis& da, const std::vector<MemoryAccess>& accesses,
+                       const std::string& innermostIV, int step) {
+    long long cost = 0;
+    for (const auto& access : accesses) {
+        long long s = da.stride(access, innermostIV) * step;
+        if (s < 0) s = -s;
+        cost += s < kCacheLineBytes ? s : kCacheLineBytes;
+    }
+    return cost;
+}
+
+void swapOperands(Instruction& inst, const std::string& a, const std::string& b) {
+    for (auto& operand : inst.operands) {
+        if (operand == a) operand = b;
+        else if (operand == b) operand = a;
+    }
+}
+
+// Exchanges the iteration spaces of the two loops: the outer phi takes the
+// inner loop's start, step and exit test and vice versa, and the body sees
+// each induction variable under the other's name.
+void interchange(const Loop* inner, InductionVariable& ivOuter, InductionVariable& ivInner) {
+    std::string a = ivOuter.phi->result;
+    std::string b = ivInner.phi->result;
+    for (BasicBlock* bb : inner->blocks) {
+        if (bb == inner->header) continue;
+        for (auto& inst : bb->insts) {
+            if (&inst != ivInner.increment) swapOperands(inst, a, b);
+        }
+    }
+
+    for (size_t k = 0; k < ivOuter.phi->operands.size(); ++k) {
+        if (ivOuter.phi->operands[k] == ivOuter.init) ivOuter.phi->operands[k] = ivInner.init;
+    }
+    for (size_t k = 0; k < ivInner.phi->operands.size(); ++k) {
+        if (ivInner.phi->operands[k] == ivInner.init) ivInner.phi->operands[k] = ivOuter.init;
+    }
+
+    auto exchange = [&](Instruction* x, Instruction* y) {
+        Instruction oldX = *x, oldY = *y;
+        *x = oldY;
+        x->result = oldX.result;
+        swapOperands(*x, a, b);
+        *y = oldX;
+        y->result = oldY.result;
+        swapOperands(*y, a, b);
+    };
+    exchange(ivOuter.compare, ivInner.compare);
+    exchange(ivOuter.increment, ivInner.increment);
+}
+
+} // namespace
+
+bool interchangeLoops(Function& f, AnalysisManager& am) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    Module& m = am.getModule();
+    const AliasAnalysis& aa = am.alias();
+    bool changed = false;
+    std::set<std::string> done;  // Outer headers already considered
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        const LoopInfo& li = am.loops(f);
+        DependenceAnalysis da(m, f, li, aa);
+        for (Loop* inner : li.loopsInPostOrder()) {
+            Loop* outer = inner->parent;
+            if (!outer || done.count(outer->header->name)) continue;
+            done.insert(outer->header->name);
+
+            InductionVariable ivOuter, ivInner;
+            if (!inner->subLoops.empty() || !li.isPerfectNest(outer, ivOuter, ivInner)) continue;
+
+            std::vector<MemoryAccess> accesses = da.accesses(inner);
+            long long current = localityCost(da, accesses, ivInner.phi->result, ivInner.step);
+            long long swapped = localityCost(da, accesses, ivOuter.phi->result, ivOuter.step);
+            if (swapped >= current || !da.isPermutable({outer, inner})) continue;
+
+            interchange(inner, ivOuter, ivInner);
+            am.invalidate(f, PreservePurity);
+            changed = progress = true;
+            break;
+        }
+    }
+    return changed;
+}
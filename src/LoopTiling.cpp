@@ -0,0 +1,218 @@
+#include "Passes.h"
+#include "LoopInfo.h"
+#include "PassManager.h"
+#include "DependenceAnalysis.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+// Cache model: a tile's working set, one T^d block per array indexed by d of
+// the band's induction variables, should fill at most half of the L1 data
+// cache so that the arrays do not evict each other. Tile sizes are multiples
+// of 8 so that a later unroll by a power of two divides whole tiles.
+static const long long kL1CacheBytes = 32 * 1024;
+static const long long kCacheLineBytes = 64;
+static const int kTileSizes[] = {256, 128, 64, 32, 16, 8};
+
+namespace {
+
+struct Band {
+    std::vector<Loop*> loops;               // Outermost first
+    std::vector<InductionVariable> ivs;
+};
+
+bool tileable(const LoopInfo& li, const Band& band) {
+    for (const auto& iv : band.ivs) {
+        if (iv.step != 1 || (iv.compare->predicate != "slt" && iv.compare->predicate != "sle")) return false;
+        if (!li.isInvariant(band.loops[0], iv.init) || !li.isInvariant(band.loops[0], iv.bound)) return false;
+    }
+    return li.preheader(band.loops[0]) != nullptr;
+}
+
+long long footprint(const DependenceAnalysis& da, const std::vector<MemoryAccess>& accesses,
+                    const Band& band, long long tile) {
+    std::map<std::string, std::pair<int, long long>> arrays;  // base -> (dims touched, element size)
+    for (const auto& access : accesses) {
+        int touched = 0;
+        for (const auto& iv : band.ivs) {
+            if (da.stride(access, iv.phi->result) != 0) ++touched;
+        }
+        auto& entry = arrays[access.base];
+        entry.first = std::max(entry.first, touched);
+        entry.second = typeSizeInBytes(access.inst->type);
+    }
+    long long bytes = 0;
+    for (const auto& [base, info] : arrays) {
+        long long block = info.second;
+        for (int d = 0; d < info.first; ++d) block *= tile;
+        bytes += block;
+    }
+    return bytes;
+}
+
+// Tiling pays off when some access is reused, or walks along a cache line,
+// as an outer band loop advances while the inner band loops sweep over more
+// data in between: exactly the reuse that is lost once that sweep no longer
+// fits in the cache.
+bool hasOuterReuse(const DependenceAnalysis& da, const std::vector<MemoryAccess>& accesses,
+                   const Band& band) {
+    for (const auto& access : accesses) {
+        for (size_t l = 0; l + 1 < band.ivs.size(); ++l) {
+            long long outer = std::llabs(da.stride(access, band.ivs[l].phi->result));
+            if (outer >= kCacheLineBytes) continue;
+            for (size_t k = l + 1; k < band.ivs.size(); ++k) {
+                if (da.stride(access, band.ivs[k].phi->result) != 0) return true;
+            }
+        }
+    }
+    return false;
+}
+
+int chooseTileSize(const DependenceAnalysis& da, const std::vector<MemoryAccess>& accesses,
+                   const Band& band) {
+    for (int tile : kTileSizes) {
+        if (footprint(da, accesses, band, tile) <= kL1CacheBytes / 2) return tile;
+    }
+    return kTileSizes[std::size(kTileSizes) - 1];
+}
+
+long long constantTripCount(const InductionVariable& iv) {
+    if (!isConstantOperand(iv.init) || !isConstantOperand(iv.bound)) return -1;
+    long long trips = static_cast<long long>(constantValue(iv.bound)) - constantValue(iv.init);
+    if (iv.compare->predicate == "sle") ++trips;
+    return trips;
+}
+
+// Wraps the band in one tile loop per band loop:
+//   for (t1 = init1; t1 < bound1; t1 += T) ... for (tn ...)
+//     for (i1 = t1; i1 < min(t1 + T, bound1); ++i1) ... original body
+// The original loops keep their blocks; only their start values, bounds and
+// the outermost loop's entry and exit edges change.
+void tileBand(Function& f, const LoopInfo& li, Band& band, int tile) {
+    size_t n = band.loops.size();
+    BasicBlock* pre = li.preheader(band.loops[0]);
+    BasicBlock* header = band.loops[0]->header;
+    std::string exit = header->terminator()->labels[1];
+
+    std::vector<std::unique_ptr<BasicBlock>> heads, enters, steps;
+    for (size_t k = 0; k < n; ++k) {
+        heads.push_back(std::make_unique<BasicBlock>(f.newBlockName()));
+        enters.push_back(std::make_unique<BasicBlock>(f.newBlockName()));
+        steps.push_back(std::make_unique<BasicBlock>(f.newBlockName()));
+    }
+
+    std::vector<std::string> tileStart(n), tileEnd(n);
+    for (size_t k = 0; k < n; ++k) {
+        const InductionVariable& iv = band.ivs[k];
+        const std::string& pred = iv.compare->predicate;
+        std::string t = f.newReg(), next = f.newReg();
+        tileStart[k] = t;
+
+        Instruction phi(Opcode::Phi, t, "i32", {iv.init, next});
+        phi.labels = {k == 0 ? pre->name : enters[k - 1]->name, steps[k]->name};
+        std::string inRange = f.newReg();
+        heads[k]->insts.push_back(phi);
+        heads[k]->insts.push_back(makeICmp(inRange, pred, t, iv.bound));
+        heads[k]->insts.push_back(makeCondBr(inRange, enters[k]->name,
+                                             k == 0 ? exit : steps[k - 1]->name));
+
+        // Last index of the tile, clamped to the loop bound
+        std::string last = f.newReg(), below = f.newReg(), end = f.newReg();
+        enters[k]->insts.push_back(Instruction(Opcode::Add, last, "i32",
+                                               {t, std::to_string(pred == "sle" ? tile - 1 : tile)}));
+        enters[k]->insts.push_back(makeICmp(below, "slt", last, iv.bound));
+        enters[k]->insts.push_back(Instruction(Opcode::Select, end, "i32", {below, last, iv.bound}));
+        enters[k]->insts.push_back(makeBr(k + 1 < n ? heads[k + 1]->name : header->name));
+        tileEnd[k] = end;
+
+        steps[k]->insts.push_back(Instruction(Opcode::Add, next, "i32", {t, std::to_string(tile)}));
+        steps[k]->insts.push_back(makeBr(heads[k]->name));
+    }
+
+    for (auto& label : pre->terminator()->labels) {
+        if (label == header->name) label = heads[0]->name;
+    }
+    for (size_t k = 0; k < n; ++k) {
+        InductionVariable& iv = band.ivs[k];
+        for (size_t i = 0; i < iv.phi->operands.size(); ++i) {
+            if (iv.phi->labels[i] == band.loops[k]->latch()->name) continue;
+            iv.phi->operands[i] = tileStart[k];
+            if (k == 0) iv.phi->labels[i] = enters[n - 1]->name;
+        }
+        iv.compare->operands[1] = tileEnd[k];
+    }
+    header->terminator()->labels[1] = steps[n - 1]->name;
+    for (auto& inst : li.block(exit)->insts) {
+        if (inst.op != Opcode::Phi) break;
+        for (auto& label : inst.labels) {
+            if (label == header->name) label = heads[0]->name;
+        }
+    }
+
+    // Tile headers go in front of the band, tile steps after its last block.
+    auto at = [&](BasicBlock* bb) {
+        return std::find_if(f.blocks.begin(), f.blocks.end(),
+                            [&](const std::unique_ptr<BasicBlock>& b) { return b.get() == bb; });
+    };
+    std::vector<std::unique_ptr<BasicBlock>> front, back;
+    for (size_t k = 0; k < n; ++k) {
+        front.push_back(std::move(heads[k]));
+        front.push_back(std::move(enters[k]));
+    }
+    for (size_t k = n; k-- > 0;) back.push_back(std::move(steps[k]));
+    auto after = at(band.loops[0]->blocks.back()) + 1;
+    f.blocks.insert(after, std::make_move_iterator(back.begin()), std::make_move_iterator(back.end()));
+    auto before = at(header);
+    f.blocks.insert(before, std::make_move_iterator(front.begin()), std::make_move_iterator(front.end()));
+}
+
+} // namespace
+
+bool tileLoops(Function& f, AnalysisManager& am, int tileSize) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    Module& m = am.getModule();
+    const AliasAnalysis& aa = am.alias();
+    bool changed = false;
+    std::set<std::string> done;  // Headers of bands already considered
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        const LoopInfo& li = am.loops(f);
+        DependenceAnalysis da(m, f, li, aa);
+        for (Loop* loop : li.loopsInPostOrder()) {
+            // Bands start at a loop that is not the inner half of a perfect nest
+            InductionVariable ivOuter, ivInner;
+            if (loop->parent && li.isPerfectNest(loop->parent, ivOuter, ivInner)) continue;
+            if (done.count(loop->header->name)) continue;
+            done.insert(loop->header->name);
+
+            Band band;
+            band.loops.push_back(loop);
+            while (li.isPerfectNest(band.loops.back(), ivOuter, ivInner)) {
+                if (band.ivs.empty()) band.ivs.push_back(ivOuter);
+                band.ivs.push_back(ivInner);
+                band.loops.push_back(band.loops.back()->subLoops[0]);
+            }
+            if (band.loops.size() < 2 || !tileable(li, band)) continue;
+
+            std::vector<MemoryAccess> accesses = da.accesses(band.loops.back());
+            if (!hasOuterReuse(da, accesses, band)) continue;
+            int tile = tileSize > 0 ? tileSize : chooseTileSize(da, accesses, band);
+            bool large = false;
+            for (const auto& iv : band.ivs) {
+                long long trips = constantTripCount(iv);
+                large |= trips < 0 || trips > tile;
+            }
+            if (!large) continue;
+
+            std::vector<const Loop*> order(band.loops.begin(), band.loops.end());
+            if (!da.isPermutable(order)) continue;
+
+            tileBand(f, li, band, tile);
+            am.invalidate(f, PreservePurity);
+            changed = progress = true;
+            break;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,110 @@
+#include "MachineIR.h"
+
+MachineOperand MachineOperand::use(int reg) {
+    MachineOperand op;
+    op.kind = Reg;
+    op.reg = reg;
+    return op;
+}
+
+MachineOperand MachineOperand::def(int reg) {
+    MachineOperand op = use(reg);
+    op.isDef = true;
+    op.isUse = false;
+    return op;
+}
+
+MachineOperand MachineOperand::useDef(int reg) {
+    MachineOperand op = use(reg);
+    op.isDef = true;
+    return op;
+}
+
+MachineOperand MachineOperand::immediate(long long value) {
+    MachineOperand op;
+    op.kind = Imm;
+    op.imm = value;
+    return op;
+}
+
+MachineOperand MachineOperand::memory(int base, long long disp, int index, int scale) {
+    MachineOperand op;
+    op.kind = Mem;
+    op.reg = base;
+    op.imm = disp;
+    op.index = index;
+    op.scale = scale;
+    return op;
+}
+
+MachineOperand MachineOperand::frame(int frameIndex, long long disp) {
+    MachineOperand op = memory(kNoReg, disp);
+    op.frameIndex = frameIndex;
+    return op;
+}
+
+MachineOperand MachineOperand::global(const std::string& symbol, long long disp) {
+    MachineOperand op = memory(kNoReg, disp);
+    op.symbol = symbol;
+    return op;
+}
+
+MachineOperand MachineOperand::label(int block) {
+    MachineOperand op;
+    op.kind = Block;
+    op.block = block;
+    return op;
+}
+
+MachineOperand MachineOperand::function(const std::string& symbol) {
+    MachineOperand op;
+    op.kind = Symbol;
+    op.symbol = symbol;
+    return op;
+}
+
+void MachineInstr::uses(std::vector<int>& regs) const {
+    for (const auto& op : ops) {
+        if (op.kind == MachineOperand::Reg && op.isUse) regs.push_back(op.reg);
+        if (op.kind == MachineOperand::Mem) {
+            if (op.reg != kNoReg) regs.push_back(op.reg);
+            if (op.index != kNoReg) regs.push_back(op.index);
+        }
+    }
+    regs.insert(regs.end(), implicitUses.begin(), implicitUses.end());
+}
+
+void MachineInstr::defs(std::vector<int>& regs) const {
+    for (const auto& op : ops) {
+        if (op.kind == MachineOperand::Reg && op.isDef) regs.push_back(op.reg);
+    }
+    regs.insert(regs.end(), implicitDefs.begin(), implicitDefs.end());
+}
+
+void MachineInstr::replaceReg(int from, int to) {
+    for (auto& op : ops) {
+        if ((op.kind == MachineOperand::Reg || op.kind == MachineOperand::Mem) && op.reg == from) op.reg = to;
+        if (op.kind == MachineOperand::Mem && op.index == from) op.index = to;
+    }
+    for (auto& reg : implicitUses) {
+        if (reg == from) reg = to;
+    }
+    for (auto& reg : implicitDefs) {
+        if (reg == from) reg = to;
+    }
+}
+
+int MachineFunction::newVReg(int size) {
+    vregSizes.push_back(size);
+    return kFirstVirtualReg + static_cast<int>(vregSizes.size()) - 1;
+}
+
+int MachineFunction::addBlock(const std::string& label) {
+    blocks.push_back(std::make_unique<MachineBasicBlock>(label));
+    return static_cast<int>(blocks.size()) - 1;
+}
+
+int MachineFunction::addFrameObject(int size, int align) {
+    frameObjects.push_back({size, align});
+    return static_cast<int>(frameObjects.size()) - 1;
+}
@@ -0,0 +1,216 @@
+#include "Passes.h"
+#include "Dominance.h"
+#include <algorithm>
+
+namespace {
+
+// The frontend emits allocas where variables are declared, which may be
+// inside a loop. Moving them to the entry block makes them static and lets
+// promotion treat every variable the same way.
+bool hoistAllocas(Function& f) {
+    BasicBlock* entry = f.entry();
+    std::vector<Instruction> hoisted;
+    for (auto& bb : f.blocks) {
+        if (bb.get() == entry) continue;
+        auto& insts = bb->insts;
+        for (auto& inst : insts) {
+            if (inst.op == Opcode::Alloca) hoisted.push_back(inst);
+        }
+        insts.erase(std::remove_if(insts.begin(), insts.end(),
+                                   [](const Instruction& i) { return i.op == Opcode::Alloca; }),
+                    insts.end());
+    }
+    if (hoisted.empty()) return false;
+    entry->insts.insert(entry->insts.begin(), hoisted.begin(), hoisted.end());
+    return true;
+}
+
+std::set<std::string> findPromotable(const Function& f) {
+    std::set<std::string> candidates;
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op == Opcode::Alloca && !isArrayTypeStr(inst.type)) candidates.insert(inst.result);
+        }
+    }
+    // Any use other than as the address of a load or store lets the address
+    // escape, e.g. a pointer passed to a call or stored somewhere.
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            for (size_t i = 0; i < inst.operands.size(); ++i) {
+                if (!candidates.count(inst.operands[i])) continue;
+                bool isAddress = (inst.op == Opcode::Load && i == 0) ||
+                                 (inst.op == Opcode::Store && i == 1);
+                if (!isAddress) candidates.erase(inst.operands[i]);
+            }
+        }
+    }
+    return candidates;
+}
+
+// Inserted phis are live if a non-phi instruction uses them, directly or
+// through other live phis. Counting uses alone would keep cycles of phis
+// that only feed each other, e.g. a variable reassigned before every use
+// but still carried around an enclosing loop.
+void removeDeadPhis(Function& f, const std::set<std::string>& inserted) {
+    std::map<std::string, const Instruction*> phis;
+    std::vector<std::string> worklist;
+    std::set<std::string> live;
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            bool isInserted = inst.op == Opcode::Phi && inserted.count(inst.result);
+            if (isInserted) phis[inst.result] = &inst;
+            for (const auto& operand : inst.operands) {
+                if (!isInserted && inserted.count(operand) && live.insert(operand).second) {
+                    worklist.push_back(operand);
+                }
+            }
+        }
+    }
+    while (!worklist.empty()) {
+        const Instruction* phi = phis[worklist.back()];
+        worklist.pop_back();
+        for (const auto& operand : phi->operands) {
+            if (inserted.count(operand) && live.insert(operand).second) worklist.push_back(operand);
+        }
+    }
+    for (auto& bb : f.blocks) {
+        auto& insts = bb->insts;
+        insts.erase(std::remove_if(insts.begin(), insts.end(), [&](const Instruction& inst) {
+            return inst.op == Opcode::Phi && inserted.count(inst.result) && !live.count(inst.result);
+        }), insts.end());
+    }
+}
+
+} // namespace
+
+bool promoteMemoryToRegisters(Function& f) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    bool changed = removeUnreachableBlocks(f);
+    changed |= promoteMemoryToRegisters(f, DominatorTree(f));
+    return changed;
+}
+
+bool promoteMemoryToRegisters(Function& f, const DominatorTree& dt) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    bool changed = hoistAllocas(f);
+
+    std::set<std::string> promotable = findPromotable(f);
+    if (promotable.empty()) return changed;
+
+    std::map<std::string, std::string> allocaTypes;
+    std::map<std::string, std::set<BasicBlock*>> defBlocks;
+    for (auto& bb : f.blocks) {
+        for (auto& inst : bb->insts) {
+            if (inst.op == Opcode::Alloca && promotable.count(inst.result)) {
+                allocaTypes[inst.result] = inst.type;
+            } else if (inst.op == Opcode::Store && promotable.count(inst.operands[1])) {
+                defBlocks[inst.operands[1]].insert(bb.get());
+            }
+        }
+    }
+
+    auto frontiers = dt.frontiers();
+
+    // Phi placement on the iterated dominance frontier of the stores. The
+    // blocks are keyed by address, so the phis are named afterwards, in
+    // block order, for the names not to depend on where the blocks were
+    // allocated.
+    std::map<BasicBlock*, std::set<std::string>> phiVariables;
+    for (const auto& [var, blocks] : defBlocks) {
+        std::vector<BasicBlock*> worklist(blocks.begin(), blocks.end());
+        std::set<BasicBlock*> queued(blocks.begin(), blocks.end());
+        while (!worklist.empty()) {
+            BasicBlock* x = worklist.back();
+            worklist.pop_back();
+            for (BasicBlock* y : frontiers[x]) {
+                if (!phiVariables[y].insert(var).second) continue;
+                if (queued.insert(y).second) worklist.push_back(y);
+            }
+        }
+    }
+    std::map<std::string, std::string> phiVariable;  // phi result -> alloca
+    for (auto& bb : f.blocks) {
+        auto it = phiVariables.find(bb.get());
+        if (it == phiVariables.end()) continue;
+        std::vector<Instruction> phis;
+        for (const auto& var : it->second) {
+            std::string phi = f.newReg();
+            phis.push_back(Instruction(Opcode::Phi, phi, allocaTypes[var]));
+            phiVariable[phi] = var;
+        }
+        bb->insts.insert(bb->insts.begin(), phis.begin(), phis.end());
+    }
+
+    // Renaming walk over the dominator tree with one value stack per variable.
+    std::map<std::string, std::vector<std::string>> stacks;
+    for (const auto& var : promotable) stacks[var].push_back("0");
+    std::map<std::string, std::string> replacements;
+    std::set<const Instruction*> dead;
+
+    struct Frame {
+        BasicBlock* bb;
+        bool entered;
+        std::vector<std::string> pushed;
+    };
+    std::vector<Frame> work;
+    work.push_back({f.entry(), false, {}});
+    while (!work.empty()) {
+        if (work.back().entered) {
+            for (const auto& var : work.back().pushed) stacks[var].pop_back();
+            work.pop_back();
+            continue;
+        }
+        work.back().entered = true;
+        BasicBlock* bb = work.back().bb;
+        std::vector<std::string> pushed;
+
+        for (auto& inst : bb->insts) {
+            if (inst.op == Opcode::Phi && phiVariable.count(inst.result)) {
+                const std::string& var = phiVariable[inst.result];
+                stacks[var].push_back(inst.result);
+                pushed.push_back(var);
+            } else if (inst.op == Opcode::Load && promotable.count(inst.operands[0])) {
+                replacements[inst.result] = stacks[inst.operands[0]].back();
+                dead.insert(&inst);
+            } else if (inst.op == Opcode::Store && promotable.count(inst.operands[1])) {
+                stacks[inst.operands[1]].push_back(inst.operands[0]);
+                pushed.push_back(inst.operands[1]);
+                dead.insert(&inst);
+            } else if (inst.op == Opcode::Alloca && promotable.count(inst.result)) {
+                dead.insert(&inst);
+            }
+        }
+
+        for (BasicBlock* succ : dt.successors(bb)) {
+            for (auto& inst : succ->insts) {
+                if (inst.op != Opcode::Phi) break;
+                auto it = phiVariable.find(inst.result);
+                if (it == phiVariable.end()) continue;
+                inst.operands.push_back(stacks[it->second].back());
+                inst.labels.push_back(bb->name);
+            }
+        }
+
+        work.back().pushed = pushed;
+        const auto& kids = dt.children(bb);
+        for (auto it = kids.rbegin(); it != kids.rend(); ++it) {
+            work.push_back({*it, false, {}});
+        }
+    }
+
+    for (auto& bb : f.blocks) {
+        auto& insts = bb->insts;
+        std::vector<Instruction> kept;
+        kept.reserve(insts.size());
+        for (auto& inst : insts) {
+            if (!dead.count(&inst)) kept.push_back(std::move(inst));
+        }
+        insts = std::move(kept);
+    }
+    f.replaceUses(replacements);
+
+    std::set<std::string> inserted;
+    for (const auto& [phi, var] : phiVariable) inserted.insert(phi);
+    removeDeadPhis(f, inserted);
+    return true;
+}
@@ -0,0 +1,123 @@
+#include "Passes.h"
+#include "PurityAnalysis.h"
+
+// Memo tables hold at most 2^16 entries. The bits are split evenly between
+// the arguments, so fib(n) memoizes n < 65536 and binom(n, k) memoizes
+// n, k < 256. Calls outside that range go straight to the original body.
+static const int kMemoIndexBits = 16;
+static const int kMaxMemoArgs = 3;
+
+// Slots start zeroed. Results are stored XOR'ed with INT_MIN so that a zero
+// slot means "not computed yet"; the one result that encodes to zero (INT_MIN
+// itself) is simply recomputed on every call.
+static const char* kSentinel = "-2147483648";
+
+static bool isMemoizable(const Function& f, const PurityAnalysis& purity) {
+    if (f.isDeclaration || f.name == "main" || f.retType != "i32") return false;
+    if (f.paramTypes.empty() || f.paramTypes.size() > kMaxMemoArgs) return false;
+    for (const auto& ty : f.paramTypes) {
+        if (ty != "i32") return false;
+    }
+    return purity.isReadNone(f.name) && purity.isSelfRecursive(f.name);
+}
+
+static Instruction makeCall(const std::string& result, const Function& callee,
+                            const std::vector<std::string>& args) {
+    Instruction inst(Opcode::Call, result, callee.retType, args);
+    inst.callee = callee.name;
+    inst.argTypes = callee.paramTypes;
+    return inst;
+}
+
+// Builds the public entry point `name` in front of the renamed original body:
+//   if (all args in range) { slot = memo[index]; if (slot) return slot ^ S;
+//                            r = impl(args); memo[index] = r ^ S; return r; }
+//   return impl(args);
+static std::unique_ptr<Function> buildWrapper(const Function& impl, const std::string& name,
+                                              const std::string& table, int bits) {
+    auto w = std::make_unique<Function>();
+    w->name = name;
+    w->retType = impl.retType;
+    w->paramTypes = impl.paramTypes;
+    w->paramNames = impl.paramNames;
+    const auto& args = w->paramNames;
+    std::string extent = std::to_string(1 << bits);
+    std::string tableType = "[" + std::to_string(1 << (bits * args.size())) + " x i32]";
+
+    BasicBlock* entry = w->addBlock("entry");
+    BasicBlock* probe = w->addBlock(w->newBlockName());
+    BasicBlock* hit = w->addBlock(w->newBlockName());
+    BasicBlock* miss = w->addBlock(w->newBlockName());
+    BasicBlock* slow = w->addBlock(w->newBlockName());
+
+    // Unsigned compares reject negative arguments as well.
+    std::string inRange;
+    for (const auto& arg : args) {
+        std::string cmp = w->newReg();
+        entry->insts.push_back(makeICmp(cmp, "ult", arg, extent));
+        if (inRange.empty()) {
+            inRange = cmp;
+        } else {
+            std::string both = w->newReg();
+            entry->insts.push_back(Instruction(Opcode::And, both, "i1", {inRange, cmp}));
+            inRange = both;
+        }
+    }
+    entry->insts.push_back(makeCondBr(inRange, probe->name, slow->name));
+
+    std::string index = args[0];
+    for (size_t i = 1; i < args.size(); ++i) {
+        std::string shifted = w->newReg();
+        probe->insts.push_back(Instruction(Opcode::Shl, shifted, "i32", {index, std::to_string(bits)}));
+        index = w->newReg();
+        probe->insts.push_back(Instruction(Opcode::Or, index, "i32", {shifted, args[i]}));
+    }
+    std::string slotPtr = w->newReg();
+    probe->insts.push_back(Instruction(Opcode::GetElementPtr, slotPtr, tableType,
+                                       {"@" + table, "0", index}));
+    std::string slot = w->newReg();
+    probe->insts.push_back(Instruction(Opcode::Load, slot, "i32", {slotPtr}));
+    std::string filled = w->newReg();
+    probe->insts.push_back(makeICmp(filled, "ne", slot, "0"));
+    probe->insts.push_back(makeCondBr(filled, hit->name, miss->name));
+
+    std::string cached = w->newReg();
+    hit->insts.push_back(Instruction(Opcode::Xor, cached, "i32", {slot, kSentinel}));
+    hit->insts.push_back(Instruction(Opcode::Ret, "", "i32", {cached}));
+
+    std::string computed = w->newReg();
+    miss->insts.push_back(makeCall(computed, impl, args));
+    std::string encoded = w->newReg();
+    miss->insts.push_back(Instruction(Opcode::Xor, encoded, "i32", {computed, kSentinel}));
+    miss->insts.push_back(Instruction(Opcode::Store, "", "i32", {encoded, slotPtr}));
+    miss->insts.push_back(Instruction(Opcode::Ret, "", "i32", {computed}));
+
+    std::string direct = w->newReg();
+    slow->insts.push_back(makeCall(direct, impl, args));
+    slow->insts.push_back(Instruction(Opcode::Ret, "", "i32", {direct}));
+    return w;
+}
+
+bool memoizePureRecursion(Module& m) {
+    PurityAnalysis purity(m);
+    std::vector<std::unique_ptr<Function>> wrappers;
+
+    for (auto& f : m.functions) {
+        if (!isMemoizable(*f, purity)) continue;
+        std::string name = f->name;
+        int bits = kMemoIndexBits / static_cast<int>(f->paramTypes.size());
+
+        GlobalVariable table;
+        table.name = name + ".memo";
+        table.type = "[" + std::to_string(1 << (bits * f->paramTypes.size())) + " x i32]";
+        m.globals.push_back(table);
+
+        // Recursive calls inside the body still name the original function,
+        // so they now go through the wrapper and hit the table too.
+        f->name = name + ".memo.impl";
+        wrappers.push_back(buildWrapper(*f, name, table.name, bits));
+    }
+
+    for (auto& w : wrappers) m.functions.push_back(std::move(w));
+    return !wrappers.empty();
+}
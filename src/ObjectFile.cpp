@@ -0,0 +1,230 @@
+#include "ObjectFile.h"
+#include <algorithm>
+
+namespace {
+
+// ELF64 constants
+constexpr uint16_t ET_REL = 1;
+constexpr uint32_t SHT_PROGBITS = 1;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint32_t SHT_STRTAB = 3;
+constexpr uint32_t SHT_RELA = 4;
+constexpr uint32_t SHT_NOBITS = 8;
+constexpr uint64_t SHF_WRITE = 1;
+constexpr uint64_t SHF_ALLOC = 2;
+constexpr uint64_t SHF_EXECINSTR = 4;
+constexpr uint64_t SHF_INFO_LINK = 0x40;
+constexpr uint8_t STB_GLOBAL = 1;
+constexpr uint8_t STT_NOTYPE = 0;
+constexpr uint8_t STT_OBJECT = 1;
+constexpr uint8_t STT_FUNC = 2;
+constexpr size_t kHeaderSize = 64;
+constexpr size_t kSectionHeaderSize = 64;
+constexpr size_t kSymbolSize = 24;
+constexpr size_t kRelaSize = 24;
+
+// Section header indices; the data sections come first, in the order of
+// ObjectFile::Section.
+enum SectionIndex {
+    IndexNull,
+    IndexText,
+    IndexData,
+    IndexRodata,
+    IndexBss,
+    IndexRelaText,
+    IndexSymtab,
+    IndexStrtab,
+    IndexShstrtab,
+    IndexNoteStack,
+    NumSectionIndices
+};
+
+void put(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out += static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+void pad(std::string& out, size_t alignment) {
+    while (out.size() % alignment) out += '\0';
+}
+
+// Appends `name` to a string table, returning its offset.
+uint32_t addString(std::string& table, const std::string& name) {
+    uint32_t offset = static_cast<uint32_t>(table.size());
+    table += name;
+    table += '\0';
+    return offset;
+}
+
+struct SectionHeader {
+    uint32_t name = 0;
+    uint32_t type = 0;
+    uint64_t flags = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t link = 0;
+    uint32_t info = 0;
+    uint64_t align = 1;
+    uint64_t entsize = 0;
+};
+
+} // namespace
+
+ObjectFile::ObjectFile() {
+    for (auto& alignment : alignments) alignment = 1;
+    alignments[Text] = 16;
+}
+
+void ObjectFile::align(Section s, uint64_t alignment, uint8_t fill) {
+    alignments[s] = std::max(alignments[s], alignment);
+    if (s == Bss) {
+        bssSize = (bssSize + alignment - 1) / alignment * alignment;
+        return;
+    }
+    while (sections[s].size() % alignment) sections[s].push_back(fill);
+}
+
+int ObjectFile::symbol(const std::string& name) {
+    auto it = symbolIndex.find(name);
+    if (it != symbolIndex.end()) return it->second;
+    int index = static_cast<int>(symbols.size());
+    symbols.push_back({name});
+    symbolIndex[name] = index;
+    return index;
+}
+
+void ObjectFile::define(const std::string& name, Section s, uint64_t offset, uint64_t size, bool function) {
+    Symbol& sym = symbols[symbol(name)];
+    sym.section = s;
+    sym.offset = offset;
+    sym.size = size;
+    sym.function = function;
+}
+
+void ObjectFile::addRelocation(uint64_t offset, const std::string& name, uint32_t type, int64_t addend) {
+    relocations.push_back({offset, symbol(name), type, addend});
+}
+
+void ObjectFile::addGlobals(const Module& m) {
+    for (const auto& g : m.globals) {
+        uint64_t size = typeSizeInBytes(g.type);
+        Section s = g.zeroInit ? Bss : g.isConstant ? Rodata : Data;
+        align(s, size >= 16 ? 16 : 4);
+        define(g.name, s, this->size(s), size, false);
+        if (s == Bss) {
+            bssSize += size;
+            continue;
+        }
+        auto& bytes = sections[s];
+        for (int value : g.init) {
+            for (int i = 0; i < 4; ++i) bytes.push_back(static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * i)));
+        }
+        bytes.resize(bytes.size() + size - 4 * g.init.size());
+    }
+}
+
+std::string ObjectFile::toELF(uint16_t machine) const {
+    std::string shstrtab(1, '\0');
+    std::string strtab(1, '\0');
+    SectionHeader headers[NumSectionIndices];
+    const char* const names[NumSectionIndices] = {"",        ".text",   ".data",   ".rodata",   ".bss",
+                                                  ".rela.text", ".symtab", ".strtab", ".shstrtab", ".note.GNU-stack"};
+    for (int i = 1; i < NumSectionIndices; ++i) headers[i].name = addString(shstrtab, names[i]);
+
+    std::string out(kHeaderSize, '\0');
+    const uint64_t flags[NumSections] = {SHF_ALLOC | SHF_EXECINSTR, SHF_ALLOC | SHF_WRITE, SHF_ALLOC,
+                                         SHF_ALLOC | SHF_WRITE};
+    for (int s = 0; s < NumSections; ++s) {
+        SectionHeader& h = headers[IndexText + s];
+        pad(out, alignments[s]);
+        h.type = s == Bss ? SHT_NOBITS : SHT_PROGBITS;
+        h.flags = flags[s];
+        h.offset = out.size();
+        h.size = size(static_cast<Section>(s));
+        h.align = alignments[s];
+        if (s != Bss) out.append(sections[s].begin(), sections[s].end());
+    }
+
+    // Symbols: the null one, then everything else, all global.
+    pad(out, 8);
+    SectionHeader& symtab = headers[IndexSymtab];
+    symtab.type = SHT_SYMTAB;
+    symtab.offset = out.size();
+    symtab.link = IndexStrtab;
+    symtab.info = 1;
+    symtab.align = 8;
+    symtab.entsize = kSymbolSize;
+    out.append(kSymbolSize, '\0');
+    for (const auto& sym : symbols) {
+        uint8_t type = sym.section < 0 ? STT_NOTYPE : sym.function ? STT_FUNC : STT_OBJECT;
+        put(out, addString(strtab, sym.name), 4);
+        put(out, (STB_GLOBAL << 4) | type, 1);
+        put(out, 0, 1);
+        put(out, sym.section < 0 ? 0 : IndexText + sym.section, 2);
+        put(out, sym.offset, 8);
+        put(out, sym.size, 8);
+    }
+    symtab.size = out.size() - symtab.offset;
+
+    SectionHeader& rela = headers[IndexRelaText];
+    rela.type = SHT_RELA;
+    rela.flags = SHF_INFO_LINK;
+    rela.offset = out.size();
+    rela.link = IndexSymtab;
+    rela.info = IndexText;
+    rela.align = 8;
+    rela.entsize = kRelaSize;
+    for (const auto& r : relocations) {
+        put(out, r.offset, 8);
+        put(out, (static_cast<uint64_t>(r.symbol + 1) << 32) | r.type, 8);
+        put(out, static_cast<uint64_t>(r.addend), 8);
+    }
+    rela.size = out.size() - rela.offset;
+
+    headers[IndexStrtab].type = SHT_STRTAB;
+    headers[IndexStrtab].offset = out.size();
+    headers[IndexStrtab].size = strtab.size();
+    out += strtab;
+    headers[IndexShstrtab].type = SHT_STRTAB;
+    headers[IndexShstrtab].offset = out.size();
+    headers[IndexShstrtab].size = shstrtab.size();
+    out += shstrtab;
+    // An empty .note.GNU-stack asks for a non-executable stack.
+    headers[IndexNoteStack].type = SHT_PROGBITS;
+    headers[IndexNoteStack].offset = out.size();
+
+    pad(out, 8);
+    uint64_t sectionHeaders = out.size();
+    for (const auto& h : headers) {
+        put(out, h.name, 4);
+        put(out, h.type, 4);
+        put(out, h.flags, 8);
+        put(out, 0, 8);  // Address
+        put(out, h.offset, 8);
+        put(out, h.size, 8);
+        put(out, h.link, 4);
+        put(out, h.info, 4);
+        put(out, h.align, 8);
+        put(out, h.entsize, 8);
+    }
+
+    std::string header = "\x7f" "ELF";
+    put(header, 2, 1);  // 64-bit
+    put(header, 1, 1);  // Little-endian
+    put(header, 1, 1);  // ELF version
+    header.resize(16, '\0');
+    put(header, ET_REL, 2);
+    put(header, machine, 2);
+    put(header, 1, 4);
+    put(header, 0, 8);  // Entry point
+    put(header, 0, 8);  // Program headers
+    put(header, sectionHeaders, 8);
+    put(header, 0, 4);  // Flags
+    put(header, kHeaderSize, 2);
+    put(header, 0, 2);
+    put(header, 0, 2);
+    put(header, kSectionHeaderSize, 2);
+    put(header, NumSectionIndices, 2);
+    put(header, IndexShstrtab, 2);
+    out.replace(0, kHeaderSize, header);
+    return out;
+}
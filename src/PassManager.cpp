@@ -0,0 +1,315 @@
+#include "PassManager.h"
+#include "PurityAnalysis.h"
+#include "Passes.h"
+#include <atomic>
+#include <cctype>
+
+AnalysisManager::FunctionAnalyses& AnalysisManager::entry(Function& f) {
+    std::lock_guard<std::mutex> lock(functionsMutex);
+    return functions[&f];
+}
+
+const DominatorTree& AnalysisManager::dominators(Function& f) {
+    auto& cached = entry(f).dominators;
+    if (!cached) cached = std::make_unique<DominatorTree>(f);
+    return *cached;
+}
+
+const LoopInfo& AnalysisManager::loops(Function& f) {
+    auto& cached = entry(f).loops;
+    if (!cached) cached = std::make_unique<LoopInfo>(f, dominators(f));
+    return *cached;
+}
+
+const ValueRangeAnalysis& AnalysisManager::valueRanges(Function& f) {
+    auto& cached = entry(f).valueRanges;
+    if (!cached) cached = std::make_unique<ValueRangeAnalysis>(loops(f));
+    return *cached;
+}
+
+const AliasAnalysis& AnalysisManager::alias() {
+    if (!aliasAnalysis) {
+        PurityAnalysis(module).annotate(module);
+        aliasAnalysis = std::make_unique<AliasAnalysis>(module);
+    }
+    return *aliasAnalysis;
+}
+
+void AnalysisManager::invalidate(Function& f, PreservedAnalyses preserved) {
+    // Loops are built on the dominator tree and value ranges on the loops,
+    // so each goes with what it was built on.
+    if (!(preserved & PreserveDominators)) preserved &= ~PreserveLoops;
+    if (!(preserved & PreserveLoops)) preserved &= ~PreserveValueRanges;
+    FunctionAnalyses& cached = entry(f);
+    if (!(preserved & PreserveDominators)) cached.dominators.reset();
+    if (!(preserved & PreserveLoops)) cached.loops.reset();
+    if (!(preserved & PreserveValueRanges)) cached.valueRanges.reset();
+    if (!(preserved & PreservePurity)) {
+        aliasAnalysis.reset();
+    } else if (aliasAnalysis && !(preserved & PreserveAlias)) {
+        aliasAnalysis->invalidate(f);
+    }
+}
+
+void AnalysisManager::invalidate(PreservedAnalyses preserved) {
+    if (preserved == PreserveAll) return;
+    // Module passes may add or remove functions, so per-function results
+    // are only kept when everything is.
+    functions.clear();
+    if (!(preserved & PreservePurity) || !(preserved & PreserveAlias)) aliasAnalysis.reset();
+}
+
+namespace {
+
+// The instruction-level passes keep the CFG, and none of them changes which
+// functions are called.
+const PreservedAnalyses kPreserveCFG = PreserveDominators | PreservePurity;
+
+// Dominance is only defined on reachable blocks, so the passes that need it
+// drop the others first, and with them the analyses of the old CFG.
+bool removeUnreachable(Function& f, AnalysisManager& am) {
+    if (!removeUnreachableBlocks(f)) return false;
+    am.invalidate(f, PreservePurity);
+    return true;
+}
+
+struct Registration {
+    const char* name;
+    bool takesNumber;
+    std::function<void(PassManager&, int)> add;
+};
+
+const std::vector<Registration>& registry() {
+    static const std::vector<Registration> passes = {
+        {"sroa", false, [](PassManager& pm, int) {
+             pm.addFunctionPass("sroa", [](Function& f, AnalysisManager&) -> PreservedAnalyses {
+                 return scalarReplaceAggregates(f) ? kPreserveCFG : PreserveAll;
+             });
+         }},
+        {"mem2reg", false, [](PassManager& pm, int) {
+             pm.addFunctionPass("mem2reg", [](Function& f, AnalysisManager& am) -> PreservedAnalyses {
+                 bool changed = removeUnreachable(f, am);
+                 changed |= promoteMemoryToRegisters(f, am.dominators(f));
+                 return changed ? kPreserveCFG : PreserveAll;
+             });
+         }},
+        {"ipsccp", false, [](PassManager& pm, int) {
+             // Specialized clones only pay off once SCCP folds their constants.
+             pm.addModulePass("ipsccp", [](Module& m, AnalysisManager&) -> PreservedAnalyses {
+                 bool changed = interproceduralSCCP(m);
+                 if (specializeFunctions(m)) {
+                     interproceduralSCCP(m);
+                     changed = true;
+                 }
+                 return changed ? PreserveNone : PreserveAll;
+             });
+         }},
+        {"vrp", false, [](PassManager& pm, int) {
+             pm.addFunctionPass("vrp", [](Function& f, AnalysisManager& am) -> PreservedAnalyses {
+                 if (f.isDeclaration) return PreserveAll;
+                 bool changed = false;
+                 if (foldBranches(f, am.valueRanges(f))) {
+                     am.invalidate(f, PreservePurity);
+                     changed = true;
+                 }
+                 const ValueRangeAnalysis& vra = am.valueRanges(f);
+                 changed |= simplifyInstructions(f, vra);
+                 changed |= reduceStrength(f, vra);
+                 return changed ? kPreserveCFG : PreserveAll;
+             });
+         }},
+        {"ifconvert", false, [](PassManager& pm, int) {
+             pm.addFunctionPass("ifconvert", [](Function& f, AnalysisManager&) -> PreservedAnalyses {
+                 return convertIfsToSelects(f) ? PreservePurity : PreserveAll;
+             });
+         }},
+        // The loop transforms drop a function's analyses as they change it,
+        // so what is cached when they return is still valid.
+        {"distribute", false, [](PassManager& pm, int) {
+             pm.addFunctionPass(
+                 "distribute",
+                 [](Function& f, AnalysisManager& am) -> PreservedAnalyses {
+                     distributeLoops(f, am);
+                     return PreserveAll;
+                 },
+                 true);
+         }},
+        {"fuse", false, [](PassManager& pm, int) {
+             pm.addFunctionPass(
+                 "fuse",
+                 [](Function& f, AnalysisManager& am) -> PreservedAnalyses {
+                     fuseLoops(f, am);
+                     return PreserveAll;
+                 },
+                 true);
+         }},
+        {"interchange", false, [](PassManager& pm, int) {
+             pm.addFunctionPass(
+                 "interchange",
+                 [](Function& f, AnalysisManager& am) -> PreservedAnalyses {
+                     interchangeLoops(f, am);
+                     return PreserveAll;
+                 },
+                 true);
+         }},
+        {"tile", true, [](PassManager& pm, int tileSize) {
+             pm.addFunctionPass(
+                 "tile",
+                 [tileSize](Function& f, AnalysisManager& am) -> PreservedAnalyses {
+                     tileLoops(f, am, tileSize);
+                     return PreserveAll;
+                 },
+                 true);
+         }},
+        {"gcm", false, [](PassManager& pm, int) {
+             pm.addFunctionPass("gcm", [](Function& f, AnalysisManager& am) -> PreservedAnalyses {
+                 bool changed = removeUnreachable(f, am);
+                 changed |= globalCodeMotion(f, am.loops(f));
+                 return changed ? kPreserveCFG : PreserveAll;
+             });
+         }},
+        {"schedule", false, [](PassManager& pm, int) {
+             pm.addFunctionPass("schedule", [](Function& f, AnalysisManager&) -> PreservedAnalyses {
+                 return scheduleInstructions(f) ? kPreserveCFG : PreserveAll;
+             });
+         }},
+        {"memoize", false, [](PassManager& pm, int) {
+             pm.addModulePass("memoize", [](Module& m, AnalysisManager&) -> PreservedAnalyses {
+                 bool changed = memoizePureRecursion(m);
+                 PurityAnalysis(m).annotate(m);
+                 return changed ? PreserveNone : PreserveAll;
+             });
+         }},
+    };
+    return passes;
+}
+
+std::string trim(const std::string& s) {
+    size_t begin = 0, end = s.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(s[begin]))) ++begin;
+    while (end > begin && std::isspace(static_cast<unsigned char>(s[end - 1]))) --end;
+    return s.substr(begin, end - begin);
+}
+
+} // namespace
+
+bool PassManager::parsePipeline(const std::string& pipeline, std::string& error) {
+    size_t start = 0;
+    while (start <= pipeline.size()) {
+        size_t comma = pipeline.find(',', start);
+        if (comma == std::string::npos) comma = pipeline.size();
+        std::string item = trim(pipeline.substr(start, comma - start));
+        start = comma + 1;
+        if (item.empty()) {
+            if (comma == pipeline.size() && passes.empty()) break;  // Empty pipeline
+            error = "empty pass name in pipeline '" + pipeline + "'";
+            return false;
+        }
+
+        std::string name = item;
+        int number = 0;
+        bool hasNumber = false;
+        size_t open = item.find('<');
+        if (open != std::string::npos) {
+            // Up to nine digits, so that the number fits an int
+            std::string digits = item.substr(open + 1, item.size() - open - 2);
+            if (item.back() != '>' || digits.empty() || digits.size() > 9 ||
+                digits.find_first_not_of("0123456789") != std::string::npos) {
+                error = "malformed pass '" + item + "'";
+                return false;
+            }
+            name = item.substr(0, open);
+            number = std::stoi(digits);
+            hasNumber = true;
+        }
+
+        const Registration* found = nullptr;
+        for (const auto& reg : registry()) {
+            if (name == reg.name) found = &reg;
+        }
+        if (!found) {
+            error = "unknown pass '" + name + "'";
+            return false;
+        }
+        if (hasNumber && !found->takesNumber) {
+            error = "pass '" + name + "' takes no parameter";
+            return false;
+        }
+        found->add(*this, number);
+    }
+    return true;
+}
+
+void PassManager::addFunctionPass(const std::string& name, FunctionPass pass, bool needsAlias) {
+    passes.push_back({name, std::move(pass), nullptr, needsAlias});
+}
+
+void PassManager::addModulePass(const std::string& name, ModulePass pass) {
+    passes.push_back({name, nullptr, std::move(pass), false});
+}
+
+bool PassManager::functionLocal() const {
+    for (const auto& pass : passes) {
+        if (!pass.function || pass.needsAlias) return false;
+    }
+    return true;
+}
+
+void PassManager::run(Module& m) {
+    AnalysisManager am(m);
+    run(m, am);
+}
+
+void PassManager::run(Module& m, AnalysisManager& am) {
+    size_t i = 0;
+    while (i < passes.size()) {
+        if (passes[i].module) {
+            am.invalidate(passes[i].module(m, am));
+            ++i;
+            continue;
+        }
+        // The alias analysis looks at every function, so it is computed
+        // in between, once all functions have been through the passes
+        // before. With or without threads, it then sees the same module.
+        size_t end = i;
+        while (end < passes.size() && passes[end].function) ++end;
+        size_t split = i;
+        while (split < end && !passes[split].needsAlias) ++split;
+        if (split > i) runFunctionPasses(m, am, i, split);
+        if (split < end) {
+            am.alias();
+            runFunctionPasses(m, am, split, end);
+        }
+        i = end;
+    }
+}
+
+void PassManager::runFunctionPasses(Module& m, AnalysisManager& am, size_t begin, size_t end) {
+    std::vector<Function*> defined;
+    for (auto& func : m.functions) {
+        if (!func->isDeclaration) defined.push_back(func.get());
+    }
+    // Losing the module-level facts only takes effect at the end, so that
+    // no function's passes pull them out from under another's.
+    std::atomic<bool> purityLost(false);
+    auto runOn = [&](size_t index) {
+        Function& func = *defined[index];
+        for (size_t k = begin; k < end; ++k) {
+            PreservedAnalyses preserved = passes[k].function(func, am);
+            if (!(preserved & PreservePurity)) purityLost = true;
+            am.invalidate(func, preserved | PreservePurity);
+        }
+    };
+    if (threads) {
+        threads->parallelFor(defined.size(), runOn);
+    } else {
+        for (size_t index = 0; index < defined.size(); ++index) runOn(index);
+    }
+    if (purityLost) am.invalidate(PreserveAll & ~PreservePurity);
+}
+
+std::vector<std::string> PassManager::registeredPasses() {
+    std::vector<std::string> names;
+    for (const auto& reg : registry()) names.push_back(reg.name);
+    return names;
+}
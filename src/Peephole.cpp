@@ -0,0 +1,21 @@
+#include "Peephole.h"
+
+std::vector<int> countRegisterReads(const MachineFunction& mf) {
+    std::vector<int> reads(mf.vregCount());
+    std::vector<int> regs;
+    for (const auto& bb : mf.blocks) {
+        for (const auto& mi : bb->insts) {
+            regs.clear();
+            mi.uses(regs);
+            for (int reg : regs) {
+                if (isVirtualReg(reg)) ++reads[reg - kFirstVirtualReg];
+            }
+        }
+    }
+    return reads;
+}
+
+bool sameAddress(const MachineOperand& a, const MachineOperand& b) {
+    return a.isMem() && b.isMem() && a.reg == b.reg && a.imm == b.imm && a.index == b.index &&
+           a.scale == b.scale && a.frameIndex == b.frameIndex && a.symbol == b.symbol;
+}
@@ -0,0 +1,87 @@
+#include "PurityAnalysis.h"
+
+namespace {
+
+// True if every load and store in f goes to the function's own stack slots.
+bool touchesOnlyLocalMemory(const Function& f) {
+    std::map<std::string, const Instruction*> defs;
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (!inst.result.empty()) defs[inst.result] = &inst;
+        }
+    }
+    auto isLocal = [&](std::string ptr) {
+        while (true) {
+            auto it = defs.find(ptr);
+            if (it == defs.end()) return false;  // Global or parameter
+            if (it->second->op == Opcode::Alloca) return true;
+            if (it->second->op != Opcode::GetElementPtr) return false;
+            ptr = it->second->operands[0];
+        }
+    };
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op == Opcode::Load && !isLocal(inst.operands[0])) return false;
+            if (inst.op == Opcode::Store && !isLocal(inst.operands[1])) return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+PurityAnalysis::PurityAnalysis(const Module& m) {
+    for (const auto& f : m.functions) {
+        if (f->isDeclaration) continue;
+        auto& calls = callGraph[f->name];
+        for (const auto& bb : f->blocks) {
+            for (const auto& inst : bb->insts) {
+                if (inst.op == Opcode::Call) calls.insert(inst.callee);
+            }
+        }
+        if (touchesOnlyLocalMemory(*f)) pure.insert(f->name);
+    }
+
+    // Declarations are never in `pure`, so calls to sylib knock callers out.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = pure.begin(); it != pure.end();) {
+            bool ok = true;
+            for (const auto& callee : callGraph[*it]) {
+                if (!pure.count(callee)) {
+                    ok = false;
+                    break;
+                }
+            }
+            if (ok) {
+                ++it;
+            } else {
+                it = pure.erase(it);
+                changed = true;
+            }
+        }
+    }
+}
+
+bool PurityAnalysis::isSelfRecursive(const std::string& func) const {
+    auto it = callGraph.find(func);
+    return it != callGraph.end() && it->second.count(func) > 0;
+}
+
+const std::set<std::string>& PurityAnalysis::callees(const std::string& func) const {
+    static const std::set<std::string> empty;
+    auto it = callGraph.find(func);
+    return it == callGraph.end() ? empty : it->second;
+}
+
+void PurityAnalysis::annotate(Module& m) const {
+    for (auto& f : m.functions) {
+        if (f->isDeclaration) continue;
+        if (isReadNone(f->name)) {
+            f->attributes.insert("readnone");
+        } else {
+            f->attributes.erase("readnone");
+        }
+    }
+}
@@ -0,0 +1,417 @@
+#include "RISCVTarget.h"
+
+using namespace riscv;
+
+namespace {
+
+int valueSize(const std::string& type) {
+    return isPointerType(type) ? 8 : 4;
+}
+
+const std::vector<int> kCallerSaved = {RA, T0, T1, T2, A0, A1, A2, A3, A4, A5, A6, A7, T3, T4, T5, T6};
+
+// Macro expansion, as for x86-64: every IR instruction becomes a fixed
+// sequence of machine instructions over virtual registers, phis become
+// copies through one temporary per phi, and conditional branches get edge
+// blocks for the copies of edges into blocks with phis. Operations with an
+// immediate form take constants that fit 12 bits directly, and zero is x0.
+class InstructionSelector {
+public:
+    InstructionSelector(const Function& f, MachineFunction& mf) : func(f), mf(mf) {}
+
+    void run();
+
+private:
+    void emit(int opcode, int size, std::vector<MachineOperand> ops) {
+        mf.blocks[current]->insts.emplace_back(opcode, size, std::move(ops));
+    }
+    MachineInstr& last() { return mf.blocks[current]->insts.back(); }
+
+    bool isFrame(const std::string& value) const { return frames.count(value) > 0; }
+    // The value in a register; constants are loaded, zero is x0.
+    int materialize(const std::string& value, int size);
+    void copy(const std::string& value, int dst, int size);
+    MachineOperand address(const std::string& pointer);
+    // dst = reg + offset on 64-bit values
+    void addOffset(int reg, long long offset, int dst);
+
+    void select(const Instruction& inst, const std::string& block);
+    void selectBinary(const Instruction& inst);
+    void selectCompare(const Instruction& inst);
+    void selectGetElementPtr(const Instruction& inst);
+    void selectCall(const Instruction& inst);
+    void selectBranch(const Instruction& inst, const std::string& from);
+    int edgeTo(const std::string& from, const std::string& target);
+    void phiCopies(const std::string& from, const std::string& target);
+
+    const Function& func;
+    MachineFunction& mf;
+    int current = 0;
+    std::map<std::string, int> regs;       // SSA value -> virtual register
+    std::map<std::string, int> frames;     // Alloca -> frame object
+    std::map<std::string, int> blocks;     // IR block -> machine block
+    std::map<std::string, const BasicBlock*> irBlocks;
+    std::map<std::string, int> phiTemps;   // Phi -> register its incoming values go through
+    int edgeBlocks = 0;
+};
+
+int InstructionSelector::materialize(const std::string& value, int size) {
+    if (isConstantOperand(value) && constantValue(value) == 0) return ZERO;
+    auto it = regs.find(value);
+    if (it != regs.end()) return it->second;
+    int reg = mf.newVReg(isFrame(value) || isGlobalOperand(value) ? 8 : size);
+    copy(value, reg, mf.vregSize(reg));
+    return reg;
+}
+
+void InstructionSelector::copy(const std::string& value, int dst, int size) {
+    if (isConstantOperand(value)) {
+        emit(LI, size, {MachineOperand::immediate(constantValue(value)), MachineOperand::def(dst)});
+    } else if (isFrame(value)) {
+        emit(LA, 8, {MachineOperand::frame(frames.at(value)), MachineOperand::def(dst)});
+    } else if (isGlobalOperand(value)) {
+        emit(LA, 8, {MachineOperand::global(value.substr(1)), MachineOperand::def(dst)});
+    } else {
+        emit(MV, size, {MachineOperand::use(regs.at(value)), MachineOperand::def(dst)});
+    }
+}
+
+MachineOperand InstructionSelector::address(const std::string& pointer) {
+    if (isFrame(pointer)) return MachineOperand::frame(frames.at(pointer));
+    // Globals are reached through their address; RISC-V loads and stores
+    // only take a register base.
+    return MachineOperand::memory(materialize(pointer, 8));
+}
+
+void InstructionSelector::addOffset(int reg, long long offset, int dst) {
+    if (offset == 0) {
+        emit(MV, 8, {MachineOperand::use(reg), MachineOperand::def(dst)});
+    } else if (fitsImm12(offset)) {
+        emit(ADDI, 8, {MachineOperand::use(reg), MachineOperand::immediate(offset), MachineOperand::def(dst)});
+    } else {
+        int temp = mf.newVReg(8);
+        emit(LI, 8, {MachineOperand::immediate(offset), MachineOperand::def(temp)});
+        emit(ADD, 8, {MachineOperand::use(reg), MachineOperand::use(temp), MachineOperand::def(dst)});
+    }
+}
+
+void InstructionSelector::selectBinary(const Instruction& inst) {
+    int dst = regs.at(inst.result);
+    std::string lhs = inst.operands[0];
+    std::string rhs = inst.operands[1];
+    // Register form, and the immediate form or -1 if there is none
+    int opcode = ADDW, immOpcode = ADDIW;
+    bool commutative = true;
+    switch (inst.op) {
+        case Opcode::Sub: opcode = SUBW; immOpcode = -1; commutative = false; break;
+        case Opcode::Mul: opcode = MULW; immOpcode = -1; break;
+        case Opcode::And: opcode = AND; immOpcode = ANDI; break;
+        case Opcode::Or: opcode = OR; immOpcode = ORI; break;
+        case Opcode::Xor: opcode = XOR; immOpcode = XORI; break;
+        case Opcode::Shl: opcode = SLLW; immOpcode = SLLIW; commutative = false; break;
+        case Opcode::AShr: opcode = SRAW; immOpcode = SRAIW; commutative = false; break;
+        case Opcode::LShr: opcode = SRLW; immOpcode = SRLIW; commutative = false; break;
+        case Opcode::SDiv: opcode = DIVW; immOpcode = -1; commutative = false; break;
+        case Opcode::SRem: opcode = REMW; immOpcode = -1; commutative = false; break;
+        default: break;
+    }
+    if (commutative && isConstantOperand(lhs) && !isConstantOperand(rhs)) std::swap(lhs, rhs);
+    if (isConstantOperand(rhs)) {
+        long long value = constantValue(rhs);
+        if (opcode == SUBW) {
+            value = -value;
+            immOpcode = ADDIW;
+        }
+        if (immOpcode == SLLIW || immOpcode == SRAIW || immOpcode == SRLIW) value &= 31;
+        if (immOpcode >= 0 && fitsImm12(value)) {
+            emit(immOpcode, 4, {MachineOperand::use(materialize(lhs, 4)), MachineOperand::immediate(value),
+                                MachineOperand::def(dst)});
+            return;
+        }
+    }
+    emit(opcode, 4, {MachineOperand::use(materialize(lhs, 4)), MachineOperand::use(materialize(rhs, 4)),
+                     MachineOperand::def(dst)});
+}
+
+void InstructionSelector::selectCompare(const Instruction& inst) {
+    int dst = regs.at(inst.result);
+    int lhs = materialize(inst.operands[0], 4);
+    int rhs = materialize(inst.operands[1], 4);
+    const std::string& pred = inst.predicate;
+    if (pred == "eq" || pred == "ne") {
+        int diff = lhs;
+        if (rhs != ZERO) {
+            diff = mf.newVReg(4);
+            emit(XOR, 4, {MachineOperand::use(lhs), MachineOperand::use(rhs), MachineOperand::def(diff)});
+        }
+        emit(pred == "eq" ? SEQZ : SNEZ, 4, {MachineOperand::use(diff), MachineOperand::def(dst)});
+        return;
+    }
+    // slt gives a < b, sltu the same unsigned; the rest swap operands or
+    // negate. Sign-extended 32-bit values compare unsigned as they would
+    // at 32 bits.
+    bool isUnsigned = pred[0] == 'u';
+    std::string order = isUnsigned ? "s" + pred.substr(1) : pred;
+    bool swap = order == "sgt" || order == "sle";
+    bool negate = order == "sge" || order == "sle";
+    int opcode = isUnsigned ? SLTU : SLT;
+    if (swap) std::swap(lhs, rhs);
+    if (!negate) {
+        emit(opcode, 4, {MachineOperand::use(lhs), MachineOperand::use(rhs), MachineOperand::def(dst)});
+        return;
+    }
+    int less = mf.newVReg(4);
+    emit(opcode, 4, {MachineOperand::use(lhs), MachineOperand::use(rhs), MachineOperand::def(less)});
+    emit(XORI, 4, {MachineOperand::use(less), MachineOperand::immediate(1), MachineOperand::def(dst)});
+}
+
+void InstructionSelector::selectGetElementPtr(const Instruction& inst) {
+    // Indices are 32-bit values kept sign-extended, so they scale and add as
+    // 64-bit ones. Constant steps fold into one offset.
+    std::string type = inst.type;
+    long long disp = 0;
+    int index = kNoReg;
+    for (size_t k = 1; k < inst.operands.size(); ++k) {
+        if (k > 1) type = arrayElementType(type);
+        long long stride = typeSizeInBytes(type);
+        const std::string& value = inst.operands[k];
+        if (isConstantOperand(value)) {
+            disp += constantValue(value) * stride;
+            continue;
+        }
+        int scaled = materialize(value, 4);
+        if (stride != 1) {
+            int shift = 0;
+            while ((1LL << shift) < stride) ++shift;
+            int product = mf.newVReg(8);
+            if ((1LL << shift) == stride) {
+                emit(SLLI, 8, {MachineOperand::use(scaled), MachineOperand::immediate(shift), MachineOperand::def(product)});
+            } else {
+                int factor = mf.newVReg(8);
+                emit(LI, 8, {MachineOperand::immediate(stride), MachineOperand::def(factor)});
+                emit(MUL, 8, {MachineOperand::use(scaled), MachineOperand::use(factor), MachineOperand::def(product)});
+            }
+            scaled = product;
+        }
+        if (index == kNoReg) {
+            index = scaled;
+        } else {
+            int sum = mf.newVReg(8);
+            emit(ADD, 8, {MachineOperand::use(index), MachineOperand::use(scaled), MachineOperand::def(sum)});
+            index = sum;
+        }
+    }
+
+    int dst = regs.at(inst.result);
+    const std::string& base = inst.operands[0];
+    if (index == kNoReg) {
+        if (isFrame(base)) {
+            emit(LA, 8, {MachineOperand::frame(frames.at(base), disp), MachineOperand::def(dst)});
+        } else if (isGlobalOperand(base)) {
+            emit(LA, 8, {MachineOperand::global(base.substr(1), disp), MachineOperand::def(dst)});
+        } else {
+            addOffset(materialize(base, 8), disp, dst);
+        }
+        return;
+    }
+    int sum = mf.newVReg(8);
+    emit(ADD, 8, {MachineOperand::use(materialize(base, 8)), MachineOperand::use(index), MachineOperand::def(sum)});
+    addOffset(sum, disp, dst);
+}
+
+void InstructionSelector::selectCall(const Instruction& inst) {
+    std::string callee = inst.callee;
+    std::vector<std::string> args = inst.operands;
+    std::vector<std::string> types = inst.argTypes;
+    // sylib's timing functions are macros passing the source line, which
+    // the IR does not keep.
+    if (callee == "starttime" || callee == "stoptime") {
+        callee = "_sysy_" + callee;
+        args = {"0"};
+        types = {"i32"};
+    }
+
+    // Arguments past the eighth go in 8-byte slots at the stack pointer,
+    // sign-extended like register arguments; variadic ones are passed the
+    // same way.
+    for (size_t i = 8; i < args.size(); ++i) {
+        emit(SD, 8, {MachineOperand::use(materialize(args[i], valueSize(types[i]))),
+                     MachineOperand::memory(SP, 8 * static_cast<long long>(i - 8))});
+    }
+    if (args.size() > 8) mf.outgoingArgsSize = std::max(mf.outgoingArgsSize, 8 * static_cast<int>(args.size() - 8));
+    std::vector<int> argRegs;
+    for (size_t i = 0; i < args.size() && i < 8; ++i) {
+        copy(args[i], kArgRegs[i], valueSize(types[i]));
+        argRegs.push_back(kArgRegs[i]);
+    }
+    emit(CALL, 8, {MachineOperand::function(callee)});
+    last().implicitUses = argRegs;
+    last().implicitDefs = kCallerSaved;
+    if (!inst.result.empty()) {
+        emit(MV, valueSize(inst.type), {MachineOperand::use(A0), MachineOperand::def(regs.at(inst.result))});
+    }
+}
+
+void InstructionSelector::phiCopies(const std::string& from, const std::string& target) {
+    for (const auto& inst : irBlocks.at(target)->insts) {
+        if (inst.op != Opcode::Phi) break;
+        for (size_t i = 0; i < inst.labels.size(); ++i) {
+            if (inst.labels[i] != from) continue;
+            int temp = phiTemps.at(inst.result);
+            copy(inst.operands[i], temp, mf.vregSize(temp));
+            break;
+        }
+    }
+}
+
+int InstructionSelector::edgeTo(const std::string& from, const std::string& target) {
+    const BasicBlock* succ = irBlocks.at(target);
+    if (succ->insts.empty() || succ->insts[0].op != Opcode::Phi) return blocks.at(target);
+    int edge = mf.addBlock(".L" + func.name + "_edge" + std::to_string(edgeBlocks++));
+    int saved = current;
+    current = edge;
+    phiCopies(from, target);
+    emit(J, 8, {MachineOperand::label(blocks.at(target))});
+    mf.blocks[edge]->succs = {blocks.at(target)};
+    current = saved;
+    return edge;
+}
+
+void InstructionSelector::selectBranch(const Instruction& inst, const std::string& from) {
+    std::string target;
+    if (inst.op == Opcode::Br) {
+        target = inst.labels[0];
+    } else if (isConstantOperand(inst.operands[0])) {
+        target = constantValue(inst.operands[0]) ? inst.labels[0] : inst.labels[1];
+    } else {
+        int cond = materialize(inst.operands[0], 4);
+        int taken = edgeTo(from, inst.labels[0]);
+        int notTaken = edgeTo(from, inst.labels[1]);
+        emit(BCC, 8, {MachineOperand::use(cond), MachineOperand::use(ZERO), MachineOperand::label(taken)});
+        last().cond = CondNE;
+        emit(J, 8, {MachineOperand::label(notTaken)});
+        mf.blocks[current]->succs = {taken, notTaken};
+        return;
+    }
+    phiCopies(from, target);
+    emit(J, 8, {MachineOperand::label(blocks.at(target))});
+    mf.blocks[current]->succs = {blocks.at(target)};
+}
+
+void InstructionSelector::select(const Instruction& inst, const std::string& block) {
+    switch (inst.op) {
+        case Opcode::Alloca:
+        case Opcode::Phi:
+        case Opcode::Unreachable:
+            break;
+        case Opcode::Load: {
+            int size = valueSize(inst.type);
+            emit(size == 8 ? LD : LW, size, {address(inst.operands[0]), MachineOperand::def(regs.at(inst.result))});
+            break;
+        }
+        case Opcode::Store: {
+            int size = valueSize(inst.type);
+            int value = materialize(inst.operands[0], size);
+            emit(size == 8 ? SD : SW, size, {MachineOperand::use(value), address(inst.operands[1])});
+            break;
+        }
+        case Opcode::GetElementPtr:
+            selectGetElementPtr(inst);
+            break;
+        case Opcode::ICmp:
+            selectCompare(inst);
+            break;
+        case Opcode::ZExt:
+            copy(inst.operands[0], regs.at(inst.result), 4);
+            break;
+        case Opcode::Select: {
+            int dst = regs.at(inst.result);
+            int size = valueSize(inst.type);
+            const std::string& cond = inst.operands[0];
+            if (isConstantOperand(cond)) {
+                copy(constantValue(cond) ? inst.operands[1] : inst.operands[2], dst, size);
+                break;
+            }
+            // No conditional move in RV64IM: dst = f ^ ((t ^ f) & -cond)
+            int whenTrue = materialize(inst.operands[1], size);
+            int whenFalse = materialize(inst.operands[2], size);
+            int mask = mf.newVReg(8), diff = mf.newVReg(size), picked = mf.newVReg(size);
+            emit(NEG, 8, {MachineOperand::use(materialize(cond, 4)), MachineOperand::def(mask)});
+            emit(XOR, size, {MachineOperand::use(whenTrue), MachineOperand::use(whenFalse), MachineOperand::def(diff)});
+            emit(AND, size, {MachineOperand::use(diff), MachineOperand::use(mask), MachineOperand::def(picked)});
+            emit(XOR, size, {MachineOperand::use(whenFalse), MachineOperand::use(picked), MachineOperand::def(dst)});
+            break;
+        }
+        case Opcode::Call:
+            selectCall(inst);
+            break;
+        case Opcode::Br:
+        case Opcode::CondBr:
+            selectBranch(inst, block);
+            break;
+        case Opcode::Ret:
+            if (!inst.operands.empty()) copy(inst.operands[0], A0, valueSize(inst.type));
+            emit(RET, 8, {});
+            if (!inst.operands.empty()) last().implicitUses = {A0};
+            break;
+        default:
+            selectBinary(inst);
+            break;
+    }
+}
+
+void InstructionSelector::run() {
+    for (const auto& bb : func.blocks) {
+        blocks[bb->name] = mf.addBlock(".L" + func.name + "_" + bb->name);
+        irBlocks[bb->name] = bb.get();
+    }
+    for (const auto& bb : func.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op == Opcode::Alloca) {
+                int size = typeSizeInBytes(inst.type);
+                frames[inst.result] = mf.addFrameObject(size, size >= 8 ? 8 : 4);
+            } else if (!inst.result.empty()) {
+                int size = valueSize(inst.resultType());
+                regs[inst.result] = mf.newVReg(size);
+                if (inst.op == Opcode::Phi) phiTemps[inst.result] = mf.newVReg(size);
+            }
+        }
+    }
+
+    // Parameters arrive in a0-a7, the rest at the incoming stack pointer,
+    // which the frame pointer keeps.
+    current = 0;
+    for (size_t i = 0; i < func.paramNames.size(); ++i) {
+        int size = valueSize(func.paramTypes[i]);
+        int reg = mf.newVReg(size);
+        regs[func.paramNames[i]] = reg;
+        if (i < 8) {
+            emit(MV, size, {MachineOperand::use(kArgRegs[i]), MachineOperand::def(reg)});
+        } else {
+            int fi = mf.addFrameObject(8, 8);
+            mf.frameObjects[fi].fixed = true;
+            mf.frameObjects[fi].offset = 8 * static_cast<long long>(i - 8);
+            emit(size == 8 ? LD : LW, size, {MachineOperand::frame(fi), MachineOperand::def(reg)});
+        }
+    }
+
+    for (const auto& bb : func.blocks) {
+        current = blocks.at(bb->name);
+        for (const auto& inst : bb->insts) {
+            if (inst.op == Opcode::Phi) {
+                emit(MV, mf.vregSize(regs.at(inst.result)),
+                     {MachineOperand::use(phiTemps.at(inst.result)), MachineOperand::def(regs.at(inst.result))});
+            } else {
+                select(inst, bb->name);
+            }
+        }
+    }
+}
+
+} // namespace
+
+std::unique_ptr<MachineFunction> RISCVTarget::selectInstructions(const Module&, const Function& f) const {
+    auto mf = std::make_unique<MachineFunction>(f.name);
+    InstructionSelector(f, *mf).run();
+    return mf;
+}
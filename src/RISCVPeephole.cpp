@@ -0,0 +1,156 @@
+#include "Peephole.h"
+#include "RISCVTarget.h"
+
+using namespace riscv;
+
+namespace {
+
+// mv r, r
+bool removeSelfCopy(const PeepholeSite& site) {
+    const MachineInstr& mi = site.inst(0);
+    if (mi.ops[0].reg != mi.ops[1].reg) return false;
+    site.erase(0);
+    return true;
+}
+
+// mv b, a; mv a, b: the second copy is redundant.
+bool removeCopyBack(const PeepholeSite& site) {
+    const MachineInstr& first = site.inst(0);
+    const MachineInstr& second = site.inst(1);
+    if (first.ops[0].reg != second.ops[1].reg || first.ops[1].reg != second.ops[0].reg) return false;
+    site.erase(1);
+    return true;
+}
+
+// sw r, mem; lw d, mem: the load becomes a copy of r.
+bool forwardStore(const PeepholeSite& site) {
+    const MachineInstr& store = site.inst(0);
+    MachineInstr& load = site.inst(1);
+    if (!sameAddress(store.ops[1], load.ops[0])) return false;
+    int value = store.ops[0].reg;
+    int dst = load.ops[1].reg;
+    if (value == dst) {
+        site.erase(1);
+        return true;
+    }
+    load = MachineInstr(MV, load.size, {MachineOperand::use(value), MachineOperand::def(dst)});
+    return true;
+}
+
+// addi d, s, 0, and addiw, since 32-bit values are already sign-extended
+bool removeAddZero(const PeepholeSite& site) {
+    MachineInstr& mi = site.inst(0);
+    if (mi.ops[1].imm != 0) return false;
+    if (mi.ops[0].reg == mi.ops[2].reg) {
+        site.erase(0);
+        return true;
+    }
+    mi = MachineInstr(MV, mi.size, {mi.ops[0], mi.ops[2]});
+    return true;
+}
+
+// Whether `branch` is bne v, zero or beq v, zero on the value `v` defined
+// just before it and read nowhere else.
+bool branchesOnlyOn(const PeepholeSite& site, const MachineInstr& branch, int v) {
+    return branch.ops[0].reg == v && branch.ops[1].reg == ZERO && site.reads(v) == 1 &&
+           (branch.cond == CondNE || branch.cond == CondEQ);
+}
+
+// Rewrites the branch at `k` to compare a and b directly, with `cond` for
+// the bne form; beq takes the inverse. Conditions invert by flipping the
+// low bit.
+void branchOn(const PeepholeSite& site, size_t k, int a, int b, int cond) {
+    MachineInstr& branch = site.inst(k);
+    branch.cond = branch.cond == CondNE ? cond : cond ^ 1;
+    branch.ops[0] = MachineOperand::use(a);
+    branch.ops[1] = MachineOperand::use(b);
+}
+
+// slt v, a, b; bnez v: blt a, b (sltu: bltu)
+bool fuseLessBranch(const PeepholeSite& site) {
+    const MachineInstr& slt = site.inst(0);
+    if (!branchesOnlyOn(site, site.inst(1), slt.ops[2].reg)) return false;
+    branchOn(site, 1, slt.ops[0].reg, slt.ops[1].reg, slt.opcode == SLTU ? CondLTU : CondLT);
+    site.erase(0);
+    return true;
+}
+
+// slt l, a, b; xori v, l, 1; bnez v: bge a, b (sltu: bgeu)
+bool fuseNotLessBranch(const PeepholeSite& site) {
+    const MachineInstr& slt = site.inst(0);
+    const MachineInstr& negate = site.inst(1);
+    int less = slt.ops[2].reg;
+    if (negate.ops[0].reg != less || negate.ops[1].imm != 1 || site.reads(less) != 1) return false;
+    if (!branchesOnlyOn(site, site.inst(2), negate.ops[2].reg)) return false;
+    branchOn(site, 2, slt.ops[0].reg, slt.ops[1].reg, slt.opcode == SLTU ? CondGEU : CondGE);
+    site.erase(1);
+    site.erase(0);
+    return true;
+}
+
+// xor d, a, b; seqz v, d; bnez v: beq a, b (snez: bne a, b)
+bool fuseEqualBranch(const PeepholeSite& site) {
+    const MachineInstr& diff = site.inst(0);
+    const MachineInstr& test = site.inst(1);
+    int d = diff.ops[2].reg;
+    if (test.ops[0].reg != d || site.reads(d) != 1) return false;
+    if (!branchesOnlyOn(site, site.inst(2), test.ops[1].reg)) return false;
+    branchOn(site, 2, diff.ops[0].reg, diff.ops[1].reg, test.opcode == SEQZ ? CondEQ : CondNE);
+    site.erase(1);
+    site.erase(0);
+    return true;
+}
+
+// seqz v, x; bnez v: beqz x (snez: bnez x)
+bool fuseZeroBranch(const PeepholeSite& site) {
+    const MachineInstr& test = site.inst(0);
+    if (!branchesOnlyOn(site, site.inst(1), test.ops[1].reg)) return false;
+    branchOn(site, 1, test.ops[0].reg, ZERO, test.opcode == SEQZ ? CondEQ : CondNE);
+    site.erase(0);
+    return true;
+}
+
+// j to the block laid out next
+bool removeJumpToNext(const PeepholeSite& site) {
+    if (!site.isNextBlock(site.inst(0).ops[0].block)) return false;
+    site.erase(0);
+    return true;
+}
+
+// bcc L; j M with L next: inverted bcc to M, falling through to L.
+bool invertBranchOverJump(const PeepholeSite& site) {
+    MachineInstr& branch = site.inst(0);
+    const MachineInstr& jump = site.inst(1);
+    if (!site.isNextBlock(branch.ops[2].block)) return false;
+    branch.cond ^= 1;
+    branch.ops[2] = jump.ops[0];
+    site.erase(1);
+    return true;
+}
+
+constexpr std::array<PeepholeRule, 16> kRules = {{
+    {{MV}, 1, removeSelfCopy},
+    {{MV, MV}, 2, removeCopyBack},
+    {{SW, LW}, 2, forwardStore},
+    {{SD, LD}, 2, forwardStore},
+    {{ADDI}, 1, removeAddZero},
+    {{ADDIW}, 1, removeAddZero},
+    {{SLT, BCC}, 2, fuseLessBranch},
+    {{SLT, XORI, BCC}, 3, fuseNotLessBranch},
+    {{SLTU, BCC}, 2, fuseLessBranch},
+    {{SLTU, XORI, BCC}, 3, fuseNotLessBranch},
+    {{XOR, SEQZ, BCC}, 3, fuseEqualBranch},
+    {{XOR, SNEZ, BCC}, 3, fuseEqualBranch},
+    {{SEQZ, BCC}, 2, fuseZeroBranch},
+    {{SNEZ, BCC}, 2, fuseZeroBranch},
+    {{J}, 1, removeJumpToNext},
+    {{BCC, J}, 2, invertBranchOverJump},
+}};
+
+constexpr PeepholeMatcher<kRules.size(), kNumMachineOpcodes> kMatcher(kRules);
+
+} // namespace
+
+bool RISCVTarget::runPeephole(MachineFunction& mf) const {
+    return kMatcher.run(mf);
+}
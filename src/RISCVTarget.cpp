@@ -0,0 +1,256 @@
+#include "RISCVTarget.h"
+#include <sstream>
+#include <stdexcept>
+
+using namespace riscv;
+
+const Reg riscv::kArgRegs[8] = {A0, A1, A2, A3, A4, A5, A6, A7};
+
+namespace {
+
+const char* const kNames[] = {"zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0",
+                              "a1",   "a2", "a3", "a4", "a5", "a6", "a7", "s2", "s3", "s4", "s5",
+                              "s6",   "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+const char* const kBranchNames[] = {"beq", "bne", "blt", "bge", "bltu", "bgeu"};
+// Indexed by MachineOpcode; BCC takes its name from the condition.
+const char* const kMnemonics[] = {
+    "li",   "la",    "mv",   "add",   "addi", "mul",   "slli", "addw", "addiw", "subw",
+    "mulw", "divw",  "remw", "and",   "andi", "or",    "ori",  "xor",  "xori",  "sllw",
+    "slliw", "sraw", "sraiw", "srlw", "srliw", "slt",  "sltu", "seqz", "snez",  "neg",
+    "lw",   "ld",    "sw",   "sd",    "",     "j",     "call", "ret"};
+
+MachineInstr instr(int opcode, std::vector<MachineOperand> ops) {
+    return MachineInstr(opcode, 8, std::move(ops));
+}
+
+} // namespace
+
+RISCVTarget::RISCVTarget() {
+    // Temporaries first, then the argument registers from the last, which
+    // calls need least, and the callee-saved ones last since they cost a
+    // save and restore.
+    allocatable = {T0, T1, T2, T3, T4, T5, A7, A6, A5, A4, A3, A2, A1, A0,
+                   S1, S2, S3, S4, S5, S6, S7, S8, S9, S10, S11};
+}
+
+bool RISCVTarget::isCalleeSaved(int reg) const {
+    return reg == S0 || reg == S1 || (reg >= S2 && reg <= S11);
+}
+
+std::string RISCVTarget::regName(int reg, int) const {
+    if (!isPhysicalReg(reg)) return "v" + std::to_string(reg - kFirstVirtualReg);
+    return kNames[reg];
+}
+
+MachineInstr RISCVTarget::loadFromFrame(int reg, int frameIndex, int size) const {
+    return MachineInstr(size == 8 ? LD : LW, size, {MachineOperand::frame(frameIndex), MachineOperand::def(reg)});
+}
+
+MachineInstr RISCVTarget::storeToFrame(int reg, int frameIndex, int size) const {
+    return MachineInstr(size == 8 ? SD : SW, size, {MachineOperand::use(reg), MachineOperand::frame(frameIndex)});
+}
+
+bool RISCVTarget::isCopy(const MachineInstr& mi, int& dst, int& src) const {
+    if (mi.opcode != MV) return false;
+    src = mi.ops[0].reg;
+    dst = mi.ops[1].reg;
+    return true;
+}
+
+bool RISCVTarget::isRematerializable(const MachineInstr& mi) const {
+    // Constants, and addresses of stack objects and globals
+    if (mi.opcode == LI) return true;
+    if (mi.opcode != LA) return false;
+    const MachineOperand& addr = mi.ops[0];
+    return addr.reg == kNoReg && addr.index == kNoReg;
+}
+
+void RISCVTarget::lowerFrame(MachineFunction& mf) const {
+    // Layout below the frame pointer, which is the incoming stack pointer:
+    // the return address and old frame pointer, the callee-saved registers,
+    // stack objects, then the outgoing arguments at the stack pointer.
+    int saved = static_cast<int>(mf.usedCalleeSaved.size());
+    long long offset = -16 - 8LL * saved;
+    for (auto& obj : mf.frameObjects) {
+        if (obj.fixed) continue;
+        offset -= obj.size;
+        offset -= ((offset % obj.align) + obj.align) % obj.align;
+        obj.offset = offset;
+    }
+    // Below the 16 bytes of return address and frame pointer, kept 16-byte
+    // aligned as the ABI requires of the stack pointer.
+    long long frameSize = -offset - 16 + mf.outgoingArgsSize;
+    frameSize = (frameSize + 15) / 16 * 16;
+
+    auto savedSlot = [](int i) { return MachineOperand::memory(FP, -24 - 8LL * i); };
+    for (auto& bb : mf.blocks) {
+        std::vector<MachineInstr> out;
+        for (auto& mi : bb->insts) {
+            for (auto& op : mi.ops) {
+                if (op.kind != MachineOperand::Mem || op.frameIndex < 0) continue;
+                long long disp = mf.frameObjects[op.frameIndex].offset + op.imm;
+                op.frameIndex = -1;
+                if (fitsImm12(disp)) {
+                    op.reg = FP;
+                    op.imm = disp;
+                    continue;
+                }
+                // Out of reach of a 12-bit offset: form the address in the
+                // scratch register.
+                out.push_back(instr(LI, {MachineOperand::immediate(disp), MachineOperand::def(kScratch)}));
+                out.push_back(instr(ADD, {MachineOperand::use(FP), MachineOperand::use(kScratch),
+                                          MachineOperand::def(kScratch)}));
+                op.reg = kScratch;
+                op.imm = 0;
+            }
+            if (mi.opcode != RET) {
+                out.push_back(std::move(mi));
+                continue;
+            }
+            for (int i = 0; i < saved; ++i) {
+                out.push_back(instr(LD, {savedSlot(i), MachineOperand::def(mf.usedCalleeSaved[i])}));
+            }
+            out.push_back(instr(ADDI, {MachineOperand::use(FP), MachineOperand::immediate(-16), MachineOperand::def(SP)}));
+            out.push_back(instr(LD, {MachineOperand::memory(SP, 8), MachineOperand::def(RA)}));
+            out.push_back(instr(LD, {MachineOperand::memory(SP, 0), MachineOperand::def(FP)}));
+            out.push_back(instr(ADDI, {MachineOperand::use(SP), MachineOperand::immediate(16), MachineOperand::def(SP)}));
+            out.push_back(std::move(mi));
+        }
+        bb->insts = std::move(out);
+    }
+
+    std::vector<MachineInstr> prologue;
+    prologue.push_back(instr(ADDI, {MachineOperand::use(SP), MachineOperand::immediate(-16), MachineOperand::def(SP)}));
+    prologue.push_back(instr(SD, {MachineOperand::use(RA), MachineOperand::memory(SP, 8)}));
+    prologue.push_back(instr(SD, {MachineOperand::use(FP), MachineOperand::memory(SP, 0)}));
+    prologue.push_back(instr(ADDI, {MachineOperand::use(SP), MachineOperand::immediate(16), MachineOperand::def(FP)}));
+    for (int i = 0; i < saved; ++i) {
+        prologue.push_back(instr(SD, {MachineOperand::use(mf.usedCalleeSaved[i]), savedSlot(i)}));
+    }
+    if (fitsImm12(-frameSize)) {
+        if (frameSize > 0) {
+            prologue.push_back(instr(ADDI, {MachineOperand::use(SP), MachineOperand::immediate(-frameSize),
+                                            MachineOperand::def(SP)}));
+        }
+    } else {
+        prologue.push_back(instr(LI, {MachineOperand::immediate(-frameSize), MachineOperand::def(kScratch)}));
+        prologue.push_back(instr(ADD, {MachineOperand::use(SP), MachineOperand::use(kScratch), MachineOperand::def(SP)}));
+    }
+    auto& entry = mf.blocks[0]->insts;
+    entry.insert(entry.begin(), prologue.begin(), prologue.end());
+}
+
+std::string RISCVTarget::printInstruction(const MachineInstr& mi, const MachineFunction& mf) const {
+    std::string mnemonic = mi.opcode == BCC ? kBranchNames[mi.cond] : kMnemonics[mi.opcode];
+    auto print = [&](const MachineOperand& op) -> std::string {
+        switch (op.kind) {
+            case MachineOperand::Reg:
+                return regName(op.reg, 8);
+            case MachineOperand::Imm:
+                return std::to_string(op.imm);
+            case MachineOperand::Mem:
+                if (!op.symbol.empty()) {
+                    std::string text = op.symbol;
+                    if (op.imm > 0) text += "+";
+                    if (op.imm != 0) text += std::to_string(op.imm);
+                    return text;
+                }
+                return std::to_string(op.imm) + "(" + regName(op.reg, 8) + ")";
+            case MachineOperand::Block:
+                return mf.blocks[op.block]->label;
+            case MachineOperand::Symbol:
+                return op.symbol;
+        }
+        return "";
+    };
+
+    // Operands are kept sources first; the assembler wants the destination
+    // first. A stack address is an addi from its base.
+    std::vector<std::string> operands;
+    if (mi.opcode == LA && mi.ops[0].symbol.empty()) {
+        mnemonic = "addi";
+        operands = {print(mi.ops[1]), regName(mi.ops[0].reg, 8), std::to_string(mi.ops[0].imm)};
+    } else {
+        for (const auto& op : mi.ops) {
+            if (op.isReg() && op.isDef) operands.insert(operands.begin(), print(op));
+        }
+        for (const auto& op : mi.ops) {
+            if (!(op.isReg() && op.isDef)) operands.push_back(print(op));
+        }
+    }
+
+    std::string text = "    " + mnemonic;
+    for (size_t i = 0; i < operands.size(); ++i) text += (i == 0 ? " " : ", ") + operands[i];
+    return text;
+}
+
+std::string RISCVTarget::printFunction(const MachineFunction& mf) const {
+    std::ostringstream out;
+    out << "    .text\n";
+    out << "    .globl " << mf.name << "\n";
+    out << "    .p2align 2\n";
+    out << "    .type " << mf.name << ", @function\n";
+    out << mf.name << ":\n";
+
+    // Conditional branches reach 4 KiB either way. Bound every instruction
+    // at 8 bytes, the size of the longest pseudo, and turn branches that
+    // may be out of range into an inverted branch over a jump.
+    std::vector<long long> blockStart;
+    long long size = 0;
+    for (const auto& bb : mf.blocks) {
+        blockStart.push_back(size);
+        size += 8 * static_cast<long long>(bb->insts.size());
+    }
+    int farBranches = 0;
+    for (size_t b = 0; b < mf.blocks.size(); ++b) {
+        out << mf.blocks[b]->label << ":\n";
+        long long pc = blockStart[b];
+        for (const auto& mi : mf.blocks[b]->insts) {
+            long long distance = mi.opcode == BCC ? blockStart[mi.ops[2].block] - pc : 0;
+            if (distance < -4000 || distance > 4000) {
+                std::string skip = ".L" + mf.name + "_far" + std::to_string(farBranches++);
+                out << "    " << kBranchNames[mi.cond ^ 1] << " " << regName(mi.ops[0].reg, 8) << ", "
+                    << regName(mi.ops[1].reg, 8) << ", " << skip << "\n";
+                out << "    j " << mf.blocks[mi.ops[2].block]->label << "\n";
+                out << skip << ":\n";
+            } else {
+                out << printInstruction(mi, mf) << "\n";
+            }
+            pc += 8;
+        }
+    }
+    out << "    .size " << mf.name << ", .-" << mf.name << "\n\n";
+    return out.str();
+}
+
+std::string RISCVTarget::printGlobals(const Module& m) const {
+    std::ostringstream out;
+    for (const auto& g : m.globals) {
+        int size = typeSizeInBytes(g.type);
+        if (g.zeroInit) {
+            out << "    .bss\n";
+        } else if (g.isConstant) {
+            out << "    .section .rodata\n";
+        } else {
+            out << "    .data\n";
+        }
+        out << "    .globl " << g.name << "\n";
+        out << "    .p2align " << (size >= 16 ? 4 : 2) << "\n";
+        out << g.name << ":\n";
+        // Trailing zeros of large arrays go out as one directive.
+        int values = g.zeroInit ? 0 : static_cast<int>(g.init.size());
+        while (values > 0 && g.init[values - 1] == 0) --values;
+        for (int i = 0; i < values; ++i) out << "    .word " << g.init[i] << "\n";
+        if (size > 4 * values) out << "    .zero " << size - 4 * values << "\n";
+    }
+    out << "    .section .note.GNU-stack,\"\",@progbits\n";
+    return out.str();
+}
+
+void RISCVTarget::encodeFunction(const MachineFunction&, ObjectFile&) const {
+    throw std::runtime_error("riscv64: object files are not supported, use -S");
+}
+
+std::unique_ptr<Target> createRISCVTarget() {
+    return std::make_unique<RISCVTarget>();
+}
@@ -0,0 +1,316 @@
+#include "RegAlloc.h"
+#include <algorithm>
+
+InstructionNumbering::InstructionNumbering(const MachineFunction& mf) {
+    int index = 0;
+    for (const auto& bb : mf.blocks) {
+        blockStart.push_back(2 * index);
+        index += static_cast<int>(bb->insts.size());
+        // Empty blocks still get a position, so that ranges through them
+        // stay ordered.
+        if (bb->insts.empty()) ++index;
+        blockEnd.push_back(2 * index - 1);
+    }
+}
+
+Liveness::Liveness(const MachineFunction& mf) {
+    size_t n = mf.blocks.size();
+    size_t regs = static_cast<size_t>(mf.vregCount());
+    std::vector<std::vector<bool>> uses(n, std::vector<bool>(regs)), defs(n, std::vector<bool>(regs));
+    for (size_t b = 0; b < n; ++b) {
+        std::vector<int> regsUsed, regsDefined;
+        for (const auto& mi : mf.blocks[b]->insts) {
+            regsUsed.clear();
+            regsDefined.clear();
+            mi.uses(regsUsed);
+            mi.defs(regsDefined);
+            for (int reg : regsUsed) {
+                if (isVirtualReg(reg) && !defs[b][reg - kFirstVirtualReg]) uses[b][reg - kFirstVirtualReg] = true;
+            }
+            for (int reg : regsDefined) {
+                if (isVirtualReg(reg)) defs[b][reg - kFirstVirtualReg] = true;
+            }
+        }
+    }
+
+    liveIn.assign(n, std::vector<bool>(regs));
+    liveOut.assign(n, std::vector<bool>(regs));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = n; b-- > 0;) {
+            std::vector<bool> out(regs);
+            for (int succ : mf.blocks[b]->succs) {
+                const auto& in = liveIn[succ];
+                for (size_t r = 0; r < regs; ++r) {
+                    if (in[r]) out[r] = true;
+                }
+            }
+            std::vector<bool> in = uses[b];
+            for (size_t r = 0; r < regs; ++r) {
+                if (out[r] && !defs[b][r]) in[r] = true;
+            }
+            if (in != liveIn[b] || out != liveOut[b]) {
+                liveIn[b] = std::move(in);
+                liveOut[b] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+}
+
+std::vector<LiveInterval> buildLiveIntervals(const MachineFunction& mf, const InstructionNumbering& numbering,
+                                             const Liveness& liveness, const std::set<int>& unspillable) {
+    int regs = mf.vregCount();
+    std::vector<int> start(regs, -1), end(regs, -1);
+    auto extend = [&](int reg, int pos) {
+        int r = reg - kFirstVirtualReg;
+        if (start[r] < 0 || pos < start[r]) start[r] = pos;
+        if (pos > end[r]) end[r] = pos;
+    };
+    std::vector<int> regsUsed, regsDefined;
+    for (size_t b = 0; b < mf.blocks.size(); ++b) {
+        for (int r = 0; r < regs; ++r) {
+            if (liveness.liveIn[b][r]) extend(kFirstVirtualReg + r, numbering.blockStart[b]);
+            if (liveness.liveOut[b][r]) extend(kFirstVirtualReg + r, numbering.blockEnd[b]);
+        }
+        int pos = numbering.blockStart[b];
+        for (const auto& mi : mf.blocks[b]->insts) {
+            regsUsed.clear();
+            regsDefined.clear();
+            mi.uses(regsUsed);
+            mi.defs(regsDefined);
+            for (int reg : regsUsed) {
+                if (isVirtualReg(reg)) extend(reg, pos);
+            }
+            for (int reg : regsDefined) {
+                if (isVirtualReg(reg)) extend(reg, pos + 1);
+            }
+            pos += 2;
+        }
+    }
+    std::vector<LiveInterval> intervals;
+    for (int r = 0; r < regs; ++r) {
+        if (start[r] < 0) continue;
+        int reg = kFirstVirtualReg + r;
+        intervals.push_back({reg, start[r], end[r], !unspillable.count(reg)});
+    }
+    return intervals;
+}
+
+std::map<int, std::vector<std::pair<int, int>>> buildFixedRanges(const MachineFunction& mf,
+                                                                 const InstructionNumbering& numbering) {
+    std::map<int, std::vector<std::pair<int, int>>> ranges;
+    std::vector<int> regsUsed, regsDefined;
+    for (size_t b = 0; b < mf.blocks.size(); ++b) {
+        // Open range of each register within the block: where it started
+        // and the last position it was seen.
+        std::map<int, std::pair<int, int>> open;
+        int pos = numbering.blockStart[b];
+        for (const auto& mi : mf.blocks[b]->insts) {
+            regsUsed.clear();
+            regsDefined.clear();
+            mi.uses(regsUsed);
+            mi.defs(regsDefined);
+            for (int reg : regsUsed) {
+                if (!isPhysicalReg(reg)) continue;
+                auto it = open.find(reg);
+                // Live into the block, e.g. an argument register in the entry
+                if (it == open.end()) it = open.insert({reg, {numbering.blockStart[b], pos}}).first;
+                it->second.second = pos;
+            }
+            for (int reg : regsDefined) {
+                if (!isPhysicalReg(reg)) continue;
+                auto it = open.find(reg);
+                if (it != open.end()) ranges[reg].push_back(it->second);
+                open[reg] = {pos + 1, pos + 1};
+            }
+            pos += 2;
+        }
+        for (const auto& [reg, range] : open) ranges[reg].push_back(range);
+    }
+    return ranges;
+}
+
+std::vector<int> computeLoopDepths(const MachineFunction& mf) {
+    size_t n = mf.blocks.size();
+    std::vector<std::vector<int>> preds(n);
+    for (size_t b = 0; b < n; ++b) {
+        for (int succ : mf.blocks[b]->succs) preds[succ].push_back(static_cast<int>(b));
+    }
+
+    // Dominators by the iterative algorithm of Cooper, Harvey and Kennedy.
+    std::vector<int> rpo, order(n, -1);
+    std::vector<bool> visited(n);
+    std::vector<std::pair<int, size_t>> stack = {{0, 0}};
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& [b, next] = stack.back();
+        const auto& succs = mf.blocks[b]->succs;
+        if (next < succs.size()) {
+            int succ = succs[next++];
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.push_back({succ, 0});
+            }
+            continue;
+        }
+        rpo.push_back(b);
+        stack.pop_back();
+    }
+    std::reverse(rpo.begin(), rpo.end());
+    for (size_t i = 0; i < rpo.size(); ++i) order[rpo[i]] = static_cast<int>(i);
+    std::vector<int> idom(n, -1);
+    idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); ++i) {
+            int b = rpo[i];
+            int dom = -1;
+            for (int p : preds[b]) {
+                if (idom[p] < 0) continue;
+                if (dom < 0) {
+                    dom = p;
+                    continue;
+                }
+                int x = p;
+                while (x != dom) {
+                    while (order[x] > order[dom]) x = idom[x];
+                    while (order[dom] > order[x]) dom = idom[dom];
+                }
+            }
+            if (dom != idom[b]) {
+                idom[b] = dom;
+                changed = true;
+            }
+        }
+    }
+    auto dominates = [&](int a, int b) {
+        for (;;) {
+            if (a == b) return true;
+            if (b == 0) return false;
+            b = idom[b];
+        }
+    };
+
+    // Natural loops, merged per header, each adding one level to its blocks.
+    std::map<int, std::set<int>> loops;
+    for (int b : rpo) {
+        for (int header : mf.blocks[b]->succs) {
+            if (!dominates(header, b)) continue;
+            std::set<int>& body = loops[header];
+            body.insert(header);
+            std::vector<int> work;
+            if (body.insert(b).second) work.push_back(b);
+            while (!work.empty()) {
+                int x = work.back();
+                work.pop_back();
+                for (int p : preds[x]) {
+                    if (idom[p] >= 0 && body.insert(p).second) work.push_back(p);
+                }
+            }
+        }
+    }
+    std::vector<int> depth(n);
+    for (const auto& [header, body] : loops) {
+        for (int b : body) ++depth[b];
+    }
+    return depth;
+}
+
+std::map<int, MachineInstr> findRematerializable(const MachineFunction& mf, const Target& target) {
+    std::map<int, MachineInstr> remat;
+    std::set<int> multiple;
+    std::vector<int> regsDefined;
+    for (const auto& bb : mf.blocks) {
+        for (const auto& mi : bb->insts) {
+            regsDefined.clear();
+            mi.defs(regsDefined);
+            for (int reg : regsDefined) {
+                if (!isVirtualReg(reg) || multiple.count(reg)) continue;
+                if (remat.count(reg) || !target.isRematerializable(mi)) {
+                    remat.erase(reg);
+                    multiple.insert(reg);
+                } else {
+                    remat.emplace(reg, mi);
+                }
+            }
+        }
+    }
+    return remat;
+}
+
+void insertSpillCode(MachineFunction& mf, const Target& target, const std::set<int>& spilled,
+                     std::set<int>& unspillable, const std::map<int, MachineInstr>& remat) {
+    std::map<int, int> slots;
+    for (int reg : spilled) {
+        if (!remat.count(reg)) slots[reg] = mf.addFrameObject(8, 8);
+    }
+    std::vector<int> regsUsed, regsDefined;
+    for (auto& bb : mf.blocks) {
+        std::vector<MachineInstr> out;
+        for (auto& mi : bb->insts) {
+            regsUsed.clear();
+            regsDefined.clear();
+            mi.uses(regsUsed);
+            mi.defs(regsDefined);
+            // The definition of a rematerialized register goes away; its
+            // uses get copies of it.
+            if (regsDefined.size() == 1 && spilled.count(regsDefined[0]) && remat.count(regsDefined[0])) continue;
+            std::vector<MachineInstr> after;
+            std::map<int, int> renamed;
+            auto rename = [&](int reg) {
+                auto it = renamed.find(reg);
+                if (it != renamed.end()) return it->second;
+                int temp = mf.newVReg(mf.vregSize(reg));
+                unspillable.insert(temp);
+                return renamed[reg] = temp;
+            };
+            for (int reg : regsUsed) {
+                if (!spilled.count(reg) || renamed.count(reg)) continue;
+                int temp = rename(reg);
+                auto it = remat.find(reg);
+                if (it != remat.end()) {
+                    MachineInstr def = it->second;
+                    def.replaceReg(reg, temp);
+                    out.push_back(std::move(def));
+                } else {
+                    out.push_back(target.loadFromFrame(temp, slots[reg], mf.vregSize(reg)));
+                }
+            }
+            std::set<int> stored;
+            for (int reg : regsDefined) {
+                if (!spilled.count(reg) || !stored.insert(reg).second) continue;
+                after.push_back(target.storeToFrame(rename(reg), slots[reg], mf.vregSize(reg)));
+            }
+            for (const auto& [from, to] : renamed) mi.replaceReg(from, to);
+            out.push_back(std::move(mi));
+            for (auto& store : after) out.push_back(std::move(store));
+        }
+        bb->insts = std::move(out);
+    }
+}
+
+void applyAssignment(MachineFunction& mf, const Target& target, const std::map<int, int>& assignment) {
+    std::set<int> calleeSaved;
+    for (const auto& [vreg, preg] : assignment) {
+        if (target.isCalleeSaved(preg)) calleeSaved.insert(preg);
+    }
+    for (auto& bb : mf.blocks) {
+        for (auto& mi : bb->insts) {
+            auto map = [&](int& reg) {
+                if (!isVirtualReg(reg)) return;
+                auto it = assignment.find(reg);
+                if (it != assignment.end()) reg = it->second;
+            };
+            for (auto& op : mi.ops) {
+                if (op.kind == MachineOperand::Reg || op.kind == MachineOperand::Mem) map(op.reg);
+                if (op.kind == MachineOperand::Mem) map(op.index);
+            }
+            for (auto& reg : mi.implicitUses) map(reg);
+            for (auto& reg : mi.implicitDefs) map(reg);
+        }
+    }
+    mf.usedCalleeSaved.assign(calleeSaved.begin(), calleeSaved.end());
+}
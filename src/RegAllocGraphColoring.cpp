@@ -0,0 +1,451 @@
+#include "RegAlloc.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+
+// Iterated register coalescing as in Appel's "Modern Compiler
+// Implementation", with nodes numbered by register: physical registers are
+// precolored, virtual registers are the nodes to color. Every node is in
+// exactly one of the worklists or sets below, recorded in `state`.
+class GraphColoring {
+public:
+    GraphColoring(MachineFunction& mf, const Target& target, const std::set<int>& unspillable)
+        : mf(mf), target(target), unspillable(unspillable) {}
+
+    // Colors the function; returns the registers to spill, or an empty set
+    // when `assignment` is complete.
+    std::set<int> run(std::map<int, int>& assignment);
+
+private:
+    enum class NodeState { Precolored, Initial, Simplify, Freeze, Spill, Spilled, Coalesced, Colored, Selected };
+    enum class MoveState { Worklist, Active, Coalesced, Constrained, Frozen };
+
+    struct Move {
+        int dst;
+        int src;
+    };
+
+    bool isNode(int reg) const { return isVirtualReg(reg) || allocatable.count(reg); }
+    bool isPrecolored(int n) const { return isPhysicalReg(n); }
+
+    void build();
+    void addEdge(int u, int v);
+    void makeWorklist();
+    std::vector<int> adjacent(int n) const;
+    std::vector<int> nodeMoves(int n) const;
+    bool moveRelated(int n) const { return !nodeMoves(n).empty(); }
+    void setState(int n, NodeState s) { state[n] = s; }
+    void simplify();
+    void decrementDegree(int m);
+    void enableMoves(int n);
+    void coalesce();
+    void addWorklist(int u);
+    bool ok(int t, int r) const;
+    bool conservative(const std::vector<int>& nodes) const;
+    int alias(int n) const;
+    void combine(int u, int v);
+    void freeze();
+    void freezeMoves(int u);
+    void selectSpill();
+    void assignColors();
+
+    bool inState(int n, NodeState s) const { return state[n] == s; }
+
+    MachineFunction& mf;
+    const Target& target;
+    const std::set<int>& unspillable;
+    std::set<int> allocatable;
+    int k = 0;
+
+    std::vector<NodeState> state;
+    std::vector<int> degree;
+    std::vector<int> aliases;
+    std::vector<int> color;
+    std::vector<double> cost;
+    std::vector<std::vector<int>> adjList;
+    std::unordered_set<long long> adjSet;
+    std::vector<std::vector<int>> moveList;
+    std::vector<Move> moves;
+    std::vector<MoveState> moveState;
+    std::set<int> worklistMoves;
+    std::set<int> simplifyWorklist, freezeWorklist, spillWorklist;
+    std::vector<int> selectStack;
+};
+
+void GraphColoring::addEdge(int u, int v) {
+    if (u == v) return;
+    long long n = static_cast<long long>(state.size());
+    if (!adjSet.insert(u * n + v).second) return;
+    adjSet.insert(v * n + u);
+    if (!isPrecolored(u)) {
+        adjList[u].push_back(v);
+        ++degree[u];
+    }
+    if (!isPrecolored(v)) {
+        adjList[v].push_back(u);
+        ++degree[v];
+    }
+}
+
+void GraphColoring::build() {
+    int nodes = kFirstVirtualReg + mf.vregCount();
+    state.assign(nodes, NodeState::Initial);
+    for (int r = 0; r < kFirstVirtualReg; ++r) state[r] = NodeState::Precolored;
+    degree.assign(nodes, 0);
+    for (int r = 0; r < kFirstVirtualReg; ++r) degree[r] = std::numeric_limits<int>::max() / 2;
+    aliases.resize(nodes);
+    for (int n = 0; n < nodes; ++n) aliases[n] = n;
+    color.assign(nodes, kNoReg);
+    for (int r = 0; r < kFirstVirtualReg; ++r) color[r] = r;
+    cost.assign(nodes, 0);
+    adjList.assign(nodes, {});
+    moveList.assign(nodes, {});
+
+    Liveness liveness(mf);
+    std::vector<int> depths = computeLoopDepths(mf);
+    std::map<int, MachineInstr> remat = findRematerializable(mf, target);
+    std::vector<int> regsUsed, regsDefined;
+    for (size_t b = 0; b < mf.blocks.size(); ++b) {
+        double weight = std::pow(10.0, std::min(depths[b], 6));
+        std::set<int> live;
+        for (int r = 0; r < mf.vregCount(); ++r) {
+            if (liveness.liveOut[b][r]) live.insert(kFirstVirtualReg + r);
+        }
+        const auto& insts = mf.blocks[b]->insts;
+        for (size_t i = insts.size(); i-- > 0;) {
+            const MachineInstr& mi = insts[i];
+            regsUsed.clear();
+            regsDefined.clear();
+            mi.uses(regsUsed);
+            mi.defs(regsDefined);
+            std::vector<int> uses, defs;
+            for (int reg : regsUsed) {
+                if (isNode(reg)) uses.push_back(reg);
+            }
+            for (int reg : regsDefined) {
+                if (isNode(reg)) defs.push_back(reg);
+            }
+
+            // A copy does not make its source and destination interfere.
+            // Copies that change the width of a value stay, since the
+            // narrower one zero-extends.
+            int dst, src;
+            if (target.isCopy(mi, dst, src) && isNode(dst) && isNode(src) &&
+                (!isVirtualReg(dst) || mf.vregSize(dst) == mi.size) &&
+                (!isVirtualReg(src) || mf.vregSize(src) == mi.size)) {
+                live.erase(src);
+                int m = static_cast<int>(moves.size());
+                moves.push_back({dst, src});
+                moveState.push_back(MoveState::Worklist);
+                worklistMoves.insert(m);
+                moveList[dst].push_back(m);
+                if (src != dst) moveList[src].push_back(m);
+            }
+            for (int d : defs) live.insert(d);
+            for (int d : defs) {
+                for (int l : live) addEdge(l, d);
+            }
+            for (int d : defs) live.erase(d);
+            for (int u : uses) live.insert(u);
+
+            // Rematerializable values cost a recomputation at each use and
+            // nothing at the definition.
+            for (int u : uses) {
+                if (isVirtualReg(u)) cost[u] += remat.count(u) ? weight / 2 : weight;
+            }
+            for (int d : defs) {
+                if (isVirtualReg(d) && !remat.count(d)) cost[d] += weight;
+            }
+        }
+    }
+}
+
+void GraphColoring::makeWorklist() {
+    for (int n = kFirstVirtualReg; n < static_cast<int>(state.size()); ++n) {
+        if (degree[n] >= k) {
+            setState(n, NodeState::Spill);
+            spillWorklist.insert(n);
+        } else if (moveRelated(n)) {
+            setState(n, NodeState::Freeze);
+            freezeWorklist.insert(n);
+        } else {
+            setState(n, NodeState::Simplify);
+            simplifyWorklist.insert(n);
+        }
+    }
+}
+
+std::vector<int> GraphColoring::adjacent(int n) const {
+    std::vector<int> result;
+    for (int m : adjList[n]) {
+        if (!inState(m, NodeState::Selected) && !inState(m, NodeState::Coalesced)) result.push_back(m);
+    }
+    return result;
+}
+
+std::vector<int> GraphColoring::nodeMoves(int n) const {
+    std::vector<int> result;
+    for (int m : moveList[n]) {
+        if (moveState[m] == MoveState::Active || moveState[m] == MoveState::Worklist) result.push_back(m);
+    }
+    return result;
+}
+
+void GraphColoring::simplify() {
+    int n = *simplifyWorklist.begin();
+    simplifyWorklist.erase(simplifyWorklist.begin());
+    setState(n, NodeState::Selected);
+    selectStack.push_back(n);
+    for (int m : adjacent(n)) decrementDegree(m);
+}
+
+void GraphColoring::decrementDegree(int m) {
+    if (isPrecolored(m)) return;
+    int d = degree[m]--;
+    if (d != k) return;
+    enableMoves(m);
+    for (int n : adjacent(m)) enableMoves(n);
+    spillWorklist.erase(m);
+    if (moveRelated(m)) {
+        setState(m, NodeState::Freeze);
+        freezeWorklist.insert(m);
+    } else {
+        setState(m, NodeState::Simplify);
+        simplifyWorklist.insert(m);
+    }
+}
+
+void GraphColoring::enableMoves(int n) {
+    for (int m : nodeMoves(n)) {
+        if (moveState[m] != MoveState::Active) continue;
+        moveState[m] = MoveState::Worklist;
+        worklistMoves.insert(m);
+    }
+}
+
+void GraphColoring::addWorklist(int u) {
+    if (isPrecolored(u) || moveRelated(u) || degree[u] >= k) return;
+    freezeWorklist.erase(u);
+    setState(u, NodeState::Simplify);
+    simplifyWorklist.insert(u);
+}
+
+// George's test for coalescing with a precolored node
+bool GraphColoring::ok(int t, int r) const {
+    long long n = static_cast<long long>(state.size());
+    return degree[t] < k || isPrecolored(t) || adjSet.count(t * n + r);
+}
+
+// Briggs's test: fewer than k neighbours of significant degree
+bool GraphColoring::conservative(const std::vector<int>& nodes) const {
+    std::set<int> seen;
+    int significant = 0;
+    for (int n : nodes) {
+        if (seen.insert(n).second && degree[n] >= k) ++significant;
+    }
+    return significant < k;
+}
+
+int GraphColoring::alias(int n) const {
+    while (inState(n, NodeState::Coalesced)) n = aliases[n];
+    return n;
+}
+
+void GraphColoring::coalesce() {
+    int m = *worklistMoves.begin();
+    worklistMoves.erase(worklistMoves.begin());
+    int x = alias(moves[m].dst);
+    int y = alias(moves[m].src);
+    int u = x, v = y;
+    if (isPrecolored(y)) std::swap(u, v);
+    long long n = static_cast<long long>(state.size());
+
+    if (u == v) {
+        moveState[m] = MoveState::Coalesced;
+        addWorklist(u);
+        return;
+    }
+    if (isPrecolored(v) || adjSet.count(u * n + v)) {
+        moveState[m] = MoveState::Constrained;
+        addWorklist(u);
+        addWorklist(v);
+        return;
+    }
+    bool safe;
+    if (isPrecolored(u)) {
+        safe = true;
+        for (int t : adjacent(v)) safe = safe && ok(t, u);
+    } else {
+        std::vector<int> nodes = adjacent(u);
+        std::vector<int> more = adjacent(v);
+        nodes.insert(nodes.end(), more.begin(), more.end());
+        safe = conservative(nodes);
+    }
+    if (safe) {
+        moveState[m] = MoveState::Coalesced;
+        combine(u, v);
+        addWorklist(u);
+    } else {
+        moveState[m] = MoveState::Active;
+    }
+}
+
+void GraphColoring::combine(int u, int v) {
+    if (inState(v, NodeState::Freeze)) {
+        freezeWorklist.erase(v);
+    } else {
+        spillWorklist.erase(v);
+    }
+    setState(v, NodeState::Coalesced);
+    aliases[v] = u;
+    moveList[u].insert(moveList[u].end(), moveList[v].begin(), moveList[v].end());
+    cost[u] += cost[v];
+    enableMoves(v);
+    for (int t : adjacent(v)) {
+        addEdge(t, u);
+        decrementDegree(t);
+    }
+    if (!isPrecolored(u) && degree[u] >= k && inState(u, NodeState::Freeze)) {
+        freezeWorklist.erase(u);
+        setState(u, NodeState::Spill);
+        spillWorklist.insert(u);
+    }
+}
+
+void GraphColoring::freeze() {
+    int u = *freezeWorklist.begin();
+    freezeWorklist.erase(freezeWorklist.begin());
+    setState(u, NodeState::Simplify);
+    simplifyWorklist.insert(u);
+    freezeMoves(u);
+}
+
+void GraphColoring::freezeMoves(int u) {
+    for (int m : nodeMoves(u)) {
+        int x = moves[m].dst, y = moves[m].src;
+        int v = alias(y) == alias(u) ? alias(x) : alias(y);
+        moveState[m] = MoveState::Frozen;
+        worklistMoves.erase(m);
+        if (!isPrecolored(v) && inState(v, NodeState::Freeze) && !moveRelated(v) && degree[v] < k) {
+            freezeWorklist.erase(v);
+            setState(v, NodeState::Simplify);
+            simplifyWorklist.insert(v);
+        }
+    }
+}
+
+void GraphColoring::selectSpill() {
+    // Cheapest per interference removed; the one-instruction temporaries of
+    // earlier spills only if nothing else is left.
+    int best = -1;
+    double bestCost = 0;
+    for (int n : spillWorklist) {
+        double c = unspillable.count(n) ? std::numeric_limits<double>::infinity() : cost[n] / degree[n];
+        if (best < 0 || c < bestCost) {
+            best = n;
+            bestCost = c;
+        }
+    }
+    spillWorklist.erase(best);
+    setState(best, NodeState::Simplify);
+    simplifyWorklist.insert(best);
+    freezeMoves(best);
+}
+
+void GraphColoring::assignColors() {
+    while (!selectStack.empty()) {
+        int n = selectStack.back();
+        selectStack.pop_back();
+        std::set<int> taken;
+        for (int w : adjList[n]) {
+            int a = alias(w);
+            if (isPrecolored(a) || inState(a, NodeState::Colored)) taken.insert(color[a]);
+        }
+        int chosen = kNoReg;
+        for (int reg : target.allocatableRegs()) {
+            if (!taken.count(reg)) {
+                chosen = reg;
+                break;
+            }
+        }
+        if (chosen == kNoReg) {
+            setState(n, NodeState::Spilled);
+        } else {
+            setState(n, NodeState::Colored);
+            color[n] = chosen;
+        }
+    }
+}
+
+std::set<int> GraphColoring::run(std::map<int, int>& assignment) {
+    allocatable.insert(target.allocatableRegs().begin(), target.allocatableRegs().end());
+    k = static_cast<int>(allocatable.size());
+    build();
+    makeWorklist();
+    while (!simplifyWorklist.empty() || !worklistMoves.empty() || !freezeWorklist.empty() ||
+           !spillWorklist.empty()) {
+        if (!simplifyWorklist.empty()) {
+            simplify();
+        } else if (!worklistMoves.empty()) {
+            coalesce();
+        } else if (!freezeWorklist.empty()) {
+            freeze();
+        } else {
+            selectSpill();
+        }
+    }
+    assignColors();
+
+    std::set<int> spilled;
+    for (int n = kFirstVirtualReg; n < static_cast<int>(state.size()); ++n) {
+        if (!inState(n, NodeState::Spilled)) continue;
+        if (unspillable.count(n)) throw std::runtime_error("register allocation failed in " + mf.name);
+        spilled.insert(n);
+    }
+    if (!spilled.empty()) return spilled;
+    for (int n = kFirstVirtualReg; n < static_cast<int>(state.size()); ++n) {
+        int c = color[alias(n)];
+        if (c != kNoReg) assignment[n] = c;
+    }
+    return spilled;
+}
+
+// Drops copies between registers that got the same physical register,
+// unless the copy narrows the value.
+void removeIdentityCopies(MachineFunction& mf, const Target& target, const std::map<int, int>& assignment) {
+    auto physical = [&](int reg) {
+        auto it = assignment.find(reg);
+        return it == assignment.end() ? reg : it->second;
+    };
+    auto sameWidth = [&](int reg, int size) { return !isVirtualReg(reg) || mf.vregSize(reg) == size; };
+    for (auto& bb : mf.blocks) {
+        std::vector<MachineInstr> out;
+        for (auto& mi : bb->insts) {
+            int dst, src;
+            if (target.isCopy(mi, dst, src) && physical(dst) == physical(src) && sameWidth(dst, mi.size) &&
+                sameWidth(src, mi.size)) {
+                continue;
+            }
+            out.push_back(std::move(mi));
+        }
+        bb->insts = std::move(out);
+    }
+}
+
+} // namespace
+
+void allocateRegistersGraphColoring(MachineFunction& mf, const Target& target) {
+    std::set<int> unspillable;
+    std::map<int, int> assignment;
+    for (;;) {
+        assignment.clear();
+        std::set<int> spilled = GraphColoring(mf, target, unspillable).run(assignment);
+        if (spilled.empty()) break;
+        insertSpillCode(mf, target, spilled, unspillable, findRematerializable(mf, target));
+    }
+    removeIdentityCopies(mf, target, assignment);
+    applyAssignment(mf, target, assignment);
+}
@@ -0,0 +1,89 @@
+#include "RegAlloc.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+bool overlaps(const std::vector<std::pair<int, int>>& ranges, int start, int end) {
+    for (const auto& [a, b] : ranges) {
+        if (a <= end && start <= b) return true;
+    }
+    return false;
+}
+
+// One round of linear scan. Returns the registers to spill; `assignment`
+// is complete when there are none.
+std::set<int> scan(const MachineFunction& mf, const Target& target, const std::set<int>& unspillable,
+                   std::map<int, int>& assignment) {
+    InstructionNumbering numbering(mf);
+    Liveness liveness(mf);
+    std::vector<LiveInterval> intervals = buildLiveIntervals(mf, numbering, liveness, unspillable);
+    auto fixed = buildFixedRanges(mf, numbering);
+    std::sort(intervals.begin(), intervals.end(), [](const LiveInterval& a, const LiveInterval& b) {
+        return a.start != b.start ? a.start < b.start : a.reg < b.reg;
+    });
+
+    // Whether `reg` stays clear of the fixed uses of physical register `preg`
+    auto fits = [&](const LiveInterval& interval, int preg) {
+        auto it = fixed.find(preg);
+        return it == fixed.end() || !overlaps(it->second, interval.start, interval.end);
+    };
+
+    std::set<int> spilled;
+    std::vector<const LiveInterval*> active;
+    std::map<int, const LiveInterval*> holder;  // Physical register -> active interval
+    for (const auto& current : intervals) {
+        for (size_t i = active.size(); i-- > 0;) {
+            if (active[i]->end < current.start) {
+                holder.erase(assignment[active[i]->reg]);
+                active.erase(active.begin() + static_cast<long>(i));
+            }
+        }
+
+        int chosen = kNoReg;
+        for (int preg : target.allocatableRegs()) {
+            if (!holder.count(preg) && fits(current, preg)) {
+                chosen = preg;
+                break;
+            }
+        }
+        if (chosen != kNoReg) {
+            assignment[current.reg] = chosen;
+            holder[chosen] = &current;
+            active.push_back(&current);
+            continue;
+        }
+
+        // Out of registers: spill whichever of the current interval and the
+        // active ones it could replace lives longest.
+        const LiveInterval* victim = current.spillable ? &current : nullptr;
+        for (const LiveInterval* other : active) {
+            if (!other->spillable || !fits(current, assignment[other->reg])) continue;
+            if (!victim || other->end > victim->end) victim = other;
+        }
+        if (!victim) throw std::runtime_error("register allocation failed in " + mf.name);
+        spilled.insert(victim->reg);
+        if (victim == &current) continue;
+        int preg = assignment[victim->reg];
+        assignment.erase(victim->reg);
+        active.erase(std::find(active.begin(), active.end(), victim));
+        assignment[current.reg] = preg;
+        holder[preg] = &current;
+        active.push_back(&current);
+    }
+    return spilled;
+}
+
+} // namespace
+
+void allocateRegistersLinearScan(MachineFunction& mf, const Target& target) {
+    std::set<int> unspillable;
+    std::map<int, int> assignment;
+    for (;;) {
+        assignment.clear();
+        std::set<int> spilled = scan(mf, target, unspillable, assignment);
+        if (spilled.empty()) break;
+        insertSpillCode(mf, target, spilled, unspillable);
+    }
+    applyAssignment(mf, target, assignment);
+}
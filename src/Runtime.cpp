@@ -0,0 +1,117 @@
+#include "Runtime.h"
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+#include <sys/time.h>
+
+namespace {
+
+// Timers, numbered from 1 in the order they stop; slot 0 holds the total.
+constexpr int kTimers = 1024;
+struct timeval timerStart;
+int startLine[kTimers], stopLine[kTimers];
+int hours[kTimers], minutes[kTimers], seconds[kTimers], micros[kTimers];
+int timerCount;
+
+} // namespace
+
+namespace runtime {
+
+int getint() {
+    int t = 0;
+    std::scanf("%d", &t);
+    return t;
+}
+
+int getch() {
+    char c = 0;
+    std::scanf("%c", &c);
+    return c;
+}
+
+int getarray(int a[]) {
+    int n = 0;
+    std::scanf("%d", &n);
+    for (int i = 0; i < n; ++i) std::scanf("%d", &a[i]);
+    return n;
+}
+
+void putint(int a) {
+    std::printf("%d", a);
+}
+
+void putch(int a) {
+    std::printf("%c", a);
+}
+
+void putarray(int n, int a[]) {
+    std::printf("%d:", n);
+    for (int i = 0; i < n; ++i) std::printf(" %d", a[i]);
+    std::printf("\n");
+}
+
+void putf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    std::vfprintf(stdout, format, args);
+    va_end(args);
+}
+
+void startTime(int line) {
+    startLine[timerCount] = line;
+    gettimeofday(&timerStart, nullptr);
+}
+
+void stopTime(int line) {
+    struct timeval end;
+    gettimeofday(&end, nullptr);
+    int i = timerCount;
+    stopLine[i] = line;
+    micros[i] += 1000000 * (end.tv_sec - timerStart.tv_sec) + end.tv_usec - timerStart.tv_usec;
+    seconds[i] += micros[i] / 1000000;
+    micros[i] %= 1000000;
+    minutes[i] += seconds[i] / 60;
+    seconds[i] %= 60;
+    hours[i] += minutes[i] / 60;
+    minutes[i] %= 60;
+    ++timerCount;
+}
+
+void* lookup(const std::string& name) {
+    static const std::map<std::string, void*> functions = {
+        {"getint", reinterpret_cast<void*>(&getint)},
+        {"getch", reinterpret_cast<void*>(&getch)},
+        {"getarray", reinterpret_cast<void*>(&getarray)},
+        {"putint", reinterpret_cast<void*>(&putint)},
+        {"putch", reinterpret_cast<void*>(&putch)},
+        {"putarray", reinterpret_cast<void*>(&putarray)},
+        {"putf", reinterpret_cast<void*>(&putf)},
+        {"_sysy_starttime", reinterpret_cast<void*>(&startTime)},
+        {"_sysy_stoptime", reinterpret_cast<void*>(&stopTime)},
+    };
+    auto it = functions.find(name);
+    return it == functions.end() ? nullptr : it->second;
+}
+
+void reset() {
+    for (int i = 0; i < kTimers; ++i) hours[i] = minutes[i] = seconds[i] = micros[i] = 0;
+    timerCount = 1;
+}
+
+void finish() {
+    std::fflush(stdout);
+    for (int i = 1; i < timerCount; ++i) {
+        std::fprintf(stderr, "Timer@%04d-%04d: %dH-%dM-%dS-%dus\n", startLine[i], stopLine[i], hours[i], minutes[i],
+                     seconds[i], micros[i]);
+        micros[0] += micros[i];
+        seconds[0] += seconds[i];
+        micros[0] %= 1000000;
+        minutes[0] += minutes[i];
+        seconds[0] %= 60;
+        hours[0] += hours[i];
+        minutes[0] %= 60;
+    }
+    std::fprintf(stderr, "TOTAL: %dH-%dM-%dS-%dus\n", hours[0], minutes[0], seconds[0], micros[0]);
+}
+
+} // namespace runtime
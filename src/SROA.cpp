@@ -0,0 +1,92 @@
+#include "Passes.h"
+#include <algorithm>
+
+// Arrays larger than this stay in memory even if every index is constant;
+// splitting them would only trade one alloca for a wall of scalars.
+static const int kMaxScalarizedElements = 64;
+
+bool scalarReplaceAggregates(Function& f) {
+    if (f.isDeclaration) return false;
+
+    std::map<std::string, std::string> arrays;  // alloca -> array type
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op != Opcode::Alloca || !isArrayTypeStr(inst.type)) continue;
+            int elements = 1;
+            for (int dim : arrayDimensions(inst.type)) elements *= dim;
+            if (elements <= kMaxScalarizedElements) arrays[inst.result] = inst.type;
+        }
+    }
+    if (arrays.empty()) return false;
+
+    // Every use of a candidate must be a full-depth GEP with in-range constant
+    // indices, and every use of such a GEP must be a load or store address.
+    std::map<std::string, std::pair<std::string, int>> elementOf;  // gep -> (alloca, flat index)
+    std::set<std::string> rejected;
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            for (size_t i = 0; i < inst.operands.size(); ++i) {
+                const std::string& operand = inst.operands[i];
+                if (!arrays.count(operand)) continue;
+                if (inst.op != Opcode::GetElementPtr || i != 0) {
+                    rejected.insert(operand);
+                    continue;
+                }
+                std::vector<int> dims = arrayDimensions(arrays[operand]);
+                bool ok = inst.operands.size() == dims.size() + 2 && inst.operands[1] == "0";
+                int flat = 0;
+                for (size_t d = 0; ok && d < dims.size(); ++d) {
+                    const std::string& index = inst.operands[d + 2];
+                    ok = isConstantOperand(index) && constantValue(index) >= 0 &&
+                         constantValue(index) < dims[d];
+                    if (ok) flat = flat * dims[d] + constantValue(index);
+                }
+                if (ok) {
+                    elementOf[inst.result] = {operand, flat};
+                } else {
+                    rejected.insert(operand);
+                }
+            }
+        }
+    }
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            for (size_t i = 0; i < inst.operands.size(); ++i) {
+                auto it = elementOf.find(inst.operands[i]);
+                if (it == elementOf.end()) continue;
+                bool isAddress = (inst.op == Opcode::Load && i == 0) ||
+                                 (inst.op == Opcode::Store && i == 1);
+                if (!isAddress) rejected.insert(it->second.first);
+            }
+        }
+    }
+    for (const auto& name : rejected) arrays.erase(name);
+    if (arrays.empty()) return false;
+
+    // One scalar alloca per element that is actually touched.
+    std::map<std::pair<std::string, int>, std::string> scalars;
+    std::map<std::string, std::string> replacements;
+    std::vector<Instruction> newAllocas;
+    for (const auto& [gep, element] : elementOf) {
+        if (!arrays.count(element.first)) continue;
+        auto it = scalars.find(element);
+        if (it == scalars.end()) {
+            std::string reg = f.newReg();
+            newAllocas.push_back(Instruction(Opcode::Alloca, reg, "i32"));
+            it = scalars.emplace(element, reg).first;
+        }
+        replacements[gep] = it->second;
+    }
+
+    for (auto& bb : f.blocks) {
+        auto& insts = bb->insts;
+        insts.erase(std::remove_if(insts.begin(), insts.end(), [&](const Instruction& inst) {
+            return (inst.op == Opcode::Alloca && arrays.count(inst.result)) ||
+                   (inst.op == Opcode::GetElementPtr && replacements.count(inst.result));
+        }), insts.end());
+    }
+    BasicBlock* entry = f.entry();
+    entry->insts.insert(entry->insts.begin(), newAllocas.begin(), newAllocas.end());
+    f.replaceUses(replacements);
+    return true;
+}
@@ -0,0 +1,180 @@
+#include "SelectionTree.h"
+
+namespace {
+
+int valueSize(const std::string& type) {
+    return isPointerType(type) ? 8 : 4;
+}
+
+// Instructions that can be recomputed anywhere their operands are
+// available. Division stays put, since it may trap.
+bool isFoldable(const Instruction& inst) {
+    if (inst.op == Opcode::SDiv || inst.op == Opcode::SRem) return false;
+    return inst.isBinary() || inst.op == Opcode::ICmp || inst.op == Opcode::ZExt ||
+           inst.op == Opcode::GetElementPtr;
+}
+
+bool isCommutative(Opcode op) {
+    return op == Opcode::Add || op == Opcode::Mul || op == Opcode::And || op == Opcode::Or || op == Opcode::Xor;
+}
+
+// The predicate that holds with the operands swapped.
+std::string swappedPredicate(const std::string& pred) {
+    if (pred == "slt") return "sgt";
+    if (pred == "sgt") return "slt";
+    if (pred == "sle") return "sge";
+    if (pred == "sge") return "sle";
+    if (pred == "ult") return "ugt";
+    if (pred == "ugt") return "ult";
+    if (pred == "ule") return "uge";
+    if (pred == "uge") return "ule";
+    return pred;
+}
+
+SelectionNode::Op treeOp(Opcode op) {
+    switch (op) {
+        case Opcode::Sub: return SelectionNode::Sub;
+        case Opcode::Mul: return SelectionNode::Mul;
+        case Opcode::And: return SelectionNode::And;
+        case Opcode::Or: return SelectionNode::Or;
+        case Opcode::Xor: return SelectionNode::Xor;
+        case Opcode::Shl: return SelectionNode::Shl;
+        case Opcode::AShr: return SelectionNode::AShr;
+        case Opcode::LShr: return SelectionNode::LShr;
+        default: return SelectionNode::Add;
+    }
+}
+
+// How many unfolded instructions a value may be moved across.
+constexpr int kMaxFoldDistance = 4;
+
+} // namespace
+
+SelectionTrees::SelectionTrees(const Function& f) {
+    for (size_t i = 0; i < f.paramNames.size(); ++i) sizes[f.paramNames[i]] = valueSize(f.paramTypes[i]);
+
+    std::map<std::string, int> uses;
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op == Opcode::Alloca) {
+                frames.insert(inst.result);
+            } else if (!inst.result.empty()) {
+                defs[inst.result] = &inst;
+                sizes[inst.result] = valueSize(inst.resultType());
+            }
+            for (const auto& operand : inst.operands) ++uses[operand];
+        }
+    }
+
+    // Folding moves a value to where its tree is emitted, keeping its
+    // operands live across everything in between. That is cheap over a
+    // few instructions, but a long chain of sums folded whole would keep
+    // every addend live at once, and values moved across a call would
+    // need callee-saved registers. Deciding from the end of the block
+    // backwards settles where each user is emitted first.
+    for (const auto& bb : f.blocks) {
+        const auto& insts = bb->insts;
+        std::map<std::string, size_t> user;
+        for (size_t i = 0; i < insts.size(); ++i) {
+            for (const auto& operand : insts[i].operands) {
+                if (insts[i].op != Opcode::Phi) user[operand] = i;
+            }
+        }
+        std::vector<size_t> emittedAt(insts.size());
+        for (size_t i = insts.size(); i-- > 0;) {
+            const Instruction& inst = insts[i];
+            emittedAt[i] = i;
+            if (inst.result.empty() || !isFoldable(inst) || uses[inst.result] != 1) continue;
+            auto it = user.find(inst.result);
+            if (it == user.end()) continue;
+            size_t at = emittedAt[it->second];
+            int skipped = 0;
+            bool crossesCall = false;
+            for (size_t k = i + 1; k < at; ++k) {
+                if (insts[k].op == Opcode::Alloca || folded.count(insts[k].result)) continue;
+                ++skipped;
+                crossesCall |= insts[k].op == Opcode::Call;
+            }
+            if (skipped > kMaxFoldDistance || crossesCall) continue;
+            folded.insert(inst.result);
+            emittedAt[i] = at;
+        }
+    }
+}
+
+SelectionNode* SelectionTrees::node(SelectionNode::Op op, int size, std::vector<SelectionNode*> kids) {
+    nodes.push_back(std::make_unique<SelectionNode>());
+    SelectionNode* n = nodes.back().get();
+    n->op = op;
+    n->size = size;
+    n->kids = std::move(kids);
+    return n;
+}
+
+SelectionNode* SelectionTrees::constant(long long value, int size) {
+    SelectionNode* n = node(SelectionNode::Const, size);
+    n->value = value;
+    return n;
+}
+
+SelectionNode* SelectionTrees::operand(const std::string& value) {
+    if (isConstantOperand(value)) return constant(constantValue(value), 4);
+    SelectionNode* n;
+    if (frames.count(value)) {
+        n = node(SelectionNode::Frame, 8);
+    } else if (isGlobalOperand(value)) {
+        n = node(SelectionNode::Global, 8);
+    } else if (folded.count(value)) {
+        return expand(*defs.at(value));
+    } else {
+        n = node(SelectionNode::Value, sizes.at(value));
+    }
+    n->name = value;
+    return n;
+}
+
+SelectionNode* SelectionTrees::expand(const Instruction& inst) {
+    if (inst.op == Opcode::GetElementPtr) return address(inst);
+    if (inst.op == Opcode::ZExt) return node(SelectionNode::ZExt, 4, {operand(inst.operands[0])});
+
+    std::string lhs = inst.operands[0];
+    std::string rhs = inst.operands[1];
+    bool constantFirst = isConstantOperand(lhs) && !isConstantOperand(rhs);
+    if (inst.op == Opcode::ICmp) {
+        // Constants go second, where instructions take immediates.
+        std::string pred = inst.predicate;
+        if (constantFirst) {
+            std::swap(lhs, rhs);
+            pred = swappedPredicate(pred);
+        }
+        SelectionNode* n = node(SelectionNode::ICmp, 4, {operand(lhs), operand(rhs)});
+        n->predicate = pred;
+        return n;
+    }
+    if (constantFirst && isCommutative(inst.op)) std::swap(lhs, rhs);
+    return node(treeOp(inst.op), 4, {operand(lhs), operand(rhs)});
+}
+
+SelectionNode* SelectionTrees::address(const Instruction& gep) {
+    // The first index steps over whole objects, every further one into an
+    // array level.
+    std::string type = gep.type;
+    long long disp = 0;
+    SelectionNode* index = nullptr;
+    for (size_t k = 1; k < gep.operands.size(); ++k) {
+        if (k > 1) type = arrayElementType(type);
+        long long stride = typeSizeInBytes(type);
+        const std::string& value = gep.operands[k];
+        if (isConstantOperand(value)) {
+            disp += constantValue(value) * stride;
+            continue;
+        }
+        SelectionNode* term = node(SelectionNode::SExt, 8, {operand(value)});
+        if (stride != 1) term = node(SelectionNode::Mul64, 8, {term, constant(stride, 8)});
+        index = index ? node(SelectionNode::Add64, 8, {index, term}) : term;
+    }
+    SelectionNode* n = operand(gep.operands[0]);
+    if (index) n = node(SelectionNode::Add64, 8, {n, index});
+    if (disp != 0) n = node(SelectionNode::Add64, 8, {n, constant(disp, 8)});
+    return n;
+}
@@ -0,0 +1,110 @@
+#include "Passes.h"
+#include <algorithm>
+
+bool removeUnreachableBlocks(Function& f) {
+    if (f.blocks.empty()) return false;
+    std::map<std::string, BasicBlock*> byName;
+    for (auto& bb : f.blocks) byName[bb->name] = bb.get();
+
+    std::set<std::string> reachable;
+    std::vector<BasicBlock*> worklist = {f.entry()};
+    reachable.insert(f.entry()->name);
+    while (!worklist.empty()) {
+        BasicBlock* bb = worklist.back();
+        worklist.pop_back();
+        for (const auto& succ : bb->successors()) {
+            if (reachable.insert(succ).second) worklist.push_back(byName.at(succ));
+        }
+    }
+    if (reachable.size() == f.blocks.size()) return false;
+
+    std::vector<std::unique_ptr<BasicBlock>> kept;
+    for (auto& bb : f.blocks) {
+        if (reachable.count(bb->name)) kept.push_back(std::move(bb));
+    }
+    f.blocks = std::move(kept);
+
+    for (auto& bb : f.blocks) {
+        for (auto& inst : bb->insts) {
+            if (inst.op != Opcode::Phi) break;
+            for (size_t i = inst.labels.size(); i-- > 0;) {
+                if (!reachable.count(inst.labels[i])) {
+                    inst.labels.erase(inst.labels.begin() + i);
+                    inst.operands.erase(inst.operands.begin() + i);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool mergeBlocks(Function& f) {
+    auto preds = f.predecessors();
+    std::set<BasicBlock*> merged;
+    std::map<std::string, std::string> replacements;
+    for (auto& bb : f.blocks) {
+        if (merged.count(bb.get())) continue;
+        for (;;) {
+            Instruction* term = bb->terminator();
+            if (!term || term->op != Opcode::Br || term->labels[0] == bb->name) break;
+            std::string next = term->labels[0];
+            if (preds[next].size() != 1 || next == f.entry()->name) break;
+            BasicBlock* succ = f.getBlock(next);
+
+            // Phis with a single incoming value become that value.
+            auto& insts = succ->insts;
+            auto firstNonPhi = std::find_if(insts.begin(), insts.end(),
+                                            [](const Instruction& i) { return i.op != Opcode::Phi; });
+            for (auto it = insts.begin(); it != firstNonPhi; ++it) replacements[it->result] = it->operands[0];
+            bb->insts.pop_back();
+            bb->insts.insert(bb->insts.end(), firstNonPhi, insts.end());
+            merged.insert(succ);
+
+            for (const auto& label : bb->successors()) {
+                for (auto& pred : preds[label]) {
+                    if (pred == next) pred = bb->name;
+                }
+                for (auto& inst : f.getBlock(label)->insts) {
+                    if (inst.op != Opcode::Phi) break;
+                    for (auto& l : inst.labels) {
+                        if (l == next) l = bb->name;
+                    }
+                }
+            }
+        }
+    }
+    if (merged.empty()) return false;
+    f.blocks.erase(std::remove_if(f.blocks.begin(), f.blocks.end(),
+                                  [&](const std::unique_ptr<BasicBlock>& b) { return merged.count(b.get()); }),
+                   f.blocks.end());
+    f.replaceUses(replacements);
+    return true;
+}
+
+bool foldBranches(Function& f, const ValueRangeAnalysis& vra) {
+    bool changed = false;
+    for (auto& bb : f.blocks) {
+        if (!vra.dominators().isReachable(bb.get())) continue;
+        Instruction* term = bb->terminator();
+        if (!term || term->op != Opcode::CondBr || term->labels[0] == term->labels[1]) continue;
+        int outcome = vra.evaluateBranch(bb.get());
+        if (outcome < 0) continue;
+        std::string kept = term->labels[outcome ? 0 : 1];
+        std::string dropped = term->labels[outcome ? 1 : 0];
+        *term = makeBr(kept);
+        for (auto& inst : f.getBlock(dropped)->insts) {
+            if (inst.op != Opcode::Phi) break;
+            for (size_t i = inst.labels.size(); i-- > 0;) {
+                if (inst.labels[i] == bb->name) {
+                    inst.labels.erase(inst.labels.begin() + i);
+                    inst.operands.erase(inst.operands.begin() + i);
+                }
+            }
+        }
+        changed = true;
+    }
+    if (!changed) return false;
+    removeUnreachableBlocks(f);
+    mergeBlocks(f);
+    return true;
+}
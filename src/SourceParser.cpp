@@ -0,0 +1,97 @@
+#include "SourceParser.h"
+
+namespace {
+
+struct Item {
+    size_t begin, end;  // Token indices
+    bool function;
+};
+
+// The top-level items of a token list ending in EOF, or nothing if it does
+// not cut cleanly. A function is an item whose third token is '(', as in
+// `int f(`, and ends at the brace closing its body; anything else ends at
+// the first ';' outside braces.
+std::vector<Item> topLevelItems(const std::vector<antlr4::Token*>& tokens) {
+    std::vector<Item> items;
+    size_t begin = 0;
+    int depth = 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        size_t type = tokens[i]->getType();
+        if (type == antlr4::Token::EOF) break;
+        bool function = i >= begin + 2 && tokens[begin + 2]->getType() == SysYLexer::LPAREN;
+        if (type == SysYLexer::LBRACE) {
+            ++depth;
+        } else if (type == SysYLexer::RBRACE && --depth < 0) {
+            return {};
+        }
+        if (depth == 0 && type == (function ? SysYLexer::RBRACE : SysYLexer::SEMICOLON)) {
+            items.push_back({begin, i + 1, function});
+            begin = i + 1;
+        }
+    }
+    if (begin + 1 != tokens.size()) return {};
+    return items;
+}
+
+} // namespace
+
+SourceParser::SourceParser(std::istream& stream, ThreadPool* threads)
+    : threads(threads), input(stream), lexer(&input), tokens(&lexer) {}
+
+SysYParser::CompUnitContext* SourceParser::parse() {
+    tokens.fill();
+    std::vector<Item> items;
+    if (threads) items = topLevelItems(tokens.getTokens());
+    if (items.empty()) return parseWhole();
+
+    pieces.resize(items.size());
+    auto parsePiece = [&](size_t index) {
+        const Item& item = items[index];
+        Piece& piece = pieces[index];
+        std::vector<std::unique_ptr<antlr4::Token>> copies;
+        for (size_t i = item.begin; i < item.end; ++i) {
+            copies.push_back(std::make_unique<antlr4::CommonToken>(tokens.get(i)));
+        }
+        piece.source = std::make_unique<antlr4::ListTokenSource>(std::move(copies));
+        piece.tokens = std::make_unique<antlr4::CommonTokenStream>(piece.source.get());
+        piece.parser = std::make_unique<SysYParser>(piece.tokens.get());
+        if (item.function) {
+            piece.tree = piece.parser->funcDef();
+        } else {
+            piece.tree = piece.parser->decl();
+        }
+    };
+    std::vector<size_t> functions;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (items[i].function) {
+            functions.push_back(i);
+        } else {
+            parsePiece(i);
+        }
+    }
+    threads->parallelFor(functions.size(), [&](size_t k) { parsePiece(functions[k]); });
+
+    size_t errors = 0;
+    for (const auto& piece : pieces) {
+        errors += piece.parser->getNumberOfSyntaxErrors();
+        // A piece the rule stopped short of without complaint was cut
+        // wrongly; the whole parse has the proper errors.
+        if (piece.tokens->LA(1) != antlr4::Token::EOF) {
+            pieces.clear();
+            return parseWhole();
+        }
+    }
+    if (errors > 0) return nullptr;
+    unit = std::make_unique<SysYParser::CompUnitContext>(nullptr, 0);
+    for (auto& piece : pieces) {
+        piece.tree->parent = unit.get();
+        unit->children.push_back(piece.tree);
+    }
+    return unit.get();
+}
+
+SysYParser::CompUnitContext* SourceParser::parseWhole() {
+    whole = std::make_unique<SysYParser>(&tokens);
+    SysYParser::CompUnitContext* tree = whole->compUnit();
+    return whole->getNumberOfSyntaxErrors() > 0 ? nullptr : tree;
+}
@@ -0,0 +1,49 @@
+#include "Passes.h"
+
+namespace {
+
+int exactLog2(const std::string& operand) {
+    if (!isConstantOperand(operand)) return -1;
+    long long value = constantValue(operand);
+    if (value <= 1 || (value & (value - 1)) != 0) return -1;
+    int k = 0;
+    while ((1LL << k) != value) ++k;
+    return k;
+}
+
+} // namespace
+
+bool reduceStrength(Function& f, const ValueRangeAnalysis& vra) {
+    if (f.isDeclaration || f.blocks.empty()) return false;
+    bool changed = false;
+    for (auto& bb : f.blocks) {
+        if (!vra.dominators().isReachable(bb.get())) continue;
+        for (auto& inst : bb->insts) {
+            if (inst.type != "i32") continue;
+            if (inst.op == Opcode::Mul) {
+                if (exactLog2(inst.operands[0]) > 0) std::swap(inst.operands[0], inst.operands[1]);
+                int k = exactLog2(inst.operands[1]);
+                if (k > 0) {
+                    inst.op = Opcode::Shl;
+                    inst.operands[1] = std::to_string(k);
+                    changed = true;
+                }
+                continue;
+            }
+            // Signed division and remainder by 2^k round toward zero, which
+            // costs a sign fixup unless the dividend cannot be negative.
+            if (inst.op != Opcode::SDiv && inst.op != Opcode::SRem) continue;
+            int k = exactLog2(inst.operands[1]);
+            if (k <= 0 || !vra.rangeAt(inst.operands[0], bb.get()).isNonNegative()) continue;
+            if (inst.op == Opcode::SDiv) {
+                inst.op = Opcode::LShr;
+                inst.operands[1] = std::to_string(k);
+            } else {
+                inst.op = Opcode::And;
+                inst.operands[1] = std::to_string((1LL << k) - 1);
+            }
+            changed = true;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,106 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 1; i < threads; ++i) workers.emplace_back([this, i]() { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& loopBody) {
+    if (workers.empty() || count <= 1) {
+        for (size_t i = 0; i < count; ++i) loopBody(i);
+        return;
+    }
+    std::lock_guard<std::mutex> serial(running);
+    // The body goes in before the items: a thread still finishing the last
+    // loop may already take one of them.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        body = &loopBody;
+        remaining = count;
+        error = nullptr;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Queue& queue = *queues[i % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.items.push_back(i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generation;
+    }
+    wake.notify_all();
+
+    work(0);
+    std::exception_ptr thrown;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return remaining == 0; });
+        body = nullptr;
+        thrown = error;
+    }
+    if (thrown) std::rethrow_exception(thrown);
+}
+
+void ThreadPool::workerLoop(unsigned self) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        work(self);
+    }
+}
+
+void ThreadPool::work(unsigned self) {
+    size_t item;
+    while (take(self, item)) {
+        const std::function<void(size_t)>* current;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = body;
+        }
+        try {
+            (*current)(item);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--remaining == 0) done.notify_all();
+    }
+}
+
+bool ThreadPool::take(unsigned self, size_t& item) {
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty()) {
+            item = own.items.back();
+            own.items.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); ++k) {
+        Queue& victim = *queues[(self + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            item = victim.items.front();
+            victim.items.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,237 @@
+#include "Tiering.h"
+#include "Interpreter.h"
+#include "JIT.h"
+#include "LoopInfo.h"
+#include "PassManager.h"
+#include "Runtime.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+std::unique_ptr<Module> cloneModule(const Module& m) {
+    auto copy = std::make_unique<Module>();
+    copy->globals = m.globals;
+    for (const auto& f : m.functions) copy->functions.push_back(f->clone(f->name));
+    return copy;
+}
+
+std::string loopEntryName(const std::string& function, const std::string& header) {
+    return function + ".osr." + header;
+}
+
+void nestedHeaders(const Loop* loop, std::vector<std::string>& headers) {
+    for (const Loop* inner : loop->subLoops) {
+        headers.push_back(inner->header->name);
+        nestedHeaders(inner, headers);
+    }
+}
+
+// A copy of `f` that starts at `header`, taking as parameters the values
+// live there: those used from the header on but defined before it, and
+// the header's phis. Everything the header cannot reach goes. For an
+// outermost loop this is still SSA, since whatever is defined inside the
+// loop and live at its header is one of its phis. Returns nullptr if it
+// would take too many arguments.
+std::unique_ptr<Function> loopEntry(const Function& f, const std::string& header, LoopEntry& entry) {
+    std::map<std::string, const BasicBlock*> blocks;
+    for (const auto& bb : f.blocks) blocks[bb->name] = bb.get();
+    std::set<std::string> reachable = {header};
+    std::vector<std::string> worklist = {header};
+    while (!worklist.empty()) {
+        std::string name = worklist.back();
+        worklist.pop_back();
+        for (const auto& succ : blocks.at(name)->successors()) {
+            if (reachable.insert(succ).second) worklist.push_back(succ);
+        }
+    }
+
+    std::set<std::string> used;
+    for (const auto& name : reachable) {
+        for (const auto& inst : blocks.at(name)->insts) used.insert(inst.operands.begin(), inst.operands.end());
+    }
+    std::vector<std::string> names;
+    std::vector<std::string> types;
+    for (size_t i = 0; i < f.paramNames.size(); ++i) {
+        if (!used.count(f.paramNames[i])) continue;
+        names.push_back(f.paramNames[i]);
+        types.push_back(f.paramTypes[i]);
+    }
+    for (const auto& bb : f.blocks) {
+        if (reachable.count(bb->name)) continue;
+        for (const auto& inst : bb->insts) {
+            if (inst.result.empty() || !used.count(inst.result)) continue;
+            names.push_back(inst.result);
+            types.push_back(inst.resultType());
+        }
+    }
+    entry.header = header;
+    entry.liveIns = names;
+
+    auto clone = f.clone(loopEntryName(f.name, header));
+    std::string start = clone->newBlockName();
+    for (auto& inst : clone->getBlock(header)->insts) {
+        if (inst.op != Opcode::Phi) break;
+        std::string param = clone->newReg();
+        names.push_back(param);
+        types.push_back(inst.type);
+        entry.liveIns.push_back(inst.result);
+        inst.operands.push_back(param);
+        inst.labels.push_back(start);
+    }
+    if (names.size() > static_cast<size_t>(TierUp::kMaxNativeArgs)) return nullptr;
+    clone->paramNames = names;
+    clone->paramTypes = types;
+
+    std::vector<std::unique_ptr<BasicBlock>> kept;
+    kept.push_back(std::make_unique<BasicBlock>(start));
+    kept.back()->insts.push_back(makeBr(header));
+    for (auto& bb : clone->blocks) {
+        if (!reachable.count(bb->name)) continue;
+        for (auto& inst : bb->insts) {
+            if (inst.op != Opcode::Phi) break;
+            for (size_t i = inst.labels.size(); i-- > 0;) {
+                if (inst.labels[i] == start || reachable.count(inst.labels[i])) continue;
+                inst.labels.erase(inst.labels.begin() + i);
+                inst.operands.erase(inst.operands.begin() + i);
+            }
+        }
+        kept.push_back(std::move(bb));
+    }
+    clone->blocks = std::move(kept);
+    return clone;
+}
+
+class TieredCompiler : public TierUp {
+public:
+    TieredCompiler(const Module& m, const std::string& pipeline, const CodeGenOptions& options)
+        : pipeline(pipeline), options(options), module(cloneModule(m)) {
+        for (const auto& f : m.functions) {
+            if (f->isDeclaration) continue;
+            LoopInfo loops(*module->getFunction(f->name));
+            for (const Loop* loop : loops.topLevelLoops()) {
+                LoopEntry entry;
+                auto clone = loopEntry(*f, loop->header->name, entry);
+                if (!clone) continue;
+                nestedHeaders(loop, entry.nested);
+                entries[f->name].push_back(entry);
+                module->functions.push_back(std::move(clone));
+            }
+        }
+    }
+
+    void attach(const Interpreter& interpreter) { this->interpreter = &interpreter; }
+
+    void* allocateGlobals(size_t bytes) override { return arena.allocate(bytes); }
+
+    std::vector<LoopEntry> loopEntries(const std::string& function) override {
+        auto it = entries.find(function);
+        return it == entries.end() ? std::vector<LoopEntry>() : it->second;
+    }
+
+    void* compileFunction(const std::string& function) override { return compile(function); }
+
+    void* compileLoop(const std::string& function, const std::string& header) override {
+        return compile(loopEntryName(function, header));
+    }
+
+private:
+    void optimize() {
+        PassManager pm;
+        std::string error;
+        if (!pm.parsePipeline(pipeline, error)) throw std::runtime_error(error);
+        pm.run(*module);
+        // Globals the passes added, such as memoization tables, are shared
+        // by every object that uses them.
+        for (const auto& g : module->globals) {
+            if (interpreter->globalAddress(g.name)) continue;
+            uint8_t* memory = arena.allocate(typeSizeInBytes(g.type));
+            if (!g.zeroInit && !g.init.empty()) std::memcpy(memory, g.init.data(), 4 * g.init.size());
+            data[g.name] = memory;
+        }
+        optimized = true;
+    }
+
+    // `name` along with the functions it calls that are not native yet.
+    // Failing leaves them to the interpreter.
+    void* compile(const std::string& name) {
+        auto known = native.find(name);
+        if (known != native.end()) return known->second;
+        try {
+            if (!optimized) optimize();
+            Function* root = module->getFunction(name);
+            if (!root || root->isDeclaration) return nullptr;
+
+            Module unit;
+            std::set<std::string> seen = {name};
+            std::vector<Function*> worklist = {root};
+            while (!worklist.empty()) {
+                Function* f = worklist.back();
+                worklist.pop_back();
+                unit.functions.push_back(f->clone(f->name));
+                for (const auto& bb : f->blocks) {
+                    for (const auto& inst : bb->insts) {
+                        if (inst.op != Opcode::Call || native.count(inst.callee) || !seen.insert(inst.callee).second) {
+                            continue;
+                        }
+                        Function* callee = module->getFunction(inst.callee);
+                        if (callee && !callee->isDeclaration) worklist.push_back(callee);
+                    }
+                }
+            }
+            for (const auto& f : module->functions) {
+                if (f->isDeclaration) unit.functions.push_back(f->clone(f->name));
+            }
+
+            ObjectFile obj = compileObject(unit, options);
+            auto loaded = std::make_unique<LoadedObject>(
+                obj, [this](const std::string& symbol) { return resolve(symbol); }, &arena);
+            for (const auto& f : unit.functions) {
+                if (!f->isDeclaration) native[f->name] = loaded->address(f->name);
+            }
+            objects.push_back(std::move(loaded));
+            return native.at(name);
+        } catch (const std::exception&) {
+            return nullptr;
+        }
+    }
+
+    void* resolve(const std::string& name) {
+        auto it = native.find(name);
+        if (it != native.end()) return it->second;
+        if (void* builtin = runtime::lookup(name)) return builtin;
+        if (void* global = interpreter->globalAddress(name)) return global;
+        auto added = data.find(name);
+        return added == data.end() ? nullptr : added->second;
+    }
+
+    std::string pipeline;
+    CodeGenOptions options;
+    CodeArena arena;
+    // A copy of the program with the loop entries, optimized on first use.
+    std::unique_ptr<Module> module;
+    bool optimized = false;
+    std::map<std::string, std::vector<LoopEntry>> entries;
+    std::map<std::string, void*> native;
+    std::map<std::string, void*> data;
+    std::vector<std::unique_ptr<LoadedObject>> objects;
+    const Interpreter* interpreter = nullptr;
+};
+
+} // namespace
+
+int runTiered(const Module& m, const std::string& pipeline, const CodeGenOptions& options) {
+#if defined(__x86_64__)
+    if (options.arch != CodeGenOptions::Arch::X86_64) {
+        throw std::runtime_error("tiered: only x86-64 code runs in-process");
+    }
+    TieredCompiler compiler(m, pipeline, options);
+    Interpreter interpreter(m, &compiler);
+    compiler.attach(interpreter);
+    return interpreter.run();
+#else
+    (void)pipeline;
+    (void)options;
+    return Interpreter(m).run();
+#endif
+}
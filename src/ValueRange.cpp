@@ -0,0 +1,468 @@
+#include "ValueRange.h"
+#include "LoopInfo.h"
+#include <algorithm>
+
+// A value still growing after this many updates is assumed to take any
+// value; this bounds the fixpoint iteration on loops that are not counted.
+static const int kMaxUpdates = 4;
+
+namespace {
+
+const uint32_t kSignBit = 0x80000000u;
+
+uint32_t lowMask(int bits) {
+    return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+}
+
+// Bits needed for a non-negative value.
+int bitWidth(long long value) {
+    int bits = 0;
+    while (bits < 32 && (value >> bits) != 0) ++bits;
+    return bits;
+}
+
+int trailingZeros(uint32_t knownZero) {
+    int bits = 0;
+    while (bits < 32 && (knownZero >> bits & 1)) ++bits;
+    return bits;
+}
+
+// Orderings of lhs against rhs that a predicate admits.
+enum Order : unsigned { OrdLT = 1, OrdEQ = 2, OrdGT = 4, OrdAny = 7 };
+
+unsigned orderMask(const std::string& pred) {
+    if (pred == "eq") return OrdEQ;
+    if (pred == "ne") return OrdLT | OrdGT;
+    if (pred == "slt") return OrdLT;
+    if (pred == "sle") return OrdLT | OrdEQ;
+    if (pred == "sgt") return OrdGT;
+    if (pred == "sge") return OrdGT | OrdEQ;
+    return OrdAny;
+}
+
+unsigned swapOrder(unsigned mask) {
+    return (mask & OrdEQ) | (mask & OrdLT ? unsigned(OrdGT) : 0u) | (mask & OrdGT ? unsigned(OrdLT) : 0u);
+}
+
+std::string inversePredicate(const std::string& pred) {
+    static const std::map<std::string, std::string> inverse = {
+        {"eq", "ne"}, {"ne", "eq"}, {"slt", "sge"}, {"sge", "slt"}, {"sgt", "sle"}, {"sle", "sgt"},
+        {"ult", "uge"}, {"uge", "ult"}, {"ugt", "ule"}, {"ule", "ugt"}};
+    return inverse.at(pred);
+}
+
+// Unsigned comparisons of non-negative values order like signed ones.
+std::string signedPredicate(const std::string& pred) {
+    if (pred.size() == 3 && pred[0] == 'u') return "s" + pred.substr(1);
+    return pred;
+}
+
+unsigned possibleOrders(const ValueRange& a, const ValueRange& b) {
+    unsigned mask = 0;
+    if (a.lo < b.hi) mask |= OrdLT;
+    if (a.lo <= b.hi && b.lo <= a.hi) mask |= OrdEQ;
+    if (a.hi > b.lo) mask |= OrdGT;
+    return mask;
+}
+
+int decide(unsigned possible, unsigned wanted) {
+    if (possible == 0) return -1;
+    if ((possible & ~wanted) == 0) return 1;
+    if ((possible & wanted) == 0) return 0;
+    return -1;
+}
+
+} // namespace
+
+ValueRange ValueRange::full(const std::string& type) {
+    ValueRange r;
+    if (type == "i1") {
+        r.lo = 0;
+        r.hi = 1;
+        r.normalize();
+    }
+    return r;
+}
+
+ValueRange ValueRange::constant(long long value) {
+    ValueRange r;
+    r.lo = r.hi = value;
+    r.knownOne = static_cast<uint32_t>(value);
+    r.knownZero = ~r.knownOne;
+    return r;
+}
+
+ValueRange ValueRange::between(long long lo, long long hi) {
+    ValueRange r;
+    if (lo < INT32_MIN || hi > INT32_MAX || lo > hi) return r;
+    r.lo = lo;
+    r.hi = hi;
+    r.normalize();
+    return r;
+}
+
+void ValueRange::normalize() {
+    if (lo >= 0) knownZero |= ~lowMask(bitWidth(hi));
+    if (hi < 0) knownOne |= kSignBit;
+    if (knownZero & kSignBit) {
+        lo = std::max(lo, static_cast<long long>(knownOne));
+        hi = std::min(hi, static_cast<long long>(~knownZero & ~kSignBit));
+    }
+    if ((knownZero | knownOne) == 0xFFFFFFFFu) lo = hi = static_cast<int32_t>(knownOne);
+    if (lo > hi || (knownZero & knownOne)) *this = ValueRange();
+}
+
+ValueRange ValueRange::unite(const ValueRange& other) const {
+    ValueRange r;
+    r.lo = std::min(lo, other.lo);
+    r.hi = std::max(hi, other.hi);
+    r.knownZero = knownZero & other.knownZero;
+    r.knownOne = knownOne & other.knownOne;
+    r.normalize();
+    return r;
+}
+
+ValueRange ValueRange::intersect(const ValueRange& other) const {
+    ValueRange r;
+    r.lo = std::max(lo, other.lo);
+    r.hi = std::min(hi, other.hi);
+    r.knownZero = knownZero | other.knownZero;
+    r.knownOne = knownOne | other.knownOne;
+    if (r.lo > r.hi || (r.knownZero & r.knownOne)) return *this;
+    r.normalize();
+    return r;
+}
+
+ValueRangeAnalysis::ValueRangeAnalysis(Function& f)
+    : ownLoops(std::make_unique<LoopInfo>(f)), dt(ownLoops->dominators()) {
+    compute(*ownLoops);
+}
+
+ValueRangeAnalysis::ValueRangeAnalysis(const LoopInfo& li) : dt(li.dominators()) {
+    compute(li);
+}
+
+void ValueRangeAnalysis::compute(const LoopInfo& li) {
+    for (BasicBlock* bb : dt.reversePostOrder()) {
+        for (const auto& inst : bb->insts) {
+            if (inst.result.empty()) continue;
+            defs[inst.result] = &inst;
+            defBlocks[inst.result] = bb;
+        }
+    }
+    for (BasicBlock* bb : dt.reversePostOrder()) {
+        Condition cond;
+        if (branchCondition(bb, true, cond)) branchConditions[bb] = cond;
+        const auto& preds = dt.predecessors(bb);
+        if (preds.size() != 1) continue;
+        const Instruction* term = preds[0]->terminator();
+        if (term->op != Opcode::CondBr || term->labels[0] == term->labels[1]) continue;
+        if (branchCondition(preds[0], term->labels[0] == bb->name, cond)) entryConditions[bb].push_back(cond);
+    }
+
+    for (Loop* loop : li.loopsInPostOrder()) {
+        InductionVariable iv;
+        if (!li.inductionVariable(loop, iv)) continue;
+        inductionVariables[iv.phi->result] = {iv.init, iv.bound, iv.compare->predicate, iv.step};
+    }
+
+    std::map<std::string, int> updates;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (BasicBlock* bb : dt.reversePostOrder()) {
+            for (const auto& inst : bb->insts) {
+                if (inst.result.empty()) continue;
+                ValueRange r;
+                if (!evaluate(inst, bb, r)) continue;
+                auto it = ranges.find(inst.result);
+                if (it != ranges.end()) {
+                    // Ranges only grow, so that the iteration converges.
+                    r = it->second.unite(r);
+                    if (r == it->second) continue;
+                    if (++updates[inst.result] > kMaxUpdates) r = ValueRange::full(inst.resultType());
+                }
+                ranges[inst.result] = r;
+                changed = true;
+            }
+        }
+    }
+    defs.clear();
+}
+
+bool ValueRangeAnalysis::branchCondition(BasicBlock* bb, bool taken, Condition& cond) const {
+    const Instruction* term = bb->terminator();
+    if (!term || term->op != Opcode::CondBr || term->labels[0] == term->labels[1]) return false;
+    std::string value = term->operands[0];
+    // Look through the frontend's "icmp ne (zext (icmp ...)), 0" wrapper.
+    for (;;) {
+        auto it = defs.find(value);
+        const Instruction* def = it == defs.end() ? nullptr : it->second;
+        if (!def || def->op != Opcode::ICmp) {
+            cond = {taken ? "ne" : "eq", value, "0"};
+            return true;
+        }
+        auto ext = defs.find(def->operands[0]);
+        bool wrapper = (def->predicate == "ne" || def->predicate == "eq") && def->operands[1] == "0" &&
+                       ext != defs.end() && ext->second->op == Opcode::ZExt && ext->second->srcType == "i1";
+        if (!wrapper) {
+            cond = {taken ? def->predicate : inversePredicate(def->predicate), def->operands[0], def->operands[1]};
+            return true;
+        }
+        if (def->predicate == "eq") taken = !taken;
+        value = ext->second->operands[0];
+    }
+}
+
+ValueRange ValueRangeAnalysis::range(const std::string& value) const {
+    if (isConstantOperand(value)) return ValueRange::constant(constantValue(value));
+    auto it = ranges.find(value);
+    return it == ranges.end() ? ValueRange::full() : it->second;
+}
+
+ValueRange ValueRangeAnalysis::narrow(const std::string& value, const ValueRange& r,
+                                      const Condition& cond) const {
+    unsigned mask;
+    std::string other;
+    if (cond.lhs == value) {
+        mask = orderMask(cond.pred);
+        other = cond.rhs;
+    } else if (cond.rhs == value) {
+        mask = swapOrder(orderMask(cond.pred));
+        other = cond.lhs;
+    } else {
+        return r;
+    }
+    ValueRange o = range(other);
+    if (cond.pred[0] == 'u') {
+        // Only informative against a non-negative bound: below it means
+        // within [0, bound).
+        if (!o.isNonNegative() || (cond.lhs == value) != (cond.pred == "ult" || cond.pred == "ule")) return r;
+        return r.intersect(ValueRange::between(0, cond.pred[2] == 'e' ? o.hi : o.hi - 1));
+    }
+    if (mask == OrdEQ) return r.intersect(o);
+    if (mask == (OrdLT | OrdGT)) {
+        if (!o.isConstant()) return r;
+        if (r.lo == o.lo && r.lo < r.hi) return r.intersect(ValueRange::between(r.lo + 1, r.hi));
+        if (r.hi == o.lo && r.lo < r.hi) return r.intersect(ValueRange::between(r.lo, r.hi - 1));
+        return r;
+    }
+    if (!(mask & OrdGT)) return r.intersect(ValueRange::between(INT32_MIN, o.hi - (mask & OrdEQ ? 0 : 1)));
+    if (!(mask & OrdLT)) return r.intersect(ValueRange::between(o.lo + (mask & OrdEQ ? 0 : 1), INT32_MAX));
+    return r;
+}
+
+ValueRange ValueRangeAnalysis::rangeAt(const std::string& value, BasicBlock* bb) const {
+    ValueRange r = range(value);
+    if (r.isConstant() || !dt.isReachable(bb)) return r;
+    auto def = defBlocks.find(value);
+    BasicBlock* stop = def == defBlocks.end() ? nullptr : def->second;
+    for (BasicBlock* d = bb; d; d = d == stop ? nullptr : dt.idom(d)) {
+        auto it = entryConditions.find(d);
+        if (it == entryConditions.end()) continue;
+        for (const auto& cond : it->second) r = narrow(value, r, cond);
+    }
+    return r;
+}
+
+ValueRange ValueRangeAnalysis::rangeOnEdge(const std::string& value, BasicBlock* from, BasicBlock* to) const {
+    ValueRange r = rangeAt(value, from);
+    const Instruction* term = from->terminator();
+    Condition cond;
+    if (term && term->op == Opcode::CondBr && term->labels[0] != term->labels[1]) {
+        auto it = branchConditions.find(from);
+        if (it != branchConditions.end()) {
+            cond = it->second;
+            if (term->labels[0] != to->name) cond.pred = inversePredicate(cond.pred);
+            r = narrow(value, r, cond);
+        }
+    }
+    return r;
+}
+
+int ValueRangeAnalysis::evaluateCompare(const std::string& pred, const std::string& lhs,
+                                        const std::string& rhs, BasicBlock* bb) const {
+    ValueRange a = rangeAt(lhs, bb), b = rangeAt(rhs, bb);
+    std::string p = pred;
+    if (p[0] == 'u') {
+        if (!a.isNonNegative() || !b.isNonNegative()) return -1;
+        p = signedPredicate(p);
+    }
+    unsigned possible = lhs == rhs ? static_cast<unsigned>(OrdEQ) : possibleOrders(a, b);
+    // Conditions on the same two values decide it even when their ranges
+    // overlap, e.g. a repeated i < n.
+    if (dt.isReachable(bb)) {
+        for (BasicBlock* d = bb; d; d = dt.idom(d)) {
+            auto it = entryConditions.find(d);
+            if (it == entryConditions.end()) continue;
+            for (const auto& cond : it->second) {
+                if (cond.pred[0] == 'u') continue;
+                if (cond.lhs == lhs && cond.rhs == rhs) possible &= orderMask(cond.pred);
+                if (cond.lhs == rhs && cond.rhs == lhs) possible &= swapOrder(orderMask(cond.pred));
+            }
+        }
+    }
+    return decide(possible, orderMask(p));
+}
+
+int ValueRangeAnalysis::evaluateBranch(BasicBlock* bb) const {
+    auto it = branchConditions.find(bb);
+    if (it == branchConditions.end()) return -1;
+    return evaluateCompare(it->second.pred, it->second.lhs, it->second.rhs, bb);
+}
+
+bool ValueRangeAnalysis::evaluate(const Instruction& inst, BasicBlock* bb, ValueRange& result) const {
+    std::string type = inst.resultType();
+    if (type != "i32" && type != "i1") return false;
+    // Integer operands not evaluated yet are still bottom: wait for them.
+    auto ready = [&](const std::string& v) {
+        auto it = defs.find(v);
+        if (it == defs.end() || ranges.count(v)) return true;
+        std::string t = it->second->resultType();
+        return t != "i32" && t != "i1";
+    };
+
+    if (inst.op == Opcode::Phi) {
+        auto iv = inductionVariables.find(inst.result);
+        if (iv != inductionVariables.end() && ready(iv->second.init) && ready(iv->second.bound)) {
+            const CountedLoop& loop = iv->second;
+            ValueRange init = range(loop.init), bound = range(loop.bound);
+            // The phi takes its start value, then one step past each value
+            // that passed the exit test.
+            if (loop.step > 0 && (loop.pred == "slt" || loop.pred == "sle")) {
+                long long last = bound.hi - (loop.pred == "slt" ? 1 : 0) + loop.step;
+                result = ValueRange::between(init.lo, std::max(init.hi, last));
+                return true;
+            }
+            if (loop.step < 0 && (loop.pred == "sgt" || loop.pred == "sge")) {
+                long long last = bound.lo + (loop.pred == "sgt" ? 1 : 0) + loop.step;
+                result = ValueRange::between(std::min(init.lo, last), init.hi);
+                return true;
+            }
+        }
+        bool any = false;
+        for (size_t i = 0; i < inst.operands.size(); ++i) {
+            BasicBlock* pred = dt.block(inst.labels[i]);
+            if (!pred || !dt.isReachable(pred) || !ready(inst.operands[i])) continue;
+            ValueRange r = rangeOnEdge(inst.operands[i], pred, bb);
+            result = any ? result.unite(r) : r;
+            any = true;
+        }
+        return any;
+    }
+
+    for (const auto& operand : inst.operands) {
+        if (!ready(operand)) return false;
+    }
+    auto operand = [&](size_t i) { return rangeAt(inst.operands[i], bb); };
+    result = ValueRange::full(type);
+    switch (inst.op) {
+        case Opcode::ICmp: {
+            int outcome = evaluateCompare(inst.predicate, inst.operands[0], inst.operands[1], bb);
+            if (outcome >= 0) result = ValueRange::constant(outcome);
+            return true;
+        }
+        case Opcode::ZExt: {
+            ValueRange a = operand(0);
+            if (a.isNonNegative()) result = a;
+            return true;
+        }
+        case Opcode::Select: {
+            ValueRange c = operand(0);
+            if (c.isConstant()) result = operand(c.lo ? 1 : 2);
+            else result = operand(1).unite(operand(2));
+            return true;
+        }
+        default:
+            break;
+    }
+    if (!inst.isBinary()) return true;
+    if (type == "i1" && inst.op != Opcode::And && inst.op != Opcode::Or && inst.op != Opcode::Xor) return true;
+
+    ValueRange a = operand(0), b = operand(1);
+    ValueRange r;
+    auto shift = isConstantOperand(inst.operands[1]) ? constantValue(inst.operands[1]) : -1;
+    switch (inst.op) {
+        case Opcode::Add:
+            r = ValueRange::between(a.lo + b.lo, a.hi + b.hi);
+            r.knownZero |= lowMask(std::min(trailingZeros(a.knownZero), trailingZeros(b.knownZero)));
+            break;
+        case Opcode::Sub:
+            r = ValueRange::between(a.lo - b.hi, a.hi - b.lo);
+            r.knownZero |= lowMask(std::min(trailingZeros(a.knownZero), trailingZeros(b.knownZero)));
+            break;
+        case Opcode::Mul: {
+            long long corners[] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+            r = ValueRange::between(*std::min_element(corners, corners + 4), *std::max_element(corners, corners + 4));
+            r.knownZero |= lowMask(trailingZeros(a.knownZero) + trailingZeros(b.knownZero));
+            break;
+        }
+        case Opcode::SDiv:
+            if (b.isConstant() && b.lo > 0) {
+                r = ValueRange::between(a.lo / b.lo, a.hi / b.lo);
+            } else if (b.isConstant() && b.lo < 0) {
+                r = ValueRange::between(a.hi / b.lo, a.lo / b.lo);
+            } else if (a.isNonNegative() && b.lo > 0) {
+                r = ValueRange::between(0, a.hi);
+            }
+            break;
+        case Opcode::SRem: {
+            // The result takes the dividend's sign and is smaller than the
+            // divisor in magnitude.
+            long long m = -1;
+            if (b.lo > 0) m = b.hi;
+            else if (b.hi < 0 && b.lo > INT32_MIN) m = -b.lo;
+            if (m < 0) break;
+            if (a.isNonNegative()) r = ValueRange::between(0, std::min(a.hi, m - 1));
+            else if (a.hi <= 0) r = ValueRange::between(std::max(a.lo, -(m - 1)), 0);
+            else r = ValueRange::between(-(m - 1), m - 1);
+            break;
+        }
+        case Opcode::Shl:
+            if (shift < 0 || shift > 31) break;
+            r = ValueRange::between(a.lo * (1LL << shift), a.hi * (1LL << shift));
+            r.knownZero |= (a.knownZero << shift) | lowMask(shift);
+            r.knownOne |= a.knownOne << shift;
+            break;
+        case Opcode::AShr:
+            if (shift < 0 || shift > 31) break;
+            r = ValueRange::between(a.lo >> shift, a.hi >> shift);
+            break;
+        case Opcode::LShr:
+            if (shift < 0 || shift > 31) break;
+            if (a.isNonNegative()) r = ValueRange::between(a.lo >> shift, a.hi >> shift);
+            else if (shift > 0) r = ValueRange::between(0, 0xFFFFFFFFLL >> shift);
+            r.knownZero |= (a.knownZero >> shift) | ~(0xFFFFFFFFu >> shift);
+            r.knownOne |= a.knownOne >> shift;
+            break;
+        case Opcode::And:
+            if (a.isNonNegative() || b.isNonNegative()) {
+                long long hi = a.isNonNegative() && b.isNonNegative() ? std::min(a.hi, b.hi)
+                               : a.isNonNegative()                   ? a.hi
+                                                                     : b.hi;
+                r = ValueRange::between(0, hi);
+            }
+            r.knownZero |= a.knownZero | b.knownZero;
+            r.knownOne |= a.knownOne & b.knownOne;
+            break;
+        case Opcode::Or:
+            if (a.isNonNegative() && b.isNonNegative()) {
+                r = ValueRange::between(std::max(a.lo, b.lo), lowMask(bitWidth(std::max(a.hi, b.hi))));
+            }
+            r.knownZero |= a.knownZero & b.knownZero;
+            r.knownOne |= a.knownOne | b.knownOne;
+            break;
+        case Opcode::Xor:
+            if (a.isNonNegative() && b.isNonNegative()) {
+                r = ValueRange::between(0, lowMask(bitWidth(std::max(a.hi, b.hi))));
+            }
+            r.knownZero |= (a.knownZero & b.knownZero) | (a.knownOne & b.knownOne);
+            r.knownOne |= (a.knownZero & b.knownOne) | (a.knownOne & b.knownZero);
+            break;
+        default:
+            break;
+    }
+    r.normalize();
+    result = type == "i1" ? r.intersect(ValueRange::full("i1")) : r;
+    return true;
+}
@@ -0,0 +1,314 @@
+#include "X86Target.h"
+#include <cstdint>
+#include <stdexcept>
+
+using namespace x86;
+
+namespace {
+
+constexpr uint32_t R_X86_64_PC32 = 2;
+constexpr uint32_t R_X86_64_PLT32 = 4;
+
+bool fitsInt8(long long value) {
+    return value >= -128 && value <= 127;
+}
+
+bool fitsInt32(long long value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// The encoding of one instruction. Branches to blocks are left open until
+// the layout is known; everything else is final.
+struct Encoded {
+    std::vector<uint8_t> bytes;
+    struct Reloc {
+        size_t at;             // Offset of the 32-bit field in `bytes`
+        std::string symbol;
+        uint32_t type;
+        int64_t addend;
+    };
+    std::vector<Reloc> relocs;
+    int branchTarget = -1;     // Block a jmp or jcc goes to
+    int cond = -1;             // Condition of a jcc
+    bool longBranch = false;
+
+    void byte(int b) { bytes.push_back(static_cast<uint8_t>(b)); }
+    void imm(long long value, int size) {
+        for (int i = 0; i < size; ++i) byte(static_cast<int>((value >> (8 * i)) & 0xff));
+    }
+    size_t size() const {
+        if (branchTarget < 0) return bytes.size();
+        if (!longBranch) return 2;
+        return cond < 0 ? 5 : 6;
+    }
+};
+
+// Builds [REX] opcode ModRM [SIB] [displacement] for an instruction whose
+// ModRM reg field holds `reg` (a register, or an opcode extension) and
+// whose r/m operand is `rm`. `immSize` is the size of the immediate that
+// follows, which RIP-relative displacements are measured past; with
+// `byteRegs`, a register r/m operand is read as its low byte.
+class InstructionEncoder {
+public:
+    explicit InstructionEncoder(Encoded& out) : out(out) {}
+
+    void modrm(std::initializer_list<int> opcode, bool wide, int reg, const MachineOperand& rm, int immSize = 0,
+               bool byteRegs = false) {
+        int rex = wide ? 0x48 : 0x40;
+        if (reg >= 8) rex |= 4;
+        if (rm.isMem() && rm.index != kNoReg && rm.index >= 8) rex |= 2;
+        if (rm.reg != kNoReg && rm.reg >= 8) rex |= 1;
+        // Without a REX prefix, byte registers 4-7 are %ah-%bh rather than
+        // %spl-%dil.
+        bool lowByte = byteRegs && rm.isReg() && rm.reg >= 4 && rm.reg < 8;
+        if (rex != 0x40 || lowByte) out.byte(rex);
+        for (int b : opcode) out.byte(b);
+
+        int r = (reg & 7) << 3;
+        if (rm.isReg()) {
+            out.byte(0xc0 | r | (rm.reg & 7));
+            return;
+        }
+        if (rm.frameIndex >= 0) throw std::logic_error("x86-64 encoder: frame index before frame layout");
+        if (!rm.symbol.empty()) {
+            out.byte(0x05 | r);
+            out.relocs.push_back({out.bytes.size(), rm.symbol, R_X86_64_PC32, rm.imm - 4 - immSize});
+            out.imm(0, 4);
+            return;
+        }
+        int scaleBits = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+        if (rm.reg == kNoReg) {
+            // Index only: SIB with no base, always with a 32-bit displacement.
+            out.byte(0x04 | r);
+            out.byte((scaleBits << 6) | ((rm.index & 7) << 3) | 5);
+            out.imm(rm.imm, 4);
+            return;
+        }
+        // %rbp and %r13 as base need a displacement even when it is zero.
+        int mod = rm.imm == 0 && (rm.reg & 7) != 5 ? 0 : fitsInt8(rm.imm) ? 1 : 2;
+        if (rm.index == kNoReg && (rm.reg & 7) != 4) {
+            out.byte((mod << 6) | r | (rm.reg & 7));
+        } else {
+            // %rsp and %r12 as base need a SIB byte; index 100 means none.
+            int index = rm.index == kNoReg ? 4 : rm.index & 7;
+            out.byte((mod << 6) | r | 4);
+            out.byte((scaleBits << 6) | (index << 3) | (rm.reg & 7));
+        }
+        if (mod == 1) out.imm(rm.imm, 1);
+        if (mod == 2) out.imm(rm.imm, 4);
+    }
+
+    // An opcode with the register in its low three bits, as push and pop.
+    void plusReg(int opcode, bool wide, int reg) {
+        int rex = (wide ? 0x48 : 0x40) | (reg >= 8 ? 1 : 0);
+        if (rex != 0x40) out.byte(rex);
+        out.byte(opcode + (reg & 7));
+    }
+
+private:
+    Encoded& out;
+};
+
+// ModRM extensions and opcodes of the arithmetic group: op r/m, r is
+// `base`, op r, r/m is `base` + 2, and op r/m, imm is 0x81 or 0x83 with
+// `digit` in the reg field.
+struct ArithmeticEncoding {
+    int base;
+    int digit;
+};
+
+ArithmeticEncoding arithmeticEncoding(int opcode) {
+    switch (opcode) {
+        case ADD: return {0x01, 0};
+        case OR: return {0x09, 1};
+        case AND: return {0x21, 4};
+        case SUB: return {0x29, 5};
+        case XOR: return {0x31, 6};
+        default: return {0x39, 7};  // CMP
+    }
+}
+
+int shiftDigit(int opcode) {
+    return opcode == SHL ? 4 : opcode == SHR ? 5 : 7;
+}
+
+Encoded encode(const MachineInstr& mi) {
+    Encoded out;
+    InstructionEncoder enc(out);
+    bool wide = mi.size == 8;
+    const auto& ops = mi.ops;
+    switch (mi.opcode) {
+        case MOV: {
+            const MachineOperand& src = ops[0];
+            const MachineOperand& dst = ops[1];
+            if (src.isImm() && dst.isReg()) {
+                if (!wide) {
+                    enc.plusReg(0xb8, false, dst.reg);
+                    out.imm(src.imm, 4);
+                } else if (fitsInt32(src.imm)) {
+                    enc.modrm({0xc7}, true, 0, dst, 4);
+                    out.imm(src.imm, 4);
+                } else {
+                    enc.plusReg(0xb8, true, dst.reg);
+                    out.imm(src.imm, 8);
+                }
+            } else if (src.isImm()) {
+                enc.modrm({0xc7}, wide, 0, dst, 4);
+                out.imm(src.imm, 4);
+            } else if (src.isMem()) {
+                enc.modrm({0x8b}, wide, dst.reg, src);
+            } else {
+                enc.modrm({0x89}, wide, src.reg, dst);
+            }
+            break;
+        }
+        case MOVSX:
+            enc.modrm({0x63}, true, ops[1].reg, ops[0]);
+            break;
+        case MOVZX8:
+            enc.modrm({0x0f, 0xb6}, false, ops[1].reg, ops[0], 0, true);
+            break;
+        case LEA:
+            enc.modrm({0x8d}, wide, ops[1].reg, ops[0]);
+            break;
+        case ADD:
+        case SUB:
+        case AND:
+        case OR:
+        case XOR:
+        case CMP: {
+            ArithmeticEncoding e = arithmeticEncoding(mi.opcode);
+            const MachineOperand& src = ops[0];
+            const MachineOperand& dst = ops[1];
+            if (src.isImm()) {
+                bool shortImm = fitsInt8(src.imm);
+                enc.modrm({shortImm ? 0x83 : 0x81}, wide, e.digit, dst, shortImm ? 1 : 4);
+                out.imm(src.imm, shortImm ? 1 : 4);
+            } else if (src.isMem()) {
+                enc.modrm({e.base + 2}, wide, dst.reg, src);
+            } else {
+                enc.modrm({e.base}, wide, src.reg, dst);
+            }
+            break;
+        }
+        case IMUL:
+            if (ops.size() == 3) {
+                bool shortImm = fitsInt8(ops[0].imm);
+                enc.modrm({shortImm ? 0x6b : 0x69}, wide, ops[2].reg, ops[1], shortImm ? 1 : 4);
+                out.imm(ops[0].imm, shortImm ? 1 : 4);
+            } else {
+                enc.modrm({0x0f, 0xaf}, wide, ops[1].reg, ops[0]);
+            }
+            break;
+        case SHL:
+        case SAR:
+        case SHR:
+            if (ops[0].isImm() && ops[0].imm == 1) {
+                enc.modrm({0xd1}, wide, shiftDigit(mi.opcode), ops[1]);
+            } else if (ops[0].isImm()) {
+                enc.modrm({0xc1}, wide, shiftDigit(mi.opcode), ops[1], 1);
+                out.imm(ops[0].imm, 1);
+            } else {
+                // By %cl
+                enc.modrm({0xd3}, wide, shiftDigit(mi.opcode), ops[1]);
+            }
+            break;
+        case CDQ:
+            if (wide) out.byte(0x48);
+            out.byte(0x99);
+            break;
+        case IDIV:
+            enc.modrm({0xf7}, wide, 7, ops[0]);
+            break;
+        case TEST:
+            enc.modrm({0x85}, wide, ops[0].reg, ops[1]);
+            break;
+        case SETCC:
+            enc.modrm({0x0f, 0x90 + mi.cond}, false, 0, ops[0], 0, true);
+            break;
+        case CMOV:
+            enc.modrm({0x0f, 0x40 + mi.cond}, wide, ops[1].reg, ops[0]);
+            break;
+        case JMP:
+            out.branchTarget = ops[0].block;
+            break;
+        case JCC:
+            out.branchTarget = ops[0].block;
+            out.cond = mi.cond;
+            break;
+        case CALL:
+            out.byte(0xe8);
+            out.relocs.push_back({1, ops[0].symbol, R_X86_64_PLT32, -4});
+            out.imm(0, 4);
+            break;
+        case RET:
+            out.byte(0xc3);
+            break;
+        case PUSH:
+            enc.plusReg(0x50, false, ops[0].reg);
+            break;
+        case POP:
+            enc.plusReg(0x58, false, ops[0].reg);
+            break;
+        default:
+            throw std::logic_error("x86-64 encoder: unknown opcode");
+    }
+    return out;
+}
+
+} // namespace
+
+void X86Target::encodeFunction(const MachineFunction& mf, ObjectFile& obj) const {
+    std::vector<Encoded> insts;
+    std::vector<size_t> blockStart;  // First instruction of each block
+    for (const auto& bb : mf.blocks) {
+        blockStart.push_back(insts.size());
+        for (const auto& mi : bb->insts) insts.push_back(encode(mi));
+    }
+
+    // Branch relaxation: start with every branch short and lengthen those
+    // that do not reach, until none changes. Branches only ever grow, so
+    // this ends.
+    std::vector<size_t> offsets(insts.size() + 1);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < insts.size(); ++i) offsets[i + 1] = offsets[i] + insts[i].size();
+        for (size_t i = 0; i < insts.size(); ++i) {
+            Encoded& e = insts[i];
+            if (e.branchTarget < 0 || e.longBranch) continue;
+            long long disp = static_cast<long long>(offsets[blockStart[e.branchTarget]]) -
+                             static_cast<long long>(offsets[i + 1]);
+            if (!fitsInt8(disp)) {
+                e.longBranch = true;
+                changed = true;
+            }
+        }
+    }
+
+    obj.align(ObjectFile::Text, 16, 0x90);
+    auto& text = obj.contents(ObjectFile::Text);
+    uint64_t start = text.size();
+    for (size_t i = 0; i < insts.size(); ++i) {
+        Encoded& e = insts[i];
+        if (e.branchTarget >= 0) {
+            long long disp = static_cast<long long>(offsets[blockStart[e.branchTarget]]) -
+                             static_cast<long long>(offsets[i + 1]);
+            if (!e.longBranch) {
+                e.byte(e.cond < 0 ? 0xeb : 0x70 + e.cond);
+                e.imm(disp, 1);
+            } else if (e.cond < 0) {
+                e.byte(0xe9);
+                e.imm(disp, 4);
+            } else {
+                e.byte(0x0f);
+                e.byte(0x80 + e.cond);
+                e.imm(disp, 4);
+            }
+        }
+        uint64_t at = text.size();
+        for (const auto& r : e.relocs) obj.addRelocation(at + r.at, r.symbol, r.type, r.addend);
+        text.insert(text.end(), e.bytes.begin(), e.bytes.end());
+    }
+    obj.define(mf.name, ObjectFile::Text, start, text.size() - start, true);
+}
@@ -0,0 +1,636 @@
+#include "SelectionTree.h"
+#include "X86Target.h"
+#include <cstdint>
+
+using namespace x86;
+
+namespace {
+
+int valueSize(const std::string& type) {
+    return isPointerType(type) ? 8 : 4;
+}
+
+Cond condition(const std::string& pred) {
+    if (pred == "eq") return CondE;
+    if (pred == "ne") return CondNE;
+    if (pred == "slt") return CondL;
+    if (pred == "sle") return CondLE;
+    if (pred == "sgt") return CondG;
+    if (pred == "sge") return CondGE;
+    if (pred == "ult") return CondB;
+    if (pred == "ule") return CondBE;
+    if (pred == "ugt") return CondA;
+    return CondAE;
+}
+
+const std::vector<int> kCallerSaved = {RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11};
+
+// What a nonterminal stands for once reduced: a register, an immediate, a
+// memory operand, a condition on the flags, or a register that an address
+// has yet to scale.
+struct Selected {
+    MachineOperand op;
+    int cond = 0;
+    int scale = 1;
+};
+
+enum Nonterminal {
+    NtReg,
+    NtImm,
+    NtCond,
+    NtBool,     // A zero-extended condition, still only in the flags
+    NtBase,     // An address that can take an index: a register or a stack object
+    NtGlobal,   // A RIP-relative address, which cannot
+    NtAddr,
+    NtScaled1,  // A 64-bit index, times 1, 2, 4 or 8
+    NtScaled2,
+    NtScaled4,
+    NtScaled8,
+    kNumNonterminals
+};
+
+class InstructionSelector;
+using Matcher = TreeMatcher<InstructionSelector, Selected>;
+const Matcher& matcher();
+
+// Tree-pattern selection: each tree from SelectionTrees is covered by the
+// cheapest derivation under the rule table below, so that address
+// arithmetic folds into memory operands, small multiplies become lea and
+// compares feed branches directly. Phis are replaced by copies, through
+// one temporary per phi, so that the copies on an edge never overwrite each
+// other's sources; edges that need copies and leave a conditional branch get
+// a block of their own.
+class InstructionSelector {
+public:
+    InstructionSelector(const Module& m, const Function& f, MachineFunction& mf)
+        : module(m), func(f), mf(mf), trees(f) {}
+
+    void run();
+
+    // Used by the rules.
+    void emit(int opcode, int size, std::vector<MachineOperand> ops) {
+        mf.blocks[current]->insts.emplace_back(opcode, size, std::move(ops));
+    }
+    MachineInstr& last() { return mf.blocks[current]->insts.back(); }
+    int newReg(int size) { return mf.newVReg(size); }
+    // The register a node's value goes to: the root's destination, or a new one.
+    int destination(const SelectionNode& n) { return n.dest != kNoReg ? n.dest : mf.newVReg(n.size); }
+    int valueReg(const std::string& value) const { return regs.at(value); }
+    int frameIndex(const std::string& value) const { return frames.at(value); }
+
+private:
+    int toRegister(SelectionNode* n) { return matcher().reduce(*this, *n, NtReg).op.reg; }
+    // An immediate where the tree is one, else a register.
+    MachineOperand toOperand(SelectionNode* n) {
+        int nt = matcher().cost(*n, NtImm) <= matcher().cost(*n, NtReg) ? NtImm : NtReg;
+        return matcher().reduce(*this, *n, nt).op;
+    }
+    MachineOperand toAddress(SelectionNode* n) { return matcher().reduce(*this, *n, NtAddr).op; }
+    // Sets the flags; the condition under which the tree is true.
+    int toCondition(SelectionNode* n) { return matcher().reduce(*this, *n, NtCond).cond; }
+    void computeInto(SelectionNode* n, int dst);
+    void copy(const std::string& value, int dst) { computeInto(trees.operand(value), dst); }
+
+    void select(const Instruction& inst, const std::string& block);
+    void selectDivision(const Instruction& inst);
+    void selectSelect(const Instruction& inst);
+    void selectCall(const Instruction& inst);
+    void selectBranch(const Instruction& inst, const std::string& from);
+    // Machine block to jump to for the edge from `from` into `target`: the
+    // target itself, or a new block holding the phi copies of the edge.
+    int edgeTo(const std::string& from, const std::string& target);
+    // Copies the values the phis of `target` take along the edge from `from`
+    // into their temporaries.
+    void phiCopies(const std::string& from, const std::string& target);
+
+    const Module& module;
+    const Function& func;
+    MachineFunction& mf;
+    SelectionTrees trees;
+    int current = 0;
+    std::map<std::string, int> regs;       // SSA value -> virtual register
+    std::map<std::string, int> frames;     // Alloca -> frame object
+    std::map<std::string, int> blocks;     // IR block -> machine block
+    std::map<std::string, const BasicBlock*> irBlocks;
+    std::map<std::string, int> phiTemps;   // Phi -> register its incoming values go through
+    int edgeBlocks = 0;
+};
+
+// Rule actions
+
+using Kids = std::vector<Selected>;
+
+Selected inRegister(int reg) {
+    return {MachineOperand::use(reg)};
+}
+
+bool fitsImm32(long long value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Multipliers a single lea applies: r + r*k for 3, 5 and 9, r*k for 2, 4 and 8.
+bool isLeaMultiplier(long long m) {
+    return m == 2 || m == 3 || m == 4 || m == 5 || m == 8 || m == 9;
+}
+
+MachineOperand timesByLea(int reg, long long m) {
+    if (m % 2) return MachineOperand::memory(reg, 0, reg, static_cast<int>(m - 1));
+    return MachineOperand::memory(kNoReg, 0, reg, static_cast<int>(m));
+}
+
+Selected lea(InstructionSelector& s, int dst, int size, const MachineOperand& addr) {
+    s.emit(LEA, size, {addr, MachineOperand::def(dst)});
+    return inRegister(dst);
+}
+
+// d = a; d op= b
+Selected twoAddress(InstructionSelector& s, SelectionNode& n, int opcode, const Kids& k) {
+    int d = s.destination(n);
+    s.emit(MOV, n.size, {k[0].op, MachineOperand::def(d)});
+    s.emit(opcode, n.size, {k[1].op, MachineOperand::useDef(d)});
+    return inRegister(d);
+}
+
+int arithmeticOpcode(SelectionNode::Op op) {
+    switch (op) {
+        case SelectionNode::Sub: return SUB;
+        case SelectionNode::Mul: return IMUL;
+        case SelectionNode::And: return AND;
+        case SelectionNode::Or: return OR;
+        case SelectionNode::Xor: return XOR;
+        case SelectionNode::Shl: return SHL;
+        case SelectionNode::AShr: return SAR;
+        case SelectionNode::LShr: return SHR;
+        default: return ADD;
+    }
+}
+
+Selected arithmetic(InstructionSelector& s, SelectionNode& n, const Kids& k) {
+    return twoAddress(s, n, arithmeticOpcode(n.op), k);
+}
+
+Selected shiftByConstant(InstructionSelector& s, SelectionNode& n, const Kids& k) {
+    return twoAddress(s, n, arithmeticOpcode(n.op), {k[0], {MachineOperand::immediate(k[1].op.imm & 31)}});
+}
+
+// Variable shift counts live in %cl.
+Selected shiftByRegister(InstructionSelector& s, SelectionNode& n, const Kids& k) {
+    s.emit(MOV, 4, {k[1].op, MachineOperand::def(RCX)});
+    return twoAddress(s, n, arithmeticOpcode(n.op), {k[0], {MachineOperand::use(RCX)}});
+}
+
+Selected compare(InstructionSelector& s, SelectionNode& n, const Kids& k) {
+    s.emit(CMP, 4, {k[1].op, k[0].op});
+    Selected result;
+    result.cond = condition(n.predicate);
+    return result;
+}
+
+Selected materializeCondition(InstructionSelector& s, SelectionNode& n, const Kids& k) {
+    int d = s.destination(n);
+    s.emit(SETCC, 1, {MachineOperand::def(d)});
+    s.last().cond = k[0].cond;
+    s.emit(MOVZX8, 4, {MachineOperand::use(d), MachineOperand::def(d)});
+    return inRegister(d);
+}
+
+Selected passThrough(InstructionSelector&, SelectionNode&, const Kids& k) {
+    return k[0];
+}
+
+Selected addDisplacement(InstructionSelector&, SelectionNode&, const Kids& k) {
+    Selected addr = k[0];
+    addr.op.imm += k[1].op.imm;
+    return addr;
+}
+
+bool hasImm32(const SelectionNode& n) {
+    return n.kids[1]->op == SelectionNode::Const && fitsImm32(n.kids[1]->value);
+}
+
+bool hasLeaMultiplier(const SelectionNode& n) {
+    return n.kids[1]->op == SelectionNode::Const && isLeaMultiplier(n.kids[1]->value);
+}
+
+// Patterns deriving a 64-bit index times `Scale`, and addresses using one.
+template <int Scale>
+constexpr int scaledNonterminal() {
+    return Scale == 1 ? NtScaled1 : Scale == 2 ? NtScaled2 : Scale == 4 ? NtScaled4 : NtScaled8;
+}
+
+template <int Scale>
+bool multiplierIsScale(const SelectionNode& n) {
+    return n.kids[1]->isConst(Scale);
+}
+
+template <int Scale>
+bool multiplierIsScaledLea(const SelectionNode& n) {
+    long long c = n.kids[1]->value;
+    return n.kids[1]->op == SelectionNode::Const && c % Scale == 0 && isLeaMultiplier(c / Scale);
+}
+
+template <int Scale>
+bool multiplierIsScaledImm(const SelectionNode& n) {
+    long long c = n.kids[1]->value;
+    return n.kids[1]->op == SelectionNode::Const && c % Scale == 0 && fitsImm32(c / Scale);
+}
+
+template <int Scale>
+Selected scaled(int reg) {
+    Selected result = inRegister(reg);
+    result.scale = Scale;
+    return result;
+}
+
+template <int Scale>
+void addScaledRules(std::vector<Matcher::Rule>& rules) {
+    constexpr int nt = scaledNonterminal<Scale>();
+    if (Scale == 1) {
+        rules.push_back({nt, Matcher::kChain, {NtReg}, 0, nullptr,
+                         [](InstructionSelector&, SelectionNode&, const Kids& k) { return scaled<Scale>(k[0].op.reg); }});
+    }
+    rules.push_back({nt, SelectionNode::Mul64, {NtReg, NtImm}, 0, multiplierIsScale<Scale>,
+                     [](InstructionSelector&, SelectionNode&, const Kids& k) { return scaled<Scale>(k[0].op.reg); }});
+    rules.push_back({nt, SelectionNode::Mul64, {NtReg, NtImm}, 1, multiplierIsScaledLea<Scale>,
+                     [](InstructionSelector& s, SelectionNode&, const Kids& k) {
+                         int t = s.newReg(8);
+                         lea(s, t, 8, timesByLea(k[0].op.reg, k[1].op.imm / Scale));
+                         return scaled<Scale>(t);
+                     }});
+    rules.push_back({nt, SelectionNode::Mul64, {NtReg, NtImm}, 3, multiplierIsScaledImm<Scale>,
+                     [](InstructionSelector& s, SelectionNode&, const Kids& k) {
+                         int t = s.newReg(8);
+                         s.emit(IMUL, 8, {MachineOperand::immediate(k[1].op.imm / Scale), k[0].op, MachineOperand::def(t)});
+                         return scaled<Scale>(t);
+                     }});
+    // a*Scale + b*Scale = (a + b)*Scale
+    rules.push_back({nt, SelectionNode::Add64, {nt, nt}, 1, nullptr,
+                     [](InstructionSelector& s, SelectionNode&, const Kids& k) {
+                         int t = s.newReg(8);
+                         lea(s, t, 8, MachineOperand::memory(k[0].op.reg, 0, k[1].op.reg));
+                         return scaled<Scale>(t);
+                     }});
+    rules.push_back({NtAddr, SelectionNode::Add64, {NtBase, nt}, 0, nullptr,
+                     [](InstructionSelector&, SelectionNode&, const Kids& k) {
+                         Selected addr = k[0];
+                         addr.op.index = k[1].op.reg;
+                         addr.op.scale = Scale;
+                         return addr;
+                     }});
+}
+
+// Costs count instructions, with a multiply as three. The copy a
+// two-address instruction needs counts too, which is what makes lea win
+// for additions.
+std::vector<Matcher::Rule> rules() {
+    using Op = SelectionNode;
+    constexpr int kChain = Matcher::kChain;
+    std::vector<Matcher::Rule> table = {
+        // Leaves
+        {NtImm, Op::Const, {}, 0, [](const SelectionNode& n) { return fitsImm32(n.value); },
+         [](InstructionSelector&, SelectionNode& n, const Kids&) { return Selected{MachineOperand::immediate(n.value)}; }},
+        {NtReg, Op::Const, {}, 1, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids&) {
+             int d = s.destination(n);
+             s.emit(MOV, n.size, {MachineOperand::immediate(n.value), MachineOperand::def(d)});
+             return inRegister(d);
+         }},
+        {NtReg, Op::Value, {}, 0, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids&) { return inRegister(s.valueReg(n.name)); }},
+        {NtBase, Op::Frame, {}, 0, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids&) {
+             return Selected{MachineOperand::frame(s.frameIndex(n.name))};
+         }},
+        {NtGlobal, Op::Global, {}, 0, nullptr,
+         [](InstructionSelector&, SelectionNode& n, const Kids&) {
+             return Selected{MachineOperand::global(n.name.substr(1))};
+         }},
+
+        // Conversions between nonterminals
+        {NtReg, kChain, {NtAddr}, 1, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) { return lea(s, s.destination(n), 8, k[0].op); }},
+        {NtBase, kChain, {NtReg}, 0, nullptr,
+         [](InstructionSelector&, SelectionNode&, const Kids& k) { return Selected{MachineOperand::memory(k[0].op.reg)}; }},
+        {NtAddr, kChain, {NtBase}, 0, nullptr, passThrough},
+        {NtAddr, kChain, {NtGlobal}, 0, nullptr, passThrough},
+        {NtReg, kChain, {NtCond}, 2, nullptr, materializeCondition},
+        {NtReg, kChain, {NtBool}, 2, nullptr, materializeCondition},
+        {NtCond, kChain, {NtReg}, 1, nullptr,
+         [](InstructionSelector& s, SelectionNode&, const Kids& k) {
+             s.emit(TEST, 4, {k[0].op, k[0].op});
+             Selected result;
+             result.cond = CondNE;
+             return result;
+         }},
+
+        // 32-bit arithmetic; lea adds without a copy.
+        {NtReg, Op::Add, {NtReg, NtReg}, 1, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) {
+             return lea(s, s.destination(n), 4, MachineOperand::memory(k[0].op.reg, 0, k[1].op.reg));
+         }},
+        {NtReg, Op::Add, {NtReg, NtImm}, 1, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) {
+             return lea(s, s.destination(n), 4, MachineOperand::memory(k[0].op.reg, k[1].op.imm));
+         }},
+        {NtReg, Op::Sub, {NtReg, NtReg}, 2, nullptr, arithmetic},
+        {NtReg, Op::Sub, {NtReg, NtImm}, 1, [](const SelectionNode& n) { return hasImm32(n) && fitsImm32(-n.kids[1]->value); },
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) {
+             return lea(s, s.destination(n), 4, MachineOperand::memory(k[0].op.reg, -k[1].op.imm));
+         }},
+        {NtReg, Op::Mul, {NtReg, NtReg}, 4, nullptr, arithmetic},
+        {NtReg, Op::Mul, {NtReg, NtImm}, 3, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) {
+             int d = s.destination(n);
+             s.emit(IMUL, 4, {k[1].op, k[0].op, MachineOperand::def(d)});
+             return inRegister(d);
+         }},
+        {NtReg, Op::Mul, {NtReg, NtImm}, 1, hasLeaMultiplier,
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) {
+             return lea(s, s.destination(n), 4, timesByLea(k[0].op.reg, k[1].op.imm));
+         }},
+        {NtReg, Op::And, {NtReg, NtReg}, 2, nullptr, arithmetic},
+        {NtReg, Op::And, {NtReg, NtImm}, 2, nullptr, arithmetic},
+        {NtReg, Op::Or, {NtReg, NtReg}, 2, nullptr, arithmetic},
+        {NtReg, Op::Or, {NtReg, NtImm}, 2, nullptr, arithmetic},
+        {NtReg, Op::Xor, {NtReg, NtReg}, 2, nullptr, arithmetic},
+        {NtReg, Op::Xor, {NtReg, NtImm}, 2, nullptr, arithmetic},
+        {NtReg, Op::Shl, {NtReg, NtImm}, 2, nullptr, shiftByConstant},
+        {NtReg, Op::Shl, {NtReg, NtImm}, 1,
+         [](const SelectionNode& n) { return n.kids[1]->op == Op::Const && n.kids[1]->value >= 1 && n.kids[1]->value <= 3; },
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) {
+             return lea(s, s.destination(n), 4, timesByLea(k[0].op.reg, 1LL << k[1].op.imm));
+         }},
+        {NtReg, Op::Shl, {NtReg, NtReg}, 3, nullptr, shiftByRegister},
+        {NtReg, Op::AShr, {NtReg, NtImm}, 2, nullptr, shiftByConstant},
+        {NtReg, Op::AShr, {NtReg, NtReg}, 3, nullptr, shiftByRegister},
+        {NtReg, Op::LShr, {NtReg, NtImm}, 2, nullptr, shiftByConstant},
+        {NtReg, Op::LShr, {NtReg, NtReg}, 3, nullptr, shiftByRegister},
+        {NtCond, Op::ICmp, {NtReg, NtReg}, 1, nullptr, compare},
+        {NtCond, Op::ICmp, {NtReg, NtImm}, 1, nullptr, compare},
+        // Booleans are already 0 or 1.
+        {NtReg, Op::ZExt, {NtReg}, 0, nullptr, passThrough},
+        // The frontend tests conditions as icmp ne (zext c), 0.
+        {NtBool, Op::ZExt, {NtCond}, 0, nullptr, passThrough},
+        {NtCond, Op::ICmp, {NtBool, NtImm}, 0,
+         [](const SelectionNode& n) { return n.kids[1]->isConst(0) && (n.predicate == "ne" || n.predicate == "eq"); },
+         [](InstructionSelector&, SelectionNode& n, const Kids& k) {
+             Selected result = k[0];
+             // Conditions invert by flipping the low bit of their encoding.
+             if (n.predicate == "eq") result.cond ^= 1;
+             return result;
+         }},
+
+        // Address arithmetic
+        {NtReg, Op::SExt, {NtReg}, 1, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) {
+             int d = s.destination(n);
+             s.emit(MOVSX, 8, {k[0].op, MachineOperand::def(d)});
+             return inRegister(d);
+         }},
+        {NtReg, Op::Mul64, {NtReg, NtImm}, 3, nullptr,
+         [](InstructionSelector& s, SelectionNode& n, const Kids& k) {
+             int d = s.destination(n);
+             s.emit(IMUL, 8, {k[1].op, k[0].op, MachineOperand::def(d)});
+             return inRegister(d);
+         }},
+        {NtBase, Op::Add64, {NtBase, NtImm}, 0, nullptr, addDisplacement},
+        {NtGlobal, Op::Add64, {NtGlobal, NtImm}, 0, nullptr, addDisplacement},
+        {NtAddr, Op::Add64, {NtAddr, NtImm}, 0, nullptr, addDisplacement},
+    };
+    addScaledRules<1>(table);
+    addScaledRules<2>(table);
+    addScaledRules<4>(table);
+    addScaledRules<8>(table);
+    return table;
+}
+
+const Matcher& matcher() {
+    static const Matcher instance(kNumNonterminals, rules());
+    return instance;
+}
+
+void InstructionSelector::computeInto(SelectionNode* n, int dst) {
+    n->dest = dst;
+    int reg = toRegister(n);
+    if (reg != dst) emit(MOV, mf.vregSize(dst), {MachineOperand::use(reg), MachineOperand::def(dst)});
+}
+
+void InstructionSelector::selectDivision(const Instruction& inst) {
+    // idiv divides %edx:%eax, leaving the quotient in %eax and the remainder
+    // in %edx.
+    int dividend = toRegister(trees.operand(inst.operands[0]));
+    int divisor = toRegister(trees.operand(inst.operands[1]));
+    emit(MOV, 4, {MachineOperand::use(dividend), MachineOperand::def(RAX)});
+    emit(CDQ, 4, {});
+    last().implicitUses = {RAX};
+    last().implicitDefs = {RDX};
+    emit(IDIV, 4, {MachineOperand::use(divisor)});
+    last().implicitUses = {RAX, RDX};
+    last().implicitDefs = {RAX, RDX};
+    int result = inst.op == Opcode::SDiv ? RAX : RDX;
+    emit(MOV, 4, {MachineOperand::use(result), MachineOperand::def(regs.at(inst.result))});
+}
+
+void InstructionSelector::selectSelect(const Instruction& inst) {
+    int dst = regs.at(inst.result);
+    const std::string& cond = inst.operands[0];
+    if (isConstantOperand(cond)) {
+        copy(constantValue(cond) ? inst.operands[1] : inst.operands[2], dst);
+        return;
+    }
+    // The flags are set last, after anything that could clobber them.
+    copy(inst.operands[2], dst);
+    int whenTrue = toRegister(trees.operand(inst.operands[1]));
+    int cc = toCondition(trees.operand(cond));
+    emit(CMOV, valueSize(inst.type), {MachineOperand::use(whenTrue), MachineOperand::useDef(dst)});
+    last().cond = cc;
+}
+
+void InstructionSelector::selectCall(const Instruction& inst) {
+    std::string callee = inst.callee;
+    std::vector<std::string> args = inst.operands;
+    std::vector<std::string> types = inst.argTypes;
+    // sylib's timing functions are macros passing the source line, which
+    // the IR does not keep.
+    if (callee == "starttime" || callee == "stoptime") {
+        callee = "_sysy_" + callee;
+        args = {"0"};
+        types = {"i32"};
+    }
+    bool varArg = false;
+    for (const auto& candidate : module.functions) {
+        if (candidate->name == inst.callee) varArg = candidate->isVarArg;
+    }
+
+    // Every argument is computed before any argument register is set, since
+    // computing one may need a fixed register such as %cl.
+    std::vector<MachineOperand> values;
+    for (const auto& arg : args) values.push_back(toOperand(trees.operand(arg)));
+    // Stack arguments first, so that the argument registers are set last
+    // and stay reserved only briefly.
+    for (size_t i = 6; i < args.size(); ++i) {
+        emit(MOV, valueSize(types[i]), {values[i], MachineOperand::memory(RSP, 8 * static_cast<long long>(i - 6))});
+    }
+    if (args.size() > 6) mf.outgoingArgsSize = std::max(mf.outgoingArgsSize, 8 * static_cast<int>(args.size() - 6));
+    std::vector<int> argRegs;
+    for (size_t i = 0; i < args.size() && i < 6; ++i) {
+        emit(MOV, valueSize(types[i]), {values[i], MachineOperand::def(kArgRegs[i])});
+        argRegs.push_back(kArgRegs[i]);
+    }
+    // Variadic callees take the number of vector registers used in %al.
+    if (varArg) {
+        emit(MOV, 4, {MachineOperand::immediate(0), MachineOperand::def(RAX)});
+        argRegs.push_back(RAX);
+    }
+    emit(CALL, 8, {MachineOperand::function(callee)});
+    last().implicitUses = argRegs;
+    last().implicitDefs = kCallerSaved;
+    if (!inst.result.empty()) {
+        emit(MOV, valueSize(inst.type), {MachineOperand::use(RAX), MachineOperand::def(regs.at(inst.result))});
+    }
+}
+
+void InstructionSelector::phiCopies(const std::string& from, const std::string& target) {
+    for (const auto& inst : irBlocks.at(target)->insts) {
+        if (inst.op != Opcode::Phi) break;
+        for (size_t i = 0; i < inst.labels.size(); ++i) {
+            if (inst.labels[i] != from) continue;
+            copy(inst.operands[i], phiTemps.at(inst.result));
+            break;
+        }
+    }
+}
+
+int InstructionSelector::edgeTo(const std::string& from, const std::string& target) {
+    const BasicBlock* succ = irBlocks.at(target);
+    if (succ->insts.empty() || succ->insts[0].op != Opcode::Phi) return blocks.at(target);
+    int edge = mf.addBlock(".L" + func.name + "_edge" + std::to_string(edgeBlocks++));
+    int saved = current;
+    current = edge;
+    phiCopies(from, target);
+    emit(JMP, 8, {MachineOperand::label(blocks.at(target))});
+    mf.blocks[edge]->succs = {blocks.at(target)};
+    current = saved;
+    return edge;
+}
+
+void InstructionSelector::selectBranch(const Instruction& inst, const std::string& from) {
+    std::string target;
+    if (inst.op == Opcode::Br) {
+        target = inst.labels[0];
+    } else if (isConstantOperand(inst.operands[0])) {
+        target = constantValue(inst.operands[0]) ? inst.labels[0] : inst.labels[1];
+    } else {
+        int taken = edgeTo(from, inst.labels[0]);
+        int notTaken = edgeTo(from, inst.labels[1]);
+        int cond = toCondition(trees.operand(inst.operands[0]));
+        emit(JCC, 8, {MachineOperand::label(taken)});
+        last().cond = cond;
+        emit(JMP, 8, {MachineOperand::label(notTaken)});
+        mf.blocks[current]->succs = {taken, notTaken};
+        return;
+    }
+    phiCopies(from, target);
+    emit(JMP, 8, {MachineOperand::label(blocks.at(target))});
+    mf.blocks[current]->succs = {blocks.at(target)};
+}
+
+void InstructionSelector::select(const Instruction& inst, const std::string& block) {
+    if (!inst.result.empty() && trees.isFolded(inst.result)) return;
+    switch (inst.op) {
+        case Opcode::Alloca:
+        case Opcode::Phi:
+        case Opcode::Unreachable:
+            break;
+        case Opcode::Load:
+            emit(MOV, valueSize(inst.type),
+                 {toAddress(trees.operand(inst.operands[0])), MachineOperand::def(regs.at(inst.result))});
+            break;
+        case Opcode::Store: {
+            MachineOperand value = toOperand(trees.operand(inst.operands[0]));
+            emit(MOV, valueSize(inst.type), {value, toAddress(trees.operand(inst.operands[1]))});
+            break;
+        }
+        case Opcode::SDiv:
+        case Opcode::SRem:
+            selectDivision(inst);
+            break;
+        case Opcode::Select:
+            selectSelect(inst);
+            break;
+        case Opcode::Call:
+            selectCall(inst);
+            break;
+        case Opcode::Br:
+        case Opcode::CondBr:
+            selectBranch(inst, block);
+            break;
+        case Opcode::Ret:
+            if (!inst.operands.empty()) {
+                emit(MOV, valueSize(inst.type), {toOperand(trees.operand(inst.operands[0])), MachineOperand::def(RAX)});
+            }
+            emit(RET, 8, {});
+            if (!inst.operands.empty()) last().implicitUses = {RAX};
+            break;
+        default:
+            // Arithmetic, compares, extensions and addresses
+            computeInto(trees.root(inst), regs.at(inst.result));
+            break;
+    }
+}
+
+void InstructionSelector::run() {
+    for (const auto& bb : func.blocks) {
+        blocks[bb->name] = mf.addBlock(".L" + func.name + "_" + bb->name);
+        irBlocks[bb->name] = bb.get();
+    }
+    for (const auto& bb : func.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op == Opcode::Alloca) {
+                int size = typeSizeInBytes(inst.type);
+                frames[inst.result] = mf.addFrameObject(size, size >= 8 ? 8 : 4);
+            } else if (!inst.result.empty() && !trees.isFolded(inst.result)) {
+                int size = valueSize(inst.resultType());
+                regs[inst.result] = mf.newVReg(size);
+                if (inst.op == Opcode::Phi) phiTemps[inst.result] = mf.newVReg(size);
+            }
+        }
+    }
+
+    // Parameters arrive in the argument registers, the rest above the
+    // return address.
+    current = 0;
+    for (size_t i = 0; i < func.paramNames.size(); ++i) {
+        int size = valueSize(func.paramTypes[i]);
+        int reg = mf.newVReg(size);
+        regs[func.paramNames[i]] = reg;
+        if (i < 6) {
+            emit(MOV, size, {MachineOperand::use(kArgRegs[i]), MachineOperand::def(reg)});
+        } else {
+            int fi = mf.addFrameObject(8, 8);
+            mf.frameObjects[fi].fixed = true;
+            mf.frameObjects[fi].offset = 16 + 8 * static_cast<long long>(i - 6);
+            emit(MOV, size, {MachineOperand::frame(fi), MachineOperand::def(reg)});
+        }
+    }
+
+    for (const auto& bb : func.blocks) {
+        current = blocks.at(bb->name);
+        for (const auto& inst : bb->insts) {
+            if (inst.op == Opcode::Phi) {
+                emit(MOV, mf.vregSize(regs.at(inst.result)),
+                     {MachineOperand::use(phiTemps.at(inst.result)), MachineOperand::def(regs.at(inst.result))});
+            } else {
+                select(inst, bb->name);
+            }
+        }
+    }
+}
+
+} // namespace
+
+std::unique_ptr<MachineFunction> X86Target::selectInstructions(const Module& m, const Function& f) const {
+    auto mf = std::make_unique<MachineFunction>(f.name);
+    InstructionSelector(m, f, *mf).run();
+    return mf;
+}
@@ -0,0 +1,120 @@
+#include "Peephole.h"
+#include "X86Target.h"
+
+using namespace x86;
+
+namespace {
+
+bool isRegCopy(const MachineInstr& mi) {
+    return mi.ops.size() == 2 && mi.ops[0].isReg() && mi.ops[1].isReg();
+}
+
+// mov %r, %r
+bool removeSelfCopy(const PeepholeSite& site) {
+    const MachineInstr& mi = site.inst(0);
+    if (!isRegCopy(mi) || mi.ops[0].reg != mi.ops[1].reg) return false;
+    site.erase(0);
+    return true;
+}
+
+// mov %a, %b; mov %b, %a: the second copy is redundant.
+bool removeCopyBack(const PeepholeSite& site) {
+    const MachineInstr& first = site.inst(0);
+    const MachineInstr& second = site.inst(1);
+    if (!isRegCopy(first) || !isRegCopy(second) || first.size != second.size) return false;
+    if (first.ops[0].reg != second.ops[1].reg || first.ops[1].reg != second.ops[0].reg) return false;
+    site.erase(1);
+    return true;
+}
+
+// mov x, mem; mov mem, %r: the load takes x directly.
+bool forwardStore(const PeepholeSite& site) {
+    const MachineInstr& store = site.inst(0);
+    MachineInstr& load = site.inst(1);
+    if (store.ops.size() != 2 || !store.ops[1].isMem() || store.ops[0].isMem()) return false;
+    if (load.ops.size() != 2 || !load.ops[1].isReg() || !sameAddress(store.ops[1], load.ops[0])) return false;
+    if (store.size != load.size) return false;
+    if (store.ops[0].isReg() && store.ops[0].reg == load.ops[1].reg) {
+        site.erase(1);
+        return true;
+    }
+    load.ops[0] = store.ops[0].isReg() ? MachineOperand::use(store.ops[0].reg) : store.ops[0];
+    return true;
+}
+
+// add $0, %r and sub $0, %r; nothing reads the flags of arithmetic.
+bool removeAddZero(const PeepholeSite& site) {
+    const MachineInstr& mi = site.inst(0);
+    if (!mi.ops[0].isImm() || mi.ops[0].imm != 0) return false;
+    site.erase(0);
+    return true;
+}
+
+// imul $1, %a, %b
+bool simplifyMultiplyByOne(const PeepholeSite& site) {
+    MachineInstr& mi = site.inst(0);
+    if (mi.ops.size() != 3 || !mi.ops[0].isImm() || mi.ops[0].imm != 1) return false;
+    mi = MachineInstr(MOV, mi.size, {mi.ops[1], mi.ops[2]});
+    return true;
+}
+
+// setcc %v; movzbl %v, %v; test %v, %v; jne L: branch on the condition
+// itself. The flags survive setcc and movzbl, so the materialized value
+// only stays if something else reads it.
+bool fuseCompareBranch(const PeepholeSite& site) {
+    const MachineInstr& set = site.inst(0);
+    const MachineInstr& extend = site.inst(1);
+    const MachineInstr& test = site.inst(2);
+    MachineInstr& branch = site.inst(3);
+    int v = set.ops[0].reg;
+    if (extend.ops[0].reg != v || extend.ops[1].reg != v) return false;
+    if (!test.ops[0].isReg() || test.ops[0].reg != v || !test.ops[1].isReg() || test.ops[1].reg != v) return false;
+    if (branch.cond != CondNE && branch.cond != CondE) return false;
+    // Conditions invert by flipping the low bit of their encoding.
+    branch.cond = branch.cond == CondNE ? set.cond : set.cond ^ 1;
+    bool dead = site.reads(v) == 3;
+    site.erase(2);
+    if (dead) {
+        site.erase(1);
+        site.erase(0);
+    }
+    return true;
+}
+
+// jmp to the block laid out next
+bool removeJumpToNext(const PeepholeSite& site) {
+    if (!site.isNextBlock(site.inst(0).ops[0].block)) return false;
+    site.erase(0);
+    return true;
+}
+
+// jcc L; jmp M with L next: jncc M and fall through.
+bool invertBranchOverJump(const PeepholeSite& site) {
+    MachineInstr& branch = site.inst(0);
+    const MachineInstr& jump = site.inst(1);
+    if (!site.isNextBlock(branch.ops[0].block)) return false;
+    branch.cond ^= 1;
+    branch.ops[0] = jump.ops[0];
+    site.erase(1);
+    return true;
+}
+
+constexpr std::array<PeepholeRule, 9> kRules = {{
+    {{MOV}, 1, removeSelfCopy},
+    {{MOV, MOV}, 2, removeCopyBack},
+    {{MOV, MOV}, 2, forwardStore},
+    {{ADD}, 1, removeAddZero},
+    {{SUB}, 1, removeAddZero},
+    {{IMUL}, 1, simplifyMultiplyByOne},
+    {{SETCC, MOVZX8, TEST, JCC}, 4, fuseCompareBranch},
+    {{JMP}, 1, removeJumpToNext},
+    {{JCC, JMP}, 2, invertBranchOverJump},
+}};
+
+constexpr PeepholeMatcher<kRules.size(), kNumMachineOpcodes> kMatcher(kRules);
+
+} // namespace
+
+bool X86Target::runPeephole(MachineFunction& mf) const {
+    return kMatcher.run(mf);
+}
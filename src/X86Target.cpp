@@ -0,0 +1,241 @@
+#include "X86Target.h"
+#include <sstream>
+
+using namespace x86;
+
+const Reg x86::kArgRegs[6] = {RDI, RSI, RDX, RCX, R8, R9};
+
+namespace {
+
+const char* const kNames64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                                "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15"};
+const char* const kNames32[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                                "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+const char* const kNames8[] = {"al",  "cl",  "dl",   "bl",   "spl",  "bpl",  "sil",  "dil",
+                               "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+const char* const kCondNames[] = {"o", "no", "b", "ae", "e", "ne", "be", "a",
+                                  "s", "ns", "p", "np", "l", "ge", "le", "g"};
+
+char suffix(int size) {
+    switch (size) {
+        case 1: return 'b';
+        case 2: return 'w';
+        case 8: return 'q';
+        default: return 'l';
+    }
+}
+
+} // namespace
+
+X86Target::X86Target() {
+    // Scratch registers no instruction needs first, then the argument
+    // registers, and the callee-saved ones last since they cost a push.
+    allocatable = {R10, R11, RSI, RDI, R8, R9, RCX, RDX, RAX, RBX, R12, R13, R14, R15};
+}
+
+bool X86Target::isCalleeSaved(int reg) const {
+    return reg == RBX || reg == RBP || (reg >= R12 && reg <= R15);
+}
+
+std::string X86Target::regName(int reg, int size) const {
+    if (!isPhysicalReg(reg)) return "v" + std::to_string(reg - kFirstVirtualReg);
+    if (size == 8) return kNames64[reg];
+    if (size == 1) return kNames8[reg];
+    return kNames32[reg];
+}
+
+MachineInstr X86Target::loadFromFrame(int reg, int frameIndex, int size) const {
+    return MachineInstr(MOV, size, {MachineOperand::frame(frameIndex), MachineOperand::def(reg)});
+}
+
+MachineInstr X86Target::storeToFrame(int reg, int frameIndex, int size) const {
+    return MachineInstr(MOV, size, {MachineOperand::use(reg), MachineOperand::frame(frameIndex)});
+}
+
+bool X86Target::isCopy(const MachineInstr& mi, int& dst, int& src) const {
+    if (mi.opcode != MOV || !mi.ops[0].isReg() || !mi.ops[1].isReg()) return false;
+    src = mi.ops[0].reg;
+    dst = mi.ops[1].reg;
+    return true;
+}
+
+bool X86Target::isRematerializable(const MachineInstr& mi) const {
+    // Constants, and addresses of stack objects and globals
+    if (mi.opcode == MOV) return mi.ops[0].isImm() && mi.ops[1].isReg();
+    if (mi.opcode != LEA) return false;
+    const MachineOperand& addr = mi.ops[0];
+    return addr.reg == kNoReg && addr.index == kNoReg;
+}
+
+void X86Target::lowerFrame(MachineFunction& mf) const {
+    // Layout below the frame pointer: callee-saved registers, stack objects,
+    // then the outgoing arguments at the stack pointer.
+    int saved = static_cast<int>(mf.usedCalleeSaved.size());
+    long long offset = -8LL * saved;
+    for (auto& obj : mf.frameObjects) {
+        if (obj.fixed) continue;
+        offset -= obj.size;
+        offset -= ((offset % obj.align) + obj.align) % obj.align;
+        obj.offset = offset;
+    }
+    long long frameSize = -offset - 8LL * saved + mf.outgoingArgsSize;
+    // Calls need the stack pointer 16-byte aligned; the return address and
+    // the saved frame pointer already take 16 bytes.
+    frameSize += (16 - (8LL * saved + frameSize) % 16) % 16;
+
+    for (auto& bb : mf.blocks) {
+        std::vector<MachineInstr> out;
+        for (auto& mi : bb->insts) {
+            for (auto& op : mi.ops) {
+                if (op.kind != MachineOperand::Mem || op.frameIndex < 0) continue;
+                op.reg = RBP;
+                op.imm += mf.frameObjects[op.frameIndex].offset;
+                op.frameIndex = -1;
+            }
+            if (mi.opcode != RET) {
+                out.push_back(std::move(mi));
+                continue;
+            }
+            if (saved) {
+                out.emplace_back(LEA, 8, std::vector<MachineOperand>{MachineOperand::memory(RBP, -8LL * saved),
+                                                                     MachineOperand::def(RSP)});
+                for (int i = saved; i-- > 0;) {
+                    out.emplace_back(POP, 8, std::vector<MachineOperand>{MachineOperand::def(mf.usedCalleeSaved[i])});
+                }
+            } else {
+                out.emplace_back(MOV, 8, std::vector<MachineOperand>{MachineOperand::use(RBP), MachineOperand::def(RSP)});
+            }
+            out.emplace_back(POP, 8, std::vector<MachineOperand>{MachineOperand::def(RBP)});
+            out.push_back(std::move(mi));
+        }
+        bb->insts = std::move(out);
+    }
+
+    std::vector<MachineInstr> prologue;
+    prologue.emplace_back(PUSH, 8, std::vector<MachineOperand>{MachineOperand::use(RBP)});
+    prologue.emplace_back(MOV, 8, std::vector<MachineOperand>{MachineOperand::use(RSP), MachineOperand::def(RBP)});
+    for (int reg : mf.usedCalleeSaved) {
+        prologue.emplace_back(PUSH, 8, std::vector<MachineOperand>{MachineOperand::use(reg)});
+    }
+    if (frameSize > 0) {
+        prologue.emplace_back(SUB, 8, std::vector<MachineOperand>{MachineOperand::immediate(frameSize),
+                                                                  MachineOperand::useDef(RSP)});
+    }
+    auto& entry = mf.blocks[0]->insts;
+    entry.insert(entry.begin(), prologue.begin(), prologue.end());
+}
+
+std::string X86Target::printInstruction(const MachineInstr& mi, const MachineFunction& mf) const {
+    std::string mnemonic;
+    char s = suffix(mi.size);
+    switch (mi.opcode) {
+        case MOV: mnemonic = std::string("mov") + s; break;
+        case MOVSX: mnemonic = "movslq"; break;
+        case MOVZX8: mnemonic = "movzbl"; break;
+        case LEA: mnemonic = std::string("lea") + s; break;
+        case ADD: mnemonic = std::string("add") + s; break;
+        case SUB: mnemonic = std::string("sub") + s; break;
+        case IMUL: mnemonic = std::string("imul") + s; break;
+        case AND: mnemonic = std::string("and") + s; break;
+        case OR: mnemonic = std::string("or") + s; break;
+        case XOR: mnemonic = std::string("xor") + s; break;
+        case SHL: mnemonic = std::string("shl") + s; break;
+        case SAR: mnemonic = std::string("sar") + s; break;
+        case SHR: mnemonic = std::string("shr") + s; break;
+        case CDQ: mnemonic = "cltd"; break;
+        case IDIV: mnemonic = std::string("idiv") + s; break;
+        case CMP: mnemonic = std::string("cmp") + s; break;
+        case TEST: mnemonic = std::string("test") + s; break;
+        case SETCC: mnemonic = std::string("set") + kCondNames[mi.cond]; break;
+        case CMOV: mnemonic = std::string("cmov") + kCondNames[mi.cond]; break;
+        case JMP: mnemonic = "jmp"; break;
+        case JCC: mnemonic = std::string("j") + kCondNames[mi.cond]; break;
+        case CALL: mnemonic = "call"; break;
+        case RET: mnemonic = "ret"; break;
+        case PUSH: mnemonic = "pushq"; break;
+        case POP: mnemonic = "popq"; break;
+    }
+
+    std::string text = "    " + mnemonic;
+    for (size_t i = 0; i < mi.ops.size(); ++i) {
+        const MachineOperand& op = mi.ops[i];
+        text += i == 0 ? " " : ", ";
+        switch (op.kind) {
+            case MachineOperand::Reg: {
+                int size = mi.size;
+                if (mi.opcode == MOVSX) size = i == 0 ? 4 : 8;
+                if (mi.opcode == MOVZX8) size = i == 0 ? 1 : 4;
+                if ((mi.opcode == SHL || mi.opcode == SAR || mi.opcode == SHR) && i == 0) size = 1;
+                if (mi.opcode == PUSH || mi.opcode == POP) size = 8;
+                text += "%" + regName(op.reg, size);
+                break;
+            }
+            case MachineOperand::Imm:
+                text += "$" + std::to_string(op.imm);
+                break;
+            case MachineOperand::Mem:
+                if (!op.symbol.empty()) {
+                    text += op.symbol;
+                    if (op.imm > 0) text += "+";
+                    if (op.imm != 0) text += std::to_string(op.imm);
+                    text += "(%rip)";
+                    break;
+                }
+                if (op.imm != 0) text += std::to_string(op.imm);
+                text += "(";
+                if (op.reg != kNoReg) text += "%" + regName(op.reg, 8);
+                if (op.index != kNoReg) text += ",%" + regName(op.index, 8) + "," + std::to_string(op.scale);
+                text += ")";
+                break;
+            case MachineOperand::Block:
+                text += mf.blocks[op.block]->label;
+                break;
+            case MachineOperand::Symbol:
+                text += op.symbol;
+                break;
+        }
+    }
+    return text;
+}
+
+std::string X86Target::printFunction(const MachineFunction& mf) const {
+    std::ostringstream out;
+    out << "    .text\n";
+    out << "    .globl " << mf.name << "\n";
+    out << "    .type " << mf.name << ", @function\n";
+    out << mf.name << ":\n";
+    for (const auto& bb : mf.blocks) {
+        out << bb->label << ":\n";
+        for (const auto& mi : bb->insts) out << printInstruction(mi, mf) << "\n";
+    }
+    out << "    .size " << mf.name << ", .-" << mf.name << "\n\n";
+    return out.str();
+}
+
+std::string X86Target::printGlobals(const Module& m) const {
+    std::ostringstream out;
+    for (const auto& g : m.globals) {
+        int size = typeSizeInBytes(g.type);
+        if (g.zeroInit) {
+            out << "    .bss\n";
+        } else if (g.isConstant) {
+            out << "    .section .rodata\n";
+        } else {
+            out << "    .data\n";
+        }
+        out << "    .globl " << g.name << "\n";
+        out << "    .p2align " << (size >= 16 ? 4 : 2) << "\n";
+        out << g.name << ":\n";
+        // Trailing zeros of large arrays go out as one directive.
+        int values = g.zeroInit ? 0 : static_cast<int>(g.init.size());
+        while (values > 0 && g.init[values - 1] == 0) --values;
+        for (int i = 0; i < values; ++i) out << "    .long " << g.init[i] << "\n";
+        if (size > 4 * values) out << "    .zero " << size - 4 * values << "\n";
+    }
+    out << "    .section .note.GNU-stack,\"\",@progbits\n";
+    return out.str();
+}
+
+std::unique_ptr<Target> createX86Target() {
+    return std::make_unique<X86Target>();
+}
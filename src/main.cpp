@@ -1,62 +1,512 @@
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <iterator>
+#include <map>
 #include "antlr4-runtime.h"
 #include "SysYLexer.h"
 #include "SysYParser.h"
 #include "IRBuilder.h"
+#include "IRParser.h"
+#include "PassManager.h"
+#include "CodeGen.h"
+#include "Interpreter.h"
+#include "JIT.h"
+#include "Tiering.h"
+#include "ThreadPool.h"
+#include "SourceParser.h"
+#include "CompileCache.h"
 
 using namespace antlr4;
 
+namespace {
+
+// The tokens under `tree` separated by spaces, so that layout and comments
+// do not change a cache key.
+void appendTokens(tree::ParseTree* node, std::string& text) {
+  if (auto* terminal = dynamic_cast<tree::TerminalNode*>(node)) {
+    if (terminal->getSymbol()->getType() == Token::EOF) {
+      return;
+    }
+    text += (text.empty() ? "" : " ") + terminal->getText();
+    return;
+  }
+  for (auto* child : node->children) {
+    appendTokens(child, text);
+  }
+}
+
+std::string normalizedText(tree::ParseTree* node) {
+  std::string text;
+  appendTokens(node, text);
+  return text;
+}
+
+} // namespace
+
 int main(int argc, const char *argv[]) {
-  if (argc < 3) {
-    std::cerr << "Usage: ./compiler <input-file> <output-file>"
+  bool memoize = false;
+  bool sroa = false;
+  bool mem2reg = false;
+  bool ipsccp = false;
+  bool vrp = false;
+  bool ifConvert = false;
+  bool distribute = false;
+  bool fuse = false;
+  bool interchange = false;
+  bool tile = false;
+  bool gcm = false;
+  bool schedule = false;
+  int tileSize = 0;
+  int optLevel = -1;  // No -O given
+  bool explicitRegAlloc = false;
+  bool emitAsm = false;
+  bool emitObj = false;
+  bool run = false;
+  bool interpret = false;
+  bool tiered = false;
+  bool batch = false;
+  int jobs = 1;
+  std::string cacheDir;
+  uintmax_t cacheMiB = 1024;
+  CodeGenOptions codegen;
+  bool explicitPasses = false;
+  std::string passes;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+      // The last level wins; the -f flags add to it wherever they are
+      optLevel = arg[2] - '0';
+    } else if (arg == "-S") {
+      emitAsm = true;
+      emitObj = false;
+    } else if (arg == "-c") {
+      emitObj = true;
+      emitAsm = false;
+    } else if (arg == "--run") {
+      run = true;
+    } else if (arg == "--interpret") {
+      interpret = true;
+    } else if (arg == "--tiered") {
+      tiered = true;
+    } else if (arg == "--batch") {
+      batch = true;
+    } else if (arg.rfind("--batch=", 0) == 0) {
+      // A manifest of input and output pairs, one per line
+      batch = true;
+      std::ifstream manifest(arg.substr(std::strlen("--batch=")));
+      if (!manifest) {
+        std::cerr << "Cannot open manifest: " << arg.substr(std::strlen("--batch=")) << std::endl;
+        return 1;
+      }
+      std::string line;
+      while (std::getline(manifest, line)) {
+        std::istringstream fields(line);
+        std::string file;
+        while (fields >> file && file[0] != '#') {
+          files.push_back(file);
+        }
+      }
+    } else if (arg.rfind("-j", 0) == 0) {
+      // Threads for optimizing and compiling functions, as -jN or -j N
+      std::string count = arg.size() > 2 ? arg.substr(2) : (i + 1 < argc ? argv[++i] : "");
+      jobs = std::atoi(count.c_str());
+      if (jobs < 1 || count.find_first_not_of("0123456789") != std::string::npos) {
+        std::cerr << "Bad thread count: " << arg << (arg.size() > 2 ? "" : " " + count) << std::endl;
+        return 1;
+      }
+    } else if (arg.rfind("--cache-dir=", 0) == 0) {
+      cacheDir = arg.substr(std::strlen("--cache-dir="));
+    } else if (arg.rfind("--cache-size=", 0) == 0) {
+      // Megabytes the cache directory may hold
+      std::string size = arg.substr(std::strlen("--cache-size="));
+      if (size.empty() || size.find_first_not_of("0123456789") != std::string::npos) {
+        std::cerr << "Bad cache size: " << arg << std::endl;
+        return 1;
+      }
+      cacheMiB = std::stoull(size);
+    } else if (arg == "--target=x86-64") {
+      codegen.arch = CodeGenOptions::Arch::X86_64;
+    } else if (arg == "--target=riscv64") {
+      codegen.arch = CodeGenOptions::Arch::RISCV64;
+    } else if (arg == "--regalloc=linear") {
+      codegen.regAlloc = CodeGenOptions::RegAllocator::LinearScan;
+      explicitRegAlloc = true;
+    } else if (arg == "--regalloc=graph") {
+      codegen.regAlloc = CodeGenOptions::RegAllocator::GraphColoring;
+      explicitRegAlloc = true;
+    } else if (arg.rfind("--passes=", 0) == 0) {
+      explicitPasses = true;
+      passes = arg.substr(std::strlen("--passes="));
+    } else if (arg == "-fmemoize") {
+      memoize = true;
+    } else if (arg == "-fsroa") {
+      sroa = true;
+    } else if (arg == "-fmem2reg") {
+      mem2reg = true;
+    } else if (arg == "-fipsccp") {
+      ipsccp = true;
+    } else if (arg == "-fvrp") {
+      vrp = true;
+    } else if (arg == "-fifconvert") {
+      ifConvert = true;
+    } else if (arg == "-fdistribute") {
+      distribute = true;
+    } else if (arg == "-ffuse") {
+      fuse = true;
+    } else if (arg == "-finterchange") {
+      interchange = true;
+    } else if (arg == "-ftile") {
+      tile = true;
+    } else if (arg.rfind("-ftile-size=", 0) == 0) {
+      // Iterations per tile instead of the cache model's choice
+      std::string size = arg.substr(std::strlen("-ftile-size="));
+      if (size.empty() || size.size() > 9 || size.find_first_not_of("0123456789") != std::string::npos ||
+          std::stoi(size) < 1) {
+        std::cerr << "Bad tile size: " << arg << std::endl;
+        return 1;
+      }
+      tile = true;
+      tileSize = std::stoi(size);
+    } else if (arg == "-fgcm") {
+      gcm = true;
+    } else if (arg == "-fschedule") {
+      schedule = true;
+    } else if (arg == "-fpeephole") {
+      codegen.peephole = true;
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return 1;
+    } else {
+      files.push_back(arg);
+    }
+  }
+  bool runs = run || interpret || tiered;
+  if (files.size() < (runs ? 1u : 2u) || (batch && (runs || files.size() % 2 != 0))) {
+    std::cerr << "Usage: ./compiler [-S|-c|--run|--interpret|--tiered] [--batch[=<manifest>]] [-jN] [--cache-dir=<dir>] [--cache-size=<MiB>] [-O0|-O1|-O2] [--passes=<pipeline>] [--target=x86-64|riscv64] [--regalloc=linear|graph] [-fmemoize] [-fsroa] [-fmem2reg] [-fipsccp] [-fvrp] [-fifconvert] [-fdistribute] [-ffuse] [-finterchange] [-ftile] [-ftile-size=N] [-fgcm] [-fschedule] [-fpeephole] <input-file> [<output-file>] [<input-file> <output-file>...]"
               << std::endl;
     return 1;
   }
-  // TODO: Implement the main function of the compiler. // completed in init
-    
-  std::string inputFile = argv[1];
-  std::string outputFile = argv[2];
-  
-  // Read input file
-  std::ifstream stream(inputFile);
-  if (!stream) {
-    std::cerr << "Cannot open input file: " << inputFile << std::endl;
+  if (emitObj && codegen.arch == CodeGenOptions::Arch::RISCV64) {
+    std::cerr << "-c is not supported for --target=riscv64; use -S" << std::endl;
     return 1;
   }
-  
-  // Create ANTLR input stream
-  ANTLRInputStream input(stream);
-  
-  // Create lexer
-  SysYLexer lexer(&input);
-  CommonTokenStream tokens(&lexer);
-  
-  // Create parser
-  SysYParser parser(&tokens);
-  
-  // Parse the input
-  SysYParser::CompUnitContext* tree = parser.compUnit();
-  
-  // Check for parser errors
-  if (parser.getNumberOfSyntaxErrors() > 0) {
-    std::cerr << "Syntax errors found" << std::endl;
-    return 1;
+
+  // Build the pass pipeline. Unless --passes= gives it, the level and -f
+  // flags select passes of a fixed pipeline: SROA only pays off once mem2reg
+  // turns the new scalars into registers, if-conversion runs after SCCP has
+  // folded the branches it can, distribution runs before fusion so that
+  // fusion only merges loops of one kind, and interchange before tiling so
+  // that tiles are walked along the rows. Code motion and scheduling come
+  // last, once the loops have their final shape. With --tiered this is
+  // what hot code gets, -O2 unless something else is asked for.
+  if (optLevel < 0 && tiered && !explicitPasses &&
+      !(sroa || mem2reg || ipsccp || vrp || ifConvert || distribute || fuse || interchange || tile || gcm ||
+        schedule || memoize)) {
+    optLevel = 2;
   }
-  
-  // Build IR
-  IRBuilder builder;
-  builder.visitCompUnit(tree);
-  
-  // Write output
-  std::ofstream outStream(outputFile);
-  if (!outStream) {
-    std::cerr << "Cannot open output file: " << outputFile << std::endl;
+  if (optLevel >= 1) {
+    // Cheap scalar cleanups
+    sroa = mem2reg = ipsccp = vrp = true;
+    codegen.peephole = true;
+  }
+  if (optLevel >= 2) {
+    // Also the loop transforms, whose dependence tests are the expensive part
+    ifConvert = distribute = fuse = interchange = tile = gcm = schedule = memoize = true;
+    if (!explicitRegAlloc) {
+      codegen.regAlloc = CodeGenOptions::RegAllocator::GraphColoring;
+    }
+  }
+  std::vector<std::string> pipeline;
+  if (sroa) {
+    pipeline.push_back("sroa");
+  }
+  if (sroa || mem2reg || ipsccp || vrp || ifConvert || distribute || fuse || interchange || tile || gcm ||
+      schedule) {
+    pipeline.push_back("mem2reg");
+  }
+  if (ipsccp) {
+    pipeline.push_back("ipsccp");
+  }
+  if (vrp) {
+    pipeline.push_back("vrp");
+  }
+  if (ifConvert) {
+    pipeline.push_back("ifconvert");
+  }
+  if (distribute) {
+    pipeline.push_back("distribute");
+  }
+  if (fuse) {
+    pipeline.push_back("fuse");
+  }
+  if (interchange) {
+    pipeline.push_back("interchange");
+  }
+  if (tile) {
+    pipeline.push_back("tile<" + std::to_string(tileSize) + ">");
+  }
+  if (gcm) {
+    pipeline.push_back("gcm");
+  }
+  if (schedule) {
+    pipeline.push_back("schedule");
+  }
+  if (memoize) {
+    pipeline.push_back("memoize");
+  }
+  if (!explicitPasses) {
+    for (const auto& pass : pipeline) {
+      passes += (passes.empty() ? "" : ",") + pass;
+    }
+  }
+  PassManager pm;
+  std::string error;
+  if (!pm.parsePipeline(passes, error)) {
+    std::cerr << error << std::endl;
+    std::cerr << "Available passes:";
+    for (const auto& name : PassManager::registeredPasses()) {
+      std::cerr << " " << name;
+    }
+    std::cerr << std::endl;
     return 1;
   }
+
+  // Functions are parsed, go through the function passes and the backend
+  // on -j threads, which does not change the output.
+  std::unique_ptr<ThreadPool> threads;
+  if (jobs > 1) {
+    threads = std::make_unique<ThreadPool>(jobs);
+    pm.setThreadPool(threads.get());
+    codegen.threads = threads.get();
+  }
+
+  // With --cache-dir, output files are kept by the hash of the source, the
+  // compiler build and the options that shape the output, and a source seen
+  // before is not even lexed. Assembly is also kept function by function
+  // when the pipeline is function-local, under the hash of the function's
+  // tokens, the global declarations and every function's signature, so
+  // that editing one function recompiles only that one. Running instead of
+  // writing a file does not use the cache.
+  std::unique_ptr<CompileCache> cache;
+  std::string cacheOptions;
+  if (!cacheDir.empty() && !runs) {
+    try {
+      cache = std::make_unique<CompileCache>(cacheDir, cacheMiB << 20);
+    } catch (const std::exception& e) {
+      std::cerr << "Cannot use cache directory: " << e.what() << std::endl;
+      return 1;
+    }
+    cacheOptions = std::string(emitObj ? "c" : emitAsm ? "S" : "ll") + "\n" + passes + "\n" +
+                   (codegen.arch == CodeGenOptions::Arch::RISCV64 ? "riscv64" : "x86-64") + "\n" +
+                   (codegen.regAlloc == CodeGenOptions::RegAllocator::GraphColoring ? "graph" : "linear") +
+                   "\n" + (codegen.peephole ? "peephole" : "") + "\n" + CompileCache::compilerVersion() + "\n";
+  }
+
+  // TODO: Implement the main function of the compiler. // completed in init
+    
+  // Compiles one file; `phases` gets the milliseconds spent parsing (into
+  // IR), optimizing and emitting.
+  using Clock = std::chrono::steady_clock;
+  auto milliseconds = [](Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+  };
+  auto compile = [&](const std::string& inputFile, const std::string& outputFile, double phases[3]) {
+    Clock::time_point start = Clock::now();
   
-  outStream << builder.getIR();
-  outStream.close();
+    // Read input file
+    std::ifstream file(inputFile, std::ios::binary);
+    if (!file) {
+      std::cerr << "Cannot open input file: " << inputFile << std::endl;
+      return 1;
+    }
+    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    auto writeOutput = [&](const std::string& output) {
+      std::ofstream outStream(outputFile, std::ios::binary);
+      if (!outStream) {
+        std::cerr << "Cannot open output file: " << outputFile << std::endl;
+        return 1;
+      }
+      outStream << output;
+      return 0;
+    };
+    std::string fileKey;
+    if (cache) {
+      fileKey = CompileCache::hash("file\n" + cacheOptions + source);
+      std::string output;
+      if (cache->lookup(fileKey, output)) {
+        phases[0] = milliseconds(start, Clock::now());
+        phases[1] = phases[2] = 0;
+        return writeOutput(output);
+      }
+    }
+
+    // Parse the input, function by function on the -j threads
+    std::istringstream stream(source);
+    SourceParser parser(stream, threads.get());
+    SysYParser::CompUnitContext* tree = parser.parse();
+
+    // Check for parser errors
+    if (!tree) {
+      std::cerr << "Syntax errors found" << std::endl;
+      return 1;
+    }
+
+    // Build IR
+    IRBuilder builder;
+    builder.visitCompUnit(tree);
+    std::string output = builder.getIR();
+    Clock::time_point parsed = Clock::now();
+    Clock::time_point optimized = parsed;
+
+    // Optimize, and lower to assembly with -S, to an object file with -c or
+    // into this process with --run, or interpret with --interpret. --tiered
+    // starts interpreting as soon as the IR is in SSA form and leaves the
+    // pipeline to the code that turns hot.
+    if (tiered) {
+      auto module = parseIR(output);
+      if (!module) {
+        return 1;
+      }
+      PassManager ssa;
+      ssa.parsePipeline("mem2reg", error);
+      ssa.run(*module);
+      try {
+        return runTiered(*module, passes, codegen);
+      } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+      }
+    }
+    if (!pm.empty() || emitAsm || emitObj || run || interpret) {
+      auto module = parseIR(output);
+      if (!module) {
+        return 1;
+      }
+
+      // Functions whose assembly is cached are left as declarations, and
+      // their text is put back in its place afterwards.
+      std::map<std::string, std::string> functionKeys, cachedText;
+      std::vector<std::string> defined;
+      if (cache && emitAsm && pm.functionLocal()) {
+        std::string context;
+        for (auto* item : tree->children) {
+          auto* func = dynamic_cast<SysYParser::FuncDefContext*>(item);
+          if (!func) {
+            context += normalizedText(item) + "\n";
+            continue;
+          }
+          for (size_t i = 0; i + 1 < func->children.size(); ++i) {
+            context += normalizedText(func->children[i]) + " ";
+          }
+          context += "\n";
+        }
+        for (auto* func : tree->funcDef()) {
+          functionKeys[func->IDENT()->getText()] =
+              CompileCache::hash("function\n" + cacheOptions + context + normalizedText(func));
+        }
+        for (auto& func : module->functions) {
+          if (func->isDeclaration) {
+            continue;
+          }
+          defined.push_back(func->name);
+          auto key = functionKeys.find(func->name);
+          std::string text;
+          if (key != functionKeys.end() && cache->lookup(key->second, text)) {
+            cachedText[func->name] = std::move(text);
+            func->blocks.clear();
+            func->isDeclaration = true;
+          }
+        }
+      }
+
+      pm.run(*module);
+      optimized = Clock::now();
+      if (run || interpret) {
+        try {
+          return run ? runInProcess(*module, codegen) : Interpreter(*module).run();
+        } catch (const std::exception& e) {
+          std::cerr << e.what() << std::endl;
+          return 1;
+        }
+      }
+      if (emitObj) {
+        output = emitObject(*module, codegen);
+      } else if (!defined.empty()) {
+        std::vector<std::string> compiled = emitFunctionAssembly(*module, codegen);
+        output.clear();
+        size_t next = 0;
+        for (const auto& name : defined) {
+          auto cached = cachedText.find(name);
+          if (cached != cachedText.end()) {
+            output += cached->second;
+            continue;
+          }
+          auto key = functionKeys.find(name);
+          if (key != functionKeys.end()) {
+            cache->store(key->second, compiled[next]);
+          }
+          output += compiled[next++];
+        }
+        output += emitGlobalAssembly(*module, codegen);
+      } else {
+        output = emitAsm ? emitAssembly(*module, codegen) : module->toString();
+      }
+    }
+
+    // Write output
+    if (writeOutput(output) != 0) {
+      return 1;
+    }
+    if (cache) {
+      cache->store(fileKey, output);
+    }
+
+    phases[0] = milliseconds(start, parsed);
+    phases[1] = milliseconds(parsed, optimized);
+    phases[2] = milliseconds(optimized, Clock::now());
+    return 0;
+  };
+
+  double phases[3] = {};
+  if (!batch) {
+    return compile(files[0], files.size() > 1 ? files[1] : "", phases);
+  }
   
-  return 0;
+  // Batch mode: the lexer and parser tables are deserialized once, up
+  // front, and the parser's DFA cache stays warm from one file to the next.
+  // Every file gets a line of timings on stderr, and a file that fails does
+  // not stop the others.
+  Clock::time_point start = Clock::now();
+  SysYLexer::initialize();
+  SysYParser::initialize();
+  std::cerr << std::fixed << std::setprecision(2) << "startup: " << milliseconds(start, Clock::now()) << " ms"
+            << std::endl;
+  int failed = 0;
+  for (size_t i = 0; i < files.size(); i += 2) {
+    Clock::time_point fileStart = Clock::now();
+    int status;
+    try {
+      status = compile(files[i], files[i + 1], phases);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      status = 1;
+    }
+    if (status != 0) {
+      std::cerr << files[i] << ": failed" << std::endl;
+      ++failed;
+      continue;
+    }
+    std::cerr << files[i] << ": " << milliseconds(fileStart, Clock::now()) << " ms (parse " << phases[0]
+              << ", optimize " << phases[1] << ", emit " << phases[2] << ")" << std::endl;
+  }
+  std::cerr << files.size() / 2 << " files, " << failed << " failed, " << milliseconds(start, Clock::now())
+            << " ms" << std::endl;
+  return failed ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include <cctype>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include "AliasAnalysis.h"
+#include "Passes.h"
+#include "TestSupport.h"
+
+namespace {
+
+// The source in SSA form, as the passes that query alias analysis see it.
+std::unique_ptr<Module> build(const std::string& source) {
+    auto module = buildModule(source);
+    if (module) {
+        for (auto& f : module->functions) promoteMemoryToRegisters(*f);
+    }
+    return module;
+}
+
+// Stores of constants in `f`, in program order: the accesses under test.
+std::vector<const Instruction*> constantStores(const Function& f) {
+    std::vector<const Instruction*> stores;
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op == Opcode::Store && isdigit(static_cast<unsigned char>(inst.operands[0][0]))) {
+                stores.push_back(&inst);
+            }
+        }
+    }
+    return stores;
+}
+
+const Instruction* firstOf(const Function& f, Opcode op) {
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) {
+            if (inst.op == op) return &inst;
+        }
+    }
+    return nullptr;
+}
+
+TEST(AliasAnalysisTest, DistinctObjectsDoNotAlias) {
+    auto module = build(R"(
+int g[10];
+int h[10];
+void f(int p[]) {
+    int a[4];
+    g[1] = 1;
+    h[1] = 2;
+    a[0] = 3;
+    p[0] = 4;
+    putint(a[0]);
+}
+int main() {
+    f(g);
+    return 0;
+}
+)");
+    ASSERT_TRUE(module);
+    const Function& f = *findFunction(*module, "f");
+    AliasAnalysis aa(*module);
+    auto s = constantStores(f);
+    ASSERT_EQ(s.size(), 4u);
+    EXPECT_EQ(aa.alias(f, *s[0], *s[1]), AliasResult::NoAlias);
+    EXPECT_EQ(aa.alias(f, *s[0], *s[2]), AliasResult::NoAlias);
+    // A parameter never points into the callee's own frame...
+    EXPECT_EQ(aa.alias(f, *s[2], *s[3]), AliasResult::NoAlias);
+    // ...and this one only ever points to g.
+    EXPECT_EQ(aa.alias(f, *s[1], *s[3]), AliasResult::NoAlias);
+    EXPECT_NE(aa.alias(f, *s[0], *s[3]), AliasResult::NoAlias);
+}
+
+TEST(AliasAnalysisTest, ComparesOffsetsOffOneBase) {
+    auto module = build(R"(
+int g[10];
+int m[4][8];
+void f(int i, int j) {
+    g[i] = 1;
+    g[i + 1] = 2;
+    g[i] = 3;
+    m[i][0] = 4;
+    m[j][1] = 5;
+    m[j][0] = 6;
+}
+int main() {
+    f(1, 2);
+    return 0;
+}
+)");
+    ASSERT_TRUE(module);
+    const Function& f = *findFunction(*module, "f");
+    AliasAnalysis aa(*module);
+    auto s = constantStores(f);
+    ASSERT_EQ(s.size(), 6u);
+    EXPECT_EQ(aa.alias(f, *s[0], *s[1]), AliasResult::NoAlias);
+    EXPECT_EQ(aa.alias(f, *s[0], *s[2]), AliasResult::MustAlias);
+    // Rows are 32 bytes apart, so column 0 and column 1 never meet...
+    EXPECT_EQ(aa.alias(f, *s[3], *s[4]), AliasResult::NoAlias);
+    // ...but the same column of two unknown rows may.
+    EXPECT_EQ(aa.alias(f, *s[3], *s[5]), AliasResult::MayAlias);
+}
+
+TEST(AliasAnalysisTest, SeparatesParametersByCallSites) {
+    const char* source = R"(
+int g[10];
+int h[10];
+void f(int p[], int q[]) {
+    p[0] = 1;
+    q[0] = 2;
+}
+int main() {
+    f(g, h);
+    f(%s, h);
+    return 0;
+}
+)";
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), source, "h");
+    auto module = build(buffer);
+    ASSERT_TRUE(module);
+    const Function& f = *findFunction(*module, "f");
+    AliasAnalysis aa(*module);
+    auto s = constantStores(f);
+    ASSERT_EQ(s.size(), 2u);
+    EXPECT_EQ(aa.pointsTo("f", 0), (std::set<std::string>{"@g", "@h"}));
+    EXPECT_EQ(aa.alias(f, *s[0], *s[1]), AliasResult::MayAlias);
+
+    snprintf(buffer, sizeof(buffer), source, "g");
+    module = build(buffer);
+    ASSERT_TRUE(module);
+    const Function& f2 = *findFunction(*module, "f");
+    AliasAnalysis aa2(*module);
+    s = constantStores(f2);
+    ASSERT_EQ(s.size(), 2u);
+    EXPECT_EQ(aa2.pointsTo("f", 0), std::set<std::string>{"@g"});
+    EXPECT_EQ(aa2.alias(f2, *s[0], *s[1]), AliasResult::NoAlias);
+}
+
+TEST(AliasAnalysisTest, SummarizesCallEffects) {
+    auto module = build(R"(
+int g[10];
+int h[10];
+void set(int v) {
+    g[0] = v;
+}
+int get() {
+    return h[1];
+}
+int main() {
+    set(1);
+    h[0] = 2;
+    g[1] = get();
+    return h[2];
+}
+)");
+    ASSERT_TRUE(module);
+    const Function& f = *findFunction(*module, "main");
+    AliasAnalysis aa(*module);
+    auto s = constantStores(f);
+    ASSERT_EQ(s.size(), 1u);
+    const Instruction* setCall = firstOf(f, Opcode::Call);
+    ASSERT_NE(setCall, nullptr);
+    ASSERT_EQ(setCall->callee, "set");
+    EXPECT_EQ(aa.getModRef(f, *setCall, *s[0]), MRI_NoModRef);
+    EXPECT_EQ(aa.getModRef(f, *setCall, "@g"), MRI_Mod);
+    EXPECT_EQ(aa.getModRef(*setCall), MRI_Mod);
+    const Instruction* load = firstOf(f, Opcode::Load);
+    ASSERT_NE(load, nullptr);
+    EXPECT_EQ(aa.getModRef(f, *setCall, *load), MRI_NoModRef);
+}
+
+} // namespace
@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <regex>
+#include "CodeGen.h"
+#include "IRParser.h"
+#include "Interpreter.h"
+#include "JIT.h"
+#include "TestSupport.h"
+#include "Tiering.h"
+
+namespace {
+
+const char* kPredicates[] = {"ult", "ule", "ugt", "uge", "slt", "sle", "sgt", "sge", "eq", "ne"};
+const int32_t kValues[] = {-1, 0, 1, 7, 65535, 65536, INT32_MIN, INT32_MAX};
+
+bool compare(const std::string& pred, int32_t a, int32_t b) {
+    uint32_t ua = static_cast<uint32_t>(a), ub = static_cast<uint32_t>(b);
+    if (pred == "ult") return ua < ub;
+    if (pred == "ule") return ua <= ub;
+    if (pred == "ugt") return ua > ub;
+    if (pred == "uge") return ua >= ub;
+    if (pred == "slt") return a < b;
+    if (pred == "sle") return a <= b;
+    if (pred == "sgt") return a > b;
+    if (pred == "sge") return a >= b;
+    if (pred == "eq") return a == b;
+    return a != b;
+}
+
+// `pred` as a value, as a branch, and against a constant on either side,
+// which the selectors handle by swapping the operands. main returns the
+// outcomes as bits.
+std::string compareModule(const std::string& pred, int32_t a, int32_t b) {
+    std::string ca = std::to_string(a), cb = std::to_string(b);
+    return "define dso_local i32 @value(i32 %a, i32 %b) {\n"
+           "entry:\n"
+           "  %t0 = icmp " + pred + " i32 %a, %b\n"
+           "  %t1 = zext i1 %t0 to i32\n"
+           "  ret i32 %t1\n"
+           "}\n"
+           "define dso_local i32 @branch(i32 %a, i32 %b) {\n"
+           "entry:\n"
+           "  %t0 = icmp " + pred + " i32 %a, %b\n"
+           "  br i1 %t0, label %yes, label %no\n"
+           "yes:\n"
+           "  ret i32 2\n"
+           "no:\n"
+           "  ret i32 0\n"
+           "}\n"
+           "define dso_local i32 @constants(i32 %a, i32 %b) {\n"
+           "entry:\n"
+           "  %t0 = icmp " + pred + " i32 %a, " + cb + "\n"
+           "  %t1 = icmp " + pred + " i32 " + ca + ", %b\n"
+           "  %t2 = zext i1 %t0 to i32\n"
+           "  %t3 = zext i1 %t1 to i32\n"
+           "  %t4 = mul i32 %t3, 2\n"
+           "  %t5 = add i32 %t2, %t4\n"
+           "  %t6 = mul i32 %t5, 4\n"
+           "  ret i32 %t6\n"
+           "}\n"
+           "define dso_local i32 @main() {\n"
+           "entry:\n"
+           "  %t0 = call i32 @value(i32 " + ca + ", i32 " + cb + ")\n"
+           "  %t1 = call i32 @branch(i32 " + ca + ", i32 " + cb + ")\n"
+           "  %t2 = call i32 @constants(i32 " + ca + ", i32 " + cb + ")\n"
+           "  %t3 = add i32 %t0, %t1\n"
+           "  %t4 = add i32 %t3, %t2\n"
+           "  ret i32 %t4\n"
+           "}\n";
+}
+
+// Recursion, a global array and nested loops; main returns 229.
+const char* kProgram = R"(
+int fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+int a[20][20];
+int main() {
+    int i = 0, s = 0;
+    while (i < 20) {
+        int j = 0;
+        while (j < 20) {
+            a[i][j] = i * j + fib(j % 10);
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    i = 0;
+    while (i < 20) {
+        int j = 0;
+        while (j < 20) {
+            s = s + a[j][i] * (i - j);
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    if (s < 0) s = -s;
+    return s % 251;
+}
+)";
+
+const char* kPipelines[] = {
+    "", "sroa,mem2reg,ipsccp,vrp",
+    "sroa,mem2reg,ipsccp,vrp,ifconvert,distribute,fuse,interchange,tile<0>,gcm,schedule,memoize"};
+
+TEST(CodeGenTest, InterpreterComparesLikeC) {
+    for (const char* pred : kPredicates) {
+        for (int32_t a : kValues) {
+            for (int32_t b : kValues) {
+                auto module = parseIR(compareModule(pred, a, b));
+                ASSERT_TRUE(module);
+                EXPECT_EQ(Interpreter(*module).run(), compare(pred, a, b) ? 15 : 0)
+                    << pred << " " << a << ", " << b;
+            }
+        }
+    }
+}
+
+TEST(CodeGenTest, InterpreterSameResultsAtEveryLevel) {
+    for (const char* passes : kPipelines) {
+        auto module = compileSource(kProgram, passes);
+        ASSERT_TRUE(module) << passes;
+        EXPECT_EQ(Interpreter(*module).run(), 229) << passes;
+    }
+}
+
+// fib turns hot by its calls, and the loop of main by its iterations.
+TEST(CodeGenTest, TieredSameResults) {
+    const char* hotLoop = R"(
+int main() {
+    int i = 0, s = 0;
+    while (i < 30000) {
+        s = (s * 7 + i * i) % 1009;
+        i = i + 1;
+    }
+    return s % 251;
+}
+)";
+    for (const char* passes : kPipelines) {
+        auto program = compileSource(kProgram, "mem2reg");
+        ASSERT_TRUE(program);
+        EXPECT_EQ(runTiered(*program, passes), 229) << passes;
+        auto loop = compileSource(hotLoop, "mem2reg");
+        ASSERT_TRUE(loop);
+        EXPECT_EQ(runTiered(*loop, passes), 220) << passes;
+    }
+}
+
+#if defined(__x86_64__)
+TEST(CodeGenTest, X86ComparesLikeC) {
+    CodeGenOptions linear, graph;
+    graph.regAlloc = CodeGenOptions::RegAllocator::GraphColoring;
+    graph.peephole = true;
+    for (const char* pred : kPredicates) {
+        for (int32_t a : kValues) {
+            for (int32_t b : kValues) {
+                auto module = parseIR(compareModule(pred, a, b));
+                ASSERT_TRUE(module);
+                int expected = compare(pred, a, b) ? 15 : 0;
+                EXPECT_EQ(runInProcess(*module, linear), expected) << pred << " " << a << ", " << b;
+                EXPECT_EQ(runInProcess(*module, graph), expected) << pred << " " << a << ", " << b;
+            }
+        }
+    }
+}
+
+TEST(CodeGenTest, X86SameResultsAtEveryLevel) {
+    CodeGenOptions linear, graph;
+    graph.regAlloc = CodeGenOptions::RegAllocator::GraphColoring;
+    graph.peephole = true;
+    for (const char* passes : kPipelines) {
+        auto module = compileSource(kProgram, passes);
+        ASSERT_TRUE(module) << passes;
+        EXPECT_EQ(runInProcess(*module, linear), 229) << passes;
+        EXPECT_EQ(runInProcess(*module, graph), 229) << passes;
+    }
+}
+#endif
+
+TEST(CodeGenTest, X86UsesUnsignedConditionCodes) {
+    const std::regex signedCondition(R"(\b(set|j|cmov)(l|le|g|ge)\b)");
+    // The compare itself, and the one with its operands swapped
+    const std::pair<const char*, const char*> conditions[] = {
+        {"ult", "a"}, {"ule", "ae"}, {"ugt", "b"}, {"uge", "be"}};
+    for (const auto& [pred, swapped] : conditions) {
+        auto module = parseIR(compareModule(pred, 1, 2));
+        ASSERT_TRUE(module);
+        std::string assembly = emitAssembly(*module);
+        EXPECT_FALSE(std::regex_search(assembly, signedCondition)) << pred << "\n" << assembly;
+        EXPECT_NE(assembly.find(std::string("set") + swapped + " "), std::string::npos) << pred << "\n" << assembly;
+    }
+}
+
+TEST(CodeGenTest, RISCVUsesUnsignedCompares) {
+    CodeGenOptions options;
+    options.arch = CodeGenOptions::Arch::RISCV64;
+    for (const char* pred : {"ult", "ule", "ugt", "uge"}) {
+        auto module = parseIR(compareModule(pred, 1, 2));
+        ASSERT_TRUE(module);
+        std::string assembly = emitAssembly(*module, options);
+        EXPECT_NE(assembly.find("sltu"), std::string::npos) << pred << "\n" << assembly;
+        EXPECT_EQ(assembly.find("slt "), std::string::npos) << pred << "\n" << assembly;
+        EXPECT_EQ(assembly.find("slti "), std::string::npos) << pred << "\n" << assembly;
+    }
+}
+
+TEST(CodeGenTest, X86FoldsTreesIntoOperands) {
+    auto module = compileSource(R"(
+int g[10];
+int main() {
+    int a[10];
+    int i = getint();
+    a[i] = 3;
+    g[i] = i * 5;
+    if (i < g[2]) return a[i];
+    return 0;
+}
+)", "mem2reg");
+    ASSERT_TRUE(module);
+    std::string assembly = emitAssembly(*module);
+    // Indexed stack and global addresses, a multiply by lea, and a compare
+    // that feeds the branch without materializing its result
+    EXPECT_TRUE(std::regex_search(assembly, std::regex(R"(movl \$3, -\d+\(%rbp,%\w+,4\))"))) << assembly;
+    EXPECT_TRUE(std::regex_search(assembly, std::regex(R"(leal \((%\w+),\1,4\))"))) << assembly;
+    EXPECT_TRUE(std::regex_search(assembly, std::regex(R"(movl g\+8\(%rip\))"))) << assembly;
+    EXPECT_EQ(assembly.find("imul"), std::string::npos) << assembly;
+    EXPECT_EQ(assembly.find("set"), std::string::npos) << assembly;
+}
+
+// Register-to-register moves in the assembly.
+int copies(const std::string& assembly) {
+    const std::regex copy(R"(\bmov[lq] %\w+, %\w+)");
+    return static_cast<int>(std::distance(std::sregex_iterator(assembly.begin(), assembly.end(), copy),
+                                          std::sregex_iterator()));
+}
+
+TEST(CodeGenTest, GraphColoringCoalescesCopies) {
+    auto module = compileSource(R"(
+int main() {
+    int a = getint(), b = getint(), i = 0, s = 0;
+    while (i < a) {
+        int t = s;
+        s = b;
+        b = t + b;
+        i = i + 1;
+    }
+    return s + b;
+}
+)", "mem2reg");
+    ASSERT_TRUE(module);
+    CodeGenOptions linear, graph;
+    graph.regAlloc = CodeGenOptions::RegAllocator::GraphColoring;
+    std::string linearAssembly = emitAssembly(*module, linear);
+    std::string graphAssembly = emitAssembly(*module, graph);
+    EXPECT_LT(copies(graphAssembly), copies(linearAssembly)) << linearAssembly << graphAssembly;
+}
+
+} // namespace
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+#include "CompileCache.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+class CompileCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        directory = fs::temp_directory_path() / ("compile-cache-test-" + std::to_string(getpid()));
+        fs::remove_all(directory);
+    }
+    void TearDown() override { fs::remove_all(directory); }
+
+    fs::path directory;
+};
+
+TEST_F(CompileCacheTest, HashIsSHA256) {
+    EXPECT_EQ(CompileCache::hash(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(CompileCache::hash("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    // Two blocks of padding
+    EXPECT_EQ(CompileCache::hash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+TEST_F(CompileCacheTest, StoresAndLooksUp) {
+    CompileCache cache(directory, 1 << 20);
+    std::string contents;
+    EXPECT_FALSE(cache.lookup("missing", contents));
+    cache.store("key", std::string("binary\0data", 11));
+    ASSERT_TRUE(cache.lookup("key", contents));
+    EXPECT_EQ(contents, std::string("binary\0data", 11));
+    cache.store("key", "replaced");
+    ASSERT_TRUE(cache.lookup("key", contents));
+    EXPECT_EQ(contents, "replaced");
+}
+
+TEST_F(CompileCacheTest, EvictsLeastRecentlyUsed) {
+    std::string kilobyte(1024, 'x');
+    {
+        CompileCache cache(directory, 2048);
+        cache.store("old", kilobyte);
+        cache.store("used", kilobyte);
+        auto past = fs::file_time_type::clock::now() - std::chrono::hours(2);
+        fs::last_write_time(directory / "old", past);
+        fs::last_write_time(directory / "used", past);
+        std::string contents;
+        ASSERT_TRUE(cache.lookup("used", contents));
+        cache.store("new", kilobyte);
+    }
+    EXPECT_FALSE(fs::exists(directory / "old"));
+    EXPECT_TRUE(fs::exists(directory / "used"));
+    EXPECT_TRUE(fs::exists(directory / "new"));
+}
+
+TEST_F(CompileCacheTest, FailedStoreIsAMiss) {
+    CompileCache cache(directory, 1 << 20);
+    // A directory in the way of the entry: the rename fails
+    fs::create_directories(directory / "key" / "inside");
+    EXPECT_NO_THROW(cache.store("key", "contents"));
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        EXPECT_EQ(entry.path().filename(), "key");
+    }
+    std::string contents;
+    cache.store("other", "contents");
+    EXPECT_TRUE(cache.lookup("other", contents));
+}
+
+} // namespace
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include "DependenceAnalysis.h"
+#include "Passes.h"
+#include "TestSupport.h"
+
+namespace {
+
+// The loop nest of main, analyzed after mem2reg.
+struct Nest {
+    std::unique_ptr<Module> module;
+    std::unique_ptr<LoopInfo> loops;
+    std::unique_ptr<AliasAnalysis> alias;
+    std::unique_ptr<DependenceAnalysis> deps;
+    std::vector<const Loop*> band;  // Outermost first
+    std::vector<std::string> ivs;
+
+    explicit Nest(const std::string& source) {
+        module = buildModule(source);
+        if (!module) return;
+        Function* main = findFunction(*module, "main");
+        promoteMemoryToRegisters(*main);
+        loops = std::make_unique<LoopInfo>(*main);
+        alias = std::make_unique<AliasAnalysis>(*module);
+        deps = std::make_unique<DependenceAnalysis>(*module, *main, *loops, *alias);
+        if (loops->topLevelLoops().size() != 1) return;
+        for (const Loop* loop = loops->topLevelLoops()[0]; loop;
+             loop = loop->subLoops.size() == 1 ? loop->subLoops[0] : nullptr) {
+            InductionVariable iv;
+            if (!loops->inductionVariable(loop, iv)) return;
+            band.push_back(loop);
+            ivs.push_back(iv.phi->result);
+        }
+    }
+
+    // Direction of the dependence from the store to the load of the
+    // innermost loop in each loop of the nest.
+    std::vector<unsigned> storeToLoad() const {
+        std::vector<MemoryAccess> accesses = deps->accesses(band.back());
+        const MemoryAccess* store = nullptr;
+        const MemoryAccess* load = nullptr;
+        for (const auto& access : accesses) (access.isWrite ? store : load) = &access;
+        if (!store || !load) return {};
+        Dependence dep = deps->depends(*store, *load, ivs, band[0]);
+        return dep.independent ? std::vector<unsigned>{} : dep.directions;
+    }
+};
+
+TEST(DependenceAnalysisTest, DirectionFollowsIterationOrder) {
+    // The load reads what the store wrote one iteration earlier.
+    Nest up(R"(
+int a[12];
+int main() {
+    int i = 1;
+    while (i < 10) { a[i] = a[i - 1] + 1; i = i + 1; }
+    return a[9];
+}
+)");
+    ASSERT_EQ(up.band.size(), 1u);
+    EXPECT_EQ(up.storeToLoad(), std::vector<unsigned>{DirLT});
+    EXPECT_TRUE(up.deps->carriesDependence(up.band[0]));
+
+    // Counting down, the same subscripts read what is written later.
+    Nest down(R"(
+int a[12];
+int main() {
+    int i = 9;
+    while (i >= 1) { a[i] = a[i - 1] + 1; i = i - 1; }
+    return a[9];
+}
+)");
+    ASSERT_EQ(down.band.size(), 1u);
+    EXPECT_EQ(down.storeToLoad(), std::vector<unsigned>{DirGT});
+    EXPECT_TRUE(down.deps->carriesDependence(down.band[0]));
+}
+
+TEST(DependenceAnalysisTest, DistanceNotCoveredByStep) {
+    Nest odd(R"(
+int a[40];
+int main() {
+    int i = 0;
+    while (i < 30) { a[i] = a[i + 1] + 1; i = i + 2; }
+    return a[9];
+}
+)");
+    ASSERT_EQ(odd.band.size(), 1u);
+    EXPECT_TRUE(odd.storeToLoad().empty());
+    EXPECT_FALSE(odd.deps->carriesDependence(odd.band[0]));
+}
+
+TEST(DependenceAnalysisTest, DirectionsOfANest) {
+    // (<, >): a[i][j] reads a[i - 1][j + 1], written one outer iteration
+    // earlier and one inner iteration later.
+    Nest nest(R"(
+int a[8][8];
+int main() {
+    int i = 1;
+    while (i <= 7) {
+        int j = 0;
+        while (j < 7) { a[i][j] = a[i][j] + a[i - 1][j + 1]; j = j + 1; }
+        i = i + 1;
+    }
+    return a[7][7];
+}
+)");
+    ASSERT_EQ(nest.band.size(), 2u);
+    EXPECT_EQ(nest.storeToLoad(), (std::vector<unsigned>{DirLT, DirGT}));
+}
+
+TEST(DependenceAnalysisTest, DescendingNestIsNotPermutable) {
+    // (<, >) once the outer loop's direction is turned around: interchanging
+    // would read a[i-1][j-1] before it is written.
+    Nest nest(R"(
+int a[8][8];
+int main() {
+    int j = 7;
+    while (j >= 1) {
+        int i = 1;
+        while (i <= 7) { a[i][j] = a[i - 1][j - 1] + a[i][j]; i = i + 1; }
+        j = j - 1;
+    }
+    return a[7][7];
+}
+)");
+    ASSERT_EQ(nest.band.size(), 2u);
+    EXPECT_FALSE(nest.deps->isPermutable(nest.band));
+
+    Nest ascending(R"(
+int a[8][8];
+int main() {
+    int j = 1;
+    while (j <= 7) {
+        int i = 1;
+        while (i <= 7) { a[i][j] = a[i - 1][j - 1] + a[i][j]; i = i + 1; }
+        j = j + 1;
+    }
+    return a[7][7];
+}
+)");
+    ASSERT_EQ(ascending.band.size(), 2u);
+    EXPECT_TRUE(ascending.deps->isPermutable(ascending.band));
+}
+
+} // namespace
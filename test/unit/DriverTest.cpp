@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+
+namespace {
+
+const char* kFib = R"(
+int fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+int main() {
+    int a[2] = {10, 20};
+    return fib(a[0]);
+}
+)";
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+struct Result {
+    int status;
+    std::string output;  // The output file
+    std::string errors;  // stderr
+};
+
+// A file in the test's temporary directory.
+std::string tempFile(const std::string& name) {
+    return ::testing::TempDir() + "driver_test_" + name;
+}
+
+// Runs the compiler with `arguments`; the result holds `output`.
+Result runCompiler(const std::string& arguments, const std::string& output) {
+    const std::string errors = tempFile("stderr");
+    std::remove(output.c_str());
+    std::string command = std::string(COMPILER_PATH) + " " + arguments + " 2>" + errors;
+    int status = std::system(command.c_str());
+    return {WIFEXITED(status) ? WEXITSTATUS(status) : -1, readFile(output), readFile(errors)};
+}
+
+// Compiles `source` with the given options.
+Result compile(const std::string& source, const std::string& options) {
+    const std::string input = tempFile("input.sy");
+    const std::string output = tempFile("output.ll");
+    std::ofstream(input) << source;
+    return runCompiler(options + " " + input + " " + output, output);
+}
+
+TEST(DriverTest, OptimizationLevels) {
+    Result o0 = compile(kFib, "-O0");
+    Result o1 = compile(kFib, "-O1");
+    Result o2 = compile(kFib, "-O2");
+    ASSERT_EQ(o0.status, 0);
+    ASSERT_EQ(o1.status, 0);
+    ASSERT_EQ(o2.status, 0);
+    EXPECT_EQ(o0.output, compile(kFib, "").output);
+    EXPECT_NE(o0.output.find("alloca"), std::string::npos);
+    EXPECT_EQ(o1.output.find("alloca"), std::string::npos);
+    EXPECT_EQ(o1.output.find("fib.memo"), std::string::npos);
+    EXPECT_NE(o2.output.find("fib.memo"), std::string::npos);
+}
+
+TEST(DriverTest, LastLevelWins) {
+    EXPECT_EQ(compile(kFib, "-O2 -O0").output, compile(kFib, "-O0").output);
+    EXPECT_EQ(compile(kFib, "-O2 -O1").output, compile(kFib, "-O1").output);
+    EXPECT_EQ(compile(kFib, "-O0 -O2").output, compile(kFib, "-O2").output);
+    // The -f flags add to the level wherever they are
+    EXPECT_EQ(compile(kFib, "-fmemoize -O1").output, compile(kFib, "-O1 -fmemoize").output);
+    EXPECT_EQ(compile(kFib, "-O2 -O0 -fmem2reg").output, compile(kFib, "-fmem2reg").output);
+}
+
+TEST(DriverTest, ExplicitPasses) {
+    EXPECT_EQ(compile(kFib, "--passes=sroa,mem2reg").output, compile(kFib, "-fsroa").output);
+    Result bad = compile(kFib, "--passes=mem2reg,nope");
+    EXPECT_EQ(bad.status, 1);
+    EXPECT_NE(bad.errors.find("unknown pass 'nope'"), std::string::npos);
+    EXPECT_NE(bad.errors.find("Available passes:"), std::string::npos);
+}
+
+TEST(DriverTest, TileSizes) {
+    EXPECT_EQ(compile(kFib, "-ftile-size=8").status, 0);
+    for (const char* size : {"", "0", "eight", "8x", "-8", "99999999999"}) {
+        Result bad = compile(kFib, std::string("-ftile-size=") + size);
+        EXPECT_EQ(bad.status, 1) << size;
+        EXPECT_NE(bad.errors.find(std::string("Bad tile size: -ftile-size=") + size), std::string::npos) << bad.errors;
+    }
+}
+
+TEST(DriverTest, ExplicitRegisterAllocatorWins) {
+    std::string linear = compile(kFib, "-S -O2 --regalloc=linear").output;
+    EXPECT_EQ(compile(kFib, "-S --regalloc=linear -O2").output, linear);
+    EXPECT_EQ(compile(kFib, "-S -O2").output, compile(kFib, "-S -O2 --regalloc=graph").output);
+    EXPECT_NE(compile(kFib, "-S -O2").output, linear);
+}
+
+TEST(DriverTest, ObjectFiles) {
+    Result object = compile(kFib, "-c -O2");
+    ASSERT_EQ(object.status, 0) << object.errors;
+    EXPECT_EQ(object.output.substr(0, 4), "\x7f" "ELF");
+    Result riscv = compile(kFib, "-c --target=riscv64");
+    EXPECT_EQ(riscv.status, 1);
+    EXPECT_NE(riscv.errors.find("-c is not supported for --target=riscv64"), std::string::npos) << riscv.errors;
+}
+
+TEST(DriverTest, BatchCompilesEachFile) {
+    const std::string good = tempFile("good.sy"), bad = tempFile("bad.sy"), other = tempFile("other.sy");
+    std::ofstream(good) << kFib;
+    std::ofstream(bad) << "int main() { return 0 }";
+    std::ofstream(other) << "int main() { return 7; }";
+    Result result = runCompiler("-O2 --batch " + good + " " + good + ".ll " + bad + " " + bad + ".ll " + other + " " +
+                                    other + ".ll",
+                                good + ".ll");
+    // A file that fails does not stop the others, but fails the batch
+    EXPECT_EQ(result.status, 1);
+    EXPECT_EQ(result.output, compile(kFib, "-O2").output);
+    EXPECT_EQ(readFile(other + ".ll"), compile("int main() { return 7; }", "-O2").output);
+    EXPECT_NE(result.errors.find("startup: "), std::string::npos) << result.errors;
+    EXPECT_NE(result.errors.find(good + ": "), std::string::npos) << result.errors;
+    EXPECT_NE(result.errors.find(" ms (parse "), std::string::npos) << result.errors;
+    EXPECT_NE(result.errors.find(bad + ": failed"), std::string::npos) << result.errors;
+    EXPECT_NE(result.errors.find(other + ": "), std::string::npos) << result.errors;
+    EXPECT_NE(result.errors.find("3 files, 1 failed"), std::string::npos) << result.errors;
+}
+
+TEST(DriverTest, BatchReadsManifests) {
+    const std::string good = tempFile("good.sy"), manifest = tempFile("manifest.txt");
+    std::ofstream(good) << kFib;
+    std::ofstream(manifest) << "# input output\n" << good << " " << good << ".ll  # fib\n\n";
+    Result result = runCompiler("--batch=" + manifest, good + ".ll");
+    EXPECT_EQ(result.status, 0) << result.errors;
+    EXPECT_EQ(result.output, compile(kFib, "").output);
+    EXPECT_NE(result.errors.find("1 files, 0 failed"), std::string::npos) << result.errors;
+    // Inputs without outputs
+    EXPECT_EQ(runCompiler("--batch " + good, good + ".ll").status, 1);
+    EXPECT_EQ(runCompiler("--batch=" + tempFile("missing.txt"), good + ".ll").status, 1);
+}
+
+TEST(DriverTest, ParallelParseMatchesSerial) {
+    EXPECT_EQ(compile(kFib, "-j4").output, compile(kFib, "-j1").output);
+    // Errors in two functions, each parsed on its own thread
+    const char* broken = "int g = 1;\n"
+                         "int f(int a) {\n"
+                         "    return a + ;\n"
+                         "}\n"
+                         "int h() { return 2 }\n"
+                         "int main() { return f(g) + h(); }\n";
+    Result serial = compile(broken, "-j1");
+    Result parallel = compile(broken, "-j4");
+    EXPECT_EQ(serial.status, 1);
+    EXPECT_EQ(parallel.status, 1);
+    EXPECT_NE(serial.errors.find("line 3:15 "), std::string::npos) << serial.errors;
+    EXPECT_NE(serial.errors.find("line 5:19 "), std::string::npos) << serial.errors;
+    EXPECT_EQ(parallel.errors, serial.errors);
+}
+
+TEST(DriverTest, ThreadsDoNotChangeOutput) {
+    for (const char* directory : {"functional", "regression"}) {
+        for (const auto& entry : std::filesystem::directory_iterator(std::string(RESOURCES_PATH) + "/" + directory)) {
+            if (entry.path().extension() != ".sy") continue;
+            const std::string input = entry.path().string();
+            for (const std::string options : {"-O2", "-S -O2"}) {
+                const std::string serial = tempFile("serial.out"), parallel = tempFile("parallel.out");
+                Result one = runCompiler("-j1 " + options + " " + input + " " + serial, serial);
+                Result eight = runCompiler("-j8 " + options + " " + input + " " + parallel, parallel);
+                ASSERT_EQ(one.status, 0) << input << "\n" << one.errors;
+                EXPECT_EQ(eight.output, one.output) << options << " " << input;
+            }
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <set>
+#include "LoopInfo.h"
+#include "Passes.h"
+#include "TestSupport.h"
+
+namespace {
+
+Function& promoted(Module& m, const std::string& name) {
+    Function* f = findFunction(m, name);
+    EXPECT_NE(f, nullptr);
+    promoteMemoryToRegisters(*f);
+    return *f;
+}
+
+// The loop depth of the block defining each instruction of the given opcode.
+std::vector<int> depthsOf(Function& f, Opcode op) {
+    LoopInfo li(f);
+    std::vector<int> depths;
+    for (const auto& bb : f.blocks) {
+        Loop* loop = li.loopFor(bb.get());
+        for (const auto& inst : bb->insts) {
+            if (inst.op == op) depths.push_back(loop ? loop->depth() : 0);
+        }
+    }
+    return depths;
+}
+
+TEST(GlobalCodeMotionTest, HoistsLoopInvariants) {
+    auto module = buildModule(R"(
+int main() {
+    int x = getint();
+    int y = getint();
+    int i = 0;
+    int s = 0;
+    while (i < 10) {
+        s = s + x * y + x / y;
+        i = i + 1;
+    }
+    return s;
+}
+)");
+    ASSERT_TRUE(module);
+    Function& f = promoted(*module, "main");
+    EXPECT_EQ(depthsOf(f, Opcode::Mul), std::vector<int>{1});
+    EXPECT_TRUE(globalCodeMotion(f));
+    EXPECT_EQ(depthsOf(f, Opcode::Mul), std::vector<int>{0});
+    // Division by zero traps, so the division stays where it was
+    EXPECT_EQ(depthsOf(f, Opcode::SDiv), std::vector<int>{1});
+    EXPECT_FALSE(globalCodeMotion(f));
+}
+
+TEST(GlobalCodeMotionTest, SchedulingKeepsDependences) {
+    auto module = buildModule(R"(
+int g[4];
+int main() {
+    int a = getint();
+    int b = a + 1;
+    int c = b * 2;
+    g[0] = c;
+    int d = g[1] * g[2];
+    g[3] = d + c;
+    return g[0] + g[3];
+}
+)");
+    ASSERT_TRUE(module);
+    Function& f = promoted(*module, "main");
+    std::vector<Opcode> before;
+    for (const auto& inst : f.blocks[0]->insts) before.push_back(inst.op);
+    scheduleInstructions(f);
+    ASSERT_EQ(f.blocks.size(), 1u);
+    const auto& insts = f.blocks[0]->insts;
+    ASSERT_EQ(insts.size(), before.size());
+    std::set<std::string> defined;
+    std::vector<std::string> sideEffects;
+    for (size_t i = 0; i < insts.size(); ++i) {
+        for (const auto& op : insts[i].operands) {
+            if (op[0] == '%') EXPECT_TRUE(defined.count(op)) << insts[i].toString();
+        }
+        if (!insts[i].result.empty()) defined.insert(insts[i].result);
+        if (insts[i].op == Opcode::Store || insts[i].op == Opcode::Call) sideEffects.push_back(insts[i].toString());
+    }
+    EXPECT_TRUE(insts.back().isTerminator());
+    // Stores and calls keep their order
+    EXPECT_EQ(sideEffects.size(), 3u);
+    EXPECT_NE(sideEffects[0].find("getint"), std::string::npos);
+    EXPECT_NE(sideEffects[1].find("store"), std::string::npos);
+    EXPECT_NE(sideEffects[2].find("store"), std::string::npos);
+}
+
+} // namespace
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include "LoopInfo.h"
+#include "PassManager.h"
+#include "Passes.h"
+#include "TestSupport.h"
+
+namespace {
+
+// c += a * b over n x n matrices.
+std::unique_ptr<Module> matmul(int n) {
+    char source[512];
+    snprintf(source, sizeof(source), R"(
+int a[%d][%d];
+int b[%d][%d];
+int c[%d][%d];
+int main() {
+    int i = 0;
+    while (i < %d) {
+        int j = 0;
+        while (j < %d) {
+            int k = 0;
+            while (k < %d) { c[i][j] = c[i][j] + a[i][k] * b[k][j]; k = k + 1; }
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    return c[1][1];
+}
+)", n, n, n, n, n, n, n, n, n);
+    auto module = buildModule(source);
+    if (module) promoteMemoryToRegisters(*findFunction(*module, "main"));
+    return module;
+}
+
+int loopCount(Function& f) {
+    return static_cast<int>(LoopInfo(f).loopsInPostOrder().size());
+}
+
+TEST(LoopTilingTest, CacheModelTilesLargeNests) {
+    // Three 32 x 32 blocks of ints fill 12 KiB, the most that stays within
+    // half the L1 cache: a 40-iteration nest is tiled by 32...
+    auto large = matmul(40);
+    ASSERT_TRUE(large);
+    Function& f = *findFunction(*large, "main");
+    AnalysisManager am(*large);
+    EXPECT_TRUE(tileLoops(f, am, 0));
+    EXPECT_EQ(loopCount(f), 6);
+
+    // ...and a 30-iteration one already fits in a tile.
+    auto small = matmul(30);
+    ASSERT_TRUE(small);
+    Function& g = *findFunction(*small, "main");
+    AnalysisManager am2(*small);
+    EXPECT_FALSE(tileLoops(g, am2, 0));
+    EXPECT_TRUE(tileLoops(g, am2, 8));
+}
+
+} // namespace
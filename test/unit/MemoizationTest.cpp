@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include "Passes.h"
+#include "TestSupport.h"
+
+namespace {
+
+const char* kSource = R"(
+int total;
+
+int fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int binom(int n, int k) {
+    if (k == 0 || k == n) return 1;
+    if (k < 0 || k > n) return 0;
+    return binom(n - 1, k - 1) + binom(n - 1, k);
+}
+
+int count(int n) {
+    if (n <= 0) return total;
+    total = total + 1;
+    return count(n - 1);
+}
+
+int echo(int n) {
+    if (n <= 0) return 0;
+    putint(n);
+    return echo(n - 1);
+}
+
+int square(int n) {
+    return n * n;
+}
+
+int main() {
+    return fib(20) + binom(10, 3) + count(5) + echo(3) + square(4);
+}
+)";
+
+TEST(MemoizationTest, WrapsPureRecursiveFunctions) {
+    auto module = buildModule(kSource);
+    ASSERT_TRUE(module);
+    EXPECT_TRUE(memoizePureRecursion(*module));
+    EXPECT_NE(findFunction(*module, "fib.memo.impl"), nullptr);
+    EXPECT_NE(findFunction(*module, "binom.memo.impl"), nullptr);
+    EXPECT_NE(findFunction(*module, "fib"), nullptr);
+}
+
+// Functions that touch globals or call into sylib are not pure, and ones
+// that do not recurse gain nothing from a table.
+TEST(MemoizationTest, LeavesOtherFunctionsAlone) {
+    auto module = buildModule(kSource);
+    ASSERT_TRUE(module);
+    memoizePureRecursion(*module);
+    EXPECT_EQ(findFunction(*module, "count.memo.impl"), nullptr);
+    EXPECT_EQ(findFunction(*module, "echo.memo.impl"), nullptr);
+    EXPECT_EQ(findFunction(*module, "square.memo.impl"), nullptr);
+    EXPECT_EQ(findFunction(*module, "main.memo.impl"), nullptr);
+}
+
+} // namespace
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "Interpreter.h"
+#include "PassManager.h"
+#include "Passes.h"
+#include "TestSupport.h"
+
+namespace {
+
+std::string pipelineError(const std::string& pipeline) {
+    PassManager pm;
+    std::string error;
+    return pm.parsePipeline(pipeline, error) ? "" : error;
+}
+
+TEST(PassManagerTest, ParsesPipelines) {
+    EXPECT_EQ(pipelineError("sroa, mem2reg ,tile<32>"), "");
+    EXPECT_EQ(pipelineError("memoize"), "");
+    PassManager pm;
+    std::string error;
+    EXPECT_TRUE(pm.parsePipeline("", error));
+    EXPECT_TRUE(pm.empty());
+}
+
+TEST(PassManagerTest, RejectsBadPipelines) {
+    EXPECT_EQ(pipelineError("nope"), "unknown pass 'nope'");
+    EXPECT_EQ(pipelineError("tile<x>"), "malformed pass 'tile<x>'");
+    EXPECT_EQ(pipelineError("tile<32"), "malformed pass 'tile<32'");
+    EXPECT_EQ(pipelineError("tile<99999999999>"), "malformed pass 'tile<99999999999>'");
+    EXPECT_EQ(pipelineError("tile<>"), "malformed pass 'tile<>'");
+    EXPECT_EQ(pipelineError("mem2reg<3>"), "pass 'mem2reg' takes no parameter");
+    EXPECT_EQ(pipelineError("sroa,,mem2reg"), "empty pass name in pipeline 'sroa,,mem2reg'");
+    EXPECT_EQ(pipelineError("sroa,"), "empty pass name in pipeline 'sroa,'");
+}
+
+TEST(PassManagerTest, RunsFunctionAndModulePasses) {
+    auto module = compileSource(R"(
+int fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+int main() {
+    int a[2] = {1, 2};
+    return fib(a[0] + a[1]);
+}
+)", "sroa,mem2reg,memoize");
+    ASSERT_TRUE(module);
+    EXPECT_NE(findFunction(*module, "fib.memo.impl"), nullptr);
+    for (const auto& bb : findFunction(*module, "main")->blocks) {
+        for (const auto& inst : bb->insts) EXPECT_NE(inst.op, Opcode::Alloca);
+    }
+}
+
+TEST(PassManagerTest, KeepsPreservedAnalyses) {
+    auto module = buildModule(R"(
+int main() {
+    int i = 0;
+    while (i < 10) i = i + 1;
+    return i;
+}
+)");
+    ASSERT_TRUE(module);
+    Function& main = *findFunction(*module, "main");
+    AnalysisManager am(*module);
+    const DominatorTree* dt = &am.dominators(main);
+    const LoopInfo* li = &am.loops(main);
+    EXPECT_EQ(&am.dominators(main), dt);
+    EXPECT_EQ(&am.loops(main), li);
+    EXPECT_EQ(li->topLevelLoops().size(), 1u);
+    am.invalidate(main, PreserveDominators);
+    EXPECT_EQ(&am.dominators(main), dt);
+}
+
+TEST(PassManagerTest, LoopPassesShareCachedLoops) {
+    auto module = buildModule(R"(
+int a[10];
+int main() {
+    int i = 0;
+    while (i < 10) {
+        a[i] = i;
+        i = i + 1;
+    }
+    return a[9];
+}
+)");
+    ASSERT_TRUE(module);
+    Function& main = *findFunction(*module, "main");
+    promoteMemoryToRegisters(main);
+    AnalysisManager am(*module);
+    const LoopInfo* li = &am.loops(main);
+    EXPECT_FALSE(interchangeLoops(main, am));
+    EXPECT_FALSE(tileLoops(main, am, 0));
+    EXPECT_FALSE(fuseLoops(main, am));
+    EXPECT_EQ(&am.loops(main), li);
+}
+
+TEST(PassManagerTest, DeletedBlocksDropTheirAnalyses) {
+    // The blocks after the first return are unreachable; mem2reg deletes them.
+    auto module = buildModule(R"(
+int main() {
+    int i = 0;
+    int s = 0;
+    while (i < 10) {
+        s = s + i * 2;
+        i = i + 1;
+    }
+    return s;
+    s = 5;
+    return s;
+}
+)");
+    ASSERT_TRUE(module);
+    Function& main = *findFunction(*module, "main");
+    AnalysisManager am(*module);
+    std::vector<std::string> unreachable;
+    for (const auto& bb : main.blocks) {
+        if (!am.dominators(main).isReachable(bb.get())) unreachable.push_back(bb->name);
+    }
+    ASSERT_FALSE(unreachable.empty());
+    PassManager pm;
+    std::string error;
+    ASSERT_TRUE(pm.parsePipeline("mem2reg", error));
+    pm.run(*module, am);
+    for (const auto& name : unreachable) EXPECT_EQ(am.dominators(main).block(name), nullptr) << name;
+    EXPECT_EQ(Interpreter(*module).run(), 90);
+}
+
+} // namespace
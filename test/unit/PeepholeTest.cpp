@@ -0,0 +1,241 @@
+#include <gtest/gtest.h>
+#include "RISCVTarget.h"
+#include "X86Target.h"
+
+namespace {
+
+using Op = MachineOperand;
+
+// Virtual register k of the functions below.
+int v(int k) { return kFirstVirtualReg + k; }
+
+MachineInstr inst(int opcode, std::vector<MachineOperand> ops, int cond = 0) {
+    MachineInstr mi(opcode, 4, std::move(ops));
+    mi.cond = cond;
+    return mi;
+}
+
+// A function with four virtual registers, one stack slot and `blocks`
+// blocks, the first holding `insts`.
+std::unique_ptr<MachineFunction> function(std::vector<MachineInstr> insts, int blocks = 1) {
+    auto mf = std::make_unique<MachineFunction>("f");
+    for (int k = 0; k < 4; ++k) mf->newVReg(4);
+    mf->addFrameObject(4, 4);
+    for (int b = 0; b < blocks; ++b) mf->addBlock("b" + std::to_string(b));
+    mf->blocks[0]->insts = std::move(insts);
+    return mf;
+}
+
+std::vector<int> opcodes(const MachineFunction& mf) {
+    std::vector<int> result;
+    for (const auto& mi : mf.blocks[0]->insts) result.push_back(mi.opcode);
+    return result;
+}
+
+class X86PeepholeTest : public ::testing::Test {
+protected:
+    // Runs the rules and returns the opcodes left in the first block.
+    std::vector<int> run(MachineFunction& mf) {
+        target.runPeephole(mf);
+        return opcodes(mf);
+    }
+
+    X86Target target;
+};
+
+TEST_F(X86PeepholeTest, RemovesSelfCopies) {
+    auto mf = function({inst(x86::MOV, {Op::use(v(0)), Op::def(v(0))}),
+                        inst(x86::MOV, {Op::use(v(0)), Op::def(v(1))})});
+    EXPECT_EQ(run(*mf), std::vector<int>{x86::MOV});
+    EXPECT_EQ(mf->blocks[0]->insts[0].ops[1].reg, v(1));
+}
+
+TEST_F(X86PeepholeTest, RemovesCopiesBack) {
+    auto mf = function({inst(x86::MOV, {Op::use(v(0)), Op::def(v(1))}),
+                        inst(x86::MOV, {Op::use(v(1)), Op::def(v(0))})});
+    EXPECT_EQ(run(*mf), std::vector<int>{x86::MOV});
+    EXPECT_EQ(mf->blocks[0]->insts[0].ops[1].reg, v(1));
+}
+
+TEST_F(X86PeepholeTest, ForwardsStoresToLoads) {
+    auto mf = function({inst(x86::MOV, {Op::use(v(0)), Op::frame(0)}),
+                        inst(x86::MOV, {Op::frame(0), Op::def(v(1))}),
+                        inst(x86::MOV, {Op::immediate(7), Op::frame(0, 4)}),
+                        inst(x86::MOV, {Op::frame(0), Op::def(v(2))})});
+    EXPECT_EQ(run(*mf), std::vector<int>(4, x86::MOV));
+    const auto& insts = mf->blocks[0]->insts;
+    EXPECT_TRUE(insts[1].ops[0].isReg());
+    EXPECT_EQ(insts[1].ops[0].reg, v(0));
+    // A different address is left alone
+    EXPECT_TRUE(insts[3].ops[0].isMem());
+
+    auto same = function({inst(x86::MOV, {Op::use(v(0)), Op::frame(0)}),
+                          inst(x86::MOV, {Op::frame(0), Op::def(v(0))})});
+    EXPECT_EQ(run(*same), std::vector<int>{x86::MOV});
+}
+
+TEST_F(X86PeepholeTest, RemovesAddsOfZero) {
+    auto mf = function({inst(x86::ADD, {Op::immediate(0), Op::useDef(v(0))}),
+                        inst(x86::SUB, {Op::immediate(0), Op::useDef(v(0))}),
+                        inst(x86::ADD, {Op::immediate(1), Op::useDef(v(0))})});
+    EXPECT_EQ(run(*mf), std::vector<int>{x86::ADD});
+    EXPECT_EQ(mf->blocks[0]->insts[0].ops[0].imm, 1);
+}
+
+TEST_F(X86PeepholeTest, MultipliesByOneAsCopies) {
+    auto mf = function({inst(x86::IMUL, {Op::immediate(1), Op::use(v(0)), Op::def(v(1))}),
+                        inst(x86::IMUL, {Op::immediate(3), Op::use(v(0)), Op::def(v(2))})});
+    EXPECT_EQ(run(*mf), (std::vector<int>{x86::MOV, x86::IMUL}));
+    EXPECT_EQ(mf->blocks[0]->insts[0].ops[0].reg, v(0));
+    EXPECT_EQ(mf->blocks[0]->insts[0].ops[1].reg, v(1));
+}
+
+TEST_F(X86PeepholeTest, FusesCompareAndBranch) {
+    auto compareAndBranch = [](int branchCond) {
+        return std::vector<MachineInstr>{
+            inst(x86::CMP, {Op::use(v(0)), Op::use(v(1))}), inst(x86::SETCC, {Op::def(v(2))}, x86::CondL),
+            inst(x86::MOVZX8, {Op::use(v(2)), Op::def(v(2))}), inst(x86::TEST, {Op::use(v(2)), Op::use(v(2))}),
+            inst(x86::JCC, {Op::label(2)}, branchCond)};
+    };
+    auto mf = function(compareAndBranch(x86::CondNE), 3);
+    EXPECT_EQ(run(*mf), (std::vector<int>{x86::CMP, x86::JCC}));
+    EXPECT_EQ(mf->blocks[0]->insts[1].cond, x86::CondL);
+
+    auto inverted = function(compareAndBranch(x86::CondE), 3);
+    EXPECT_EQ(run(*inverted), (std::vector<int>{x86::CMP, x86::JCC}));
+    EXPECT_EQ(inverted->blocks[0]->insts[1].cond, x86::CondGE);
+
+    // The value stays when something else reads it
+    auto used = function(compareAndBranch(x86::CondNE), 3);
+    used->blocks[1]->insts.push_back(inst(x86::MOV, {Op::use(v(2)), Op::def(v(3))}));
+    EXPECT_EQ(run(*used), (std::vector<int>{x86::CMP, x86::SETCC, x86::MOVZX8, x86::JCC}));
+}
+
+TEST_F(X86PeepholeTest, RemovesJumpsToTheNextBlock) {
+    auto mf = function({inst(x86::JMP, {Op::label(1)})}, 3);
+    EXPECT_EQ(run(*mf), std::vector<int>{});
+    auto far = function({inst(x86::JMP, {Op::label(2)})}, 3);
+    EXPECT_EQ(run(*far), std::vector<int>{x86::JMP});
+}
+
+TEST_F(X86PeepholeTest, InvertsBranchesOverJumps) {
+    auto mf = function({inst(x86::JCC, {Op::label(1)}, x86::CondL), inst(x86::JMP, {Op::label(2)})}, 3);
+    EXPECT_EQ(run(*mf), std::vector<int>{x86::JCC});
+    EXPECT_EQ(mf->blocks[0]->insts[0].cond, x86::CondGE);
+    EXPECT_EQ(mf->blocks[0]->insts[0].ops[0].block, 2);
+}
+
+class RISCVPeepholeTest : public ::testing::Test {
+protected:
+    std::vector<int> run(MachineFunction& mf) {
+        target.runPeephole(mf);
+        return opcodes(mf);
+    }
+
+    // `insts` followed by bnez (or beqz) on v2 to block 2
+    std::unique_ptr<MachineFunction> branchingOn(std::vector<MachineInstr> insts, int cond = riscv::CondNE) {
+        insts.push_back(inst(riscv::BCC, {Op::use(v(2)), Op::use(riscv::ZERO), Op::label(2)}, cond));
+        return function(std::move(insts), 3);
+    }
+
+    // The branch that ends the first block
+    static const MachineInstr& branch(const MachineFunction& mf) { return mf.blocks[0]->insts.back(); }
+
+    RISCVTarget target;
+};
+
+TEST_F(RISCVPeepholeTest, RemovesSelfCopies) {
+    auto mf = function({inst(riscv::MV, {Op::use(v(0)), Op::def(v(0))})});
+    EXPECT_EQ(run(*mf), std::vector<int>{});
+}
+
+TEST_F(RISCVPeepholeTest, RemovesCopiesBack) {
+    auto mf = function({inst(riscv::MV, {Op::use(v(0)), Op::def(v(1))}),
+                        inst(riscv::MV, {Op::use(v(1)), Op::def(v(0))})});
+    EXPECT_EQ(run(*mf), std::vector<int>{riscv::MV});
+}
+
+TEST_F(RISCVPeepholeTest, ForwardsStoresToLoads) {
+    for (auto [store, load] : {std::pair{riscv::SW, riscv::LW}, std::pair{riscv::SD, riscv::LD}}) {
+        auto mf = function({inst(store, {Op::use(v(0)), Op::frame(0)}), inst(load, {Op::frame(0), Op::def(v(1))})});
+        EXPECT_EQ(run(*mf), (std::vector<int>{store, riscv::MV}));
+        auto same = function({inst(store, {Op::use(v(0)), Op::frame(0)}), inst(load, {Op::frame(0), Op::def(v(0))})});
+        EXPECT_EQ(run(*same), std::vector<int>{store});
+        auto other = function({inst(store, {Op::use(v(0)), Op::frame(0)}), inst(load, {Op::frame(0, 8), Op::def(v(1))})});
+        EXPECT_EQ(run(*other), (std::vector<int>{store, load}));
+    }
+}
+
+TEST_F(RISCVPeepholeTest, RemovesAddsOfZero) {
+    for (auto add : {riscv::ADDI, riscv::ADDIW}) {
+        auto mf = function({inst(add, {Op::use(v(0)), Op::immediate(0), Op::def(v(0))}),
+                            inst(add, {Op::use(v(0)), Op::immediate(0), Op::def(v(1))}),
+                            inst(add, {Op::use(v(0)), Op::immediate(5), Op::def(v(2))})});
+        EXPECT_EQ(run(*mf), (std::vector<int>{riscv::MV, add}));
+    }
+}
+
+TEST_F(RISCVPeepholeTest, FusesLessThanIntoBranches) {
+    for (auto [slt, cond] : {std::pair{riscv::SLT, riscv::CondLT}, std::pair{riscv::SLTU, riscv::CondLTU}}) {
+        auto mf = branchingOn({inst(slt, {Op::use(v(0)), Op::use(v(1)), Op::def(v(2))})});
+        EXPECT_EQ(run(*mf), std::vector<int>{riscv::BCC});
+        EXPECT_EQ(branch(*mf).cond, cond);
+        EXPECT_EQ(branch(*mf).ops[0].reg, v(0));
+        EXPECT_EQ(branch(*mf).ops[1].reg, v(1));
+        // beqz takes the inverse
+        auto inverted = branchingOn({inst(slt, {Op::use(v(0)), Op::use(v(1)), Op::def(v(2))})}, riscv::CondEQ);
+        EXPECT_EQ(run(*inverted), std::vector<int>{riscv::BCC});
+        EXPECT_EQ(branch(*inverted).cond, cond ^ 1);
+    }
+}
+
+TEST_F(RISCVPeepholeTest, FusesNotLessThanIntoBranches) {
+    for (auto [slt, cond] : {std::pair{riscv::SLT, riscv::CondGE}, std::pair{riscv::SLTU, riscv::CondGEU}}) {
+        auto mf = branchingOn({inst(slt, {Op::use(v(0)), Op::use(v(1)), Op::def(v(3))}),
+                               inst(riscv::XORI, {Op::use(v(3)), Op::immediate(1), Op::def(v(2))})});
+        EXPECT_EQ(run(*mf), std::vector<int>{riscv::BCC});
+        EXPECT_EQ(branch(*mf).cond, cond);
+    }
+}
+
+TEST_F(RISCVPeepholeTest, FusesEqualityIntoBranches) {
+    for (auto [test, cond] : {std::pair{riscv::SEQZ, riscv::CondEQ}, std::pair{riscv::SNEZ, riscv::CondNE}}) {
+        auto mf = branchingOn({inst(riscv::XOR, {Op::use(v(0)), Op::use(v(1)), Op::def(v(3))}),
+                               inst(test, {Op::use(v(3)), Op::def(v(2))})});
+        EXPECT_EQ(run(*mf), std::vector<int>{riscv::BCC});
+        EXPECT_EQ(branch(*mf).cond, cond);
+        EXPECT_EQ(branch(*mf).ops[0].reg, v(0));
+        EXPECT_EQ(branch(*mf).ops[1].reg, v(1));
+    }
+}
+
+TEST_F(RISCVPeepholeTest, FusesZeroTestsIntoBranches) {
+    for (auto [test, cond] : {std::pair{riscv::SEQZ, riscv::CondEQ}, std::pair{riscv::SNEZ, riscv::CondNE}}) {
+        auto mf = branchingOn({inst(test, {Op::use(v(0)), Op::def(v(2))})});
+        EXPECT_EQ(run(*mf), std::vector<int>{riscv::BCC});
+        EXPECT_EQ(branch(*mf).cond, cond);
+        EXPECT_EQ(branch(*mf).ops[0].reg, v(0));
+        EXPECT_EQ(branch(*mf).ops[1].reg, riscv::ZERO);
+    }
+    // Not when the value is read elsewhere
+    auto used = branchingOn({inst(riscv::SEQZ, {Op::use(v(0)), Op::def(v(2))})});
+    used->blocks[1]->insts.push_back(inst(riscv::MV, {Op::use(v(2)), Op::def(v(3))}));
+    EXPECT_EQ(run(*used), (std::vector<int>{riscv::SEQZ, riscv::BCC}));
+}
+
+TEST_F(RISCVPeepholeTest, RemovesJumpsToTheNextBlock) {
+    auto mf = function({inst(riscv::J, {Op::label(1)})}, 3);
+    EXPECT_EQ(run(*mf), std::vector<int>{});
+    auto far = function({inst(riscv::J, {Op::label(2)})}, 3);
+    EXPECT_EQ(run(*far), std::vector<int>{riscv::J});
+}
+
+TEST_F(RISCVPeepholeTest, InvertsBranchesOverJumps) {
+    auto mf = function({inst(riscv::BCC, {Op::use(v(0)), Op::use(v(1)), Op::label(1)}, riscv::CondLTU),
+                        inst(riscv::J, {Op::label(2)})}, 3);
+    EXPECT_EQ(run(*mf), std::vector<int>{riscv::BCC});
+    EXPECT_EQ(branch(*mf).cond, riscv::CondGEU);
+    EXPECT_EQ(branch(*mf).ops[2].block, 2);
+}
+
+} // namespace
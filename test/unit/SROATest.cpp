@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include "Passes.h"
+#include "TestSupport.h"
+
+namespace {
+
+int count(const Function& f, Opcode op) {
+    int n = 0;
+    for (const auto& bb : f.blocks) {
+        for (const auto& inst : bb->insts) n += inst.op == op;
+    }
+    return n;
+}
+
+Function& promoted(Module& m, const std::string& name) {
+    Function* f = findFunction(m, name);
+    EXPECT_NE(f, nullptr);
+    scalarReplaceAggregates(*f);
+    promoteMemoryToRegisters(*f);
+    return *f;
+}
+
+TEST(SROATest, SplitsConstantIndexedArrays) {
+    auto module = buildModule(R"(
+int main() {
+    int a[3] = {1, 2, 3};
+    int i = 0;
+    while (i < 4) {
+        a[i - i] = a[0] + a[2];
+        i = i + 1;
+    }
+    a[1] = a[1] * 2;
+    return a[0] + a[1];
+}
+)");
+    ASSERT_TRUE(module);
+    // a[i - i] is not a constant index, so a stays in memory here
+    Function& f = promoted(*module, "main");
+    EXPECT_EQ(count(f, Opcode::Alloca), 1);
+
+    module = buildModule(R"(
+int main() {
+    int a[3] = {1, 2, 3};
+    int i = 0;
+    while (i < 4) {
+        a[0] = a[0] + a[2];
+        i = i + 1;
+    }
+    a[1] = a[1] * 2;
+    return a[0] + a[1];
+}
+)");
+    ASSERT_TRUE(module);
+    Function& g = promoted(*module, "main");
+    EXPECT_EQ(count(g, Opcode::Alloca), 0);
+    EXPECT_EQ(count(g, Opcode::Load), 0);
+    EXPECT_EQ(count(g, Opcode::Store), 0);
+    EXPECT_GT(count(g, Opcode::Phi), 0);
+}
+
+// Arrays that escape into a call, or are too large, keep their storage.
+TEST(SROATest, KeepsEscapingAndLargeArrays) {
+    auto module = buildModule(R"(
+int main() {
+    int a[2] = {1, 2};
+    int b[100];
+    b[0] = 1;
+    putarray(2, a);
+    return b[0];
+}
+)");
+    ASSERT_TRUE(module);
+    Function& f = promoted(*module, "main");
+    EXPECT_EQ(count(f, Opcode::Alloca), 2);
+}
+
+} // namespace
@@ -0,0 +1,22 @@
+#include "TestSupport.h"
+#include <sstream>
+#include "antlr4-runtime.h"
+#include "SysYLexer.h"
+#include "SysYParser.h"
+#include "IRBuilder.h"
+#include "IRParser.h"
+
+// Kept out of the header, so that the tests do not see the ANTLR runtime's
+// global names.
+std::unique_ptr<Module> buildModule(const std::string& source) {
+    std::istringstream stream(source);
+    antlr4::ANTLRInputStream input(stream);
+    SysYLexer lexer(&input);
+    antlr4::CommonTokenStream tokens(&lexer);
+    SysYParser parser(&tokens);
+    SysYParser::CompUnitContext* tree = parser.compUnit();
+    if (parser.getNumberOfSyntaxErrors() > 0) return nullptr;
+    IRBuilder builder;
+    builder.visitCompUnit(tree);
+    return parseIR(builder.getIR());
+}
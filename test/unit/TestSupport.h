@@ -0,0 +1,30 @@
+#ifndef TESTSUPPORT_H
+#define TESTSUPPORT_H
+
+#include <memory>
+#include <string>
+#include "IR.h"
+#include "PassManager.h"
+
+// SysY source through the frontend into the optimizer's IR, as the compiler
+// does it; nullptr if the parser or the IR reader rejects it.
+std::unique_ptr<Module> buildModule(const std::string& source);
+
+// The same, then through the pass pipeline `passes`.
+inline std::unique_ptr<Module> compileSource(const std::string& source, const std::string& passes) {
+    auto module = buildModule(source);
+    PassManager pm;
+    std::string error;
+    if (!module || !pm.parsePipeline(passes, error)) return nullptr;
+    pm.run(*module);
+    return module;
+}
+
+inline Function* findFunction(Module& m, const std::string& name) {
+    for (auto& f : m.functions) {
+        if (f->name == name) return f.get();
+    }
+    return nullptr;
+}
+
+#endif // TESTSUPPORT_H
@@ -0,0 +1,34 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace {
+
+TEST(ThreadPoolTest, RunsEveryIterationOnce) {
+    ThreadPool pool(4);
+    for (size_t count : {0, 1, 3, 1000}) {
+        std::vector<std::atomic<int>> runs(count);
+        pool.parallelFor(count, [&](size_t i) { runs[i]++; });
+        for (size_t i = 0; i < count; ++i) EXPECT_EQ(runs[i], 1) << i;
+    }
+}
+
+TEST(ThreadPoolTest, RethrowsAfterTheRestRan) {
+    ThreadPool pool(3);
+    std::atomic<int> ran{0};
+    EXPECT_THROW(pool.parallelFor(100,
+                                  [&](size_t i) {
+                                      ran++;
+                                      if (i == 10) throw std::runtime_error("iteration 10");
+                                  }),
+                 std::runtime_error);
+    EXPECT_EQ(ran, 100);
+    // The pool is still usable afterwards.
+    ran = 0;
+    pool.parallelFor(10, [&](size_t) { ran++; });
+    EXPECT_EQ(ran, 10);
+}
+
+} // namespace
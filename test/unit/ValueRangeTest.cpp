@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include "Passes.h"
+#include "TestSupport.h"
+#include "ValueRange.h"
+
+namespace {
+
+TEST(ValueRangeTest, IntervalsAndKnownBitsTightenEachOther) {
+    ValueRange small = ValueRange::between(0, 7);
+    EXPECT_EQ(small.knownZero, ~7u);
+    EXPECT_EQ(small.knownOne, 0u);
+
+    ValueRange twelve = ValueRange::constant(12);
+    EXPECT_TRUE(twelve.isConstant());
+    EXPECT_EQ(twelve.knownOne, 12u);
+    EXPECT_EQ(twelve.knownZero, ~12u);
+
+    // Bit 2 is set on both sides, bit 0 on neither.
+    ValueRange joined = ValueRange::constant(4).unite(ValueRange::constant(6));
+    EXPECT_EQ(joined.lo, 4);
+    EXPECT_EQ(joined.hi, 6);
+    EXPECT_EQ(joined.knownOne, 4u);
+    EXPECT_EQ(joined.knownZero, ~6u);
+
+    // A negative interval has the sign bit set.
+    EXPECT_EQ(ValueRange::between(-8, -1).knownOne, 0x80000000u);
+}
+
+TEST(ValueRangeTest, WrappingAndEmptyIntervals) {
+    EXPECT_EQ(ValueRange::between(0, 1LL << 31), ValueRange::full());
+    EXPECT_EQ(ValueRange::between(5, 4), ValueRange::full());
+    EXPECT_EQ(ValueRange::full("i1"), ValueRange::between(0, 1));
+    // Disjoint facts only meet on paths that never run.
+    ValueRange r = ValueRange::between(0, 3);
+    EXPECT_EQ(r.intersect(ValueRange::between(10, 20)), r);
+    EXPECT_EQ(r.intersect(ValueRange::between(2, 20)), ValueRange::between(2, 3));
+}
+
+// Outcome of every conditional branch of main, in block order.
+std::vector<int> branchOutcomes(const std::string& source) {
+    auto module = buildModule(source);
+    if (!module) return {};
+    Function& main = *findFunction(*module, "main");
+    promoteMemoryToRegisters(main);
+    ValueRangeAnalysis vra(main);
+    std::vector<int> outcomes;
+    for (auto& bb : main.blocks) {
+        if (bb->terminator() && bb->terminator()->op == Opcode::CondBr) outcomes.push_back(vra.evaluateBranch(bb.get()));
+    }
+    return outcomes;
+}
+
+TEST(ValueRangeTest, FoldsBranchesImpliedByRanges) {
+    // The loop test itself and r > 5 go either way; i - 50 < 0 too.
+    EXPECT_EQ(branchOutcomes(R"(
+int main() {
+    int i = 0, s = 0;
+    while (i < 100) {
+        int r = i % 10;
+        if (r < 10) s = s + 1;
+        if (r >= 0) s = s + 2;
+        if (r > 5) s = s + 4;
+        if (i + 1 > 0) s = s + 8;
+        if (i - 50 < 0) s = s + 16;
+        i = i + 1;
+    }
+    return s;
+}
+)"), (std::vector<int>{-1, 1, 1, -1, 1, -1}));
+}
+
+TEST(ValueRangeTest, NarrowsByDominatingConditions) {
+    EXPECT_EQ(branchOutcomes(R"(
+int main() {
+    int n = getint();
+    if (n > 3) {
+        if (n > 2) return 1;
+        return 0;
+    }
+    if (n < 4) return 2;
+    return 3;
+}
+)"), (std::vector<int>{-1, 1, 1}));
+}
+
+TEST(ValueRangeTest, RangesOfLoopValues) {
+    auto module = buildModule(R"(
+int main() {
+    int i = 0, s = 0;
+    while (i < 100) {
+        s = s + (i % 10) * 4;
+        i = i + 1;
+    }
+    return s;
+}
+)");
+    ASSERT_TRUE(module);
+    Function& main = *findFunction(*module, "main");
+    promoteMemoryToRegisters(main);
+    ValueRangeAnalysis vra(main);
+    const Instruction* rem = nullptr;
+    const Instruction* mul = nullptr;
+    for (auto& bb : main.blocks) {
+        for (auto& inst : bb->insts) {
+            if (inst.op == Opcode::SRem) rem = &inst;
+            if (inst.op == Opcode::Mul) mul = &inst;
+        }
+    }
+    ASSERT_TRUE(rem && mul);
+    // The counted loop bounds i to [0, 99] in the body...
+    EXPECT_EQ(vra.range(rem->result), ValueRange::between(0, 9));
+    // ...and multiplying by 4 clears the two low bits.
+    ValueRange scaled = vra.range(mul->result);
+    EXPECT_EQ(scaled.lo, 0);
+    EXPECT_EQ(scaled.hi, 36);
+    EXPECT_EQ(scaled.knownZero & 3u, 3u);
+}
+
+} // namespace